@@ -24,14 +24,18 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <getopt.h>
 
 // open ssl related includes
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/engine.h>
+#include <openssl/pem.h>
 
 // Socket related includes
 #include <sys/types.h>
@@ -73,24 +77,159 @@ typedef enum {
 	SOCKET_OPERATION_OK
 } timeout_state;
 
+// Client settings
+typedef struct {
+	const char	*ipaddr;
+	short int	port;
+	int		connections;
+	int		messages;
+	int		delayMs;
+	int		resume;
+	int		earlyData;
+	int		clientCert;
+	const char	*sessionFile;
+} client_cfg_t;
+
 //extern
 extern	int waitpid();
 
 // Function Protoyping
 void doClientConnect(void);
 
+static client_cfg_t	cfg = {DEFAULT_IP, DEFAULT_PORT, 1, 100, 1000, 1, 0, 0, NULL};
+
+// Engine for the client certificate
+static ENGINE		*e = NULL;
+
+// Latest resumable session from the server
+static SSL_SESSION	*session = NULL;
+static int		hsResumed = 0;
+static int		hsEarly = 0;
+
+static void helpmenu(void)
+{
+	printf("\nHelp menu: simpleTest_Client <option> ...<option>\n");
+	printf("option:- \n");
+	printf("-i <IP>       : Server IP [default %s] \n", DEFAULT_IP);
+	printf("-p <port>     : Server port [default %d] \n", DEFAULT_PORT);
+	printf("-n <count>    : Connect <count> times [default 1] \n");
+	printf("-m <count>    : Messages per connection, 1 to 100 [default 100] \n");
+	printf("-d <ms>       : Delay between the messages [default 1000] \n");
+	printf("-s <file>     : Load the session from <file> and save the last one to it \n");
+	printf("-e            : Send the first message as TLS 1.3 early data when resuming \n");
+	printf("-N            : No session resumption, full handshake for every connection \n");
+	printf("-c            : Authenticate with the chip certificate 0xE0E0 and key 0xE0F0 \n");
+	printf("-h            : Print this help \n");
+}
 
 int main (int argc, char *argv[])
 {
+	FILE	*fp;
+	int	option;
+	int	i;
+
+	while (-1 != (option = getopt(argc, argv, "i:p:n:m:d:s:eNch")))
+	{
+		switch (option)
+		{
+			case 'i':
+				cfg.ipaddr = optarg;
+				break;
+			case 'p':
+				cfg.port = atoi(optarg);
+				break;
+			case 'n':
+				cfg.connections = atoi(optarg);
+				break;
+			case 'm':
+				cfg.messages = atoi(optarg);
+				break;
+			case 'd':
+				cfg.delayMs = atoi(optarg);
+				break;
+			case 's':
+				cfg.sessionFile = optarg;
+				break;
+			case 'e':
+				cfg.earlyData = 1;
+				break;
+			case 'N':
+				cfg.resume = 0;
+				break;
+			case 'c':
+				cfg.clientCert = 1;
+				break;
+			case 'h':
+			default:
+				helpmenu();
+				exit(0);
+		}
+	}
+
+	if ((cfg.connections < 1) || (cfg.messages < 1) || (cfg.messages > 100) || (cfg.delayMs < 0))
+	{
+		helpmenu();
+		exit(1);
+	}
 
 	//Print Heading
 	DEBUGPRINT("*****************************************");
-	
-	doClientConnect();
+
+	// The engine hands the chip certificate and key to the handshake,
+	// the certificate is read from the chip once for all connections
+	if (cfg.clientCert)
+	{
+		ENGINE_load_builtin_engines();
+		e = ENGINE_by_id(ENGINE_NAME);
+		if ((e == NULL) || !ENGINE_init(e) || !ENGINE_set_default_EC(e))
+		{
+			DEBUGPRINT("Cannot use TrustM Engine!!");
+			ERR_print_errors_fp(stderr);
+			exit(1);
+		}
+		DEBUGPRINT("Client certificate from %s", ENGINE_get_id(e));
+	}
+
+	// Session of an earlier run
+	if (cfg.resume && (cfg.sessionFile != NULL) && ((fp = fopen(cfg.sessionFile, "r")) != NULL))
+	{
+		session = PEM_read_SSL_SESSION(fp, NULL, NULL, NULL);
+		fclose(fp);
+		DEBUGPRINT("Session loaded from %s : %s", cfg.sessionFile, session ? "ok" : "fail");
+	}
+
+	for (i = 0; i < cfg.connections; i++)
+		doClientConnect();
+
+	DEBUGPRINT("Connections : %d, resumed : %d, early data accepted : %d",
+			cfg.connections, hsResumed, hsEarly);
+
+	if (cfg.resume && (cfg.sessionFile != NULL) && (session != NULL))
+	{
+		fp = fopen(cfg.sessionFile, "w");
+		if ((fp == NULL) || !PEM_write_SSL_SESSION(fp, session))
+			DEBUGPRINT("Session save to %s fail", cfg.sessionFile);
+		if (fp != NULL)
+			fclose(fp);
+	}
+	SSL_SESSION_free(session);
+
+	if (e != NULL)
+	{
+		ENGINE_finish(e);
+		ENGINE_free(e);
+	}
 
 	return 0;
 }
 
+// TLS 1.2 sessions come with the handshake, TLS 1.3 tickets after it
+static int newSessionCb(SSL *ssl, SSL_SESSION *sess)
+{
+	SSL_SESSION_free(session);
+	session = sess;
+	return 1;	// keep the reference
+}
 void doClientConnect(void)
 {
 	int 		err;
@@ -99,15 +238,18 @@ void doClientConnect(void)
 	SSL		*ssl;
 	SSL_METHOD	*meth;
 	uint8_t		buf[4096];
+	uint8_t		msg;
+	size_t		written;
+	int		earlySent = 0;
 	
 	int		sock;
 	struct sockaddr_in	server_addr;
 
-	short int	s_port = DEFAULT_PORT;
+	short int	s_port = cfg.port;
 
 	//int		sockstate;
 
-	uint8_t		s_ipaddr[] = DEFAULT_IP;
+	const char	*s_ipaddr = cfg.ipaddr;
 
 	DEBUGPRINT("s_ipaddr : %s", s_ipaddr);
 
@@ -130,6 +272,24 @@ void doClientConnect(void)
 	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
 	SSL_CTX_set_verify_depth(ctx, 1);
 
+	if ((e != NULL) && !SSL_CTX_set_client_cert_engine(ctx, e))
+	{
+		ERR_print_errors_fp(stderr);
+		exit(1);
+	}
+
+	// The server does ECDHE on P-256 only, a key share for it up front
+	// saves the HelloRetryRequest. After a retry TLS 1.3 early data is
+	// rejected, and with anti-replay the ticket is spent already.
+	SSL_CTX_set1_groups_list(ctx, "P-256:X25519");
+
+	// The sessions are kept by newSessionCb across the connections
+	if (cfg.resume)
+	{
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ctx, newSessionCb);
+	}
+
 	/*********************************************************************/
 	// Setting the Socket
 	sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP); // IPPROTO_TCP
@@ -183,8 +343,22 @@ void doClientConnect(void)
 	// Assign the socket into the SSL structure
 	SSL_set_fd(ssl, sock);
 
+	// Resume the last session, the server then skips the signature
+	if (cfg.resume && (session != NULL))
+	{
+		SSL_set_session(ssl, session);
+
+		// The first message goes with the ClientHello
+		if (cfg.earlyData && (SSL_SESSION_get_max_early_data(session) > 0))
+		{
+			msg = 1;
+			if (SSL_write_early_data(ssl, &msg, 1, &written) == 1)
+				earlySent = 1;
+			else
+				ERR_print_errors_fp(stderr);
+		}
+	}
 
-	
 	// SSL Perfrom Handshaking
 	DEBUGPRINT("Performing Handshaking .....");
 	err = SSL_connect(ssl);
@@ -197,17 +371,33 @@ void doClientConnect(void)
 
 	DEBUGPRINT("Connection using : %s", SSL_get_cipher(ssl));
 	DEBUGPRINT("                 : %s", SSL_get_version(ssl));	
+	DEBUGPRINT("Session reused   : %s", SSL_session_reused(ssl) ? "yes" : "no");
+	if (SSL_session_reused(ssl))
+		hsResumed++;
+	if (earlySent)
+	{
+		// Rejected early data is sent again below
+		if (SSL_get_early_data_status(ssl) == SSL_EARLY_DATA_ACCEPTED)
+			hsEarly++;
+		else
+			earlySent = 0;
+		DEBUGPRINT("Early data       : %s", earlySent ? "accepted" : "rejected");
+	}
 
 	/**********************************************************************/
 			j =0;
-			while(j < 101)
+			while(j < cfg.messages)
 			{
 				j++;
-				err = SSL_write(ssl, &j, 1);
-				if (err==-1)
+				msg = j;
+				if ((j > 1) || !earlySent)
 				{
-					ERR_print_errors_fp(stderr);
-				} 
+					err = SSL_write(ssl, &msg, 1);
+					if (err==-1)
+					{
+						ERR_print_errors_fp(stderr);
+					}
+				}
 				
 				len = SSL_read(ssl, buf, sizeof(buf) - 1);
 				err = SSL_get_error(ssl, len);
@@ -224,9 +414,13 @@ void doClientConnect(void)
 					}
 					printf("\n");
 				}
-				sleep(1);
+				usleep(cfg.delayMs * 1000);
 			}
 
+			// Any message above 100 closes the connection
+			msg = 101;
+			SSL_write(ssl, &msg, 1);
+
 	DEBUGPRINT("Connection Closed!!!");
 
 	/**********************************************************************/
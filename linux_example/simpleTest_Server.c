@@ -23,23 +23,39 @@
 
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <stdint.h>
 
 // open ssl related includes
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/engine.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+#include <openssl/pem.h>
 
 // Socket related includes
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
+#include "trustm_ticket.h"
+#include "trustm_dc.h"
+
 
 #ifndef DEBUG
 	#define DEBUG 1
@@ -65,15 +81,100 @@
 #define SECURE_COMM		TLS_server_method()
 //#define SECURE_COMM		DTLS_server_method()
 
+// Prefork server defaults
+#define DEFAULT_WORKERS         4       // worker processes
+#define DEFAULT_BACKLOG         1024    // listen backlog
+#define DEFAULT_ADMISSION       2       // handshakes in progress per worker
+#define DEFAULT_MAX_CONN        256     // connections per worker
+#define IDLE_TIMEOUT            5       // [s] idle connection is closed
+#define MAX_EVENTS              64
+#define WORKER_MIN_UP           5       // [s] a worker exiting earlier failed to start
+#define WORKER_MAX_FAIL         5       // failed starts in a row stop the server
+
+// Session resumption defaults
+#define RESUME_OFF              0       // full handshake for every connection
+#define RESUME_CACHE            1       // session-ID cache (TLS 1.3: stateful tickets)
+#define RESUME_TICKET           2       // session-ID cache and session tickets
+#define DEFAULT_RESUME          RESUME_TICKET
+#define DEFAULT_TICKET_ROTATE   3600    // [s] ticket key lifetime
+#define DEFAULT_SESSION_LIFETIME 7200   // [s] resumable session lifetime
+#define SESSION_ID_CONTEXT      "simpleTest_Server"
+
+// Delegated credentials
+#define DC_MIN_VALID            600     // [s] shortest credential validity
+#define DC_RETRY                60      // [s] next try after a failed renewal
+
+// ECDHE key pairs in the chip session contexts
+#define ECDHE_GROUPS            "P-256:P-384"
+#define ECDHE_POLL_MS           10      // [ms] epoll timeout while key pairs are generated
+
 //typedef
-// For Socket
+// Connection served by a worker
 typedef enum {
-	SOCKET_IS_NONBLOCKING,
-	SOCKET_IS_BLOCKING,
-	SOCKET_HAS_TIMED_OUT,
-	SOCKET_HAS_BEEN_CLOSED,
-	SOCKET_OPERATION_OK
-} timeout_state;
+	CONN_FREE,
+	CONN_EARLY,
+	CONN_HANDSHAKE,
+	CONN_DATA
+} conn_state;
+
+typedef struct {
+	int		fd;
+	SSL		*ssl;
+	conn_state	state;
+	uint32_t	events;
+	time_t		last;
+} conn_t;
+
+// Worker process seen by the master
+typedef struct {
+	pid_t		pid;
+	time_t		started;
+	time_t		restart;	// not forked again before
+	int		failed;		// failed starts in a row
+} worker_t;
+
+// Server settings
+typedef struct {
+	short int	port;
+	int		workers;
+	int		backlog;
+	int		admission;
+	int		maxConn;
+	int		forkPerConn;
+	int		resume;
+	int		ticketRotate;
+	int		sessionLifetime;
+	int		maxEarlyData;
+	int		softRand;
+	uint16_t	ticketOid;
+	int		dcValid;
+	int		ecdhePool;
+} server_cfg_t;
+
+// Session ticket keys. The store is created before the workers are
+// forked and is shared by all of them, so a ticket issued by one worker
+// resumes on any other. Only the master rotates the keys, the workers
+// read them under the sequence count.
+typedef struct {
+	unsigned char	name[16];
+	unsigned char	aesKey[32];
+	unsigned char	hmacKey[32];
+} ticket_key_t;
+
+typedef struct {
+	uint32_t	seq;		// odd while the master writes the keys
+	time_t		rotated;
+	ticket_key_t	key[2];		// [0] current, [1] previous
+} ticket_store_t;
+
+// Delegated credential, signed by the chip in the master and renewed
+// there at half of its validity. The workers pick up a new one at the
+// next accept.
+typedef struct {
+	uint32_t	seq;		// odd while the master writes the credential
+	time_t		renew;		// master only: next renewal
+	trustm_dc_t	dc;
+} dc_store_t;
 
 //extern
 extern  int waitpid();
@@ -81,18 +182,367 @@ extern  int waitpid();
 // Function Protoyping
 void serverListen(void);
 void doServerConnected(int,int);
+void serverPrefork(void);
+SSL_CTX *setupServerCtx(ENGINE **pe);
+int ticketStoreInit(void);
+void ticketStoreRotate(void);
+int dcStoreInit(void);
+void dcStoreRenew(void);
+
+static server_cfg_t	cfg = {DEFAULT_PORT, DEFAULT_WORKERS, DEFAULT_BACKLOG,
+				DEFAULT_ADMISSION, DEFAULT_MAX_CONN, 0,
+				DEFAULT_RESUME, DEFAULT_TICKET_ROTATE, DEFAULT_SESSION_LIFETIME,
+				0, 0, 0, 0, 0};
+static volatile sig_atomic_t	stop = 0;
+static ticket_store_t		*ticketStore = NULL;
+static dc_store_t		*dcStore = NULL;
+
+static void helpmenu(void)
+{
+	printf("\nHelp menu: simpleTest_Server <option> ...<option>\n");
+	printf("option:- \n");
+	printf("-p <port>     : Listen port [default %d] \n", DEFAULT_PORT);
+	printf("-w <workers>  : Worker processes [default %d] \n", DEFAULT_WORKERS);
+	printf("-b <backlog>  : Listen backlog [default %d] \n", DEFAULT_BACKLOG);
+	printf("-a <count>    : Handshakes in progress per worker [default %d] \n", DEFAULT_ADMISSION);
+	printf("-c <count>    : Connections per worker [default %d] \n", DEFAULT_MAX_CONN);
+	printf("-f            : Fork a process per connection (original server) \n");
+	printf("-r <mode>     : Session resumption, 0 off, 1 session-ID cache, \n");
+	printf("                2 session-ID cache and tickets [default %d] \n", DEFAULT_RESUME);
+	printf("-t <sec>      : Ticket key rotation period [default %d] \n", DEFAULT_TICKET_ROTATE);
+	printf("-l <sec>      : Lifetime of a resumable session [default %d] \n", DEFAULT_SESSION_LIFETIME);
+	printf("-k <OID>      : Ticket keys derived by the chip from the secret in <OID>, \n");
+	printf("                kept over restarts. An empty OID gets a new secret \n");
+	printf("-e <bytes>    : Accept TLS 1.3 early data up to <bytes> [default 0, off] \n");
+	printf("-s            : Handshake random from the OpenSSL DRBG instead of the chip, \n");
+	printf("                resumed handshakes then do not use the chip at all \n");
+	printf("-d <sec>      : Delegated credentials valid for <sec>, %d to %d. TLS 1.3 \n", DC_MIN_VALID, TRUSTM_DC_MAX_VALID);
+	printf("                clients supporting them get a software signature [default 0, off] \n");
+	printf("-x <count>    : ECDHE key shares pre-generated in <count> chip session contexts, \n");
+	printf("                1 to 4, needs one worker [default 0, off] \n");
+	printf("-h            : Print this help \n");
+}
 
 int main (int argc, char *argv[])
 {
+	int option;
+
+	while (-1 != (option = getopt(argc, argv, "p:w:b:a:c:fr:t:l:k:e:sd:x:h")))
+	{
+		switch (option)
+		{
+			case 'p':
+				cfg.port = atoi(optarg);
+				break;
+			case 'w':
+				cfg.workers = atoi(optarg);
+				break;
+			case 'b':
+				cfg.backlog = atoi(optarg);
+				break;
+			case 'a':
+				cfg.admission = atoi(optarg);
+				break;
+			case 'c':
+				cfg.maxConn = atoi(optarg);
+				break;
+			case 'f':
+				cfg.forkPerConn = 1;
+				break;
+			case 'r':
+				cfg.resume = atoi(optarg);
+				break;
+			case 't':
+				cfg.ticketRotate = atoi(optarg);
+				break;
+			case 'l':
+				cfg.sessionLifetime = atoi(optarg);
+				break;
+			case 'k':
+				cfg.ticketOid = strtol(optarg, NULL, 16);
+				break;
+			case 'e':
+				cfg.maxEarlyData = atoi(optarg);
+				break;
+			case 's':
+				cfg.softRand = 1;
+				break;
+			case 'd':
+				cfg.dcValid = atoi(optarg);
+				break;
+			case 'x':
+				cfg.ecdhePool = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				helpmenu();
+				exit(0);
+		}
+	}
+
+	if ((cfg.workers < 1) || (cfg.backlog < 1) || (cfg.admission < 1) || (cfg.maxConn < 1) ||
+	    (cfg.resume < RESUME_OFF) || (cfg.resume > RESUME_TICKET) || (cfg.ticketRotate < 1) ||
+	    (cfg.sessionLifetime < 1) || (cfg.maxEarlyData < 0) || (cfg.dcValid < 0) ||
+	    ((cfg.dcValid != 0) && ((cfg.dcValid < DC_MIN_VALID) || (cfg.dcValid > TRUSTM_DC_MAX_VALID))) ||
+	    (cfg.ecdhePool < 0) || (cfg.ecdhePool > 4) ||
+	    ((cfg.ecdhePool != 0) && (cfg.forkPerConn || (cfg.workers != 1))))
+	{
+		helpmenu();
+		exit(1);
+	}
 
 	//Print Heading
 	DEBUGPRINT("*****************************************");
 
-	serverListen();
+	// Before the fork, the workers inherit the ticket keys
+	if (cfg.resume == RESUME_TICKET)
+	{
+		if (cfg.ticketOid != 0)
+		{
+			if (trustmTicketInit(cfg.ticketOid, cfg.ticketRotate) != OPTIGA_LIB_SUCCESS)
+			{
+				DEBUGPRINT("Ticket secret 0x%.4X not usable", cfg.ticketOid);
+				exit(1);
+			}
+			DEBUGPRINT("Ticket keys from 0x%.4X", cfg.ticketOid);
+		}
+		else if (ticketStoreInit() != 0)
+		{
+			exit(1);
+		}
+	}
+
+	if ((cfg.dcValid > 0) && (dcStoreInit() != 0))
+		exit(1);
+
+	if (cfg.forkPerConn)
+		serverListen();
+	else
+		serverPrefork();
+
+	return 0;
+}
+
+/**********************************************************************
+* Session ticket keys
+* The keys are made by the master with the OpenSSL DRBG, the master
+* never loads the engine. A ticket is accepted while its key is the
+* current or the previous one, so it stays valid for one to two
+* rotation periods; tickets under the previous key are renewed.
+**********************************************************************/
+static void ticketKeyNew(ticket_key_t *key)
+{
+	if ((RAND_bytes(key->name, sizeof(key->name)) != 1) ||
+	    (RAND_bytes(key->aesKey, sizeof(key->aesKey)) != 1) ||
+	    (RAND_bytes(key->hmacKey, sizeof(key->hmacKey)) != 1))
+	{
+		DEBUGPRINT("Ticket key generation fail");
+	}
+}
 
+int ticketStoreInit(void)
+{
+	ticketStore = mmap(NULL, sizeof(ticket_store_t), PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (ticketStore == MAP_FAILED)
+	{
+		perror("mmap");
+		ticketStore = NULL;
+		return 1;
+	}
+	memset(ticketStore, 0, sizeof(ticket_store_t));
+	ticketKeyNew(&ticketStore->key[0]);
+	ticketKeyNew(&ticketStore->key[1]);
+	ticketStore->rotated = time(NULL);
 	return 0;
 }
 
+// Called by the master only, rotates the keys once the period is over
+void ticketStoreRotate(void)
+{
+	ticket_key_t	key;
+	time_t		now = time(NULL);
+
+	if ((ticketStore == NULL) || ((now - ticketStore->rotated) < cfg.ticketRotate))
+		return;
+
+	ticketKeyNew(&key);
+	__atomic_add_fetch(&ticketStore->seq, 1, __ATOMIC_SEQ_CST);
+	ticketStore->key[1] = ticketStore->key[0];
+	ticketStore->key[0] = key;
+	ticketStore->rotated = now;
+	__atomic_add_fetch(&ticketStore->seq, 1, __ATOMIC_SEQ_CST);
+	OPENSSL_cleanse(&key, sizeof(key));
+	DEBUGPRINT("Ticket key rotated");
+}
+
+static void ticketStoreRead(ticket_key_t key[2])
+{
+	uint32_t seq;
+
+	do {
+		while ((seq = __atomic_load_n(&ticketStore->seq, __ATOMIC_ACQUIRE)) & 1);
+		memcpy(key, ticketStore->key, sizeof(ticketStore->key));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (seq != __atomic_load_n(&ticketStore->seq, __ATOMIC_RELAXED));
+}
+
+static int ticketKeyCb(SSL *ssl, unsigned char keyName[16], unsigned char *iv,
+			EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc)
+{
+	ticket_key_t	key[2];
+	int		ret = 0;
+	int		i;
+
+	ticketStoreRead(key);
+	if (enc)
+	{
+		// The IV needs no chip random, keep the ticket off the chip
+		if (RAND_OpenSSL()->bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) == 1)
+		{
+			memcpy(keyName, key[0].name, sizeof(key[0].name));
+			EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key[0].aesKey, iv);
+			HMAC_Init_ex(hctx, key[0].hmacKey, sizeof(key[0].hmacKey), EVP_sha256(), NULL);
+			ret = 1;
+		}
+		else
+		{
+			ret = -1;
+		}
+	}
+	else
+	{
+		for (i = 0; i < 2; i++)
+		{
+			if (memcmp(keyName, key[i].name, sizeof(key[i].name)) != 0)
+				continue;
+			HMAC_Init_ex(hctx, key[i].hmacKey, sizeof(key[i].hmacKey), EVP_sha256(), NULL);
+			EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key[i].aesKey, iv);
+			// 2: valid, issue a new ticket. Under the previous key it
+			// is renewed, and a TLS 1.3 client uses a ticket only once
+			ret = ((i == 0) && (SSL_version(ssl) != TLS1_3_VERSION)) ? 1 : 2;
+			break;
+		}
+	}
+	OPENSSL_cleanse(key, sizeof(key));
+	return ret;
+}
+
+/**********************************************************************
+* Delegated credentials
+* The master has the chip key sign a credential for a new software key,
+* the workers sign the TLS 1.3 handshakes of clients supporting
+* delegated credentials with that key. The chip signs once per renewal
+* instead of once per handshake, the certificate key stays in the chip.
+**********************************************************************/
+static int dcCreate(trustm_dc_t *dc)
+{
+	FILE			*fp;
+	X509			*cert = NULL;
+	optiga_lib_status_t	status;
+
+	fp = fopen(SERVER_CERT, "r");
+	if (fp != NULL)
+	{
+		cert = PEM_read_X509(fp, NULL, NULL, NULL);
+		fclose(fp);
+	}
+	if (cert == NULL)
+	{
+		DEBUGPRINT("Load Certificate Fail");
+		return 1;
+	}
+
+	status = trustmDCCreate(strtol(SERVER_KEY, NULL, 16), cert, cfg.dcValid, dc);
+	X509_free(cert);
+	return (status == OPTIGA_LIB_SUCCESS) ? 0 : 1;
+}
+
+int dcStoreInit(void)
+{
+	dcStore = mmap(NULL, sizeof(dc_store_t), PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (dcStore == MAP_FAILED)
+	{
+		perror("mmap");
+		dcStore = NULL;
+		return 1;
+	}
+	memset(dcStore, 0, sizeof(dc_store_t));
+	if (dcCreate(&dcStore->dc) != 0)
+	{
+		DEBUGPRINT("Delegated credential fail");
+		return 1;
+	}
+	dcStore->renew = time(NULL) + cfg.dcValid / 2;
+	DEBUGPRINT("Delegated credential valid for %d s", cfg.dcValid);
+	return 0;
+}
+
+// Called by the master only, renews the credential at half its validity
+void dcStoreRenew(void)
+{
+	trustm_dc_t	dc;
+	time_t		now = time(NULL);
+
+	if ((dcStore == NULL) || (now < dcStore->renew))
+		return;
+
+	if (dcCreate(&dc) != 0)
+	{
+		// The workers keep the current credential while it is valid
+		DEBUGPRINT("Delegated credential renewal fail");
+		dcStore->renew = now + DC_RETRY;
+		return;
+	}
+	__atomic_add_fetch(&dcStore->seq, 1, __ATOMIC_SEQ_CST);
+	dcStore->dc = dc;
+	__atomic_add_fetch(&dcStore->seq, 1, __ATOMIC_SEQ_CST);
+	dcStore->renew = now + cfg.dcValid / 2;
+	OPENSSL_cleanse(&dc, sizeof(dc));
+	DEBUGPRINT("Delegated credential renewed");
+}
+
+// Worker: take over a credential renewed by the master
+static void dcStoreUse(SSL_CTX *ctx)
+{
+	static uint32_t	used = 1;	// odd: none yet
+	trustm_dc_t	dc;
+	uint32_t	seq;
+
+	if ((dcStore == NULL) || (__atomic_load_n(&dcStore->seq, __ATOMIC_ACQUIRE) == used))
+		return;
+
+	do {
+		while ((seq = __atomic_load_n(&dcStore->seq, __ATOMIC_ACQUIRE)) & 1);
+		memcpy(&dc, &dcStore->dc, sizeof(dc));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (seq != __atomic_load_n(&dcStore->seq, __ATOMIC_RELAXED));
+
+	if (trustmDCSet(SSL_CTX_get0_certificate(ctx), &dc))
+		used = seq;
+	OPENSSL_cleanse(&dc, sizeof(dc));
+}
+
+// Seconds until the master rotates or renews, 0: nothing to do
+static int masterTimeout(void)
+{
+	time_t	next = 0;
+	time_t	now = time(NULL);
+
+	if (ticketStore != NULL)
+		next = ticketStore->rotated + cfg.ticketRotate;
+	if ((dcStore != NULL) && ((next == 0) || (dcStore->renew < next)))
+		next = dcStore->renew;
+	if (next == 0)
+		return 0;
+	return (next > now) ? (next - now) : 1;
+}
+
+/**********************************************************************
+* Original server: a child process per connection, every child loads
+* the engine and the key again.
+**********************************************************************/
 void serverListen(void)
 {
 	int                     err;
@@ -103,7 +553,7 @@ void serverListen(void)
 	struct sockaddr_in      sa_serv;
 	struct sockaddr_in      sa_cli;
 	size_t                  client_len;
-	short int               s_port = DEFAULT_PORT;
+	short int               s_port = cfg.port;
 
 	int                     connect=0;
 
@@ -135,6 +585,11 @@ void serverListen(void)
 	}
 	client_len = sizeof(sa_cli);
 
+	// The children are reaped by the kernel, a client going away
+	// must not kill the server
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
 	while (error == 0)
 	{
 		/* Socket for TCP/IP connection is created */
@@ -145,6 +600,8 @@ void serverListen(void)
 			error=1;
 			break;
 		}
+		ticketStoreRotate();
+		dcStoreRenew();
 
 		DEBUGPRINT("Connection from %d.%d.%d.%d, port :0x%.4x",
 				sa_cli.sin_addr.s_addr & 0x000000ff,
@@ -169,6 +626,11 @@ void serverListen(void)
 			DEBUGPRINT("[%d] Return from Child", connect);
 			error=1;
 		}
+		else
+		{
+			// The child owns the connection
+			close(sock);
+		}
 	}
 
 	// Close the Socket
@@ -181,22 +643,18 @@ void serverListen(void)
 	DEBUGPRINT("[%d] Leaving Routine!!!", connect);
 }
 
-void doServerConnected(int sock, int connect)
+/**********************************************************************
+* setupServerCtx()
+* Load the engine and the key, and build the server SSL_CTX.
+**********************************************************************/
+SSL_CTX *setupServerCtx(ENGINE **pe)
 {
-	int             err;
-	int             len;
-	int             error=0;
-	clock_t		start, end;
-
-
-	SSL_CTX         *ctx;
-	SSL             *ssl;
+	SSL_CTX         *ctx = NULL;
 	SSL_METHOD      *meth;
-
-	char         buf[4096];
+	int             error = 1;
 
 	// For Engine
-	ENGINE          *e;
+	ENGINE          *e = NULL;
 	EVP_PKEY        *pkey;
 	UI_METHOD       *ui_method;
 	EC_KEY *ecdh;
@@ -212,7 +670,7 @@ void doServerConnected(int sock, int connect)
 	    if (!ctx)
 	    {
 		ERR_print_errors_fp(stderr);
-		exit(1);
+		break;
 	    }
 
 	    ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
@@ -221,6 +679,7 @@ void doServerConnected(int sock, int connect)
 		DEBUGPRINT("ECDH Param error......... ");
 	    }
 	    SSL_CTX_set_tmp_ecdh(ctx,ecdh);
+	    EC_KEY_free(ecdh);
 
 
 	    //Load and init Engine
@@ -229,25 +688,46 @@ void doServerConnected(int sock, int connect)
 	    if(!e)
 	    {
 		DEBUGPRINT("Error loading Engine!!");
+		break;
 	    }
 	    DEBUGPRINT("Engine ID : %s",ENGINE_get_id(e));
 
 	    if(!ENGINE_init(e))
 	    {
 		DEBUGPRINT("Cannot Init TrustM Engine!!");
+		ENGINE_free(e);
+		e = NULL;
+		break;
 	    }
 	    DEBUGPRINT("Init TrustM Engine. Ok");
 
-	    if(!ENGINE_set_default(e, ENGINE_METHOD_ALL))
+	    // The key is bound to the engine when loaded, -s leaves the
+	    // handshake random to the OpenSSL DRBG
+	    if(!ENGINE_set_default(e, cfg.softRand ? (ENGINE_METHOD_ALL & ~ENGINE_METHOD_RAND) : ENGINE_METHOD_ALL))
 	    {
 		DEBUGPRINT(" Cannot use TrustM Engine!");
+		break;
 	    }
 	    DEBUGPRINT("Set Default Engine Ok.");
 
+	    // The worker holds the chip, the key shares come from the
+	    // session contexts. No X25519, the chip has no such curve
+	    if (cfg.ecdhePool > 0)
+	    {
+		if (!ENGINE_ctrl_cmd(e, "ECDHE_POOL", cfg.ecdhePool, NULL, NULL, 0) ||
+		    !SSL_CTX_set1_groups_list(ctx, ECDHE_GROUPS))
+		{
+			DEBUGPRINT("ECDHE session contexts fail");
+			break;
+		}
+		DEBUGPRINT("ECDHE from %d session contexts", cfg.ecdhePool);
+	    }
+
 	    // Load key
 	    ui_method = UI_OpenSSL();
 	    pkey = ENGINE_load_private_key(e,SERVER_KEY,ui_method,NULL);
 	    SSL_CTX_use_PrivateKey(ctx, pkey);
+	    EVP_PKEY_free(pkey);
 
 	    // Load the servr certificate into ctx
 	    if(SSL_CTX_use_certificate_file(ctx, SERVER_CERT, SSL_FILETYPE_PEM) <= 0)
@@ -279,8 +759,71 @@ void doServerConnected(int sock, int connect)
 
 	   // Set verify depth to 1
 	   SSL_CTX_set_verify_depth(ctx,1);
+
+	   // Session resumption, a resumed handshake needs no chip signature
+	   SSL_CTX_set_session_id_context(ctx, (const unsigned char *)SESSION_ID_CONTEXT,
+						strlen(SESSION_ID_CONTEXT));
+	   if (cfg.resume == RESUME_OFF)
+	   {
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+		SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+		SSL_CTX_set_num_tickets(ctx, 0);
+	   }
+	   else
+	   {
+		// The session-ID cache is per process, the tickets work across workers
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_set_timeout(ctx, cfg.sessionLifetime);
+		if (cfg.resume == RESUME_CACHE)
+			SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+		else if (cfg.ticketOid != 0)
+			SSL_CTX_set_tlsext_ticket_key_cb(ctx, trustmTicketKeyCb);
+		else
+			SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticketKeyCb);
+		SSL_CTX_set_max_early_data(ctx, cfg.maxEarlyData);
+	   }
+
+	   // Delegated credentials, dcStoreUse() sets the key
+	   if ((cfg.dcValid > 0) && !trustmDCEnable(ctx))
+	   {
+		DEBUGPRINT("Delegated credentials fail");
+		break;
+	   }
+	   error = 0;
 	}while(0);
 
+	if (error)
+	{
+		if (ctx)
+			SSL_CTX_free(ctx);
+		ctx = NULL;
+	}
+	*pe = e;
+	return ctx;
+}
+
+void doServerConnected(int sock, int connect)
+{
+	int             err;
+	int             len;
+	int             error=0;
+	clock_t		start, end;
+
+
+	SSL_CTX         *ctx;
+	SSL             *ssl = NULL;
+
+	char         buf[4096];
+
+	// For Engine
+	ENGINE          *e;
+
+	ctx = setupServerCtx(&e);
+	if (ctx == NULL)
+		error = 1;
+	else
+		dcStoreUse(ctx);
+
     if(error==0)
     {
 	// Estabish the SSL Connection
@@ -302,6 +845,7 @@ void doServerConnected(int sock, int connect)
 		case 1:
 			DEBUGPRINT("Connection using : %s", SSL_get_cipher(ssl));
 			DEBUGPRINT("                 : %s", SSL_get_version(ssl));
+			DEBUGPRINT("Session reused   : %s", SSL_session_reused(ssl) ? "yes" : "no");
 			DEBUGPRINT("++++++++++++++++++++++++++++++++++++++++++++++");
 
 			start = clock();
@@ -352,3 +896,421 @@ void doServerConnected(int sock, int connect)
     SSL_CTX_free(ctx);
     DEBUGPRINT("Leaving Routine!!!");
 }
+
+/**********************************************************************
+* Prefork server: the workers load the engine and the key once and
+* serve the connections with non-blocking I/O on epoll.
+* Admission: a worker stops accepting while it has cfg.admission
+* handshakes in progress. The chip signs one handshake at a time, so
+* more handshakes in progress only add latency to all of them; the
+* connections wait in the listen backlog instead.
+**********************************************************************/
+static uint32_t	hsFull = 0;		// handshakes of this worker
+static uint32_t	hsResumed = 0;
+static uint32_t	hsEarly = 0;
+static uint32_t	hsDelegated = 0;
+
+static void onSignal(int sig)
+{
+	stop = 1;
+}
+
+// Wakes the master from wait() for the ticket key rotation and the
+// credential renewal
+static void onAlarm(int sig)
+{
+}
+
+static void connClose(int epfd, conn_t *conn, int *inflight, int *nconn)
+{
+	if ((conn->state == CONN_EARLY) || (conn->state == CONN_HANDSHAKE))
+		(*inflight)--;
+	epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+	if (conn->state == CONN_DATA)
+		SSL_shutdown(conn->ssl);
+	SSL_free(conn->ssl);
+	close(conn->fd);
+	conn->ssl = NULL;
+	conn->fd = -1;
+	conn->state = CONN_FREE;
+	(*nconn)--;
+}
+
+static void connWant(int epfd, conn_t *conn, int sslerr)
+{
+	struct epoll_event ev;
+	uint32_t events = (sslerr == SSL_ERROR_WANT_WRITE) ? EPOLLOUT : EPOLLIN;
+
+	if (events == conn->events)
+		return;
+	conn->events = events;
+	ev.events = events;
+	ev.data.ptr = conn;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+// Answer a message, returns 0 if the connection is to be closed
+static int connEcho(SSL *ssl, char *buf, int early)
+{
+	size_t written;
+	int len;
+
+	if (buf[0] > 100)
+		return 0;
+
+	len = sprintf(buf,"From Server [%d] : %.3d",getpid(), buf[0]);
+	if (early)
+		return SSL_write_early_data(ssl, buf, len, &written);
+	return (SSL_write(ssl, buf, len) > 0);
+}
+
+// Returns 0 if the connection is to be closed
+static int connStep(int epfd, conn_t *conn, int *inflight)
+{
+	char buf[4096];
+	size_t readbytes;
+	int len, err;
+
+	conn->last = time(NULL);
+
+	// TLS 1.3 early data comes with the ClientHello of a resumed session
+	if (conn->state == CONN_EARLY)
+	{
+		while (1)
+		{
+			err = SSL_read_early_data(conn->ssl, buf, sizeof(buf) - 1, &readbytes);
+			if (err == SSL_READ_EARLY_DATA_ERROR)
+			{
+				err = SSL_get_error(conn->ssl, 0);
+				if ((err == SSL_ERROR_WANT_READ) || (err == SSL_ERROR_WANT_WRITE))
+				{
+					connWant(epfd, conn, err);
+					return 1;
+				}
+				ERR_clear_error();
+				return 0;
+			}
+			if ((readbytes > 0) && !connEcho(conn->ssl, buf, 1))
+			{
+				ERR_clear_error();
+				return 0;
+			}
+			if (err == SSL_READ_EARLY_DATA_FINISH)
+				break;
+		}
+		conn->state = CONN_HANDSHAKE;
+	}
+
+	if (conn->state == CONN_HANDSHAKE)
+	{
+		err = SSL_do_handshake(conn->ssl);
+		if (err != 1)
+		{
+			err = SSL_get_error(conn->ssl, err);
+			if ((err == SSL_ERROR_WANT_READ) || (err == SSL_ERROR_WANT_WRITE))
+			{
+				connWant(epfd, conn, err);
+				return 1;
+			}
+			ERR_clear_error();
+			return 0;
+		}
+		conn->state = CONN_DATA;
+		(*inflight)--;
+
+		if (SSL_session_reused(conn->ssl))
+			hsResumed++;
+		else
+			hsFull++;
+		if (SSL_get_early_data_status(conn->ssl) == SSL_EARLY_DATA_ACCEPTED)
+			hsEarly++;
+		if (trustmDCUsed(conn->ssl))
+			hsDelegated++;
+	}
+
+	while (1)
+	{
+		len = SSL_read(conn->ssl, buf, sizeof(buf) - 1);
+		if (len <= 0)
+		{
+			err = SSL_get_error(conn->ssl, len);
+			if ((err == SSL_ERROR_WANT_READ) || (err == SSL_ERROR_WANT_WRITE))
+			{
+				connWant(epfd, conn, err);
+				return 1;
+			}
+			ERR_clear_error();
+			return 0;
+		}
+
+		if (!connEcho(conn->ssl, buf, 0))
+		{
+			ERR_clear_error();
+			return 0;
+		}
+	}
+}
+
+static void serverWorker(int listen_sock)
+{
+	struct epoll_event	ev;
+	struct epoll_event	events[MAX_EVENTS];
+	conn_t			*conn;
+	conn_t			*c;
+	conn_t			listener;
+	SSL_CTX			*ctx;
+	ENGINE			*e;
+	int			epfd;
+	int			listening = 0;
+	int			inflight = 0;
+	int			nconn = 0;
+	int			n, i, fd;
+	int			one = 1;
+	int			ecdhePending = 0;
+	time_t			now, lastSweep = 0;
+
+	ctx = setupServerCtx(&e);
+	if (ctx == NULL)
+		exit(1);
+
+	conn = calloc(cfg.maxConn, sizeof(conn_t));
+	epfd = epoll_create1(0);
+	if ((conn == NULL) || (epfd == -1))
+		exit(1);
+	for (i = 0; i < cfg.maxConn; i++)
+		conn[i].fd = -1;
+
+	DEBUGPRINT("[%d] Worker ready", getpid());
+
+	while (!stop)
+	{
+		// Admission: accept only while below the limits
+		if (!listening && (inflight < cfg.admission) && (nconn < cfg.maxConn))
+		{
+			ev.data.ptr = &listener;
+			ev.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+			ev.events |= EPOLLEXCLUSIVE;
+#endif
+			if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_sock, &ev) == 0)
+				listening = 1;
+		}
+		else if (listening && ((inflight >= cfg.admission) || (nconn >= cfg.maxConn)))
+		{
+			epoll_ctl(epfd, EPOLL_CTL_DEL, listen_sock, NULL);
+			listening = 0;
+		}
+
+		n = epoll_wait(epfd, events, MAX_EVENTS, ecdhePending ? ECDHE_POLL_MS : 1000);
+
+		// Only the key shares of the handshakes come from the session contexts
+		if (cfg.ecdhePool > 0)
+			ENGINE_ctrl_cmd(e, "ECDHE_HANDSHAKE", 1, NULL, NULL, 0);
+		for (i = 0; i < n; i++)
+		{
+			if (events[i].data.ptr == &listener)
+			{
+				while ((inflight < cfg.admission) && (nconn < cfg.maxConn))
+				{
+					fd = accept4(listen_sock, NULL, NULL, SOCK_NONBLOCK);
+					if (fd == -1)
+						break;
+					setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+					dcStoreUse(ctx);
+
+					for (c = conn; c->state != CONN_FREE; c++);
+					c->ssl = SSL_new(ctx);
+					if (c->ssl == NULL)
+					{
+						close(fd);
+						continue;
+					}
+					c->fd = fd;
+					c->state = (cfg.maxEarlyData > 0) ? CONN_EARLY : CONN_HANDSHAKE;
+					c->events = EPOLLIN;
+					SSL_set_fd(c->ssl, fd);
+					SSL_set_accept_state(c->ssl);
+					ev.events = EPOLLIN;
+					ev.data.ptr = c;
+					epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+					inflight++;
+					nconn++;
+
+					// The ClientHello may be there already
+					if (!connStep(epfd, c, &inflight))
+						connClose(epfd, c, &inflight, &nconn);
+				}
+			}
+			else
+			{
+				c = (conn_t *)events[i].data.ptr;
+				if (c->state == CONN_FREE)
+					continue;
+				if (!connStep(epfd, c, &inflight))
+					connClose(epfd, c, &inflight, &nconn);
+			}
+		}
+		if (cfg.ecdhePool > 0)
+			ENGINE_ctrl_cmd(e, "ECDHE_HANDSHAKE", 0, NULL, NULL, 0);
+
+		// No handshake waits for the chip, refill the session contexts.
+		// The chip generates the key pairs while the worker accepts,
+		// they are collected at the next turns
+		if ((cfg.ecdhePool > 0) && (inflight == 0))
+			ecdhePending = ENGINE_ctrl_cmd(e, "ECDHE_POLL", 0, NULL, NULL, 0);
+
+		// Close idle connections
+		now = time(NULL);
+		if (now != lastSweep)
+		{
+			lastSweep = now;
+			for (i = 0; i < cfg.maxConn; i++)
+			{
+				if ((conn[i].state != CONN_FREE) && ((now - conn[i].last) > IDLE_TIMEOUT))
+					connClose(epfd, &conn[i], &inflight, &nconn);
+			}
+		}
+	}
+
+	for (i = 0; i < cfg.maxConn; i++)
+	{
+		if (conn[i].state != CONN_FREE)
+			connClose(epfd, &conn[i], &inflight, &nconn);
+	}
+	close(epfd);
+	free(conn);
+	SSL_CTX_free(ctx);
+	ENGINE_finish(e);
+	ENGINE_free(e);
+	DEBUGPRINT("[%d] Worker stopped, handshakes: %u full, %u resumed, %u with early data, "
+			"%u signed with the delegated credential",
+			getpid(), hsFull, hsResumed, hsEarly, hsDelegated);
+	exit(0);
+}
+
+void serverPrefork(void)
+{
+	struct sockaddr_in	sa_serv;
+	struct sigaction	sa;
+	worker_t		*worker;
+	pid_t			pid;
+	time_t			now;
+	int			listen_sock;
+	int			one = 1;
+	int			i, status, timeout;
+
+	do {
+		worker = calloc(cfg.workers, sizeof(worker_t));
+		if (worker == NULL)
+			break;
+
+		listen_sock = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+		if (listen_sock == -1)
+		{
+			perror("socket");
+			break;
+		}
+		setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+		memset(&sa_serv, '\0', sizeof(sa_serv));
+		sa_serv.sin_family = AF_INET;
+		sa_serv.sin_addr.s_addr = INADDR_ANY;
+		sa_serv.sin_port = htons(cfg.port);
+		if (bind(listen_sock, (struct sockaddr*)&sa_serv,sizeof(sa_serv)) == -1)
+		{
+			perror("bind");
+			break;
+		}
+
+		if (listen(listen_sock, cfg.backlog) == -1)
+		{
+			perror("listen");
+			break;
+		}
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = onSignal;
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+		sa.sa_handler = onAlarm;
+		sigaction(SIGALRM, &sa, NULL);
+		signal(SIGPIPE, SIG_IGN);
+
+		DEBUGPRINT("Port %d, %d workers, backlog %d, admission %d, %d connections per worker",
+				cfg.port, cfg.workers, cfg.backlog, cfg.admission, cfg.maxConn);
+		DEBUGPRINT("Resumption %d, ticket key rotation %d s, session lifetime %d s, early data %d bytes",
+				cfg.resume, cfg.ticketRotate, cfg.sessionLifetime, cfg.maxEarlyData);
+
+		// Start the workers, restart a worker if it dies. A worker
+		// failing at start-up, e.g. on a bad key, certificate or engine
+		// setting, is restarted after 2, 4, 8... s; after
+		// WORKER_MAX_FAIL failed starts in a row the server stops
+		while (!stop)
+		{
+			now = time(NULL);
+			timeout = masterTimeout();
+			for (i = 0; i < cfg.workers; i++)
+			{
+				if (worker[i].pid != 0)
+					continue;
+				if (now < worker[i].restart)
+				{
+					if ((timeout == 0) || ((worker[i].restart - now) < timeout))
+						timeout = worker[i].restart - now;
+					continue;
+				}
+				pid = fork();
+				if (pid == 0)
+					serverWorker(listen_sock);
+				if (pid > 0)
+				{
+					worker[i].pid = pid;
+					worker[i].started = now;
+				}
+			}
+
+			if (timeout > 0)
+				alarm(timeout);
+			pid = wait(&status);
+			ticketStoreRotate();
+			dcStoreRenew();
+			now = time(NULL);
+			for (i = 0; i < cfg.workers; i++)
+			{
+				if ((pid <= 0) || (worker[i].pid != pid))
+					continue;
+				DEBUGPRINT("Worker %d exit", pid);
+				worker[i].pid = 0;
+				if ((WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ||
+				    ((now - worker[i].started) >= WORKER_MIN_UP))
+				{
+					worker[i].failed = 0;
+					continue;
+				}
+				worker[i].failed++;
+				if (worker[i].failed >= WORKER_MAX_FAIL)
+				{
+					DEBUGPRINT("Worker failed to start %d times, stop", worker[i].failed);
+					stop = 1;
+					break;
+				}
+				worker[i].restart = now + (1 << worker[i].failed);
+				DEBUGPRINT("Worker failed to start, restart in %d s", 1 << worker[i].failed);
+			}
+			if ((pid == -1) && (errno != EINTR))
+				sleep(1);
+		}
+
+		alarm(0);
+		for (i = 0; i < cfg.workers; i++)
+		{
+			if (worker[i].pid != 0)
+				kill(worker[i].pid, SIGTERM);
+		}
+		while (wait(&status) > 0);
+		close(listen_sock);
+	} while(0);
+
+	free(worker);
+	DEBUGPRINT("Leaving Routine!!!");
+}
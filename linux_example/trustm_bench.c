@@ -0,0 +1,738 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "optiga/ifx_i2c/ifx_i2c_config.h"
+#include "optiga/optiga_util.h"
+
+#include "trustm_helper.h"
+#include "trustm_certcomp.h"
+
+#define BENCH_NEED_KEYGEN   0x01    // needs the public key from -g
+#define BENCH_NEED_WRITE    0x02    // needs -w <OID>
+#define BENCH_NEED_COUNTER  0x04    // needs -c <OID>
+#define BENCH_NO_SHIELD     0x08    // not affected by the protection level
+#define BENCH_SIZE          0x10    // param is the data size
+
+typedef struct bench_case_str
+{
+    const char  *name;
+    uint16_t    param;                                  // size, curve or key type
+    uint8_t     flags;
+    void        (*prepare)(uint16_t param);             // untimed, before every run
+    optiga_lib_status_t (*run)(uint16_t param);         // timed
+} bench_case_t;
+
+typedef struct bench_result_str
+{
+    uint32_t    count;
+    uint32_t    fail;
+    uint64_t    min;
+    uint64_t    mean;
+    uint64_t    p50;
+    uint64_t    p99;
+    uint64_t    max;
+} bench_result_t;
+
+typedef struct _OPTFLAG {
+    uint16_t    keygen      : 1;
+    uint16_t    write       : 1;
+    uint16_t    counter     : 1;
+    uint16_t    json        : 1;
+    uint16_t    filter      : 1;
+    uint16_t    dummy5      : 1;
+    uint16_t    dummy6      : 1;
+    uint16_t    dummy7      : 1;
+    uint16_t    dummy8      : 1;
+    uint16_t    dummy9      : 1;
+    uint16_t    dummy10     : 1;
+    uint16_t    dummy11     : 1;
+    uint16_t    dummy12     : 1;
+    uint16_t    dummy13     : 1;
+    uint16_t    dummy14     : 1;
+    uint16_t    dummy15     : 1;
+}OPTFLAG;
+
+union _uOptFlag {
+    OPTFLAG    flags;
+    uint16_t    all;
+} uOptFlag;
+
+// Objects used by the benchmark
+static uint16_t bench_read_oid = 0xE0E0;
+static uint16_t bench_write_oid = 0;
+static uint16_t bench_counter_oid = 0;
+static uint16_t bench_key_p256 = 0xE0F1;
+static uint16_t bench_key_p384 = 0xE0F2;
+static uint16_t bench_key_rsa1024 = 0xE0FC;
+static uint16_t bench_key_rsa2048 = 0xE0FD;
+
+// RSA ciphertext for the decrypt runs, made from the key generated with -g
+static uint8_t bench_rsa1024_enc[128];
+static uint16_t bench_rsa1024_encLen = 0;
+static uint8_t bench_rsa2048_enc[256];
+static uint16_t bench_rsa2048_encLen = 0;
+
+static uint8_t bench_buf[1500];
+
+// Certificate of the read object, written to the write object as DER or
+// compressed for the read_cert runs
+static uint8_t bench_cert[TRUSTM_CERTCOMP_MAX_LEN];
+static uint16_t bench_certLen = 0;
+static uint16_t bench_certFormat = 0xFFFF;     // format in the write object
+
+static optiga_lib_status_t _open(uint16_t restore);
+static optiga_lib_status_t _ecdsaSign(uint16_t curve);
+static optiga_lib_status_t _rsaSign(uint16_t keyType);
+static optiga_lib_status_t _rsaDecrypt(uint16_t keyType);
+static optiga_lib_status_t _random(uint16_t size);
+static optiga_lib_status_t _readData(uint16_t size);
+static optiga_lib_status_t _writeData(uint16_t size);
+static optiga_lib_status_t _readMetadata(uint16_t dummy);
+static optiga_lib_status_t _hash(uint16_t size);
+static void _certPrepare(uint16_t format);
+static optiga_lib_status_t _readCert(uint16_t format);
+static optiga_lib_status_t _updateCount(uint16_t dummy);
+static void _close(uint16_t restore);
+
+static const bench_case_t bench_case[] =
+{
+    {"open",             0,                                     BENCH_NO_SHIELD,                 _close,  _open},
+    {"open_restore",     1,                                     BENCH_NO_SHIELD,                 _close,  _open},
+    {"ecdsa_p256_sign",  OPTIGA_ECC_CURVE_NIST_P_256,           0,                               NULL,    _ecdsaSign},
+    {"ecdsa_p384_sign",  OPTIGA_ECC_CURVE_NIST_P_384,           0,                               NULL,    _ecdsaSign},
+    {"rsa1024_sign",     OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL,   0,                               NULL,    _rsaSign},
+    {"rsa2048_sign",     OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL,   0,                               NULL,    _rsaSign},
+    {"rsa1024_decrypt",  OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL,   BENCH_NEED_KEYGEN,               NULL,    _rsaDecrypt},
+    {"rsa2048_decrypt",  OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL,   BENCH_NEED_KEYGEN,               NULL,    _rsaDecrypt},
+    {"random",           8,                                     BENCH_SIZE,                      NULL,    _random},
+    {"random",           32,                                    BENCH_SIZE,                      NULL,    _random},
+    {"random",           64,                                    BENCH_SIZE,                      NULL,    _random},
+    {"random",           256,                                   BENCH_SIZE,                      NULL,    _random},
+    {"read_data",        32,                                    BENCH_SIZE,                      NULL,    _readData},
+    {"read_data",        256,                                   BENCH_SIZE,                      NULL,    _readData},
+    {"read_data",        1024,                                  BENCH_SIZE,                      NULL,    _readData},
+    {"write_data",       32,                                    BENCH_NEED_WRITE | BENCH_SIZE,   NULL,    _writeData},
+    {"write_data",       140,                                   BENCH_NEED_WRITE | BENCH_SIZE,   NULL,    _writeData},
+    {"write_data",       512,                                   BENCH_NEED_WRITE | BENCH_SIZE,   NULL,    _writeData},
+    {"read_cert_der",    0,                                     BENCH_NEED_WRITE,                _certPrepare, _readCert},
+    {"read_cert_zlib",   TRUSTM_CERTCOMP_ZLIB,                  BENCH_NEED_WRITE,                _certPrepare, _readCert},
+    {"read_metadata",    0,                                     0,                               NULL,    _readMetadata},
+    {"sha256",           64,                                    BENCH_SIZE,                      NULL,    _hash},
+    {"sha256",           1024,                                  BENCH_SIZE,                      NULL,    _hash},
+    {"update_count",     0,                                     BENCH_NEED_COUNTER,              NULL,    _updateCount},
+};
+
+#define BENCH_CASE_COUNT    (sizeof(bench_case)/sizeof(bench_case[0]))
+
+static void _helpmenu(void)
+{
+    printf("\nHelp menu: trustm_bench <option> ...<option>\n");
+    printf("option:- \n");
+    printf("-n <count>    : Measured runs per primitive [default 20] \n");
+    printf("-u <count>    : Warm-up runs per primitive [default 3] \n");
+    printf("-m <mode>     : 0:unshielded 1:shielded 2:both [default 2] \n");
+    printf("-t <name>     : Only run primitives starting with <name> \n");
+    printf("-r <OID>      : Data object for read data/metadata [default 0xE0E0] \n");
+    printf("-w <OID>      : Data object for write data and read cert [default none, destroys content] \n");
+    printf("-c <OID>      : Monotonic counter for update count [default none, consumes counter] \n");
+    printf("-g            : Generate the benchmark keys first [destroys 0xE0F1/0xE0F2/0xE0FC/0xE0FD] \n");
+    printf("-j            : JSON output \n");
+    printf("-h            : Print this help \n");
+}
+
+static optiga_lib_status_t _wait(optiga_lib_status_t return_status)
+{
+    if (OPTIGA_LIB_SUCCESS != return_status)
+        return return_status;
+    return trustmWaitCompletion();
+}
+
+static void _protect(uint8_t shielded)
+{
+    if (shielded)
+    {
+        // OPTIGA Comms Shielded connection settings to enable the protection
+        TRUSTM_UTIL_SHIELDED(me_util);
+        TRUSTM_CRYPT_SHIELDED(me_crypt);
+    }
+    else
+    {
+        OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_NO_PROTECTION);
+        OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_NO_PROTECTION);
+    }
+}
+
+/**********************************************************************
+* Primitives
+**********************************************************************/
+static void _close(uint16_t restore)
+{
+    utrustm_UID_t UID;
+
+    if (restore)
+    {
+        // Context is saved for an established shielded session only,
+        // and with the Security Event Counter at 0
+        TRUSTM_UTIL_SHIELDED(me_util);
+        trustm_readUID(&UID);
+        while (trustmReadSecCnt() != 0)
+            mssleep(TRUSTM_GOV_SEC_DECAY_MS);
+    }
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    _wait(optiga_util_close_application(me_util, (restore ? TRUE : FALSE)));
+}
+
+static optiga_lib_status_t _open(uint16_t restore)
+{
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_util_open_application(me_util, (restore ? TRUE : FALSE)));
+}
+
+static optiga_lib_status_t _ecdsaSign(uint16_t curve)
+{
+    uint8_t digest[48];
+    uint8_t signature[110];
+    uint16_t signature_length = sizeof(signature);
+
+    memset(digest, 0x5A, sizeof(digest));
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    if (curve == OPTIGA_ECC_CURVE_NIST_P_256)
+        return _wait(optiga_crypt_ecdsa_sign(me_crypt, digest, 32, bench_key_p256,
+                                             signature, &signature_length));
+    else
+        return _wait(optiga_crypt_ecdsa_sign(me_crypt, digest, 48, bench_key_p384,
+                                             signature, &signature_length));
+}
+
+static optiga_lib_status_t _rsaSign(uint16_t keyType)
+{
+    uint8_t digest[32];
+    uint8_t signature[300];
+    uint16_t signature_length = sizeof(signature);
+
+    memset(digest, 0x5A, sizeof(digest));
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_crypt_rsa_sign(me_crypt,
+                                       OPTIGA_RSASSA_PKCS1_V15_SHA256,
+                                       digest,
+                                       sizeof(digest),
+                                       (keyType == OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL) ?
+                                            bench_key_rsa1024 : bench_key_rsa2048,
+                                       signature,
+                                       &signature_length,
+                                       0x0000));
+}
+
+static optiga_lib_status_t _rsaDecrypt(uint16_t keyType)
+{
+    uint8_t message[256];
+    uint16_t messagelen = sizeof(message);
+
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    if (keyType == OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL)
+        return _wait(optiga_crypt_rsa_decrypt_and_export(me_crypt, OPTIGA_RSAES_PKCS1_V15,
+                                                         bench_rsa1024_enc, bench_rsa1024_encLen,
+                                                         NULL, 0, bench_key_rsa1024,
+                                                         message, &messagelen));
+    else
+        return _wait(optiga_crypt_rsa_decrypt_and_export(me_crypt, OPTIGA_RSAES_PKCS1_V15,
+                                                         bench_rsa2048_enc, bench_rsa2048_encLen,
+                                                         NULL, 0, bench_key_rsa2048,
+                                                         message, &messagelen));
+}
+
+static optiga_lib_status_t _random(uint16_t size)
+{
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_crypt_random(me_crypt, OPTIGA_RNG_TYPE_TRNG, bench_buf, size));
+}
+
+static optiga_lib_status_t _readData(uint16_t size)
+{
+    uint16_t bytes_to_read = size;
+
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_util_read_data(me_util, bench_read_oid, 0, bench_buf, &bytes_to_read));
+}
+
+static optiga_lib_status_t _writeData(uint16_t size)
+{
+    memset(bench_buf, 0xA5, size);
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_util_write_data(me_util, bench_write_oid, OPTIGA_UTIL_ERASE_AND_WRITE,
+                                        0, bench_buf, size));
+}
+
+static void _certPrepare(uint16_t format)
+{
+    uint8_t obj[TRUSTM_CERTCOMP_MAX_LEN];
+    uint16_t objLen = sizeof(obj);
+    unsigned char *der = bench_cert;
+    X509 *x509;
+
+    if (bench_certFormat == format)
+        return;
+
+    // Certificate from the read object, once
+    if (bench_certLen == 0)
+    {
+        optiga_lib_status = OPTIGA_LIB_BUSY;
+        if (_wait(optiga_util_read_data(me_util, bench_read_oid, 0, obj, &objLen)) != OPTIGA_LIB_SUCCESS)
+            return;
+        x509 = trustmCertParse(obj, objLen);
+        if (x509 == NULL)
+            return;
+        if (i2d_X509(x509, NULL) <= (int)sizeof(bench_cert))
+            bench_certLen = (uint16_t)i2d_X509(x509, &der);
+        X509_free(x509);
+        if (bench_certLen == 0)
+            return;
+    }
+
+    objLen = sizeof(obj);
+    if (format == TRUSTM_CERTCOMP_ZLIB)
+    {
+        if (trustmCertCompress(bench_cert, bench_certLen, obj, &objLen) != 0)
+            return;
+    }
+    else
+    {
+        memcpy(obj, bench_cert, bench_certLen);
+        objLen = bench_certLen;
+    }
+
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    if (_wait(optiga_util_write_data(me_util, bench_write_oid, OPTIGA_UTIL_ERASE_AND_WRITE,
+                                     0, obj, objLen)) == OPTIGA_LIB_SUCCESS)
+        bench_certFormat = format;
+}
+
+// Read and parse, the inflate time of the compressed object is included
+static optiga_lib_status_t _readCert(uint16_t format)
+{
+    optiga_lib_status_t return_status;
+    uint8_t obj[TRUSTM_CERTCOMP_MAX_LEN];
+    uint16_t objLen = sizeof(obj);
+    X509 *x509;
+
+    if (bench_certFormat != format)
+        return OPTIGA_UTIL_ERROR;
+
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return_status = _wait(optiga_util_read_data(me_util, bench_write_oid, 0, obj, &objLen));
+    if (return_status != OPTIGA_LIB_SUCCESS)
+        return return_status;
+
+    x509 = trustmCertParse(obj, objLen);
+    if (x509 == NULL)
+        return OPTIGA_UTIL_ERROR;
+    X509_free(x509);
+    return OPTIGA_LIB_SUCCESS;
+}
+
+static optiga_lib_status_t _readMetadata(uint16_t dummy)
+{
+    uint16_t bytes_to_read = sizeof(bench_buf);
+
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_util_read_metadata(me_util, bench_read_oid, bench_buf, &bytes_to_read));
+}
+
+static optiga_lib_status_t _hash(uint16_t size)
+{
+    optiga_lib_status_t return_status;
+    optiga_hash_context_t hash_context;
+    hash_data_from_host_t hash_data_host;
+    uint8_t hash_context_buffer[2048];
+    uint8_t digest[32];
+
+    hash_context.context_buffer = hash_context_buffer;
+    hash_context.context_buffer_length = sizeof(hash_context_buffer);
+    hash_context.hash_algo = (uint8_t)OPTIGA_HASH_TYPE_SHA_256;
+
+    memset(bench_buf, 0x5A, size);
+    hash_data_host.buffer = bench_buf;
+    hash_data_host.length = size;
+
+    do
+    {
+        optiga_lib_status = OPTIGA_LIB_BUSY;
+        return_status = _wait(optiga_crypt_hash_start(me_crypt, &hash_context));
+        if (OPTIGA_LIB_SUCCESS != return_status)
+            break;
+
+        optiga_lib_status = OPTIGA_LIB_BUSY;
+        return_status = _wait(optiga_crypt_hash_update(me_crypt, &hash_context,
+                                                       OPTIGA_CRYPT_HOST_DATA, &hash_data_host));
+        if (OPTIGA_LIB_SUCCESS != return_status)
+            break;
+
+        optiga_lib_status = OPTIGA_LIB_BUSY;
+        return_status = _wait(optiga_crypt_hash_finalize(me_crypt, &hash_context, digest));
+    } while (FALSE);
+
+    return return_status;
+}
+
+static optiga_lib_status_t _updateCount(uint16_t dummy)
+{
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_util_update_count(me_util, bench_counter_oid, 1));
+}
+
+/**********************************************************************
+* Key generation (-g)
+**********************************************************************/
+static optiga_lib_status_t _keygen(void)
+{
+    optiga_lib_status_t return_status;
+    public_key_from_host_t public_key_from_host;
+    optiga_key_id_t optiga_key_id;
+    uint8_t pubKey[300];
+    uint16_t pubKeyLen;
+    uint8_t message[32];
+    uint8_t i;
+
+    memset(message, 0x5A, sizeof(message));
+
+    do
+    {
+        _protect(1);
+        for (i = 0; i < 2; i++)
+        {
+            optiga_key_id = (i == 0) ? bench_key_p256 : bench_key_p384;
+            pubKeyLen = sizeof(pubKey);
+            optiga_lib_status = OPTIGA_LIB_BUSY;
+            return_status = optiga_crypt_ecc_generate_keypair(me_crypt,
+                                                              (i == 0) ? OPTIGA_ECC_CURVE_NIST_P_256 :
+                                                                         OPTIGA_ECC_CURVE_NIST_P_384,
+                                                              OPTIGA_KEY_USAGE_SIGN,
+                                                              FALSE,
+                                                              &optiga_key_id,
+                                                              pubKey,
+                                                              &pubKeyLen);
+            if (OPTIGA_LIB_SUCCESS == return_status)
+                return_status = trustmWaitCompletionMs(TRUSTM_CMD_TIMEOUT_LONG_MS);
+            if (OPTIGA_LIB_SUCCESS != return_status)
+                break;
+        }
+        if (OPTIGA_LIB_SUCCESS != return_status)
+            break;
+
+        for (i = 0; i < 2; i++)
+        {
+            optiga_key_id = (i == 0) ? bench_key_rsa1024 : bench_key_rsa2048;
+            pubKeyLen = sizeof(pubKey);
+            optiga_lib_status = OPTIGA_LIB_BUSY;
+            return_status = optiga_crypt_rsa_generate_keypair(me_crypt,
+                                                              (i == 0) ? OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL :
+                                                                         OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL,
+                                                              OPTIGA_KEY_USAGE_SIGN | OPTIGA_KEY_USAGE_ENCRYPTION,
+                                                              FALSE,
+                                                              &optiga_key_id,
+                                                              pubKey,
+                                                              &pubKeyLen);
+            if (OPTIGA_LIB_SUCCESS == return_status)
+                return_status = trustmWaitCompletionMs(TRUSTM_CMD_TIMEOUT_LONG_MS);
+            if (OPTIGA_LIB_SUCCESS != return_status)
+                break;
+
+            // Ciphertext for the decrypt runs
+            public_key_from_host.public_key = pubKey;
+            public_key_from_host.length = pubKeyLen;
+            public_key_from_host.key_type = (uint8_t)((i == 0) ? OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL :
+                                                                 OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL);
+            if (i == 0)
+                bench_rsa1024_encLen = sizeof(bench_rsa1024_enc);
+            else
+                bench_rsa2048_encLen = sizeof(bench_rsa2048_enc);
+
+            optiga_lib_status = OPTIGA_LIB_BUSY;
+            return_status = _wait(optiga_crypt_rsa_encrypt_message(me_crypt,
+                                                                   OPTIGA_RSAES_PKCS1_V15,
+                                                                   message,
+                                                                   sizeof(message),
+                                                                   NULL,
+                                                                   0,
+                                                                   OPTIGA_CRYPT_HOST_DATA,
+                                                                   &public_key_from_host,
+                                                                   (i == 0) ? bench_rsa1024_enc : bench_rsa2048_enc,
+                                                                   (i == 0) ? &bench_rsa1024_encLen : &bench_rsa2048_encLen));
+            if (OPTIGA_LIB_SUCCESS != return_status)
+                break;
+        }
+    } while (FALSE);
+
+    if (OPTIGA_LIB_SUCCESS != return_status)
+    {
+        bench_rsa1024_encLen = 0;
+        bench_rsa2048_encLen = 0;
+    }
+    return return_status;
+}
+
+/**********************************************************************
+* Measurement
+**********************************************************************/
+static void _measure(const bench_case_t *bc, uint8_t shielded, uint32_t count, uint32_t warmup,
+                     uint64_t *sample, bench_result_t *result)
+{
+    optiga_lib_status_t return_status;
+    uint64_t start, sum;
+    uint32_t i;
+
+    for (i = 0; i < warmup + count; i++)
+    {
+        if (bc->prepare != NULL)
+            bc->prepare(bc->param);
+        _protect(shielded);
+
+        start = trustmNowUs();
+        return_status = bc->run(bc->param);
+        if (i < warmup)
+            continue;
+
+        sample[i - warmup] = trustmNowUs() - start;
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            result->fail++;
+    }
+
+    trustmSortSamples(sample, count);
+
+    sum = 0;
+    for (i = 0; i < count; i++)
+        sum += sample[i];
+
+    result->count = count;
+    result->min = sample[0];
+    result->mean = sum / count;
+    result->p50 = trustmPercentile(sample, count, 500);
+    result->p99 = trustmPercentile(sample, count, 990);
+    result->max = sample[count-1];
+}
+
+static void _printResult(const bench_case_t *bc, uint8_t shielded, bench_result_t *result, uint8_t first)
+{
+    char name[32];
+    double opsPerSec;
+
+    opsPerSec = (result->mean != 0) ? (1000000.0 / (double)result->mean) : 0.0;
+
+    if(uOptFlag.flags.json == 1)
+    {
+        printf("%s    {\"name\":\"%s\",\"size\":%d,\"shielded\":%s,\"count\":%d,\"fail\":%d,"
+               "\"min_us\":%llu,\"mean_us\":%llu,\"p50_us\":%llu,\"p99_us\":%llu,\"max_us\":%llu,"
+               "\"ops_per_s\":%.2f}",
+                first ? "" : ",\n",
+                bc->name,
+                (bc->flags & BENCH_SIZE) ? bc->param : 0,
+                shielded ? "true" : "false",
+                result->count, result->fail,
+                (unsigned long long)result->min, (unsigned long long)result->mean,
+                (unsigned long long)result->p50, (unsigned long long)result->p99,
+                (unsigned long long)result->max, opsPerSec);
+    }
+    else
+    {
+        if (bc->flags & BENCH_SIZE)
+            snprintf(name, sizeof(name), "%s/%d", bc->name, bc->param);
+        else
+            snprintf(name, sizeof(name), "%s", bc->name);
+        printf("%-20s %-4s %5d %4d %9llu %9llu %9llu %9llu %9llu %9.2f\n",
+                name,
+                shielded ? "yes" : "no",
+                result->count, result->fail,
+                (unsigned long long)result->min, (unsigned long long)result->mean,
+                (unsigned long long)result->p50, (unsigned long long)result->p99,
+                (unsigned long long)result->max, opsPerSec);
+    }
+    fflush(stdout);
+}
+
+int main (int argc, char **argv)
+{
+    optiga_lib_status_t return_status;
+    utrustm_UID_t UID;
+    bench_result_t result;
+    uint64_t *sample;
+    uint32_t count = 20;
+    uint32_t warmup = 3;
+    uint32_t mode = 2;
+    const char *filter = NULL;
+    uint8_t shielded;
+    uint8_t first = 1;
+    uint32_t i;
+
+    int option = 0;                    // Command line option.
+
+/***************************************************************
+ * Getting Input from CLI
+ **************************************************************/
+    uOptFlag.all = 0;
+    do // Begin of DO WHILE(FALSE) for error handling.
+    {
+        // ---------- Command line parsing with getopt ----------
+        opterr = 0; // Disable getopt error messages in case of unknown parameters
+
+        // Loop through parameters with getopt.
+        while (-1 != (option = getopt(argc, argv, "n:u:m:t:r:w:c:gjh")))
+        {
+            switch (option)
+            {
+                case 'n': // Measured runs
+                    count = trustmHexorDec(optarg);
+                    break;
+                case 'u': // Warm-up runs
+                    warmup = trustmHexorDec(optarg);
+                    break;
+                case 'm': // Protection mode
+                    mode = trustmHexorDec(optarg);
+                    break;
+                case 't': // Primitive filter
+                    uOptFlag.flags.filter = 1;
+                    filter = optarg;
+                    break;
+                case 'r': // Read data object
+                    bench_read_oid = trustmHexorDec(optarg);
+                    break;
+                case 'w': // Write data object
+                    uOptFlag.flags.write = 1;
+                    bench_write_oid = trustmHexorDec(optarg);
+                    break;
+                case 'c': // Monotonic counter
+                    uOptFlag.flags.counter = 1;
+                    bench_counter_oid = trustmHexorDec(optarg);
+                    break;
+                case 'g': // Key generation
+                    uOptFlag.flags.keygen = 1;
+                    break;
+                case 'j': // JSON output
+                    uOptFlag.flags.json = 1;
+                    break;
+                case 'h': // Print Help Menu
+                default:  // Any other command Print Help Menu
+                    _helpmenu();
+                    exit(0);
+                    break;
+            }
+        }
+    } while (0); // End of DO WHILE FALSE loop.
+
+    if ((count == 0) || (mode > 2))
+    {
+        _helpmenu();
+        exit(0);
+    }
+
+/***************************************************************
+ * Example
+ **************************************************************/
+    sample = malloc(count * sizeof(uint64_t));
+    if (sample == NULL)
+        exit(1);
+
+    trustm_hibernate_flag = 0; // disable hibernate Context Save
+    return_status = trustm_Open();
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        free(sample);
+        exit(1);
+    }
+
+    memset(&UID, 0, sizeof(UID));
+    trustm_readUID(&UID);
+
+    if(uOptFlag.flags.keygen == 1)
+    {
+        if (uOptFlag.flags.json != 1)
+            printf("Generating benchmark keys ........\n");
+        return_status = _keygen();
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            trustmPrintErrorCode(return_status);
+    }
+
+    if(uOptFlag.flags.json == 1)
+    {
+        printf("{\n  \"tool\":\"trustm_bench\",\n");
+        printf("  \"firmware\":\"0x%.2x%.2x%.2x%.2x\",\n  \"build\":\"%.2x%.2x\",\n",
+                UID.st.dwFirmwareIdentifier[0], UID.st.dwFirmwareIdentifier[1],
+                UID.st.dwFirmwareIdentifier[2], UID.st.dwFirmwareIdentifier[3],
+                UID.st.rgbESWBuild[0], UID.st.rgbESWBuild[1]);
+        printf("  \"count\":%d,\n  \"warmup\":%d,\n  \"results\":[\n", count, warmup);
+    }
+    else
+    {
+        printf("========================================================\n");
+        printf("Firmware 0x%.2x%.2x%.2x%.2x build %.2x%.2x, %d runs (%d warm-up), times in us\n",
+                UID.st.dwFirmwareIdentifier[0], UID.st.dwFirmwareIdentifier[1],
+                UID.st.dwFirmwareIdentifier[2], UID.st.dwFirmwareIdentifier[3],
+                UID.st.rgbESWBuild[0], UID.st.rgbESWBuild[1], count, warmup);
+        printf("%-20s %-4s %5s %4s %9s %9s %9s %9s %9s %9s\n",
+                "Primitive", "Shld", "Runs", "Fail", "Min", "Mean", "p50", "p99", "Max", "ops/s");
+        printf("--------------------------------------------------------"
+               "--------------------------------------------\n");
+    }
+
+    for (i = 0; i < BENCH_CASE_COUNT; i++)
+    {
+        if ((filter != NULL) && (strncmp(bench_case[i].name, filter, strlen(filter)) != 0))
+            continue;
+        if ((bench_case[i].flags & BENCH_NEED_KEYGEN) && (bench_rsa1024_encLen == 0))
+            continue;
+        if ((bench_case[i].flags & BENCH_NEED_WRITE) && (uOptFlag.flags.write != 1))
+            continue;
+        if ((bench_case[i].flags & BENCH_NEED_COUNTER) && (uOptFlag.flags.counter != 1))
+            continue;
+
+        for (shielded = 0; shielded < 2; shielded++)
+        {
+            if ((mode != 2) && (mode != shielded))
+                continue;
+            // Same command either way, measure it once
+            if ((bench_case[i].flags & BENCH_NO_SHIELD) && (mode == 2) && (shielded == 1))
+                continue;
+
+            memset(&result, 0, sizeof(result));
+            _measure(&bench_case[i], shielded, count, warmup, sample, &result);
+            _printResult(&bench_case[i], shielded, &result, first);
+            first = 0;
+        }
+    }
+
+    if(uOptFlag.flags.json == 1)
+        printf("\n  ]\n}\n");
+    else
+        printf("========================================================\n");
+
+    trustm_Close();
+    trustm_hibernate_flag = 0; // Disable hibernate Context Save
+
+    free(sample);
+    return 0;
+}
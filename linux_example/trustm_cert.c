@@ -36,6 +36,8 @@
 #include "optiga/optiga_util.h"
 
 #include "trustm_helper.h"
+#include "trustm_cache.h"
+#include "trustm_certcomp.h"
 
 #define MAX_OID_PUB_CERT_SIZE   1728
 
@@ -47,7 +49,7 @@ typedef struct _OPTFLAG {
     uint16_t    clear       : 1;
     uint16_t    input       : 1;
     uint16_t    bypass      : 1;
-    uint16_t    dummy7      : 1;
+    uint16_t    compress    : 1;
     uint16_t    dummy8      : 1;
     uint16_t    dummy9      : 1;
     uint16_t    dummy10     : 1;
@@ -73,6 +75,8 @@ void helpmenu(void)
     printf("-o <filename>   : Output certificate to file \n");
     printf("-i <filename>   : Input certificate to file \n");
     printf("-c <Cert OID>   : Clear cert OID data to zero \n");
+    printf("-z              : Write the certificate compressed (zlib), not for \n");
+    printf("                  OIDs the chip reads (0xE0E0-0xE0E3, 0xE0E8, 0xE0E9, 0xE0EF)\n");
     printf("-X              : Bypass Shielded Communication \n");
     printf("-h              : Print this help \n");
 }
@@ -112,7 +116,7 @@ int main (int argc, char **argv)
         opterr = 0; // Disable getopt error messages in case of unknown parameters
 
         // Loop through parameters with getopt.
-        while (-1 != (option = getopt(argc, argv, "r:w:o:i:f:c:Xh")))
+        while (-1 != (option = getopt(argc, argv, "r:w:o:i:f:c:zXh")))
         {
             switch (option)
             {
@@ -140,6 +144,9 @@ int main (int argc, char **argv)
                     uOptFlag.flags.clear = 1;   
                     optiga_oid = trustmHexorDec(optarg);                                
                     break;
+                case 'z': // Compressed Cert
+                    uOptFlag.flags.compress = 1;
+                    break;
                 case 'X': // Bypass Shielded Communication
                     uOptFlag.flags.bypass = 1;
                     printf("Bypass Shielded Communication. \n");
@@ -186,61 +193,33 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);      
-                OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_UTIL_SHIELDED(me_util);
             }
 
-            optiga_lib_status = OPTIGA_LIB_BUSY;
-            return_status = optiga_util_read_data(me_util,
-                                                optiga_oid,
+            // Immutable objects come from the cache
+            return_status = trustmCacheReadData(optiga_oid,
                                                 offset,
                                                 read_data_buffer,
                                                 (uint16_t *)&bytes_to_read);
-            if (OPTIGA_LIB_SUCCESS != return_status)
-                break;
-            //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
             {
-                switch (read_data_buffer[0])
+                // DER, TLS identity or compressed cert
+                if (read_data_buffer[0] == TRUSTM_CERTCOMP_TAG)
+                    printf("Compressed Cert  : %d bytes\n", bytes_to_read);
+                x509Cert = trustmCertParse(read_data_buffer, bytes_to_read);
+                if(!x509Cert)
                 {
-                case 0x30: // DER format Cert
-                    pCert = read_data_buffer;
-                    certLen = bytes_to_read;
-                    break;
-                case 0xC0: // TLS Indentity
-                    pCert = read_data_buffer + 9;
-                    certLen = bytes_to_read - 9;
-                    break;
-                case 0xC2: // USB Type-C identity
-                default:
-                    pCert = NULL;
-                    certLen = 0;
-                    break;
-                }
-                
-                if (pCert != NULL)
-                {
-                    x509Cert = d2i_X509(NULL, (const uint8_t **)&pCert, certLen);
-                    if(!x509Cert)
-                    {
-                        printf("Unable to parse cert in OID Ox%.4X\n",optiga_oid);  
-                    }
-                    else
-                    {
-                        ret = trustmWriteX509PEM(x509Cert, outFile);
-                        if (ret != 0)
-                            printf("Write file error!!!!\n");
-                        else    
-                            printf("Success!!!\n");
-                    }
+                    printf("Error :No X.509 cert found in OID 0x%.4X!!!!\n",optiga_oid);
                 }
                 else
                 {
-                    printf("Error :No X.509 cert found!!!!\n");
+                    ret = trustmWriteX509PEM(x509Cert, outFile);
+                    if (ret != 0)
+                        printf("Write file error!!!!\n");
+                    else    
+                        printf("Success!!!\n");
                 }
             }   
         }
@@ -253,18 +232,37 @@ int main (int argc, char **argv)
                 break;
             }
             
+            if((uOptFlag.flags.compress == 1) && (trustmCertChipOid(optiga_oid) == 1))
+            {
+                printf("OID 0x%.4X must be DER, the chip parses it!!!!\n",optiga_oid);
+                break;
+            }
+
             ret = trustmReadX509PEM(&x509Cert, inFile);
             if (ret == 0)
             {
                 certLen = i2d_X509(x509Cert, &pCert);
                 if(certLen != 0)
                 {
+                    if(uOptFlag.flags.compress == 1)
+                    {
+                        bytes_to_read = sizeof(read_data_buffer);
+                        if(trustmCertCompress(pCert, certLen, read_data_buffer, &bytes_to_read) == 0)
+                        {
+                            printf("Compressed Cert  : %d -> %d bytes\n", certLen, bytes_to_read);
+                            pCert = read_data_buffer;
+                            certLen = bytes_to_read;
+                        }
+                        else
+                        {
+                            printf("Compression gains nothing, writing DER.\n");
+                        }
+                    }
                     
                     if(uOptFlag.flags.bypass != 1)
                     {
                         // OPTIGA Comms Shielded connection settings to enable the protection
-                        OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);      
-                        OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
+                        TRUSTM_UTIL_SHIELDED(me_util);
                     }
                     
                     optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -277,8 +275,7 @@ int main (int argc, char **argv)
                     if (OPTIGA_LIB_SUCCESS != return_status)
                         break;          
                     //Wait until the optiga_util_read_metadata operation is completed
-                    while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-                    return_status = optiga_lib_status;
+                    return_status = trustmWaitCompletion();
                     if (return_status != OPTIGA_LIB_SUCCESS)
                         break;
                     else
@@ -304,8 +301,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);       
-                OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_UTIL_SHIELDED(me_util);
             }
 
             optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -318,8 +314,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;          
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -335,5 +330,5 @@ int main (int argc, char **argv)
         
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (return_status != OPTIGA_LIB_SUCCESS);
 }
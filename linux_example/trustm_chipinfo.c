@@ -103,5 +103,5 @@ int main (int argc, char **argv)
 
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (return_status != OPTIGA_LIB_SUCCESS);
 }
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
@@ -35,6 +36,9 @@
 #include "optiga/optiga_util.h"
 
 #include "trustm_helper.h"
+#include "trustm_cache.h"
+
+#define DATA_CHUNK_MAX  1728    // largest data object, one transfer
 
 typedef struct _OPTFLAG {
     uint16_t    read        : 1;
@@ -45,8 +49,8 @@ typedef struct _OPTFLAG {
     uint16_t    erase       : 1;
     uint16_t    bypass      : 1;
     uint16_t    invalue     : 1;
-    uint16_t    dummy8      : 1;
-    uint16_t    dummy9      : 1;
+    uint16_t    chunk       : 1;
+    uint16_t    resume      : 1;
     uint16_t    dummy10     : 1;
     uint16_t    dummy11     : 1;
     uint16_t    dummy12     : 1;
@@ -71,10 +75,71 @@ static void _helpmenu(void)
     printf("-o <filename> : Output file \n");
     printf("-p <offset>   : Offset position \n");
     printf("-e            : Erase and wirte \n");
+    printf("-C <size>     : Transfer in chunks of <size> bytes \n");
+    printf("-R            : Resume, read: append to output file\n");
+    printf("                        write: skip the data already in OID\n");
     printf("-X            : Bypass Shielded Communication \n");
     printf("-h            : Print this help \n");
 }
 
+static void _protect(void)
+{
+    if(uOptFlag.flags.bypass != 1)
+    {
+        // OPTIGA Comms Shielded connection settings to enable the protection
+        TRUSTM_UTIL_SHIELDED(me_util);
+    }
+}
+
+// Whole input file, it is read before the first chip transfer
+static uint8_t *_readFile(const char *filename, uint32_t *len)
+{
+    FILE *fp;
+    long size;
+    uint8_t *buf = NULL;
+
+    fp = fopen(filename, "rb");
+    if (fp == NULL)
+        return NULL;
+    if ((fseek(fp, 0, SEEK_END) == 0) && ((size = ftell(fp)) > 0) && (size <= 0xFFFF))
+    {
+        rewind(fp);
+        buf = malloc(size);
+        if ((buf != NULL) && (fread(buf, 1, size, fp) != (size_t)size))
+        {
+            free(buf);
+            buf = NULL;
+        }
+        *len = (uint32_t)size;
+    }
+    fclose(fp);
+    return buf;
+}
+
+// Read one chunk. Reads are replayed after a watchdog reset.
+static optiga_lib_status_t _readChunk(uint16_t oid, uint16_t offset, uint8_t *buf, uint16_t *len)
+{
+    optiga_lib_status_t return_status;
+    uint16_t size = *len;
+
+    TRUSTM_REPLAY(return_status,
+                  _protect(); *len = size,
+                  optiga_util_read_data(me_util, oid, offset, buf, len));
+    return return_status;
+}
+
+// Write one chunk. Writing the same bytes at the same offset again
+// gives the same content, so writes are replayed as well.
+static optiga_lib_status_t _writeChunk(uint16_t oid, uint8_t mode, uint16_t offset, const uint8_t *buf, uint16_t len)
+{
+    optiga_lib_status_t return_status;
+
+    TRUSTM_REPLAY(return_status,
+                  _protect(),
+                  optiga_util_write_data(me_util, oid, mode, offset, buf, len));
+    return return_status;
+}
+
 int main (int argc, char **argv)
 {
     optiga_lib_status_t return_status;
@@ -83,6 +148,14 @@ int main (int argc, char **argv)
     uint16_t optiga_oid;
     uint8_t read_data_buffer[2048];
     uint8_t mode = OPTIGA_UTIL_WRITE_ONLY;
+    uint16_t chunk = 0;
+    uint16_t len;
+    uint32_t pos, total, used;
+    uint32_t inLen = 0;
+    uint8_t *inData = NULL;
+    uint16_t chunks = 0;
+    trustm_metadata_t oidMetadata;
+    FILE *fp;
 
     char    messagebuf[500];
 
@@ -111,7 +184,7 @@ int main (int argc, char **argv)
         opterr = 0; // Disable getopt error messages in case of unknown parameters
 
         // Loop through parameters with getopt.
-        while (-1 != (option = getopt(argc, argv, "r:w:i:I:o:p:eXh")))
+        while (-1 != (option = getopt(argc, argv, "r:w:i:I:o:p:eC:RXh")))
         {
             switch (option)
             {
@@ -143,6 +216,18 @@ int main (int argc, char **argv)
                     uOptFlag.flags.erase = 1;
                     mode = OPTIGA_UTIL_ERASE_AND_WRITE;
                     break;
+                case 'C': // chunk size
+                    uOptFlag.flags.chunk = 1;
+                    chunk = trustmHexorDec(optarg);
+                    if ((chunk == 0) || (chunk > DATA_CHUNK_MAX))
+                    {
+                        printf("Chunk size 1 to %d!!!\n", DATA_CHUNK_MAX);
+                        exit(1);
+                    }
+                    break;
+                case 'R': // resume
+                    uOptFlag.flags.resume = 1;
+                    break;
                 case 'X': // Bypass Shielded Communication
                     uOptFlag.flags.bypass = 1;
                     printf("Bypass Shielded Communication. \n");
@@ -184,27 +269,20 @@ int main (int argc, char **argv)
 
     do
     {
-        if(uOptFlag.flags.read == 1)
+        if((uOptFlag.flags.read == 1) && (uOptFlag.flags.chunk != 1) && (uOptFlag.flags.resume != 1))
         {
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_UTIL_SHIELDED(me_util);
             }
 
             bytes_to_read = sizeof(read_data_buffer);
-            optiga_lib_status = OPTIGA_LIB_BUSY;
-            return_status = optiga_util_read_data(me_util,
-                                                optiga_oid,
+            // Immutable objects come from the cache
+            return_status = trustmCacheReadData(optiga_oid,
                                                 offset,
                                                 read_data_buffer,
                                                 (uint16_t *)&bytes_to_read);
-            if (OPTIGA_LIB_SUCCESS != return_status)
-                break;
-            //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -222,6 +300,65 @@ int main (int argc, char **argv)
             }
         }
 
+        if((uOptFlag.flags.read == 1) && ((uOptFlag.flags.chunk == 1) || (uOptFlag.flags.resume == 1)))
+        {
+            // Stream the object from offset to its used size
+            return_status = trustmReadMetadata(optiga_oid, &oidMetadata);
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                break;
+            if (chunk == 0)
+                chunk = DATA_CHUNK_MAX;
+            // Without used size read until a short chunk
+            used = (oidMetadata.present & TRUSTM_MD_C5) ? oidMetadata.C5_used : 0xFFFF;
+
+            fp = NULL;
+            pos = offset;
+            if(uOptFlag.flags.outfile == 1)
+            {
+                // Output file holds the data from offset, continue behind it
+                fp = fopen(outFile, (uOptFlag.flags.resume == 1) ? "ab" : "wb");
+                if (fp == NULL)
+                {
+                    printf("Open %s error!!!\n", outFile);
+                    break;
+                }
+                if(uOptFlag.flags.resume == 1)
+                    pos += ftell(fp);
+            }
+
+            total = 0;
+            while (pos < used)
+            {
+                len = ((used - pos) < chunk) ? (used - pos) : chunk;
+                return_status = _readChunk(optiga_oid, pos, read_data_buffer, &len);
+                if ((return_status != OPTIGA_LIB_SUCCESS) || (len == 0))
+                    break;
+                if ((len < chunk) && (used == 0xFFFF))
+                    used = pos + len;
+                if ((fp != NULL) && (fwrite(read_data_buffer, 1, len, fp) != len))
+                {
+                    printf("Write %s error!!!\n", outFile);
+                    break;
+                }
+                printf("[Offset %.4d Size %.4d] : \n", pos, len);
+                trustmHexDump(read_data_buffer, len);
+                pos += len;
+                total += len;
+                chunks++;
+            }
+            if (fp != NULL)
+                fclose(fp);
+
+            if (pos < used)
+            {
+                printf("Read stopped at offset %d, use -R to resume.\n", pos);
+                break;
+            }
+            printf("Read %d bytes in %d chunks.\n", total, chunks);
+            if(uOptFlag.flags.outfile == 1)
+                printf("Output to %s\n",outFile);
+        }
+
         if(uOptFlag.flags.write == 1)
         {
             if((uOptFlag.flags.infile != 1) && (uOptFlag.flags.invalue != 1))
@@ -232,46 +369,66 @@ int main (int argc, char **argv)
 
             if(uOptFlag.flags.infile == 1)
             {
-                bytes_to_read = 0;
-                trustmReadDER(read_data_buffer, &bytes_to_read, inFile);
-                if (bytes_to_read <= 0)
+                inData = _readFile(inFile, &inLen);
+                if (inData == NULL)
                 {
-                    printf("Read file: %s error!!!", inFile);
+                    printf("Read file: %s error!!!\n", inFile);
+                    break;
                 }
             }
             else
             {
-                bytes_to_read = 1;
+                inLen = 1;
                 read_data_buffer[0] = invalue;
             }
+            if (chunk == 0)
+                chunk = DATA_CHUNK_MAX;
 
             printf("Offset: %d\n", offset);
             printf("Input data : \n");
-            trustmHexDump(read_data_buffer,bytes_to_read);
+            trustmHexDump((inData != NULL) ? inData : read_data_buffer, inLen);
 
-            if(uOptFlag.flags.bypass != 1)
+            // Resume behind the data which is in the object already
+            pos = 0;
+            while ((uOptFlag.flags.resume == 1) && (pos < inLen))
             {
-                // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
+                len = ((inLen - pos) < chunk) ? (inLen - pos) : chunk;
+                if ((_readChunk(optiga_oid, offset + pos, read_data_buffer, &len) != OPTIGA_LIB_SUCCESS) ||
+                    (len == 0))
+                    break;
+                for (total = 0; (total < len) &&
+                                (read_data_buffer[total] == ((inData != NULL) ? inData[pos + total] : invalue)); total++);
+                pos += total;
+                if (total < chunk)
+                    break;
             }
+            if (pos != 0)
+                printf("Resume at offset %d\n", offset + pos);
+
+            total = pos;
+            while (pos < inLen)
+            {
+                len = ((inLen - pos) < chunk) ? (inLen - pos) : chunk;
+                return_status = _writeChunk(optiga_oid,
+                                            (pos == 0) ? mode : OPTIGA_UTIL_WRITE_ONLY,
+                                            offset + pos,
+                                            (inData != NULL) ? (inData + pos) : &invalue,
+                                            len);
+                if (return_status != OPTIGA_LIB_SUCCESS)
+                    break;
+                pos += len;
+                chunks++;
+            }
+            free(inData);
 
-            optiga_lib_status = OPTIGA_LIB_BUSY;
-            return_status = optiga_util_write_data(me_util,
-                                                    optiga_oid,
-                                                    mode,
-                                                    offset,
-                                                    read_data_buffer,
-                                                    bytes_to_read);
-            if (OPTIGA_LIB_SUCCESS != return_status)
-                break;
-            //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
             if (return_status != OPTIGA_LIB_SUCCESS)
+            {
+                printf("Write stopped at offset %d, use -R to resume.\n", offset + pos);
                 break;
-            else
-                printf("Write Success.\n");
+            }
+            printf("Write Success.\n");
+            if (chunks > 1)
+                printf("%d bytes in %d chunks.\n", inLen - total, chunks);
         }
     } while(FALSE);
 
@@ -283,5 +440,5 @@ int main (int argc, char **argv)
 
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (return_status != OPTIGA_LIB_SUCCESS);
 }
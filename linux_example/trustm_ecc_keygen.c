@@ -220,8 +220,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_CRYPT_SHIELDED(me_crypt);
             }
             
             optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -235,8 +234,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletionMs(TRUSTM_CMD_TIMEOUT_LONG_MS);
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -258,8 +256,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_UTIL_SHIELDED(me_util);
             }
 
             optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -272,8 +269,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -288,5 +284,5 @@ int main (int argc, char **argv)
     printf("========================================================\n");
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (return_status != OPTIGA_LIB_SUCCESS);
 }
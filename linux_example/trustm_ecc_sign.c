@@ -31,6 +31,7 @@
 #include "optiga/optiga_util.h"
 
 #include "trustm_helper.h"
+#include "trustm_batch.h"
 
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
@@ -46,7 +47,7 @@ typedef struct _OPTFLAG {
     uint16_t    outputssl   : 1;
     uint16_t    hash        : 1;
     uint16_t    bypass      : 1;
-    uint16_t    dummy6      : 1;
+    uint16_t    batch       : 1;
     uint16_t    dummy7      : 1;
     uint16_t    dummy8      : 1;
     uint16_t    dummy9      : 1;
@@ -72,6 +73,9 @@ void _helpmenu(void)
     printf("-O <filename> : Output to file without header\n");    
     printf("-i <filename> : Input Data file\n");
     printf("-H            : Hash before sign\n");
+    printf("-b <listfile> : Batch sign the files listed, one per line\n");
+    printf("-m <manifest> : Batch output to manifest instead of <file>.sig\n");
+    printf("-j <threads>  : Batch hash threads (default: online CPUs)\n");
     printf("-X            : Bypass Shielded Communication \n");
     printf("-h            : Print this help \n");
 }
@@ -94,8 +98,11 @@ int main (int argc, char **argv)
 
     char *outFile = NULL;
     char *inFile = NULL;
-    FILE *fp = NULL;
-    
+    char *listFile = NULL;
+    char *manifestFile = NULL;
+    uint16_t threads = 0;
+    uint32_t batchFail = 0;
+
     int i;
 
     int option = 0;                    // Command line option.
@@ -120,7 +127,7 @@ int main (int argc, char **argv)
         opterr = 0; // Disable getopt error messages in case of unknown parameters
 
         // Loop through parameters with getopt.
-        while (-1 != (option = getopt(argc, argv, "k:o:O:i:HXh")))
+        while (-1 != (option = getopt(argc, argv, "k:o:O:i:Hb:m:j:Xh")))
         {
             switch (option)
             {
@@ -143,6 +150,16 @@ int main (int argc, char **argv)
                 case 'H': // Input
                     uOptFlag.flags.hash = 1;
                     break;
+                case 'b': // Batch list
+                    uOptFlag.flags.batch = 1;
+                    listFile = optarg;
+                    break;
+                case 'm': // Batch manifest
+                    manifestFile = optarg;
+                    break;
+                case 'j': // Batch hash threads
+                    threads = trustmHexorDec(optarg);
+                    break;
                 case 'X': // Bypass Shielded Communication
                     uOptFlag.flags.bypass = 1;
                     printf("Bypass Shielded Communication. \n");
@@ -177,7 +194,13 @@ int main (int argc, char **argv)
 
     do
     {
-        if(uOptFlag.flags.sign == 1)
+        if((uOptFlag.flags.sign == 1) && (uOptFlag.flags.batch == 1))
+        {
+            printf("OID Key          : 0x%.4X\n",optiga_key_id);
+            printf("List File Name   : %s \n", listFile);
+            batchFail = trustmBatchSign(optiga_key_id, EVP_PKEY_EC, listFile, manifestFile,
+                                        threads, uOptFlag.flags.bypass);
+        } else if(uOptFlag.flags.sign == 1)
         {
             if((uOptFlag.flags.output != 1) && (uOptFlag.flags.outputssl != 1))
             {
@@ -197,33 +220,13 @@ int main (int argc, char **argv)
 
             if(uOptFlag.flags.hash == 1)
             {
-                //open
-                fp = fopen((const char *)inFile,"rb");
-                if (!fp)
+                if (trustmHashFile(inFile, EVP_sha256(), digest, &digestLen) != 0)
                 {
                     printf("error opening file : %s\n",inFile);
-                    exit(1);
+                    break;
                 }
-		
-
-                  SHA256_CTX sha256;
-                  SHA256_Init(&sha256);
-                  const int bufSize = 32768;
-                  char* buffer = malloc(bufSize);
-                  int bytesRead = 0;
-                  if(!buffer) return -1;
-                  while((bytesRead = fread(buffer, 1, bufSize, fp)))
-                  {
-                      SHA256_Update(&sha256, buffer, bytesRead);
-                  }
-                  SHA256_Final(digest, &sha256);
-                  digestLen = sizeof(digest);
-                  printf("Hash Success : SHA256\n");
-                  trustmHexDump(digest,digestLen);
-                //}
-
-                
-
+                printf("Hash Success : SHA256\n");
+                trustmHexDump(digest,digestLen);
             } else
             {
                 digestLen = trustmreadFrom(digest, (uint8_t *) inFile);
@@ -246,8 +249,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_CRYPT_SHIELDED(me_crypt);
             }
                 
             optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -260,8 +262,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -291,5 +292,5 @@ int main (int argc, char **argv)
 
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (batchFail != 0);
 }
@@ -31,6 +31,7 @@
 #include "optiga/optiga_util.h"
 
 #include "trustm_helper.h"
+#include "trustm_batch.h"
 
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
@@ -44,8 +45,8 @@ typedef struct _OPTFLAG {
     uint16_t    hash        : 1;
     uint16_t    pubkey      : 1;
     uint16_t    bypass      : 1;
-    uint16_t    dummy6      : 1;
-    uint16_t    dummy7      : 1;
+    uint16_t    hosthash    : 1;
+    uint16_t    batch       : 1;
     uint16_t    dummy8      : 1;
     uint16_t    dummy9      : 1;
     uint16_t    dummy10     : 1;
@@ -70,6 +71,9 @@ void _helpmenu(void)
     printf("-i <filename>  : Input Data file\n");
     printf("-s <signature> : Signature file\n");
     printf("-H             : Hash input before verify\n");
+    printf("-S <256|384>   : Hash input on the host with SHA-256/384\n");
+    printf("-b <manifest>  : Batch verify the manifest on the host with the key of -k/-p\n");
+    printf("-j <threads>   : Batch verify threads (default: online CPUs)\n");
     printf("-X             : Bypass Shielded Communication \n");
     printf("-h             : Print this help \n");
 }
@@ -77,31 +81,26 @@ void _helpmenu(void)
 int main (int argc, char **argv)
 {
     optiga_lib_status_t return_status;
-    optiga_hash_context_t hash_context;
-    hash_data_from_host_t hash_data_host;
     public_key_from_host_t public_key_details;
 
-    uint8_t hash_context_buffer[2048];
-
     uint16_t optiga_oid;
     uint8_t signature [100];     //To store the signture generated
     uint16_t signatureLen = sizeof(signature);
-    uint8_t digest[32];
+    uint8_t digest[TRUSTM_HASH_MAX];
     uint16_t digestLen = 0;
     uint8_t pubkey[2048];
     uint32_t pubkeyLen;
     uint16_t pubkeySize;
     uint16_t pubkeyType;
 
-    uint8_t data[2048];
-    uint16_t dataLen = 0;
-
     char *inFile = NULL;
     char *signatureFile = NULL;
     char *pubkeyFile = NULL;
     char name[100];
-    FILE *fp = NULL;
-    uint16_t filesize;
+    uint16_t hashBits = 256;
+    char *manifestFile = NULL;
+    uint16_t threads = 0;
+    uint32_t batchFail = 0;
     uint16_t i;
 
     int option = 0;                    // Command line option.
@@ -126,7 +125,7 @@ int main (int argc, char **argv)
         opterr = 0; // Disable getopt error messages in case of unknown parameters
 
         // Loop through parameters with getopt.
-        while (-1 != (option = getopt(argc, argv, "k:i:s:p:HXh")))
+        while (-1 != (option = getopt(argc, argv, "k:i:s:p:HS:b:j:Xh")))
         {
             switch (option)
             {
@@ -149,6 +148,22 @@ int main (int argc, char **argv)
                 case 'H': // Input
                     uOptFlag.flags.hash = 1;
                     break;
+                case 'S': // Hash on the host
+                    uOptFlag.flags.hosthash = 1;
+                    hashBits = trustmHexorDec(optarg);
+                    if ((hashBits != 256) && (hashBits != 384))
+                    {
+                        printf("Invalid hash size!!!\n");
+                        exit(1);
+                    }
+                    break;
+                case 'b': // Batch manifest
+                    uOptFlag.flags.batch = 1;
+                    manifestFile = optarg;
+                    break;
+                case 'j': // Batch verify threads
+                    threads = trustmHexorDec(optarg);
+                    break;
                 case 'X': // Bypass Shielded Communication
                     uOptFlag.flags.bypass = 1;
                     printf("Bypass Shielded Communication. \n");
@@ -183,6 +198,22 @@ int main (int argc, char **argv)
 
     do
     {
+        if(uOptFlag.flags.batch == 1)
+        {
+            if((uOptFlag.flags.verify != 1) && (uOptFlag.flags.pubkey != 1))
+            {
+                printf("Key OID or pubkey file missing!!!\n");
+                batchFail = 1;
+                break;
+            }
+            printf("Manifest File Name  : %s \n", manifestFile);
+            batchFail = trustmBatchVerifyManifest(optiga_oid,
+                                                  (uOptFlag.flags.pubkey == 1) ? pubkeyFile : NULL,
+                                                  EVP_PKEY_EC, hashBits, manifestFile, threads,
+                                                  uOptFlag.flags.bypass);
+            break;
+        }
+
         if(uOptFlag.flags.input != 1)
         {
             printf("Input filename missing!!!\n");
@@ -213,93 +244,22 @@ int main (int argc, char **argv)
             }
         }
 
-        if(uOptFlag.flags.hash == 1)
+        if(uOptFlag.flags.hosthash == 1)
         {
-            //open
-            fp = fopen((const char *)inFile,"rb");
-            if (!fp)
-            {
-                printf("error opening file : %s\n",inFile);
-                exit(1);
-            }
-
-            hash_context.context_buffer = hash_context_buffer;
-            hash_context.context_buffer_length = sizeof(hash_context_buffer);
-            hash_context.hash_algo = (uint8_t)OPTIGA_HASH_TYPE_SHA_256;
-            filesize = 0;
-
-            if(uOptFlag.flags.bypass != 1)
-            {
-                // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
-            }
-
-            optiga_lib_status = OPTIGA_LIB_BUSY;
-            return_status = optiga_crypt_hash_start(me_crypt, &hash_context);
-            if (OPTIGA_LIB_SUCCESS != return_status)
-                break;
-            //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
-            if (return_status != OPTIGA_LIB_SUCCESS)
-                break;
-
-            while((dataLen = fread(data,1,sizeof(data),fp)) > 0)
+            // Hash on the host, only the digest goes to the chip
+            if (trustmHashFile(inFile, (hashBits == 384) ? EVP_sha384() : EVP_sha256(),
+                               digest, &digestLen) != 0)
             {
-                hash_data_host.buffer = data;
-                hash_data_host.length = dataLen;
-
-                if(uOptFlag.flags.bypass != 1)
-                {
-                    // OPTIGA Comms Shielded connection settings to enable the protection
-                    OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                    OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
-                }
-
-                optiga_lib_status = OPTIGA_LIB_BUSY;
-                return_status = optiga_crypt_hash_update(me_crypt,
-                                                         &hash_context,
-                                                         OPTIGA_CRYPT_HOST_DATA,
-                                                         &hash_data_host);
-                if (OPTIGA_LIB_SUCCESS != return_status)
-                    break;
-                //Wait until the optiga_util_read_metadata operation is completed
-                while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-                return_status = optiga_lib_status;
-                if (return_status != OPTIGA_LIB_SUCCESS)
-                    break;
-
-                filesize += dataLen;
-            }
-
-            // Capture OPTIGA Trust M error
-            if (return_status != OPTIGA_LIB_SUCCESS)
-            {
-                trustmPrintErrorCode(return_status);
+                printf("Error hashing input file!!!\n");
                 break;
             }
-
-            if(uOptFlag.flags.bypass != 1)
-            {
-                // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
-            }
-
-            optiga_lib_status = OPTIGA_LIB_BUSY;
-            return_status = optiga_crypt_hash_finalize(me_crypt,
-                                                       &hash_context,
-                                                       digest);
-            if (OPTIGA_LIB_SUCCESS != return_status)
-                break;
-            //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+        } else if(uOptFlag.flags.hash == 1)
+        {
+            return_status = trustmChipHashFile(inFile, (uOptFlag.flags.bypass != 1), digest);
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
-                digestLen = sizeof(digest);
+                digestLen = 32;
         } else
         {
             digestLen = trustmreadFrom(digest, (uint8_t *) inFile);
@@ -316,7 +276,7 @@ int main (int argc, char **argv)
             printf("Input File Name     : %s \n", inFile);
             printf("Signature File Name : %s \n", signatureFile);
 
-            if(uOptFlag.flags.hash == 1)
+            if((uOptFlag.flags.hash == 1) || (uOptFlag.flags.hosthash == 1))
                 printf("Hash Digest : \n");
             else
                 printf("Input data : \n");
@@ -328,8 +288,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_CRYPT_SHIELDED(me_crypt);
             }
 
             optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -343,8 +302,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -376,7 +334,7 @@ int main (int argc, char **argv)
                 break;
             }
 
-            if(uOptFlag.flags.hash == 1)
+            if((uOptFlag.flags.hash == 1) || (uOptFlag.flags.hosthash == 1))
                 printf("Hash Digest : \n");
             else
                 printf("Input data : \n");
@@ -400,8 +358,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_CRYPT_SHIELDED(me_crypt);
             }
 
             optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -415,8 +372,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -432,5 +388,5 @@ int main (int argc, char **argv)
 
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (batchFail != 0);
 }
@@ -23,6 +23,9 @@ int main (int argc, char **argv)
 	for(err=0x0402; err<=0x0405;err++)
 		trustmPrintErrorCode(err);
 
+	for(err=0x0F02; err<=0x0F04;err++)
+		trustmPrintErrorCode(err);
+
 	for(err=0x8001; err<=0x8010;err++)
 		trustmPrintErrorCode(err);
 
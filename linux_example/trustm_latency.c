@@ -0,0 +1,297 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "optiga/ifx_i2c/ifx_i2c_config.h"
+#include "optiga/optiga_util.h"
+
+#include "trustm_helper.h"
+
+#define MAX_LOAD    64
+#define WARMUP      10
+
+typedef struct _OPTFLAG {
+    uint16_t    count       : 1;
+    uint16_t    load        : 1;
+    uint16_t    mode        : 1;
+    uint16_t    read        : 1;
+    uint16_t    bypass      : 1;
+    uint16_t    dummy5      : 1;
+    uint16_t    dummy6      : 1;
+    uint16_t    dummy7      : 1;
+    uint16_t    dummy8      : 1;
+    uint16_t    dummy9      : 1;
+    uint16_t    dummy10     : 1;
+    uint16_t    dummy11     : 1;
+    uint16_t    dummy12     : 1;
+    uint16_t    dummy13     : 1;
+    uint16_t    dummy14     : 1;
+    uint16_t    dummy15     : 1;
+}OPTFLAG;
+
+union _uOptFlag {
+    OPTFLAG    flags;
+    uint16_t    all;
+} uOptFlag;
+
+static void _helpmenu(void)
+{
+    printf("\nHelp menu: trustm_latency <option> ...<option>\n");
+    printf("option:- \n");
+    printf("-n <count>    : Number of commands [default 1000] \n");
+    printf("-l <procs>    : Busy loop processes as CPU load [default 0] \n");
+    printf("-w <mode>     : 0:timer signal 1:PAL worker thread 2:both [default 2] \n");
+    printf("-i <OID>      : Measure read of data object OID [default random 32 bytes] \n");
+    printf("-X            : Bypass Shielded Communication \n");
+    printf("-h            : Print this help \n");
+    printf("PAL worker settings are taken from TRUSTM_PAL_WORKER_CPU, \n");
+    printf("TRUSTM_PAL_WORKER_PRIO and TRUSTM_PAL_WORKER_MLOCK. \n");
+}
+
+// Only in the PAL of patch/pal_os_event.c (make workaround_patch)
+extern uint8_t pal_os_event_worker_active(void) __attribute__((weak));
+
+static optiga_lib_status_t _command(uint16_t optiga_oid)
+{
+    optiga_lib_status_t return_status;
+    uint8_t read_data_buffer[1024];
+    uint16_t bytes_to_read;
+
+    if(uOptFlag.flags.bypass != 1)
+    {
+        // OPTIGA Comms Shielded connection settings to enable the protection
+        TRUSTM_UTIL_SHIELDED(me_util);
+        TRUSTM_CRYPT_SHIELDED(me_crypt);
+    }
+
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    if(uOptFlag.flags.read == 1)
+    {
+        bytes_to_read = sizeof(read_data_buffer);
+        return_status = optiga_util_read_data(me_util,
+                                              optiga_oid,
+                                              0,
+                                              read_data_buffer,
+                                              &bytes_to_read);
+    }
+    else
+    {
+        return_status = optiga_crypt_random(me_crypt,
+                                            OPTIGA_RNG_TYPE_TRNG,
+                                            read_data_buffer,
+                                            32);
+    }
+    if (OPTIGA_LIB_SUCCESS != return_status)
+        return return_status;
+
+    return trustmWaitCompletion();
+}
+
+static int _bench(uint8_t worker, uint32_t count, uint16_t optiga_oid)
+{
+    optiga_lib_status_t return_status;
+    uint64_t *sample;
+    uint64_t start, sum;
+    uint32_t i, fail;
+    uint8_t active;
+
+    setenv("TRUSTM_PAL_WORKER", (worker ? "1" : "0"), 1);
+
+    sample = malloc(count * sizeof(uint64_t));
+    if (sample == NULL)
+        return 1;
+
+    trustm_hibernate_flag = 0; // disable hibernate Context Save
+    return_status = trustm_Open();
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        free(sample);
+        return 1;
+    }
+
+    for (i = 0; i < WARMUP; i++)
+        _command(optiga_oid);
+
+    fail = 0;
+    sum = 0;
+    for (i = 0; i < count; i++)
+    {
+        start = trustmNowUs();
+        return_status = _command(optiga_oid);
+        sample[i] = trustmNowUs() - start;
+        sum += sample[i];
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            fail++;
+    }
+
+    // Mode the PAL runs in, not the one asked for
+    active = (pal_os_event_worker_active != NULL) ? pal_os_event_worker_active() : 0;
+
+    trustm_Close();
+
+    trustmSortSamples(sample, count);
+
+    if (active)
+        printf("Mode          : PAL worker thread (cpu %s, prio %s, mlock %s)\n",
+                                    getenv("TRUSTM_PAL_WORKER_CPU") ? getenv("TRUSTM_PAL_WORKER_CPU") : "-",
+                                    getenv("TRUSTM_PAL_WORKER_PRIO") ? getenv("TRUSTM_PAL_WORKER_PRIO") : "-",
+                                    getenv("TRUSTM_PAL_WORKER_MLOCK") ? getenv("TRUSTM_PAL_WORKER_MLOCK") : "0");
+    else if (pal_os_event_worker_active == NULL)
+        printf("Mode          : timer signal (PAL without worker, see make workaround_patch)\n");
+    else if (worker)
+        printf("Mode          : timer signal (PAL worker failed to start)\n");
+    else
+        printf("Mode          : timer signal\n");
+    printf("Samples       : %d (failed %d)\n", count, fail);
+    printf("Latency mean  : %llu us\n", (unsigned long long)(sum / count));
+    printf("Latency p50   : %llu us\n", (unsigned long long)trustmPercentile(sample, count, 500));
+    printf("Latency p99   : %llu us\n", (unsigned long long)trustmPercentile(sample, count, 990));
+    printf("Latency p99.9 : %llu us\n", (unsigned long long)trustmPercentile(sample, count, 999));
+    printf("Latency max   : %llu us\n", (unsigned long long)sample[count-1]);
+    printf("--------------------------------------------------------\n");
+    fflush(stdout);
+
+    free(sample);
+    return 0;
+}
+
+int main (int argc, char **argv)
+{
+    uint32_t count = 1000;
+    uint32_t load = 0;
+    uint32_t mode = 2;
+    uint16_t optiga_oid = 0;
+    pid_t loadpid[MAX_LOAD];
+    pid_t pid;
+    uint32_t i;
+    int status;
+
+    int option = 0;                    // Command line option.
+
+/***************************************************************
+ * Getting Input from CLI
+ **************************************************************/
+    uOptFlag.all = 0;
+    printf("\n");
+    do // Begin of DO WHILE(FALSE) for error handling.
+    {
+        // ---------- Command line parsing with getopt ----------
+        opterr = 0; // Disable getopt error messages in case of unknown parameters
+
+        // Loop through parameters with getopt.
+        while (-1 != (option = getopt(argc, argv, "n:l:w:i:Xh")))
+        {
+            switch (option)
+            {
+                case 'n': // Number of commands
+                    uOptFlag.flags.count = 1;
+                    count = trustmHexorDec(optarg);
+                    break;
+                case 'l': // CPU load
+                    uOptFlag.flags.load = 1;
+                    load = trustmHexorDec(optarg);
+                    if (load > MAX_LOAD)
+                        load = MAX_LOAD;
+                    break;
+                case 'w': // Event mode
+                    uOptFlag.flags.mode = 1;
+                    mode = trustmHexorDec(optarg);
+                    break;
+                case 'i': // Read data object
+                    uOptFlag.flags.read = 1;
+                    optiga_oid = trustmHexorDec(optarg);
+                    break;
+                case 'X': // Bypass Shielded Communication
+                    uOptFlag.flags.bypass = 1;
+                    printf("Bypass Shielded Communication. \n");
+                    break;
+                case 'h': // Print Help Menu
+                default:  // Any other command Print Help Menu
+                    _helpmenu();
+                    exit(0);
+                    break;
+            }
+        }
+    } while (0); // End of DO WHILE FALSE loop.
+
+    if ((count == 0) || (mode > 2))
+    {
+        _helpmenu();
+        exit(0);
+    }
+
+/***************************************************************
+ * Example
+ **************************************************************/
+    printf("========================================================\n");
+    if(uOptFlag.flags.read == 1)
+        printf("Command       : read data 0x%.4X\n", optiga_oid);
+    else
+        printf("Command       : random 32 bytes\n");
+    printf("CPU load      : %d processes\n", load);
+    printf("--------------------------------------------------------\n");
+    fflush(stdout);
+
+    // Synthetic CPU load
+    for (i = 0; i < load; i++)
+    {
+        loadpid[i] = fork();
+        if (loadpid[i] == 0)
+        {
+            for (;;) {}
+        }
+    }
+
+    // Each mode runs in its own process, the PAL event mode is chosen
+    // when the library creates its event
+    for (i = 0; i < 2; i++)
+    {
+        if ((mode != 2) && (mode != i))
+            continue;
+
+        pid = fork();
+        if (pid == 0)
+            exit(_bench((uint8_t)i, count, optiga_oid));
+        if (pid > 0)
+            waitpid(pid, &status, 0);
+    }
+
+    for (i = 0; i < load; i++)
+    {
+        if (loadpid[i] > 0)
+        {
+            kill(loadpid[i], SIGKILL);
+            waitpid(loadpid[i], &status, 0);
+        }
+    }
+
+    printf("========================================================\n");
+    return 0;
+}
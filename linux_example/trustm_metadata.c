@@ -30,6 +30,7 @@
 #include "optiga/optiga_util.h"
 
 #include "trustm_helper.h"
+#include "trustm_cache.h"
 
 static const uint8_t __bALW[] = {0x01,0x00}; // alway read or write
 static const uint8_t __bNEV[] = {0x01,0xff}; // disable read or write
@@ -236,8 +237,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_UTIL_SHIELDED(me_util);
             }
 
             bytes_to_read = sizeof(read_data_buffer);
@@ -249,8 +249,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -461,8 +460,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_UTIL_SHIELDED(me_util);
             }
 
             optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -473,12 +471,12 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
                 printf("Write Success.\n");
+            trustmCacheForget(optiga_oid);
         }
 
     } while(FALSE);
@@ -491,5 +489,5 @@ int main (int argc, char **argv)
 
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (return_status != OPTIGA_LIB_SUCCESS);
 }
@@ -0,0 +1,775 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <openssl/sha.h>
+
+#include "optiga/ifx_i2c/ifx_i2c_config.h"
+#include "optiga/optiga_util.h"
+#include "optiga/optiga_crypt.h"
+
+#include "trustm_helper.h"
+#include "trustm_cache.h"
+#include "trustm_certcomp.h"
+
+#define PROVISION_LINE_MAX      4096
+#define PROVISION_DATA_MAX      1728    // largest data object
+#define PROVISION_META_MAX      64
+#define PROVISION_GAP           32      // unchanged bytes merged into one write, cheaper than a command
+
+typedef struct _OPTFLAG {
+    uint16_t    manifest    : 1;
+    uint16_t    dryrun      : 1;
+    uint16_t    force       : 1;
+    uint16_t    bypass      : 1;
+    uint16_t    dummy4      : 1;
+    uint16_t    dummy5      : 1;
+    uint16_t    dummy6      : 1;
+    uint16_t    dummy7      : 1;
+    uint16_t    dummy8      : 1;
+    uint16_t    dummy9      : 1;
+    uint16_t    dummy10     : 1;
+    uint16_t    dummy11     : 1;
+    uint16_t    dummy12     : 1;
+    uint16_t    dummy13     : 1;
+    uint16_t    dummy14     : 1;
+    uint16_t    dummy15     : 1;
+}OPTFLAG;
+
+union _uOptFlag {
+    OPTFLAG    flags;
+    uint16_t    all;
+} uOptFlag;
+
+typedef struct provision_stats_str
+{
+    uint16_t    entries;
+    uint16_t    unchanged;      // entries already in the chip
+    uint16_t    changed;        // entries written or keys generated
+    uint32_t    commands;       // write and key generation commands
+    uint32_t    bytesWritten;
+    uint32_t    bytesKept;      // bytes of changed objects not written again
+} provision_stats_t;
+
+static provision_stats_t provision_stats;
+
+static const uint8_t eccheader256[] = {0x30,0x59, // SEQUENCE
+                                       0x30,0x13, // SEQUENCE
+                                       0x06,0x07, // OID:1.2.840.10045.2.1
+                                       0x2A,0x86,0x48,0xCE,0x3D,0x02,0x01,
+                                       0x06,0x08, // OID:1.2.840.10045.3.1.7
+                                       0x2A,0x86,0x48,0xCE,0x3D,0x03,0x01,0x07};
+
+static const uint8_t eccheader384[] = {0x30,0x76, // SEQUENCE
+                                       0x30,0x10, //SEQUENCE
+                                       0x06,0x07, // OID:1.2.840.10045.2.1
+                                       0x2A,0x86,0x48,0xCE,0x3D,0x02,0x01,
+                                       0x06,0x05, // OID:1.3.132.0.34
+                                       0x2B,0x81,0x04,0x00,0x22};
+
+static const uint8_t rsaheader2048[] = {0x30,0x82,0x01,0x22, // SEQUENCE
+                                        0x30,0x0d,          // SEQUENCE
+                                        0x06,0x09,          // OID : 1.2.840.113549.1.1.1
+                                        0x2a,0x86,0x48,0x86,0xf7,0x0d,0x01,0x01,0x01,
+                                        0x05,0x00};         // NULL
+
+static const uint8_t rsaheader1024[] = {0x30,0x81,0x9F,      // SEQUENCE
+                                        0x30,0x0D,          // SEQUENCE
+                                        0x06,0x09,          // OID : 1.2.840.113549.1.1.1
+                                        0x2A,0x86,0x48,0x86,0xF7,0x0D,0x01,0x01,0x01,
+                                        0x05,0x00};         // NULL
+
+static void _helpmenu(void)
+{
+    printf("\nHelp menu: trustm_provision <option> ...<option>\n");
+    printf("option:- \n");
+    printf("-m <filename> : Manifest to apply \n");
+    printf("-n            : Dry run, show what would be written \n");
+    printf("-f            : Generate keys even if present \n");
+    printf("-X            : Bypass Shielded Communication \n");
+    printf("-h            : Print this help \n");
+    printf("\nManifest, one entry per line, applied in order:\n");
+    printf("data     <OID> file=<filename> | hex=<hex bytes>\n");
+    printf("cert     <OID> file=<PEM filename> [compress]\n");
+    printf("metadata <OID> file=<filename> | hex=<metadata 20...>\n");
+    printf("keygen   <OID> type=ecc256|ecc384|rsa1024|rsa2048 [usage=<key type>]\n");
+    printf("               [pubout=<PEM filename>] [pubsave=<OID>]\n");
+}
+
+/**********************************************************************
+* Chip access
+**********************************************************************/
+static void _protectUtil(void)
+{
+    if(uOptFlag.flags.bypass != 1)
+    {
+        // OPTIGA Comms Shielded connection settings to enable the protection
+        TRUSTM_UTIL_SHIELDED(me_util);
+    }
+}
+
+static optiga_lib_status_t _wait(optiga_lib_status_t return_status)
+{
+    if (OPTIGA_LIB_SUCCESS != return_status)
+        return return_status;
+    return trustmWaitCompletion();
+}
+
+static optiga_lib_status_t _readData(uint16_t oid, uint8_t *buf, uint16_t *len)
+{
+    _protectUtil();
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_util_read_data(me_util, oid, 0, buf, len));
+}
+
+static optiga_lib_status_t _readMetadata(uint16_t oid, uint8_t *buf, uint16_t *len)
+{
+    _protectUtil();
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_util_read_metadata(me_util, oid, buf, len));
+}
+
+static optiga_lib_status_t _writeData(uint16_t oid, uint8_t mode, uint16_t offset, const uint8_t *buf, uint16_t len)
+{
+    provision_stats.commands++;
+    provision_stats.bytesWritten += len;
+    if (uOptFlag.flags.dryrun == 1)
+        return OPTIGA_LIB_SUCCESS;
+
+    _protectUtil();
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    return _wait(optiga_util_write_data(me_util, oid, mode, offset, buf, len));
+}
+
+/**********************************************************************
+* Manifest values
+**********************************************************************/
+// Value of key=value in the entry arguments, "" for a plain flag, NULL if absent
+static const char *_arg(char **arg, uint16_t argc, const char *key)
+{
+    uint16_t i;
+    size_t keyLen = strlen(key);
+
+    for (i = 0; i < argc; i++)
+    {
+        if (strncmp(arg[i], key, keyLen) != 0)
+            continue;
+        if (arg[i][keyLen] == '=')
+            return arg[i] + keyLen + 1;
+        if (arg[i][keyLen] == '\0')
+            return "";
+    }
+    return NULL;
+}
+
+// Hex bytes, ':' allowed between bytes. Returns the length, 0 on error
+static uint16_t _parseHex(const char *hex, uint8_t *buf, uint16_t max)
+{
+    uint16_t len = 0;
+    unsigned int byte;
+
+    while (*hex != '\0')
+    {
+        if (*hex == ':')
+        {
+            hex++;
+            continue;
+        }
+        if ((len >= max) || !isxdigit((unsigned char)hex[0]) || !isxdigit((unsigned char)hex[1]) ||
+            (sscanf(hex, "%2x", &byte) != 1))
+            return 0;
+        buf[len++] = (uint8_t)byte;
+        hex += 2;
+    }
+    return len;
+}
+
+// Content of an entry from file= or hex=. Returns the length, 0 on error
+static uint16_t _content(char **arg, uint16_t argc, uint8_t *buf, uint16_t max)
+{
+    uint8_t file[2048];
+    uint32_t len = 0;
+    const char *value;
+
+    value = _arg(arg, argc, "hex");
+    if ((value != NULL) && (*value != '\0'))
+        return _parseHex(value, buf, max);
+
+    value = _arg(arg, argc, "file");
+    if ((value == NULL) || (*value == '\0'))
+        return 0;
+    if ((trustmReadDER(file, &len, value) != 0) || (len == 0) || (len > max))
+    {
+        printf("Read file: %s error!!!\n", value);
+        return 0;
+    }
+    memcpy(buf, file, len);
+    return (uint16_t)len;
+}
+
+static void _printDigest(const uint8_t *data, uint16_t len)
+{
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    uint16_t i;
+
+    SHA256(data, len, digest);
+    for (i = 0; i < 8; i++)
+        printf("%.2x", digest[i]);
+}
+
+/**********************************************************************
+* _provisionData()
+* Bring a data object to the given content. The object is read back
+* first, unchanged objects are not written, changed ones only in the
+* byte ranges that differ. Shorter content needs an erase.
+**********************************************************************/
+static optiga_lib_status_t _provisionData(uint16_t oid, const char *kind, const uint8_t *data, uint16_t len)
+{
+    optiga_lib_status_t return_status;
+    uint8_t cur[PROVISION_DATA_MAX];
+    uint16_t curLen = sizeof(cur);
+    uint16_t i, j, start, end;
+    uint16_t ranges = 0;
+    uint32_t written = provision_stats.bytesWritten;
+
+    printf("0x%.4X %-8s ", oid, kind);
+
+    // Unreadable objects are written in full
+    if (_readData(oid, cur, &curLen) != OPTIGA_LIB_SUCCESS)
+        curLen = 0;
+
+    if ((curLen == len) && (memcmp(cur, data, len) == 0))
+    {
+        provision_stats.unchanged++;
+        printf("unchanged          sha256 ");
+        _printDigest(data, len);
+        printf(" (%d bytes)\n", len);
+        return OPTIGA_LIB_SUCCESS;
+    }
+
+    do
+    {
+        if ((curLen == 0) || (len < curLen))
+        {
+            return_status = _writeData(oid, OPTIGA_UTIL_ERASE_AND_WRITE, 0, data, len);
+            ranges = 1;
+            break;
+        }
+
+        return_status = OPTIGA_LIB_SUCCESS;
+        i = 0;
+        while (i < len)
+        {
+            if ((i < curLen) && (cur[i] == data[i]))
+            {
+                i++;
+                continue;
+            }
+
+            // Extend the range over gaps shorter than PROVISION_GAP
+            start = i;
+            end = i + 1;
+            for (j = end; (j < len) && (j - end < PROVISION_GAP); j++)
+            {
+                if ((j >= curLen) || (cur[j] != data[j]))
+                    end = j + 1;
+            }
+
+            return_status = _writeData(oid, OPTIGA_UTIL_WRITE_ONLY, start, data + start, end - start);
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                break;
+            ranges++;
+            i = end;
+        }
+    } while (FALSE);
+
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        printf("write failed\n");
+        return return_status;
+    }
+
+    written = provision_stats.bytesWritten - written;
+    provision_stats.changed++;
+    provision_stats.bytesKept += len - written;
+    printf("%s%2d range%s %4d/%-4d sha256 ", (uOptFlag.flags.dryrun == 1) ? "(dry) " : "",
+           ranges, (ranges == 1) ? " " : "s", written, len);
+    if (curLen != 0)
+    {
+        _printDigest(cur, curLen);
+        printf(" -> ");
+    }
+    _printDigest(data, len);
+    printf("\n");
+    return OPTIGA_LIB_SUCCESS;
+}
+
+/**********************************************************************
+* _provisionMetadata()
+* Write the tags of the given metadata that differ from the chip.
+**********************************************************************/
+static optiga_lib_status_t _provisionMetadata(uint16_t oid, const uint8_t *meta, uint16_t len)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    uint8_t cur[PROVISION_META_MAX];
+    uint16_t curLen = sizeof(cur);
+    uint8_t out[PROVISION_META_MAX];
+    uint16_t outLen = 2;
+    uint16_t i, j;
+    uint8_t same;
+
+    printf("0x%.4X %-8s ", oid, "metadata");
+    if ((len < 2) || (meta[0] != 0x20) || (meta[1] + 2 != len))
+    {
+        printf("invalid metadata\n");
+        return OPTIGA_UTIL_ERROR;
+    }
+
+    if ((_readMetadata(oid, cur, &curLen) != OPTIGA_LIB_SUCCESS) || (cur[0] != 0x20))
+        curLen = 0;
+
+    for (i = 2; i < len; i += meta[i+1] + 2)
+    {
+        if (i + 2 + meta[i+1] > len)
+        {
+            printf("invalid metadata\n");
+            return OPTIGA_UTIL_ERROR;
+        }
+
+        same = 0;
+        for (j = 2; (j + 2 <= curLen) && (j + 2 + cur[j+1] <= curLen); j += cur[j+1] + 2)
+        {
+            if (cur[j] != meta[i])
+                continue;
+            same = ((cur[j+1] == meta[i+1]) && (memcmp(&cur[j+2], &meta[i+2], meta[i+1]) == 0));
+            break;
+        }
+        if (same)
+            continue;
+
+        memcpy(&out[outLen], &meta[i], meta[i+1] + 2);
+        outLen += meta[i+1] + 2;
+    }
+
+    if (outLen == 2)
+    {
+        provision_stats.unchanged++;
+        printf("unchanged\n");
+        return OPTIGA_LIB_SUCCESS;
+    }
+    out[0] = 0x20;
+    out[1] = (uint8_t)(outLen - 2);
+
+    provision_stats.commands++;
+    provision_stats.bytesWritten += outLen;
+    if (uOptFlag.flags.dryrun != 1)
+    {
+        _protectUtil();
+        optiga_lib_status = OPTIGA_LIB_BUSY;
+        return_status = _wait(optiga_util_write_metadata(me_util, oid, out, outLen));
+        if (return_status != OPTIGA_LIB_SUCCESS)
+        {
+            printf("write failed\n");
+            return return_status;
+        }
+        trustmCacheForget(oid);
+    }
+
+    provision_stats.changed++;
+    printf("%swritten:", (uOptFlag.flags.dryrun == 1) ? "(dry) " : "");
+    for (i = 0; i < outLen; i++)
+        printf(" %.2X", out[i]);
+    printf("\n");
+    return OPTIGA_LIB_SUCCESS;
+}
+
+/**********************************************************************
+* _provisionKey()
+* Generate a key unless the key object holds one of the same algorithm
+* and usage already (metadata tags E0 and E1), or -f is given. The chip
+* does not export the public key of a present key, pubout then takes the
+* copy stored in pubsave.
+**********************************************************************/
+static optiga_lib_status_t _provisionKey(uint16_t oid, uint8_t algo, uint8_t usage,
+                                         const char *pubout, int32_t pubsave)
+{
+    optiga_lib_status_t return_status;
+    optiga_key_id_t optiga_key_id = (optiga_key_id_t)oid;
+    uint8_t meta[PROVISION_META_MAX];
+    uint16_t metaLen = sizeof(meta);
+    uint8_t curAlgo = 0;
+    uint8_t curUsage = 0;
+    uint8_t pubKey[300];
+    uint16_t pubKeyLen;
+    const uint8_t *header;
+    uint16_t hdrLen;
+    uint16_t i;
+
+    switch (algo)
+    {
+        case OPTIGA_ECC_CURVE_NIST_P_384:
+            hdrLen = sizeof(eccheader384);
+            header = eccheader384;
+            break;
+        case OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL:
+            hdrLen = sizeof(rsaheader1024);
+            header = rsaheader1024;
+            break;
+        case OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL:
+            hdrLen = sizeof(rsaheader2048);
+            header = rsaheader2048;
+            break;
+        case OPTIGA_ECC_CURVE_NIST_P_256:
+        default:
+            hdrLen = sizeof(eccheader256);
+            header = eccheader256;
+            break;
+    }
+
+    printf("0x%.4X %-8s ", oid, "keygen");
+    if ((_readMetadata(oid, meta, &metaLen) == OPTIGA_LIB_SUCCESS) && (meta[0] == 0x20))
+    {
+        for (i = 2; (i + 2 < metaLen) && (i + 2 + meta[i+1] <= metaLen); i += meta[i+1] + 2)
+        {
+            if (meta[i] == 0xE0)
+                curAlgo = meta[i+2];
+            if (meta[i] == 0xE1)
+                curUsage = meta[i+2];
+        }
+    }
+
+    if ((uOptFlag.flags.force != 1) && (curAlgo == algo) && (curUsage == usage))
+    {
+        provision_stats.unchanged++;
+        printf("present            algo 0x%.2X usage 0x%.2X\n", algo, usage);
+        if ((pubout == NULL) && (pubsave < 0))
+            return OPTIGA_LIB_SUCCESS;
+
+        // Stored copy must be a public key of this algorithm
+        pubKeyLen = sizeof(pubKey);
+        if ((pubsave < 0) ||
+            (_readData((uint16_t)pubsave, pubKey, &pubKeyLen) != OPTIGA_LIB_SUCCESS) ||
+            (pubKeyLen <= hdrLen) || (memcmp(pubKey, header, hdrLen) != 0))
+        {
+            printf("0x%.4X no stored public key, use -f to generate a new key\n", oid);
+            return OPTIGA_UTIL_ERROR;
+        }
+        if ((pubout != NULL) && (uOptFlag.flags.dryrun != 1) &&
+            (trustmWritePEM(pubKey, pubKeyLen, pubout, "PUBLIC KEY") != 0))
+        {
+            printf("Error when saving file %s!!!\n", pubout);
+            return OPTIGA_UTIL_ERROR;
+        }
+        return OPTIGA_LIB_SUCCESS;
+    }
+
+    provision_stats.commands++;
+    if (uOptFlag.flags.dryrun == 1)
+    {
+        provision_stats.changed++;
+        printf("(dry) generate     algo 0x%.2X usage 0x%.2X\n", algo, usage);
+        return OPTIGA_LIB_SUCCESS;
+    }
+
+    memcpy(pubKey, header, hdrLen);
+    pubKeyLen = sizeof(pubKey) - hdrLen;
+
+    if(uOptFlag.flags.bypass != 1)
+    {
+        // OPTIGA Comms Shielded connection settings to enable the protection
+        TRUSTM_CRYPT_SHIELDED(me_crypt);
+    }
+    optiga_lib_status = OPTIGA_LIB_BUSY;
+    if ((algo == OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL) || (algo == OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL))
+        return_status = optiga_crypt_rsa_generate_keypair(me_crypt, algo, usage, FALSE,
+                                                          &optiga_key_id, pubKey + hdrLen, &pubKeyLen);
+    else
+        return_status = optiga_crypt_ecc_generate_keypair(me_crypt, algo, usage, FALSE,
+                                                          &optiga_key_id, pubKey + hdrLen, &pubKeyLen);
+    if (OPTIGA_LIB_SUCCESS == return_status)
+        return_status = trustmWaitCompletionMs(TRUSTM_CMD_TIMEOUT_LONG_MS);
+    if (OPTIGA_LIB_SUCCESS != return_status)
+    {
+        printf("generate failed\n");
+        return return_status;
+    }
+
+    provision_stats.changed++;
+    printf("generated          algo 0x%.2X usage 0x%.2X\n", algo, usage);
+
+    if (pubout != NULL)
+    {
+        if (trustmWritePEM(pubKey, pubKeyLen + hdrLen, pubout, "PUBLIC KEY") != 0)
+        {
+            printf("Error when saving file %s!!!\n", pubout);
+            return OPTIGA_UTIL_ERROR;
+        }
+    }
+    if (pubsave >= 0)
+        return _provisionData((uint16_t)pubsave, "pubkey", pubKey, pubKeyLen + hdrLen);
+    return OPTIGA_LIB_SUCCESS;
+}
+
+/**********************************************************************
+* _provisionEntry()
+* One manifest line: <type> <OID> [key=value ...]
+**********************************************************************/
+static optiga_lib_status_t _provisionEntry(char *line, uint32_t lineNo)
+{
+    char *tok[16];
+    uint16_t tokCount = 0;
+    char *save = NULL;
+    char *p;
+    uint8_t data[PROVISION_DATA_MAX];
+    uint16_t len;
+    uint16_t oid;
+    const char *value;
+    X509 *x509 = NULL;
+    unsigned char *der = NULL;
+    int derLen;
+    uint8_t algo;
+    uint8_t usage;
+
+    p = strchr(line, '#');
+    if (p != NULL)
+        *p = '\0';
+    for (p = strtok_r(line, " \t\r\n", &save); (p != NULL) && (tokCount < 16); p = strtok_r(NULL, " \t\r\n", &save))
+        tok[tokCount++] = p;
+    if (tokCount == 0)
+        return OPTIGA_LIB_SUCCESS;
+    if (tokCount < 2)
+    {
+        printf("line %d: OID missing\n", lineNo);
+        return OPTIGA_UTIL_ERROR;
+    }
+
+    provision_stats.entries++;
+    oid = (uint16_t)trustmHexorDec(tok[1]);
+
+    if (strcmp(tok[0], "data") == 0)
+    {
+        len = _content(&tok[2], tokCount - 2, data, sizeof(data));
+        if (len == 0)
+        {
+            printf("line %d: data needs file= or hex=\n", lineNo);
+            return OPTIGA_UTIL_ERROR;
+        }
+        return _provisionData(oid, "data", data, len);
+    }
+
+    if (strcmp(tok[0], "cert") == 0)
+    {
+        value = _arg(&tok[2], tokCount - 2, "file");
+        if ((value == NULL) || (trustmReadX509PEM(&x509, value) != 0))
+        {
+            printf("line %d: cert needs file=<PEM filename>\n", lineNo);
+            return OPTIGA_UTIL_ERROR;
+        }
+        derLen = i2d_X509(x509, &der);
+        X509_free(x509);
+        if ((derLen <= 0) || (derLen > (int)sizeof(data)))
+        {
+            OPENSSL_free(der);
+            printf("line %d: invalid cert\n", lineNo);
+            return OPTIGA_UTIL_ERROR;
+        }
+
+        if ((_arg(&tok[2], tokCount - 2, "compress") != NULL) && (trustmCertChipOid(oid) == 1))
+        {
+            OPENSSL_free(der);
+            printf("line %d: 0x%.4X must be DER, the chip parses it\n", lineNo, oid);
+            return OPTIGA_UTIL_ERROR;
+        }
+
+        // The same certificate compresses to the same container
+        len = sizeof(data);
+        if ((_arg(&tok[2], tokCount - 2, "compress") == NULL) ||
+            (trustmCertCompress(der, (uint16_t)derLen, data, &len) != 0))
+        {
+            memcpy(data, der, derLen);
+            len = (uint16_t)derLen;
+        }
+        OPENSSL_free(der);
+        return _provisionData(oid, "cert", data, len);
+    }
+
+    if (strcmp(tok[0], "metadata") == 0)
+    {
+        len = _content(&tok[2], tokCount - 2, data, PROVISION_META_MAX);
+        if (len == 0)
+        {
+            printf("line %d: metadata needs file= or hex=\n", lineNo);
+            return OPTIGA_UTIL_ERROR;
+        }
+        return _provisionMetadata(oid, data, len);
+    }
+
+    if (strcmp(tok[0], "keygen") == 0)
+    {
+        value = _arg(&tok[2], tokCount - 2, "type");
+        if ((value != NULL) && (strcmp(value, "ecc384") == 0))
+            algo = OPTIGA_ECC_CURVE_NIST_P_384;
+        else if ((value != NULL) && (strcmp(value, "rsa1024") == 0))
+            algo = OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL;
+        else if ((value != NULL) && (strcmp(value, "rsa2048") == 0))
+            algo = OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL;
+        else if ((value == NULL) || (strcmp(value, "ecc256") == 0))
+            algo = OPTIGA_ECC_CURVE_NIST_P_256;
+        else
+        {
+            printf("line %d: unknown key type %s\n", lineNo, value);
+            return OPTIGA_UTIL_ERROR;
+        }
+
+        value = _arg(&tok[2], tokCount - 2, "usage");
+        usage = (value != NULL) ? (uint8_t)trustmHexorDec(value) : 0x01; // default Auth
+        if ((usage == 0x00) || (usage & 0xc0))
+        {
+            printf("line %d: key type error\n", lineNo);
+            return OPTIGA_UTIL_ERROR;
+        }
+
+        value = _arg(&tok[2], tokCount - 2, "pubsave");
+        return _provisionKey(oid, algo, usage,
+                             _arg(&tok[2], tokCount - 2, "pubout"),
+                             (value != NULL) ? (int32_t)trustmHexorDec(value) : -1);
+    }
+
+    printf("line %d: unknown entry %s\n", lineNo, tok[0]);
+    return OPTIGA_UTIL_ERROR;
+}
+
+int main (int argc, char **argv)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    char *manifest = NULL;
+    char line[PROVISION_LINE_MAX];
+    uint32_t lineNo = 0;
+    FILE *fp;
+
+    int option = 0;                    // Command line option.
+
+/***************************************************************
+ * Getting Input from CLI
+ **************************************************************/
+    uOptFlag.all = 0;
+    do // Begin of DO WHILE(FALSE) for error handling.
+    {
+        // ---------- Command line parsing with getopt ----------
+        opterr = 0; // Disable getopt error messages in case of unknown parameters
+
+        // Loop through parameters with getopt.
+        while (-1 != (option = getopt(argc, argv, "m:nfXh")))
+        {
+            switch (option)
+            {
+                case 'm': // Manifest
+                    uOptFlag.flags.manifest = 1;
+                    manifest = optarg;
+                    break;
+                case 'n': // Dry run
+                    uOptFlag.flags.dryrun = 1;
+                    break;
+                case 'f': // Force key generation
+                    uOptFlag.flags.force = 1;
+                    break;
+                case 'X': // Bypass Shielded Communication
+                    uOptFlag.flags.bypass = 1;
+                    printf("Bypass Shielded Communication. \n");
+                    break;
+                case 'h': // Print Help Menu
+                default:  // Any other command Print Help Menu
+                    _helpmenu();
+                    exit(0);
+                    break;
+            }
+        }
+    } while (0); // End of DO WHILE FALSE loop.
+
+    if (uOptFlag.flags.manifest != 1)
+    {
+        _helpmenu();
+        exit(0);
+    }
+
+    fp = fopen(manifest, "r");
+    if (fp == NULL)
+    {
+        printf("Manifest %s open error!!!\n", manifest);
+        exit(1);
+    }
+
+/***************************************************************
+ * Example
+ **************************************************************/
+    // One session for the whole manifest
+    trustm_hibernate_flag = 0; // disable hibernate Context Save
+    return_status = trustm_Open();
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        fclose(fp);
+        exit(1);
+    }
+
+    printf("========================================================\n");
+    if (uOptFlag.flags.dryrun == 1)
+        printf("Dry run, nothing is written.\n");
+
+    memset(&provision_stats, 0, sizeof(provision_stats));
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        lineNo++;
+        // Entries depend on the ones before, e.g. metadata locking an object
+        return_status = _provisionEntry(line, lineNo);
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+    }
+    fclose(fp);
+
+    printf("--------------------------------------------------------\n");
+    printf("Entries %d, unchanged %d, changed %d, commands %d\n",
+           provision_stats.entries, provision_stats.unchanged,
+           provision_stats.changed, provision_stats.commands);
+    printf("Bytes written %d, bytes of changed objects kept %d\n",
+           provision_stats.bytesWritten, provision_stats.bytesKept);
+
+    // Capture OPTIGA Trust M error
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        printf("Stopped at line %d\n", lineNo);
+        trustmPrintErrorCode(return_status);
+    }
+
+    printf("========================================================\n");
+
+    trustm_Close();
+    trustm_hibernate_flag = 0; // Disable hibernate Context Save
+    return (return_status == OPTIGA_LIB_SUCCESS) ? 0 : 1;
+}
@@ -29,6 +29,7 @@
 #include "optiga/optiga_util.h"
 
 #include "trustm_helper.h"
+#include "trustm_cache.h"
 
 typedef struct _OPTFLAG {
     uint16_t    bypass      : 1;
@@ -67,6 +68,7 @@ int main (int argc, char **argv)
 {
     optiga_lib_status_t return_status;
     uint16_t i;
+    uint16_t failed = 0;
 
     uint16_t offset, bytes_to_read;
     uint16_t optiga_oid;
@@ -135,22 +137,15 @@ int main (int argc, char **argv)
                     if(uOptFlag.flags.bypass != 1)
                     {
                         // OPTIGA Comms Shielded connection settings to enable the protection
-                        OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                        OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
+                        TRUSTM_UTIL_SHIELDED(me_util);
                     }
 
                     bytes_to_read = sizeof(read_data_buffer);
-                    optiga_lib_status = OPTIGA_LIB_BUSY;
-                    return_status = optiga_util_read_data(me_util,
-                                                        optiga_oid,
+                    // Immutable objects come from the cache
+                    return_status = trustmCacheReadData(optiga_oid,
                                                         offset,
                                                         read_data_buffer,
                                                         (uint16_t *)&bytes_to_read);
-                    if (OPTIGA_LIB_SUCCESS != return_status)
-                        break;
-                    //Wait until the optiga_util_read_metadata operation is completed
-                    while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-                    return_status = optiga_lib_status;
                     if (return_status != OPTIGA_LIB_SUCCESS)
                         break;
                     else
@@ -164,12 +159,15 @@ int main (int argc, char **argv)
 
         // Capture OPTIGA Trust M error
         if (return_status != OPTIGA_LIB_SUCCESS)
+        {
             trustmPrintErrorCode(return_status);
+            failed++;
+        }
 
     } // End of for loop
 
     printf("========================================================\n");
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (failed != 0);
 }
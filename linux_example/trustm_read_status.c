@@ -63,16 +63,42 @@ void helpmenu(void)
     printf("-h : Print this help \n");
 }
 
+static void _printData(uint16_t optiga_oid, uint8_t *read_data_buffer, uint16_t bytes_to_read,
+                       optiga_lib_status_t return_status)
+{
+    char    messagebuf[500];
+
+    trustmGetOIDName(optiga_oid, messagebuf);
+    printf(messagebuf);
+
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        // Capture OPTIGA Trust M error
+        trustmPrintErrorCode(return_status);
+        return;
+    }
+
+    printf("[Size %.4d] : ", bytes_to_read);
+    if(optiga_oid == 0xE0C2)
+        printf("\n");
+    trustmHexDump(read_data_buffer, bytes_to_read);
+}
+
 int main (int argc, char **argv)
 {
     optiga_lib_status_t return_status;
-    uint16_t i;
+    uint16_t i, j, n;
+    uint16_t failed = 0;
 
     uint16_t offset, bytes_to_read;
     uint16_t optiga_oid;
     uint8_t read_data_buffer[1024];
 
-    char    messagebuf[500];
+    // Reads queued together on the pool instances
+    trustm_inst_t *inst[TRUSTM_POOL_SIZE];
+    uint8_t pool_buffer[TRUSTM_POOL_SIZE][1024];
+    uint16_t pool_bytes[TRUSTM_POOL_SIZE];
+    optiga_lib_status_t pool_status[TRUSTM_POOL_SIZE];
 
     uint16_t arrayOID[] = {0xE0C0,0xE0C1,0xE0C2,0xE0C3,0xE0C4,0xE0C5,0xE0C6,
                             0xF1C0,0xF1C1,0xF1C2};
@@ -117,56 +143,78 @@ int main (int argc, char **argv)
     if (return_status != OPTIGA_LIB_SUCCESS) {exit(1);}
 
     printf("========================================================\n");
-    for (i = 0; i < sizeof(arrayOID)/2; i++)
+    for (i = 0; i < sizeof(arrayOID)/2; i += n)
     {
+        // Queue up to TRUSTM_POOL_SIZE reads in the host library
+        for (n = 0; (n < TRUSTM_POOL_SIZE) && ((i+n) < sizeof(arrayOID)/2); n++)
+        {
+            inst[n] = trustmPoolGet();
+            if (inst[n] == NULL)
+                break;
+
+            if(uOptFlag.flags.bypass != 1)
+            {
+                // OPTIGA Comms Shielded connection settings to enable the protection
+                TRUSTM_UTIL_SHIELDED(inst[n]->util);
+            }
+
+            pool_bytes[n] = sizeof(pool_buffer[n]);
+            inst[n]->status = OPTIGA_LIB_BUSY;
+            pool_status[n] = optiga_util_read_data(inst[n]->util,
+                                                   arrayOID[i+n],
+                                                   0x00,
+                                                   pool_buffer[n],
+                                                   &pool_bytes[n]);
+        }
+
+        // Collect the results in order
+        for (j = 0; j < n; j++)
+        {
+            if (OPTIGA_LIB_SUCCESS == pool_status[j])
+                pool_status[j] = trustmPoolWait(inst[j]);
+            trustmPoolPut(inst[j]);
+
+            _printData(arrayOID[i+j], pool_buffer[j], pool_bytes[j], pool_status[j]);
+            if (pool_status[j] != OPTIGA_LIB_SUCCESS)
+                failed++;
+        }
+
+        if (n > 0)
+            continue;
+
+        // No pool instance available, read on me_util
+        n = 1;
         do
         {
             offset = 0x00;
             optiga_oid = arrayOID[i];
-            trustmGetOIDName(optiga_oid, messagebuf);
 
-            if(messagebuf != NULL)
+            if(uOptFlag.flags.bypass != 1)
             {
-                printf(messagebuf);
-
-                if(uOptFlag.flags.bypass != 1)
-                {
-                    // OPTIGA Comms Shielded connection settings to enable the protection
-                    OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(me_util, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                    OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(me_util, OPTIGA_COMMS_FULL_PROTECTION);
-                }
-
-                bytes_to_read = sizeof(read_data_buffer);
-                optiga_lib_status = OPTIGA_LIB_BUSY;
-                return_status = optiga_util_read_data(me_util,
-                                                    optiga_oid,
-                                                    offset,
-                                                    read_data_buffer,
-                                                    (uint16_t *)&bytes_to_read);
-                if (OPTIGA_LIB_SUCCESS != return_status)
-                    break;
-                //Wait until the optiga_util_read_metadata operation is completed
-                while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-                return_status = optiga_lib_status;
-                if (return_status != OPTIGA_LIB_SUCCESS)
-                    break;
-                else
-                {
-                    printf("[Size %.4d] : ", bytes_to_read);
-                    if(optiga_oid == 0xE0C2)
-                        printf("\n");
-                    trustmHexDump(read_data_buffer, bytes_to_read);
-                } // End of if
-            } // End of if
+                // OPTIGA Comms Shielded connection settings to enable the protection
+                TRUSTM_UTIL_SHIELDED(me_util);
+            }
+
+            bytes_to_read = sizeof(read_data_buffer);
+            optiga_lib_status = OPTIGA_LIB_BUSY;
+            return_status = optiga_util_read_data(me_util,
+                                                optiga_oid,
+                                                offset,
+                                                read_data_buffer,
+                                                (uint16_t *)&bytes_to_read);
+            if (OPTIGA_LIB_SUCCESS != return_status)
+                break;
+            //Wait until the optiga_util_read_metadata operation is completed
+            return_status = trustmWaitCompletion();
         }while(FALSE);
 
-        // Capture OPTIGA Trust M error
+        _printData(optiga_oid, read_data_buffer, bytes_to_read, return_status);
         if (return_status != OPTIGA_LIB_SUCCESS)
-            trustmPrintErrorCode(return_status);
+            failed++;
     }
     printf("========================================================\n");
 
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (failed != 0);
 }
@@ -0,0 +1,227 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include "optiga/ifx_i2c/ifx_i2c_config.h"
+#include "optiga/optiga_util.h"
+
+#include "trustm_helper.h"
+
+typedef struct _OPTFLAG {
+    uint16_t    bypass      : 1;
+    uint16_t    json        : 1;
+    uint16_t    dummy2      : 1;
+    uint16_t    dummy3      : 1;
+    uint16_t    dummy4      : 1;
+    uint16_t    dummy5      : 1;
+    uint16_t    dummy6      : 1;
+    uint16_t    dummy7      : 1;
+    uint16_t    dummy8      : 1;
+    uint16_t    dummy9      : 1;
+    uint16_t    dummy10     : 1;
+    uint16_t    dummy11     : 1;
+    uint16_t    dummy12     : 1;
+    uint16_t    dummy13     : 1;
+    uint16_t    dummy14     : 1;
+    uint16_t    dummy15     : 1;
+}OPTFLAG;
+
+union _uOptFlag {
+    OPTFLAG flags;
+    uint16_t    all;
+} uOptFlag;
+
+
+void helpmenu(void)
+{
+    printf("\nHelp menu: trustm_readmetadata_all <option> ...<option>\n");
+    printf("option:- \n");
+    printf("-j : JSON output \n");
+    printf("-X : Bypass Shield Communication \n");
+    printf("-h : Print this help \n");
+}
+
+// Object name of trustmGetOIDName without the OID and padding
+static void _name(uint16_t oid, char *name)
+{
+    char *p;
+
+    trustmGetOIDName(oid, name);
+    p = strchr(name, '[');
+    if (p == NULL)
+        p = name + strlen(name);
+    while ((p > name) && (*(p-1) == ' '))
+        p--;
+    *p = '\0';
+}
+
+static void _printJSON(const utrustm_UID_t *UID, const trustm_oid_info_t *info, uint16_t count)
+{
+    const trustm_metadata_t *md;
+    char name[100];
+    char str[TRUSTM_METADATA_STR_MAX];
+    uint16_t i, j;
+
+    printf("{\n  \"uid\":\"");
+    for (j = 0; j < sizeof(UID->b); j++)
+        printf("%.2X", UID->b[j]);
+    printf("\",\n  \"objects\":[\n");
+
+    for (i = 0; i < count; i++)
+    {
+        md = &info[i].md;
+        _name(info[i].oid, name);
+        printf("    {\"oid\":\"0x%.4X\",\"name\":\"%s\",\"status\":\"0x%.4X\"",
+                info[i].oid, name, info[i].status);
+        if (info[i].status == OPTIGA_LIB_SUCCESS)
+        {
+            printf(",\"metadata\":\"");
+            for (j = 0; j < info[i].rawLen; j++)
+                printf("%.2X", info[i].raw[j]);
+            printf("\"");
+        }
+        if (md->present & TRUSTM_MD_C0)
+            printf(",\"lcso\":\"0x%.2X\"", md->C0_lsc0);
+        if (md->present & TRUSTM_MD_C1)
+            printf(",\"version\":\"0x%.2X%.2X\"", md->C1_verion[0], md->C1_verion[1]);
+        if (md->present & TRUSTM_MD_C4)
+            printf(",\"max_size\":%d", md->C4_maxSize);
+        if (md->present & TRUSTM_MD_C5)
+            printf(",\"used_size\":%d", md->C5_used);
+        if (md->present & TRUSTM_MD_D0)
+            printf(",\"change\":\"%s\"", trustmMetadataACStr(md->D0_change, md->D0_changeLen, str, sizeof(str)));
+        if (md->present & TRUSTM_MD_D1)
+            printf(",\"read\":\"%s\"", trustmMetadataACStr(md->D1_read, md->D1_readLen, str, sizeof(str)));
+        if (md->present & TRUSTM_MD_D3)
+            printf(",\"execute\":\"%s\"", trustmMetadataACStr(md->D3_execute, md->D3_executeLen, str, sizeof(str)));
+        if (md->present & TRUSTM_MD_E0)
+            printf(",\"algo\":\"%s\"", trustmMetadataAlgoStr(md->E0_algo));
+        if (md->present & TRUSTM_MD_E1)
+            printf(",\"key_usage\":\"%s\"", trustmMetadataKeyUsageStr(md->E1_keyUsage, str, sizeof(str)));
+        if (md->present & TRUSTM_MD_E8)
+            printf(",\"data_type\":\"%s\"", trustmMetadataDataTypeStr(md->E8_dataObjType));
+        printf("}%s\n", (i + 1 < count) ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+int main (int argc, char **argv)
+{
+    optiga_lib_status_t return_status;
+    trustm_oid_info_t info[TRUSTM_SWEEP_MAX];
+    utrustm_UID_t UID;
+    uint16_t count;
+    uint16_t failed = 0;
+    uint16_t i;
+
+    char    messagebuf[500];
+
+    int option = 0;                    // Command line option.
+
+    uOptFlag.all = 0;
+
+    do // Begin of DO WHILE(FALSE) for error handling.
+    {
+        // ---------- Command line parsing with getopt ----------
+        opterr = 0; // Disable getopt error messages in case of unknown parameters
+
+        // Loop through parameters with getopt.
+        while (-1 != (option = getopt(argc, argv, "jXh")))
+        {
+            switch (option)
+            {
+                case 'j': // JSON output
+                    uOptFlag.flags.json = 1;
+                    break;
+                case 'X': // Bypass Shielded Communication
+                    uOptFlag.flags.bypass = 1;
+                    break;
+                case 'h': // Print Help Menu
+                default:  // Any other command Print Help Menu
+                    helpmenu();
+                    exit(0);
+                break;
+            }
+        }
+    } while (FALSE); // End of DO WHILE FALSE loop.
+
+    if(uOptFlag.flags.bypass != 1)
+    #ifdef HIBERNATE_ENABLE
+        trustm_hibernate_flag = 1; // Enable hibernate Context Save
+    #else
+        trustm_hibernate_flag = 0; // disable hibernate Context Save
+    #endif 
+    else
+        trustm_hibernate_flag = 0; // disable hibernate Context Save
+
+    return_status = trustm_Open();
+    if (return_status != OPTIGA_LIB_SUCCESS)
+        exit(1);
+
+    // All objects in this session
+    memset(&UID, 0, sizeof(UID));
+    trustm_readUID(&UID);
+    count = trustmSweepMetadata(info, TRUSTM_SWEEP_MAX, (uOptFlag.flags.bypass != 1));
+
+    trustm_Close();
+    trustm_hibernate_flag = 0; // Disable hibernate Context Save
+
+    for (i = 0; i < count; i++)
+    {
+        if (info[i].status != OPTIGA_LIB_SUCCESS)
+            failed++;
+    }
+
+    if (uOptFlag.flags.json == 1)
+    {
+        _printJSON(&UID, info, count);
+        return (failed != 0);
+    }
+
+    if (uOptFlag.flags.bypass == 1)
+        printf("Bypass Shielded Communication. \n");
+    for (i = 0; i < count; i++)
+    {
+        trustmGetOIDName(info[i].oid, messagebuf);
+        printf("===========================================\n");
+        printf("%s", messagebuf);
+        if (info[i].status != OPTIGA_LIB_SUCCESS)
+        {
+            printf("\n");
+            trustmPrintErrorCode(info[i].status);
+            continue;
+        }
+        printf("[Size %.4d] : \n", info[i].rawLen);
+        trustmHexDump(info[i].raw, info[i].rawLen);
+        printf("\t");
+        trustmdecodeMetaData(info[i].raw);
+        printf("\n");
+    }
+    printf("========================================================\n");
+    return (failed != 0);
+}
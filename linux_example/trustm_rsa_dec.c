@@ -29,6 +29,9 @@
 #include "optiga/optiga_util.h"
 
 #include "trustm_helper.h"
+#include "trustm_envelope.h"
+
+#include <openssl/crypto.h>
 
 #define MAX_OID_PUB_CERT_SIZE   1728
 
@@ -39,7 +42,7 @@ typedef struct _OPTFLAG {
     uint16_t    hash        : 1;
     uint16_t    pubkey      : 1;
     uint16_t    bypass      : 1;
-    uint16_t    dummy6      : 1;
+    uint16_t    envelope    : 1;
     uint16_t    dummy7      : 1;
     uint16_t    dummy8      : 1;
     uint16_t    dummy9      : 1;
@@ -63,10 +66,76 @@ void _helpmenu(void)
     printf("-k <OID Key>  : Select key to decrypt OID 0xNNNN \n");
     printf("-o <filename> : Output to file \n");
     printf("-i <filename> : Input Data file\n");
+    printf("-E            : Envelope, decrypt a file written by trustm_rsa_enc -E\n");
     printf("-X            : Bypass Shielded Communication \n");
     printf("-h            : Print this help \n");
 }
 
+static void _protect(void)
+{
+    if(uOptFlag.flags.bypass != 1)
+    {
+        // OPTIGA Comms Shielded connection settings to enable the protection
+        TRUSTM_CRYPT_SHIELDED(me_crypt);
+    }
+}
+
+/**********************************************************************
+* _envelopeDecrypt()
+* Decrypt an envelope of any size with one chip RSA decrypt of the
+* wrapped AES-256-GCM key, the body is decrypted on the host.
+* Returns 0 on success, chip errors are returned in return_status.
+**********************************************************************/
+static uint16_t _envelopeDecrypt(optiga_key_id_t optiga_key_id,
+                                 const char *inFile, const char *outFile,
+                                 optiga_lib_status_t *return_status)
+{
+    trustm_envelope_t env;
+    uint8_t key[TRUSTM_ENVELOPE_WRAP_MAX];
+    uint16_t keyLen;
+    uint16_t ret = 1;
+
+    do
+    {
+        if (trustmEnvelopeReadHeader(inFile, &env) != 0)
+        {
+            printf("Invalid envelope file!!!\n");
+            break;
+        }
+        printf("Envelope         : AES-256-GCM, key wrapped [%d]\n", env.wrapLen);
+
+        TRUSTM_REPLAY(*return_status,
+                      _protect(); keyLen = sizeof(key),
+                      optiga_crypt_rsa_decrypt_and_export(me_crypt,
+                                                          OPTIGA_RSAES_PKCS1_V15,
+                                                          env.wrap,
+                                                          env.wrapLen,
+                                                          NULL,
+                                                          0,
+                                                          optiga_key_id,
+                                                          key,
+                                                          &keyLen));
+        if (*return_status != OPTIGA_LIB_SUCCESS)
+            break;
+        if (keyLen != TRUSTM_ENVELOPE_KEY_LEN)
+        {
+            printf("Invalid envelope key!!!\n");
+            break;
+        }
+
+        ret = trustmEnvelopeDecrypt(inFile, outFile, key);
+        if (ret == TRUSTM_ENVELOPE_AUTH)
+            printf("Authentication failed, output removed!!!\n");
+        else if (ret != 0)
+            printf("Error decrypting file!!!\n");
+        else
+            printf("Success\n");
+    } while (FALSE);
+
+    OPENSSL_cleanse(key, sizeof(key));
+    return ret;
+}
+
 int main (int argc, char **argv)
 {
     optiga_lib_status_t return_status;
@@ -81,6 +150,7 @@ int main (int argc, char **argv)
     char *inFile = NULL;
 
     optiga_rsa_encryption_scheme_t encryption_scheme;
+    uint16_t envFail = 0;
 
     int option = 0;                    // Command line option.
 
@@ -104,7 +174,7 @@ int main (int argc, char **argv)
         opterr = 0; // Disable getopt error messages in case of unknown parameters
 
         // Loop through parameters with getopt.
-        while (-1 != (option = getopt(argc, argv, "k:o:i:Xh")))
+        while (-1 != (option = getopt(argc, argv, "k:o:i:EXh")))
         {
             switch (option)
             {
@@ -120,6 +190,9 @@ int main (int argc, char **argv)
                     uOptFlag.flags.input = 1;
                     inFile = optarg;
                     break;
+                case 'E': // Envelope
+                    uOptFlag.flags.envelope = 1;
+                    break;
                 case 'X': // Bypass Shielded Communication
                     uOptFlag.flags.bypass = 1;
                     printf("Bypass Shielded Communication. \n");
@@ -172,6 +245,12 @@ int main (int argc, char **argv)
             printf("Output File Name : %s \n", outFile);
             printf("Input File Name  : %s \n", inFile);
 
+            if(uOptFlag.flags.envelope == 1)
+            {
+                envFail = _envelopeDecrypt(optiga_key_id, inFile, outFile, &return_status);
+                break;
+            }
+
             encyptdatalen = trustmreadFrom(encyptdata, (uint8_t *) inFile);
             if (encyptdatalen == 0)
             {
@@ -185,8 +264,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);             
-                OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_CRYPT_SHIELDED(me_crypt);
             }
         
             optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -203,8 +281,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -223,5 +300,5 @@ int main (int argc, char **argv)
 
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (envFail != 0);
 }
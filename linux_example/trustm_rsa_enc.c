@@ -29,6 +29,9 @@
 #include "optiga/optiga_util.h"
 
 #include "trustm_helper.h"
+#include "trustm_envelope.h"
+
+#include <openssl/crypto.h>
 
 #define MAX_OID_PUB_CERT_SIZE   1728
 
@@ -39,7 +42,7 @@ typedef struct _OPTFLAG {
     uint16_t    hash        : 1;
     uint16_t    pubkey      : 1;
     uint16_t    bypass      : 1;
-    uint16_t    dummy6      : 1;
+    uint16_t    envelope    : 1;
     uint16_t    dummy7      : 1;
     uint16_t    dummy8      : 1;
     uint16_t    dummy9      : 1;
@@ -64,10 +67,75 @@ void _helpmenu(void)
     printf("-p <pubkey>   : Use Pubkey file\n");
     printf("-o <filename> : Output to file \n");
     printf("-i <filename> : Input Data file\n");
+    printf("-E            : Envelope, encrypt a file of any size with AES-256-GCM\n");
     printf("-X            : Bypass Shielded Communication \n");
     printf("-h            : Print this help \n");
 }
 
+static void _protect(void)
+{
+    if(uOptFlag.flags.bypass != 1)
+    {
+        // OPTIGA Comms Shielded connection settings to enable the protection
+        TRUSTM_CRYPT_SHIELDED(me_crypt);
+    }
+}
+
+/**********************************************************************
+* _envelopeEncrypt()
+* Encrypt inFile of any size into an envelope. The AES-256-GCM key and
+* IV come from the chip TRNG, the key is wrapped with the RSA key given
+* by keySource/key (as for optiga_crypt_rsa_encrypt_message), the body
+* is encrypted on the host. Returns 0 on success, chip errors are
+* returned in return_status.
+**********************************************************************/
+static uint16_t _envelopeEncrypt(uint8_t keySource, const void *key,
+                                 const char *inFile, const char *outFile,
+                                 optiga_lib_status_t *return_status)
+{
+    trustm_envelope_t env;
+    uint8_t secret[TRUSTM_ENVELOPE_KEY_LEN + TRUSTM_ENVELOPE_IV_LEN];
+    uint16_t ret = 1;
+
+    do
+    {
+        TRUSTM_REPLAY(*return_status,
+                      _protect(),
+                      optiga_crypt_random(me_crypt,
+                                          OPTIGA_RNG_TYPE_TRNG,
+                                          secret,
+                                          sizeof(secret)));
+        if (*return_status != OPTIGA_LIB_SUCCESS)
+            break;
+
+        TRUSTM_REPLAY(*return_status,
+                      _protect(); env.wrapLen = sizeof(env.wrap),
+                      optiga_crypt_rsa_encrypt_message(me_crypt,
+                                                       OPTIGA_RSAES_PKCS1_V15,
+                                                       secret,
+                                                       TRUSTM_ENVELOPE_KEY_LEN,
+                                                       NULL,
+                                                       0,
+                                                       keySource,
+                                                       (void *)key,
+                                                       env.wrap,
+                                                       &env.wrapLen));
+        if (*return_status != OPTIGA_LIB_SUCCESS)
+            break;
+        memcpy(env.iv, secret + TRUSTM_ENVELOPE_KEY_LEN, TRUSTM_ENVELOPE_IV_LEN);
+
+        printf("Envelope         : AES-256-GCM, key wrapped [%d]\n", env.wrapLen);
+        ret = trustmEnvelopeEncrypt(inFile, outFile, &env, secret);
+        if (ret != 0)
+            printf("Error encrypting file!!!\n");
+        else
+            printf("Success\n");
+    } while (FALSE);
+
+    OPENSSL_cleanse(secret, sizeof(secret));
+    return ret;
+}
+
 int main (int argc, char **argv)
 {
     optiga_lib_status_t return_status;
@@ -90,6 +158,7 @@ int main (int argc, char **argv)
 
     public_key_from_host_t public_key_from_host;
     optiga_rsa_encryption_scheme_t encryption_scheme;
+    uint16_t envFail = 0;
 
     int option = 0;                    // Command line option.
 
@@ -113,7 +182,7 @@ int main (int argc, char **argv)
         opterr = 0; // Disable getopt error messages in case of unknown parameters
 
         // Loop through parameters with getopt.
-        while (-1 != (option = getopt(argc, argv, "k:o:i:p:Xh")))
+        while (-1 != (option = getopt(argc, argv, "k:o:i:p:EXh")))
         {
             switch (option)
             {
@@ -133,6 +202,9 @@ int main (int argc, char **argv)
                     uOptFlag.flags.pubkey = 1;
                     pubkeyFile = optarg;
                     break;
+                case 'E': // Envelope
+                    uOptFlag.flags.envelope = 1;
+                    break;
                 case 'X': // Bypass Shielded Communication
                     uOptFlag.flags.bypass = 1;
                     printf("Bypass Shielded Communication. \n");
@@ -185,6 +257,13 @@ int main (int argc, char **argv)
             printf("Output File Name : %s \n", outFile);
             printf("Input File Name  : %s \n", inFile);
 
+            if(uOptFlag.flags.envelope == 1)
+            {
+                envFail = _envelopeEncrypt(OPTIGA_CRYPT_OID_DATA, &optiga_key_id,
+                                           inFile, outFile, &return_status);
+                break;
+            }
+
             messagelen = trustmreadFrom(message, (uint8_t *) inFile);
             if (messagelen == 0)
             {
@@ -198,8 +277,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_CRYPT_SHIELDED(me_crypt);
             }
 
             encryption_scheme = OPTIGA_RSAES_PKCS1_V15;
@@ -217,8 +295,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -263,6 +340,22 @@ int main (int argc, char **argv)
             printf("Output File Name : %s \n", outFile);
             printf("Input File Name  : %s \n", inFile);
 
+            encryption_scheme = OPTIGA_RSAES_PKCS1_V15;
+            public_key_from_host.public_key = pubkey;
+            public_key_from_host.length = pubkeyLen;
+
+            if(pubkeySize == 1024)
+                public_key_from_host.key_type = (uint8_t)OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL;
+            else
+                public_key_from_host.key_type = (uint8_t)OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL;
+
+            if(uOptFlag.flags.envelope == 1)
+            {
+                envFail = _envelopeEncrypt(OPTIGA_CRYPT_HOST_DATA, &public_key_from_host,
+                                           inFile, outFile, &return_status);
+                break;
+            }
+
             messagelen = trustmreadFrom(message, (uint8_t *) inFile);
             if (messagelen == 0)
             {
@@ -273,20 +366,10 @@ int main (int argc, char **argv)
             printf("Input data : \n");
             trustmHexDump(message,messagelen);
 
-            encryption_scheme = OPTIGA_RSAES_PKCS1_V15;
-            public_key_from_host.public_key = pubkey;
-            public_key_from_host.length = pubkeyLen;
-
-            if(pubkeySize == 1024)
-                public_key_from_host.key_type = (uint8_t)OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL;
-            else
-                public_key_from_host.key_type = (uint8_t)OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL;
-
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
-                OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
-                OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_FULL_PROTECTION);
+                TRUSTM_CRYPT_SHIELDED(me_crypt);
             }
 
             optiga_lib_status = OPTIGA_LIB_BUSY;
@@ -303,8 +386,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -323,5 +405,5 @@ int main (int argc, char **argv)
 
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (envFail != 0);
 }
@@ -31,6 +31,7 @@
 #include "optiga/optiga_util.h"
 
 #include "trustm_helper.h"
+#include "trustm_batch.h"
 
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
@@ -45,7 +46,7 @@ typedef struct _OPTFLAG {
     uint16_t    output      : 1;
     uint16_t    hash        : 1;
     uint16_t    bypass      : 1;
-    uint16_t    dummy5      : 1;
+    uint16_t    batch       : 1;
     uint16_t    dummy6      : 1;
     uint16_t    dummy7      : 1;
     uint16_t    dummy8      : 1;
@@ -71,6 +72,9 @@ void _helpmenu(void)
     printf("-o <filename> : Output to file \n");
     printf("-i <filename> : Input Data file\n");
     printf("-H            : Hash before sign\n");
+    printf("-b <listfile> : Batch sign the files listed, one per line\n");
+    printf("-m <manifest> : Batch output to manifest instead of <file>.sig\n");
+    printf("-j <threads>  : Batch hash threads (default: online CPUs)\n");
     printf("-X            : Bypass Shielded Communication \n");
     printf("-h            : Print this help \n");
 }
@@ -95,6 +99,10 @@ int main (int argc, char **argv)
     char *inFile = NULL;
     FILE *fp = NULL;
     uint16_t filesize;
+    char *listFile = NULL;
+    char *manifestFile = NULL;
+    uint16_t threads = 0;
+    uint32_t batchFail = 0;
 
     int option = 0;                    // Command line option.
 
@@ -118,7 +126,7 @@ int main (int argc, char **argv)
         opterr = 0; // Disable getopt error messages in case of unknown parameters
 
         // Loop through parameters with getopt.
-        while (-1 != (option = getopt(argc, argv, "k:o:i:HXh")))
+        while (-1 != (option = getopt(argc, argv, "k:o:i:Hb:m:j:Xh")))
         {
             switch (option)
             {
@@ -137,6 +145,16 @@ int main (int argc, char **argv)
                 case 'H': // Input
                     uOptFlag.flags.hash = 1;
                     break;
+                case 'b': // Batch list
+                    uOptFlag.flags.batch = 1;
+                    listFile = optarg;
+                    break;
+                case 'm': // Batch manifest
+                    manifestFile = optarg;
+                    break;
+                case 'j': // Batch hash threads
+                    threads = trustmHexorDec(optarg);
+                    break;
                 case 'X': // Bypass Shielded Communication
                     uOptFlag.flags.bypass = 1;
                     printf("Bypass Shielded Communication. \n");
@@ -171,7 +189,13 @@ int main (int argc, char **argv)
 
     do
     {
-        if(uOptFlag.flags.sign == 1)
+        if((uOptFlag.flags.sign == 1) && (uOptFlag.flags.batch == 1))
+        {
+            printf("OID Key          : 0x%.4X\n",optiga_key_id);
+            printf("List File Name   : %s \n", listFile);
+            batchFail = trustmBatchSign(optiga_key_id, EVP_PKEY_RSA, listFile, manifestFile,
+                                        threads, uOptFlag.flags.bypass);
+        } else if(uOptFlag.flags.sign == 1)
         {
             if(uOptFlag.flags.output != 1)
             {
@@ -207,6 +231,7 @@ int main (int argc, char **argv)
                 if(uOptFlag.flags.bypass != 1)
                 {
                     // OPTIGA Comms Shielded connection settings to enable the protection
+                    trustmGovernorShielded();
                     OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
                     OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_COMMAND_PROTECTION);
                 }
@@ -216,8 +241,7 @@ int main (int argc, char **argv)
                 if (OPTIGA_LIB_SUCCESS != return_status)
                     break;
                 //Wait until the optiga_util_read_metadata operation is completed
-                while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-                return_status = optiga_lib_status;
+                return_status = trustmWaitCompletion();
                 if (return_status != OPTIGA_LIB_SUCCESS)
                     break;
 
@@ -229,6 +253,7 @@ int main (int argc, char **argv)
                     if(uOptFlag.flags.bypass != 1)
                     {
                         // OPTIGA Comms Shielded connection settings to enable the protection
+                        trustmGovernorShielded();
                         OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
                         OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_COMMAND_PROTECTION);
                     }
@@ -241,8 +266,7 @@ int main (int argc, char **argv)
                     if (OPTIGA_LIB_SUCCESS != return_status)
                         break;
                     //Wait until the optiga_util_read_metadata operation is completed
-                    while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-                    return_status = optiga_lib_status;
+                    return_status = trustmWaitCompletion();
                     if (return_status != OPTIGA_LIB_SUCCESS)
                         break;
                     filesize += dataLen;
@@ -258,6 +282,7 @@ int main (int argc, char **argv)
                 if(uOptFlag.flags.bypass != 1)
                 {
                     // OPTIGA Comms Shielded connection settings to enable the protection
+                    trustmGovernorShielded();
                     OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
                     OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_COMMAND_PROTECTION);
                 }
@@ -269,8 +294,7 @@ int main (int argc, char **argv)
                 if (OPTIGA_LIB_SUCCESS != return_status)
                     break;
                 //Wait until the optiga_util_read_metadata operation is completed
-                while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-                return_status = optiga_lib_status;
+                return_status = trustmWaitCompletion();
                 if (return_status != OPTIGA_LIB_SUCCESS)
                     break;
                 else
@@ -308,6 +332,7 @@ int main (int argc, char **argv)
             if(uOptFlag.flags.bypass != 1)
             {
                 // OPTIGA Comms Shielded connection settings to enable the protection
+                trustmGovernorShielded();
                 OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
                 OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_COMMAND_PROTECTION);
             }
@@ -324,8 +349,7 @@ int main (int argc, char **argv)
             if (OPTIGA_LIB_SUCCESS != return_status)
                 break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             else
@@ -345,5 +369,5 @@ int main (int argc, char **argv)
 
     trustm_Close();
     trustm_hibernate_flag = 0; // Disable hibernate Context Save
-    return 0;
+    return (batchFail != 0);
 }
@@ -0,0 +1,133 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*/
+#include <stdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "optiga/ifx_i2c/ifx_i2c_config.h"
+#include "optiga/optiga_util.h"
+
+#include "trustm_helper.h"
+
+typedef struct _OPTFLAG {
+    uint16_t    sync        : 1;
+    uint16_t    clear       : 1;
+    uint16_t    dummy2      : 1;
+    uint16_t    dummy3      : 1;
+    uint16_t    dummy4      : 1;
+    uint16_t    dummy5      : 1;
+    uint16_t    dummy6      : 1;
+    uint16_t    dummy7      : 1;
+    uint16_t    dummy8      : 1;
+    uint16_t    dummy9      : 1;
+    uint16_t    dummy10     : 1;
+    uint16_t    dummy11     : 1;
+    uint16_t    dummy12     : 1;
+    uint16_t    dummy13     : 1;
+    uint16_t    dummy14     : 1;
+    uint16_t    dummy15     : 1;
+}OPTFLAG;
+
+union _uOptFlag {
+    OPTFLAG    flags;
+    uint16_t    all;
+} uOptFlag;
+
+static void _helpmenu(void)
+{
+    printf("\nHelp menu: trustm_stats <option> ...<option>\n");
+    printf("option:- \n");
+    printf("-s            : Read Security Event Counter from chip before printing \n");
+    printf("-c            : Clear statistics \n");
+    printf("-h            : Print this help \n");
+}
+
+int main (int argc, char **argv)
+{
+    optiga_lib_status_t return_status;
+    uint8_t secCnt;
+
+    int option = 0;                    // Command line option.
+
+/***************************************************************
+ * Getting Input from CLI
+ **************************************************************/
+    uOptFlag.all = 0;
+    printf("\n");
+    do // Begin of DO WHILE(FALSE) for error handling.
+    {
+        // ---------- Command line parsing with getopt ----------
+        opterr = 0; // Disable getopt error messages in case of unknown parameters
+
+        // Loop through parameters with getopt.
+        while (-1 != (option = getopt(argc, argv, "sch")))
+        {
+            switch (option)
+            {
+                case 's': // Sync with chip
+                    uOptFlag.flags.sync = 1;
+                    break;
+                case 'c': // Clear
+                    uOptFlag.flags.clear = 1;
+                    break;
+                case 'h': // Print Help Menu
+                default:  // Any other command Print Help Menu
+                    _helpmenu();
+                    exit(0);
+                    break;
+            }
+        }
+    } while (0); // End of DO WHILE FALSE loop.
+
+/***************************************************************
+ * Example
+ **************************************************************/
+    printf("========================================================\n");
+
+    if(uOptFlag.flags.sync == 1)
+    {
+        trustm_hibernate_flag = 0; // disable hibernate Context Save
+        return_status = trustm_Open();
+        if (return_status != OPTIGA_LIB_SUCCESS) {exit(1);}
+
+        secCnt = trustmReadSecCnt();
+        printf("Security Event Counter read : %d\n", secCnt);
+
+        trustm_Close();
+    }
+
+    trustmPrintStats();
+
+    if(uOptFlag.flags.clear == 1)
+    {
+        trustmClearStats();
+        printf("Statistics cleared.\n");
+    }
+
+    printf("========================================================\n");
+
+    return 0;
+}
@@ -0,0 +1,550 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <signal.h>
+
+// open ssl related includes
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// Socket related includes
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "optiga/ifx_i2c/ifx_i2c_config.h"
+#include "optiga/optiga_util.h"
+
+#include "trustm_helper.h"
+
+// Default IP/PORT, same as simpleTest_Server
+#define DEFAULT_IP          "127.0.0.1"
+#define DEFAULT_PORT        5000
+
+#define MAX_CONCURRENCY     256
+#define MAX_SAMPLES         100000      // per run, later handshakes are counted only
+#define SWEEP_GAIN          5           // [%] less throughput gain ends the sweep
+
+typedef struct load_run_str
+{
+    // settings
+    struct sockaddr_in  server_addr;
+    SSL_CTX             *ctx;
+    uint32_t            concurrency;
+    uint32_t            rate;           // handshakes/s for all connections, 0: no limit
+    uint32_t            count;          // handshakes in total, 0: run for duration
+    uint64_t            duration;       // [us]
+
+    // shared state
+    pthread_mutex_t     lock;
+    uint64_t            start;          // [us]
+    uint32_t            issued;
+    uint32_t            done;
+    uint32_t            errConnect;
+    uint32_t            errHandshake;
+    uint32_t            errShutdown;
+    uint32_t            resumed;
+    uint64_t            *sample;        // handshake latency [us]
+    uint32_t            sampleCount;
+} load_run_t;
+
+typedef struct load_result_str
+{
+    uint32_t    done;
+    uint32_t    errors;
+    uint32_t    resumed;
+    double      hsPerSec;
+    uint64_t    p50;
+    uint64_t    p90;
+    uint64_t    p99;
+    uint64_t    max;
+    double      chipShare;          // [%]
+} load_result_t;
+
+typedef struct _OPTFLAG {
+    uint16_t    cafile      : 1;
+    uint16_t    sweep       : 1;
+    uint16_t    count       : 1;
+    uint16_t    nochip      : 1;
+    uint16_t    resume      : 1;
+    uint16_t    dummy5      : 1;
+    uint16_t    dummy6      : 1;
+    uint16_t    dummy7      : 1;
+    uint16_t    dummy8      : 1;
+    uint16_t    dummy9      : 1;
+    uint16_t    dummy10     : 1;
+    uint16_t    dummy11     : 1;
+    uint16_t    dummy12     : 1;
+    uint16_t    dummy13     : 1;
+    uint16_t    dummy14     : 1;
+    uint16_t    dummy15     : 1;
+}OPTFLAG;
+
+union _uOptFlag {
+    OPTFLAG    flags;
+    uint16_t    all;
+} uOptFlag;
+
+static void _helpmenu(void)
+{
+    printf("\nHelp menu: trustm_tls_load <option> ...<option>\n");
+    printf("option:- \n");
+    printf("-i <IP>       : Server IP [default %s] \n", DEFAULT_IP);
+    printf("-p <port>     : Server port [default %d] \n", DEFAULT_PORT);
+    printf("-c <conn>     : Concurrent connections [default 4] \n");
+    printf("-r <rate>     : Target handshakes/s, 0 for no limit [default 0] \n");
+    printf("-d <sec>      : Run time in seconds [default 10] \n");
+    printf("-n <count>    : Stop after <count> handshakes instead of -d \n");
+    printf("-C <file>     : CA certificate to verify the server [default no verify] \n");
+    printf("-S            : Sweep concurrency 1,2,4.. up to -c, find the saturation point \n");
+    printf("-N            : Server chip not on this host, skip chip time share \n");
+    printf("-R            : Reconnect with the last session of the connection, \n");
+    printf("                one echo message per connection picks up the ticket \n");
+    printf("-h            : Print this help \n");
+}
+
+/**********************************************************************
+* _nextSlot()
+* Claim the next handshake. With a target rate, sleeps until the
+* handshake is due. Returns 0 once the run is over.
+**********************************************************************/
+static uint8_t _nextSlot(load_run_t *run)
+{
+    uint64_t due = 0;
+    uint64_t now;
+    uint32_t slot;
+
+    pthread_mutex_lock(&run->lock);
+    slot = run->issued;
+    if (run->count != 0)
+    {
+        if (slot >= run->count)
+        {
+            pthread_mutex_unlock(&run->lock);
+            return 0;
+        }
+    }
+    run->issued++;
+    pthread_mutex_unlock(&run->lock);
+
+    if (run->rate != 0)
+        due = run->start + ((uint64_t)slot * 1000000) / run->rate;
+
+    now = trustmNowUs();
+    if ((run->count == 0) && (now - run->start >= run->duration))
+        return 0;
+
+    if (due > now)
+    {
+        if ((run->count == 0) && (due - run->start >= run->duration))
+            return 0;
+        usleep(due - now);
+    }
+    return 1;
+}
+
+static void * _worker(void *arg)
+{
+    load_run_t *run = (load_run_t *)arg;
+    SSL *ssl;
+    SSL_SESSION *sess = NULL;
+    struct timeval timeout = {2, 0};
+    uint8_t buf[64];
+    int sock;
+    int one = 1;
+    uint64_t start, latency;
+    int err;
+
+    while (_nextSlot(run))
+    {
+        start = trustmNowUs();
+
+        sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == -1)
+        {
+            pthread_mutex_lock(&run->lock);
+            run->errConnect++;
+            pthread_mutex_unlock(&run->lock);
+            continue;
+        }
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (connect(sock, (struct sockaddr*)&run->server_addr, sizeof(run->server_addr)) == -1)
+        {
+            close(sock);
+            pthread_mutex_lock(&run->lock);
+            run->errConnect++;
+            pthread_mutex_unlock(&run->lock);
+            continue;
+        }
+
+        ssl = SSL_new(run->ctx);
+        if (ssl == NULL)
+        {
+            close(sock);
+            pthread_mutex_lock(&run->lock);
+            run->errHandshake++;
+            pthread_mutex_unlock(&run->lock);
+            continue;
+        }
+        SSL_set_fd(ssl, sock);
+        if (sess != NULL)
+            SSL_set_session(ssl, sess);
+
+        err = SSL_connect(ssl);
+        latency = trustmNowUs() - start;
+
+        pthread_mutex_lock(&run->lock);
+        if (err != 1)
+        {
+            run->errHandshake++;
+        }
+        else
+        {
+            run->done++;
+            if (SSL_session_reused(ssl))
+                run->resumed++;
+            if (run->sampleCount < MAX_SAMPLES)
+                run->sample[run->sampleCount++] = latency;
+        }
+        pthread_mutex_unlock(&run->lock);
+
+        // A TLS 1.3 ticket comes after the handshake, read the echo for it
+        if ((err == 1) && (uOptFlag.flags.resume == 1))
+        {
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            buf[0] = 1;
+            if ((SSL_write(ssl, buf, 1) == 1) && (SSL_read(ssl, buf, sizeof(buf)) > 0))
+            {
+                SSL_SESSION_free(sess);
+                sess = SSL_get1_session(ssl);
+            }
+            else
+            {
+                ERR_clear_error();
+            }
+        }
+
+        if (err == 1)
+        {
+            if (SSL_shutdown(ssl) < 0)
+            {
+                pthread_mutex_lock(&run->lock);
+                run->errShutdown++;
+                pthread_mutex_unlock(&run->lock);
+            }
+        }
+        else
+        {
+            ERR_clear_error();
+        }
+
+        SSL_free(ssl);
+        close(sock);
+    }
+
+    SSL_SESSION_free(sess);
+    return NULL;
+}
+
+/**********************************************************************
+* _runLoad()
+* Run one load level and fill in the result.
+**********************************************************************/
+static int _runLoad(load_run_t *run, load_result_t *result)
+{
+    pthread_t thread[MAX_CONCURRENCY];
+    trustm_stats_t statsStart, statsEnd;
+    uint64_t wall;
+    uint32_t i, started;
+
+    run->issued = 0;
+    run->done = 0;
+    run->errConnect = 0;
+    run->errHandshake = 0;
+    run->errShutdown = 0;
+    run->resumed = 0;
+    run->sampleCount = 0;
+
+    if(uOptFlag.flags.nochip != 1)
+        trustmGetStats(&statsStart);
+
+    run->start = trustmNowUs();
+    for (started = 0; started < run->concurrency; started++)
+    {
+        if (pthread_create(&thread[started], NULL, _worker, run) != 0)
+            break;
+    }
+    for (i = 0; i < started; i++)
+        pthread_join(thread[i], NULL);
+    wall = trustmNowUs() - run->start;
+
+    if (started == 0)
+        return 1;
+
+    trustmSortSamples(run->sample, run->sampleCount);
+
+    result->done = run->done;
+    result->errors = run->errConnect + run->errHandshake + run->errShutdown;
+    result->resumed = run->resumed;
+    result->hsPerSec = (wall != 0) ? ((double)run->done * 1000000.0 / (double)wall) : 0.0;
+    result->p50 = trustmPercentile(run->sample, run->sampleCount, 500);
+    result->p90 = trustmPercentile(run->sample, run->sampleCount, 900);
+    result->p99 = trustmPercentile(run->sample, run->sampleCount, 990);
+    result->max = (run->sampleCount != 0) ? run->sample[run->sampleCount-1] : 0;
+    result->chipShare = -1.0;
+
+    // Chip busy time recorded by the access layer of the server process
+    if(uOptFlag.flags.nochip != 1)
+    {
+        trustmGetStats(&statsEnd);
+        if (wall != 0)
+            result->chipShare = (double)(statsEnd.busyUs - statsStart.busyUs) * 100.0 / (double)wall;
+    }
+
+    return 0;
+}
+
+static void _printResult(load_run_t *run, load_result_t *result)
+{
+    printf("%5d %9.1f %7d %6d %9llu %9llu %9llu %9llu ",
+            run->concurrency, result->hsPerSec, result->done, result->errors,
+            (unsigned long long)(result->p50 / 1000),
+            (unsigned long long)(result->p90 / 1000),
+            (unsigned long long)(result->p99 / 1000),
+            (unsigned long long)(result->max / 1000));
+    if ((uOptFlag.flags.resume != 1) || (result->done == 0))
+        printf("%6s ", "-");
+    else
+        printf("%5.1f%% ", (double)result->resumed * 100.0 / (double)result->done);
+    if (result->chipShare < 0)
+        printf("%7s\n", "-");
+    else
+        printf("%6.1f%%\n", result->chipShare);
+    fflush(stdout);
+}
+
+int main (int argc, char **argv)
+{
+    load_run_t run;
+    load_result_t result, best;
+    const char *ipaddr = DEFAULT_IP;
+    const char *caFile = NULL;
+    uint16_t port = DEFAULT_PORT;
+    uint32_t concurrency = 4;
+    uint32_t seconds = 10;
+    uint32_t level;
+    uint32_t bestLevel = 0;
+    int ret = 0;
+
+    int option = 0;                    // Command line option.
+
+/***************************************************************
+ * Getting Input from CLI
+ **************************************************************/
+    uOptFlag.all = 0;
+    memset(&run, 0, sizeof(run));
+    printf("\n");
+    do // Begin of DO WHILE(FALSE) for error handling.
+    {
+        // ---------- Command line parsing with getopt ----------
+        opterr = 0; // Disable getopt error messages in case of unknown parameters
+
+        // Loop through parameters with getopt.
+        while (-1 != (option = getopt(argc, argv, "i:p:c:r:d:n:C:SNRh")))
+        {
+            switch (option)
+            {
+                case 'i': // Server IP
+                    ipaddr = optarg;
+                    break;
+                case 'p': // Server port
+                    port = trustmHexorDec(optarg);
+                    break;
+                case 'c': // Concurrency
+                    concurrency = trustmHexorDec(optarg);
+                    break;
+                case 'r': // Target rate
+                    run.rate = trustmHexorDec(optarg);
+                    break;
+                case 'd': // Run time
+                    seconds = trustmHexorDec(optarg);
+                    break;
+                case 'n': // Handshake count
+                    uOptFlag.flags.count = 1;
+                    run.count = trustmHexorDec(optarg);
+                    break;
+                case 'C': // CA certificate
+                    uOptFlag.flags.cafile = 1;
+                    caFile = optarg;
+                    break;
+                case 'S': // Concurrency sweep
+                    uOptFlag.flags.sweep = 1;
+                    break;
+                case 'N': // No chip on this host
+                    uOptFlag.flags.nochip = 1;
+                    break;
+                case 'R': // Session resumption
+                    uOptFlag.flags.resume = 1;
+                    break;
+                case 'h': // Print Help Menu
+                default:  // Any other command Print Help Menu
+                    _helpmenu();
+                    exit(0);
+                    break;
+            }
+        }
+    } while (0); // End of DO WHILE FALSE loop.
+
+    if ((concurrency == 0) || (concurrency > MAX_CONCURRENCY) ||
+        ((seconds == 0) && (uOptFlag.flags.count != 1)))
+    {
+        _helpmenu();
+        exit(0);
+    }
+
+/***************************************************************
+ * Example
+ **************************************************************/
+    // A server closing mid write must fail the handshake, not kill the run
+    signal(SIGPIPE, SIG_IGN);
+
+    do
+    {
+        run.duration = (uint64_t)seconds * 1000000;
+        run.server_addr.sin_family = AF_INET;
+        run.server_addr.sin_port = htons(port);
+        run.server_addr.sin_addr.s_addr = inet_addr(ipaddr);
+        pthread_mutex_init(&run.lock, NULL);
+
+        run.sample = malloc(MAX_SAMPLES * sizeof(uint64_t));
+        if (run.sample == NULL)
+        {
+            ret = 1;
+            break;
+        }
+
+        run.ctx = SSL_CTX_new(TLS_client_method());
+        if (run.ctx == NULL)
+        {
+            ERR_print_errors_fp(stderr);
+            ret = 1;
+            break;
+        }
+        // The connections keep their own session with -R, no shared cache
+        SSL_CTX_set_session_cache_mode(run.ctx, SSL_SESS_CACHE_OFF);
+        // simpleTest_Server does ECDHE on P-256 only, offer its key share
+        // first so no handshake takes an extra HelloRetryRequest round trip
+        SSL_CTX_set1_groups_list(run.ctx, "P-256:X25519");
+
+        if(uOptFlag.flags.cafile == 1)
+        {
+            if (!SSL_CTX_load_verify_locations(run.ctx, caFile, NULL))
+            {
+                ERR_print_errors_fp(stderr);
+                ret = 1;
+                break;
+            }
+            SSL_CTX_set_verify(run.ctx, SSL_VERIFY_PEER, NULL);
+        }
+
+        printf("========================================================\n");
+        printf("Server        : %s:%d\n", ipaddr, port);
+        if (run.rate != 0)
+            printf("Target rate   : %d handshakes/s\n", run.rate);
+        else
+            printf("Target rate   : no limit\n");
+        if(uOptFlag.flags.count == 1)
+            printf("Handshakes    : %d per level\n", run.count);
+        else
+            printf("Run time      : %d s per level\n", seconds);
+        if(uOptFlag.flags.resume == 1)
+            printf("Resumption    : each connection resumes its last session\n");
+        printf("--------------------------------------------------------\n");
+        printf("%5s %9s %7s %6s %9s %9s %9s %9s %6s %7s\n",
+                "Conn", "HS/s", "Done", "Err", "p50[ms]", "p90[ms]", "p99[ms]", "max[ms]", "Reuse", "Chip");
+
+        if(uOptFlag.flags.sweep != 1)
+        {
+            run.concurrency = concurrency;
+            ret = _runLoad(&run, &result);
+            if (ret == 0)
+            {
+                _printResult(&run, &result);
+                printf("--------------------------------------------------------\n");
+                printf("Errors        : connect %d, handshake %d, shutdown %d\n",
+                        run.errConnect, run.errHandshake, run.errShutdown);
+                if ((uOptFlag.flags.resume == 1) && (result.done != 0))
+                    printf("Resumed       : %d of %d handshakes (%.1f%%) without a chip signature\n",
+                            result.resumed, result.done, (double)result.resumed * 100.0 / (double)result.done);
+            }
+            break;
+        }
+
+        // Sweep: double the concurrency until the throughput stops growing
+        memset(&best, 0, sizeof(best));
+        level = 1;
+        while (1)
+        {
+            run.concurrency = level;
+            ret = _runLoad(&run, &result);
+            if (ret != 0)
+                break;
+            _printResult(&run, &result);
+
+            if ((bestLevel != 0) &&
+                (result.hsPerSec * 100.0 < best.hsPerSec * (100.0 + SWEEP_GAIN)))
+                break;
+            best = result;
+            bestLevel = level;
+
+            if (level >= concurrency)
+                break;
+            level = (level * 2 > concurrency) ? concurrency : level * 2;
+        }
+
+        printf("--------------------------------------------------------\n");
+        if (bestLevel != 0)
+            printf("Saturation    : %.1f handshakes/s at %d connections (p99 %llu ms)\n",
+                    best.hsPerSec, bestLevel, (unsigned long long)(best.p99 / 1000));
+    } while (FALSE);
+
+    printf("========================================================\n");
+
+    if (run.ctx != NULL)
+        SSL_CTX_free(run.ctx);
+    free(run.sample);
+    pthread_mutex_destroy(&run.lock);
+
+    return ret;
+}
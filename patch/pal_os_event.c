@@ -34,12 +34,17 @@
 * @{
 */
 
+#define _GNU_SOURCE     // pthread_setaffinity_np()
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <signal.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include "optiga/pal/pal_os_timer.h"
 #include "optiga/pal/pal_os_event.h"
 
@@ -64,6 +69,37 @@
 #define CLOCKID CLOCK_REALTIME
 #define SIG SIGRTMIN
 
+// Period of the workaround timer, see pal_os_event_arm()
+#define WORKAROUND_PERIOD_NS    294967296
+
+/*
+ * Worker thread mode.
+ * Instead of the SIGRTMIN timer, event callbacks (and the I2C transfers
+ * they drive) run on one dedicated thread. Enabled at run time:
+ *   TRUSTM_PAL_WORKER=1          use the worker thread
+ *   TRUSTM_PAL_WORKER_CPU=<n>    pin the worker to CPU n
+ *   TRUSTM_PAL_WORKER_PRIO=<n>   run the worker SCHED_FIFO at priority n
+ *   TRUSTM_PAL_WORKER_MLOCK=1    lock the process memory (stack and buffers)
+ */
+#ifndef PAL_OS_EVENT_WORKER_STACK
+#define PAL_OS_EVENT_WORKER_STACK   (64*1024)
+#endif
+
+typedef struct pal_os_event_worker
+{
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    struct timespec due;        // next callback trigger (CLOCK_MONOTONIC)
+    long long       period_ns;  // re-trigger period, 0 for one shot
+    uint8_t         armed;
+    uint8_t         running;
+    int             cpu;
+    int             prio;
+} pal_os_event_worker_t;
+
+static pal_os_event_worker_t worker = {.lock = PTHREAD_MUTEX_INITIALIZER, .cpu = -1};
+
 
 static void handler(int sig, siginfo_t *si, void *uc)
 {
@@ -78,6 +114,138 @@ static void handler(int sig, siginfo_t *si, void *uc)
 static pal_os_event_t pal_os_event_0 = {0};
 static 	timer_t timerid;
 
+static int pal_os_event_getenv(const char *name, int def)
+{
+    char *value = getenv(name);
+
+    if (value == NULL)
+        return def;
+    return atoi(value);
+}
+
+static void pal_os_event_timespec_add(struct timespec *ts, long long ns)
+{
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+static void pal_os_event_worker_set(long long first_ns, long long period_ns)
+{
+    pthread_mutex_lock(&worker.lock);
+    if (first_ns == 0 && period_ns == 0)
+    {
+        worker.armed = FALSE;
+    }
+    else
+    {
+        clock_gettime(CLOCK_MONOTONIC, &worker.due);
+        pal_os_event_timespec_add(&worker.due, first_ns);
+        worker.armed = TRUE;
+    }
+    worker.period_ns = period_ns;
+    pthread_cond_signal(&worker.cond);
+    pthread_mutex_unlock(&worker.lock);
+}
+
+static void * pal_os_event_worker_main(void *arg)
+{
+    struct timespec now;
+    struct sched_param param;
+    cpu_set_t cpuset;
+
+    if (worker.cpu >= 0)
+    {
+        CPU_ZERO(&cpuset);
+        CPU_SET(worker.cpu, &cpuset);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0)
+            TRUSTM_PAL_EVENT_ERRFN("Fail to pin worker to CPU %d", worker.cpu);
+    }
+
+    if (worker.prio > 0)
+    {
+        param.sched_priority = worker.prio;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+            TRUSTM_PAL_EVENT_ERRFN("Fail to set SCHED_FIFO priority %d", worker.prio);
+    }
+
+    pthread_mutex_lock(&worker.lock);
+    while (TRUE)
+    {
+        if (!worker.armed)
+        {
+            pthread_cond_wait(&worker.cond, &worker.lock);
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec < worker.due.tv_sec) ||
+            ((now.tv_sec == worker.due.tv_sec) && (now.tv_nsec < worker.due.tv_nsec)))
+        {
+            pthread_cond_timedwait(&worker.cond, &worker.lock, &worker.due);
+            continue;
+        }
+
+        if (worker.period_ns)
+            pal_os_event_timespec_add(&worker.due, worker.period_ns);
+        else
+            worker.armed = FALSE;
+
+        pthread_mutex_unlock(&worker.lock);
+        pal_os_event_trigger_registered_callback();
+        pthread_mutex_lock(&worker.lock);
+    }
+
+    return NULL;
+}
+
+static int pal_os_event_worker_start(void)
+{
+    pthread_attr_t attr;
+    pthread_condattr_t condattr;
+
+    if (worker.running)
+        return TRUE;
+
+    if (pal_os_event_getenv("TRUSTM_PAL_WORKER", 0) == 0)
+        return FALSE;
+
+    worker.cpu = pal_os_event_getenv("TRUSTM_PAL_WORKER_CPU", -1);
+    worker.prio = pal_os_event_getenv("TRUSTM_PAL_WORKER_PRIO", 0);
+
+    if (pal_os_event_getenv("TRUSTM_PAL_WORKER_MLOCK", 0) != 0)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+            TRUSTM_PAL_EVENT_ERRFN("mlockall failed (errno %d)", errno);
+    }
+
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&worker.cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PAL_OS_EVENT_WORKER_STACK);
+    if (pthread_create(&worker.thread, &attr, pal_os_event_worker_main, NULL) != 0)
+    {
+        TRUSTM_PAL_EVENT_ERRFN("Fail to create worker, use timer signal");
+        pthread_attr_destroy(&attr);
+        return FALSE;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_detach(worker.thread);
+
+    worker.running = TRUE;
+    TRUSTM_PAL_EVENT_DBGFN("worker cpu %d prio %d", worker.cpu, worker.prio);
+    return TRUE;
+}
+
+// Event mode in use, lets tools tell this PAL from the unpatched one
+uint8_t pal_os_event_worker_active(void)
+{
+    return worker.running;
+}
+
 void pal_os_event_start(pal_os_event_t * p_pal_os_event, register_callback callback, void * callback_args)
 {
     TRUSTM_PAL_EVENT_DBGFN(">");    
@@ -107,6 +275,12 @@ void pal_os_event_disarm(void)
 	struct itimerspec its;
 
 	TRUSTM_PAL_EVENT_DBGFN(">");    
+	if (worker.running)
+	{
+		pal_os_event_worker_set(0, 0);
+		return;
+	}
+
 	its.it_value.tv_sec = 0;
 	its.it_value.tv_nsec = 0;
 	its.it_interval.tv_sec = 0;
@@ -126,10 +300,16 @@ void pal_os_event_arm(void)
 	struct itimerspec its;
 
 	TRUSTM_PAL_EVENT_DBGFN(">");    
+	if (worker.running)
+	{
+		pal_os_event_worker_set(1000000, WORKAROUND_PERIOD_NS);
+		return;
+	}
+
 	its.it_value.tv_sec = 0;
 	its.it_value.tv_nsec = 1000000;
 	its.it_interval.tv_sec = 0;
-	its.it_interval.tv_nsec = 294967296;
+	its.it_interval.tv_nsec = WORKAROUND_PERIOD_NS;
 	
 	if (timer_settime(timerid, 0, &its, NULL) == -1)
 	{
@@ -143,6 +323,11 @@ void pal_os_event_arm(void)
 void pal_os_event_destroy1(void)
 {
     TRUSTM_PAL_EVENT_DBGFN(">");    
+    if (worker.running)
+    {
+        pal_os_event_worker_set(0, 0);
+        return;
+    }
     timer_delete(timerid);
     TRUSTM_PAL_EVENT_DBGFN("<");    
 }
@@ -156,6 +341,12 @@ pal_os_event_t * pal_os_event_create(register_callback callback, void * callback
 	
     if(( NULL != callback )&&( NULL != callback_args ))
     {
+        if (pal_os_event_worker_start())
+        {
+            pal_os_event_start(&pal_os_event_0,callback,callback_args);
+            return (&pal_os_event_0);
+        }
+
 		/* Establishing handler for signal */
 		
         sa.sa_flags = SA_SIGINFO;
@@ -202,6 +393,12 @@ void pal_os_event_trigger_registered_callback(void)
         pal_os_event_0.callback_registered = NULL;
 	
 	// Stop the timer
+	if (worker.running)
+	{
+	    pal_os_event_worker_set(0, 0);
+	    callback((void * )pal_os_event_0.callback_ctx);
+	    return;
+	}
 	its.it_value.tv_sec = 0;
 	its.it_value.tv_nsec = 0;
 	its.it_interval.tv_sec = 0;
@@ -240,6 +437,11 @@ void pal_os_event_register_callback_oneshot(pal_os_event_t * p_pal_os_event,
 	/* Start the timer */
 
 	freq_nanosecs = time_us * 1000;
+	if (worker.running)
+	{
+	    pal_os_event_worker_set(freq_nanosecs, freq_nanosecs);
+	    return;
+	}
 	its.it_value.tv_sec = freq_nanosecs / 1000000000;
 	its.it_value.tv_nsec = freq_nanosecs % 1000000000;
 	its.it_interval.tv_sec = its.it_value.tv_sec;
@@ -264,6 +466,12 @@ void pal_os_event_register_callback_oneshot(pal_os_event_t * p_pal_os_event,
 void pal_os_event_destroy(pal_os_event_t * pal_os_event)
 {
     TRUSTM_PAL_EVENT_DBGFN(">");    
+    if (worker.running)
+    {
+        // The worker stays for the next pal_os_event_create()
+        pal_os_event_worker_set(0, 0);
+        return;
+    }
     timer_delete(timerid);
     TRUSTM_PAL_EVENT_DBGFN("<");    
 
@@ -0,0 +1,532 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <libgen.h>
+#include <setjmp.h>
+
+#include "optiga/ifx_i2c/ifx_i2c_config.h"
+#include "optiga/optiga_util.h"
+
+#include "trustm_helper.h"
+
+#define MAX_BATCH_LINE      4096
+#define MAX_BATCH_ARGS      64
+#define MAX_BATCH_OPEN      16  // files and buffers tracked per batch command
+
+// Batch line status of a tool leaving through exit(0), i.e. help or usage
+#define BATCH_USAGE_ERROR   2
+
+typedef int (*trustm_cmd_main_t)(int argc, char **argv);
+
+typedef struct trustm_cmd_str
+{
+    const char          *name;
+    trustm_cmd_main_t   cmdMain;
+    uint8_t             bypass;     // Tool accepts -X
+} trustm_cmd_t;
+
+// main() of every tool, renamed at build time (see Makefile)
+int trustm_cert_main(int argc, char **argv);
+int trustm_chipinfo_main(int argc, char **argv);
+int trustm_data_main(int argc, char **argv);
+int trustm_ecc_keygen_main(int argc, char **argv);
+int trustm_ecc_sign_main(int argc, char **argv);
+int trustm_ecc_verify_main(int argc, char **argv);
+int trustm_errorcode_main(int argc, char **argv);
+int trustm_metadata_main(int argc, char **argv);
+int trustm_monotonic_counter_main(int argc, char **argv);
+int trustm_provision_main(int argc, char **argv);
+int trustm_read_data_main(int argc, char **argv);
+int trustm_read_status_main(int argc, char **argv);
+int trustm_readmetadata_all_main(int argc, char **argv);
+int trustm_readmetadata_data_main(int argc, char **argv);
+int trustm_readmetadata_private_main(int argc, char **argv);
+int trustm_readmetadata_status_main(int argc, char **argv);
+int trustm_rsa_dec_main(int argc, char **argv);
+int trustm_rsa_enc_main(int argc, char **argv);
+int trustm_rsa_keygen_main(int argc, char **argv);
+int trustm_rsa_sign_main(int argc, char **argv);
+int trustm_rsa_verify_main(int argc, char **argv);
+int trustm_stats_main(int argc, char **argv);
+
+static const trustm_cmd_t trustm_cmd[] =
+{
+    {"cert",                   trustm_cert_main,                 1},
+    {"chipinfo",               trustm_chipinfo_main,             0},
+    {"data",                   trustm_data_main,                 1},
+    {"ecc_keygen",             trustm_ecc_keygen_main,           1},
+    {"ecc_sign",               trustm_ecc_sign_main,             1},
+    {"ecc_verify",             trustm_ecc_verify_main,           1},
+    {"errorcode",              trustm_errorcode_main,            0},
+    {"metadata",               trustm_metadata_main,             1},
+    {"monotonic_counter",      trustm_monotonic_counter_main,    1},
+    {"provision",              trustm_provision_main,            1},
+    {"read_data",              trustm_read_data_main,            1},
+    {"read_status",            trustm_read_status_main,          1},
+    {"readmetadata_all",       trustm_readmetadata_all_main,     1},
+    {"readmetadata_data",      trustm_readmetadata_data_main,    1},
+    {"readmetadata_private",   trustm_readmetadata_private_main, 1},
+    {"readmetadata_status",    trustm_readmetadata_status_main,  1},
+    {"rsa_dec",                trustm_rsa_dec_main,              1},
+    {"rsa_enc",                trustm_rsa_enc_main,              1},
+    {"rsa_keygen",             trustm_rsa_keygen_main,           1},
+    {"rsa_sign",               trustm_rsa_sign_main,             1},
+    {"rsa_verify",             trustm_rsa_verify_main,           1},
+    {"stats",                  trustm_stats_main,                0},
+};
+
+#define TRUSTM_CMD_COUNT    (sizeof(trustm_cmd)/sizeof(trustm_cmd[0]))
+
+typedef struct _OPTFLAG {
+    uint16_t    batch       : 1;
+    uint16_t    keepgoing   : 1;
+    uint16_t    bypass      : 1;
+    uint16_t    dummy3      : 1;
+    uint16_t    dummy4      : 1;
+    uint16_t    dummy5      : 1;
+    uint16_t    dummy6      : 1;
+    uint16_t    dummy7      : 1;
+    uint16_t    dummy8      : 1;
+    uint16_t    dummy9      : 1;
+    uint16_t    dummy10     : 1;
+    uint16_t    dummy11     : 1;
+    uint16_t    dummy12     : 1;
+    uint16_t    dummy13     : 1;
+    uint16_t    dummy14     : 1;
+    uint16_t    dummy15     : 1;
+}OPTFLAG;
+
+union _uOptFlag {
+    OPTFLAG    flags;
+    uint16_t    all;
+} uOptFlag;
+
+// Armed while a batch command runs, see trustm_cli_exit()
+static jmp_buf *batchJmp = NULL;
+static int batchExitStatus;
+
+// Files and buffers of the running batch command, released when it ends
+static FILE *batchFiles[MAX_BATCH_OPEN];
+static void *batchBufs[MAX_BATCH_OPEN];
+
+void trustm_cli_exit(int status) __attribute__((noreturn));
+FILE *trustm_cli_fopen(const char *filename, const char *mode);
+int trustm_cli_fclose(FILE *fp);
+void *trustm_cli_malloc(size_t size);
+void trustm_cli_free(void *ptr);
+
+static void _helpmenu(void)
+{
+    uint16_t i;
+
+    printf("\nHelp menu: trustm <option> ...<option> <command> <command option> ...\n");
+    printf("option:- \n");
+    printf("-b <file>     : Run the commands listed in <file> in one chip session\n");
+    printf("                Use '-' to read the commands from stdin\n");
+    printf("-k            : Batch continues after a failed command\n");
+    printf("-X            : Bypass Shielded Communication for every batch command \n");
+    printf("-h            : Print this help \n");
+    printf("command:- \n");
+    for (i = 0; i < TRUSTM_CMD_COUNT; i++)
+        printf("  %s\n", trustm_cmd[i].name);
+    printf("\nBatch file : one command with its options per line, '#' starts a comment\n");
+    printf("  e.g. read_data -r 0xE0E0 -o cert.der\n");
+}
+
+static const trustm_cmd_t * _findCmd(const char *name)
+{
+    uint16_t i;
+
+    // Accept the tool name as well, e.g. "trustm_data" for "data"
+    if (strncmp(name, "trustm_", 7) == 0)
+        name += 7;
+
+    for (i = 0; i < TRUSTM_CMD_COUNT; i++)
+    {
+        if (strcmp(name, trustm_cmd[i].name) == 0)
+            return &trustm_cmd[i];
+    }
+    return NULL;
+}
+
+static int _runCmd(int argc, char **argv)
+{
+    const trustm_cmd_t *cmd;
+
+    cmd = _findCmd(argv[0]);
+    if (cmd == NULL)
+    {
+        printf("Unknown command : %s\n", argv[0]);
+        return 1;
+    }
+
+    // Every tool parses its own options with getopt, restart the scan
+    optind = 0;
+    opterr = 0;
+    return cmd->cmdMain(argc, argv);
+}
+
+/**********************************************************************
+* trustm_cli_exit()
+* exit() of every linked tool (see Makefile). The tools only call it for
+* help, usage errors and a failed open. Within a batch the command line
+* fails instead and the batch decides whether to go on.
+**********************************************************************/
+void trustm_cli_exit(int status)
+{
+    if (batchJmp != NULL)
+    {
+        // Help and usage errors leave with 0 but ran nothing
+        batchExitStatus = (status != 0) ? status : BATCH_USAGE_ERROR;
+        longjmp(*batchJmp, 1);
+    }
+    exit(status);
+}
+
+/**********************************************************************
+* trustm_cli_fopen() / trustm_cli_fclose()
+* trustm_cli_malloc() / trustm_cli_free()
+* fopen(), fclose(), malloc() and free() of every linked tool (see
+* Makefile). Within a batch the open files and buffers of the command
+* are tracked, so a command left through trustm_cli_exit() or one that
+* forgets to close a file does not leak into the next command. An entry
+* beyond MAX_BATCH_OPEN is not tracked.
+**********************************************************************/
+static void _batchTrack(void **table, void *ptr)
+{
+    int i;
+
+    for (i = 0; (ptr != NULL) && (batchJmp != NULL) && (i < MAX_BATCH_OPEN); i++)
+    {
+        if (table[i] == NULL)
+        {
+            table[i] = ptr;
+            break;
+        }
+    }
+}
+
+static void _batchUntrack(void **table, void *ptr)
+{
+    int i;
+
+    for (i = 0; (ptr != NULL) && (i < MAX_BATCH_OPEN); i++)
+    {
+        if (table[i] == ptr)
+        {
+            table[i] = NULL;
+            break;
+        }
+    }
+}
+
+FILE *trustm_cli_fopen(const char *filename, const char *mode)
+{
+    FILE *fp = fopen(filename, mode);
+
+    _batchTrack((void **)batchFiles, fp);
+    return fp;
+}
+
+int trustm_cli_fclose(FILE *fp)
+{
+    _batchUntrack((void **)batchFiles, fp);
+    return fclose(fp);
+}
+
+void *trustm_cli_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+
+    _batchTrack(batchBufs, ptr);
+    return ptr;
+}
+
+void trustm_cli_free(void *ptr)
+{
+    _batchUntrack(batchBufs, ptr);
+    free(ptr);
+}
+
+// Close and free what the command left behind
+static void _batchRelease(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_BATCH_OPEN; i++)
+    {
+        if (batchFiles[i] != NULL)
+            fclose(batchFiles[i]);
+        free(batchBufs[i]);
+        batchFiles[i] = NULL;
+        batchBufs[i] = NULL;
+    }
+}
+
+static int _runBatchCmd(int argc, char **argv)
+{
+    const trustm_cmd_t *cmd;
+    jmp_buf jmp;
+    volatile int ret;
+    int i;
+
+    // Batch -X applies the tool's own -X to each command
+    cmd = _findCmd(argv[0]);
+    if ((uOptFlag.flags.bypass == 1) && (cmd != NULL) && (cmd->bypass == 1))
+    {
+        for (i = argc; i > 0; i--)
+            argv[i + 1] = argv[i];
+        argv[1] = "-X";
+        argc++;
+    }
+
+    if (setjmp(jmp) == 0)
+    {
+        batchJmp = &jmp;
+        ret = _runCmd(argc, argv);
+    }
+    else
+    {
+        ret = batchExitStatus;
+        if (ret == BATCH_USAGE_ERROR)
+            printf("Invalid command options\n");
+    }
+    batchJmp = NULL;
+    _batchRelease();
+    return ret;
+}
+
+// Split a batch line into arguments in place. Single and double quotes
+// group words, '#' outside quotes starts a comment.
+static int _splitLine(char *line, char **argv, int maxArgs)
+{
+    int argc = 0;
+    char *rd = line;
+    char *wr;
+    char quote;
+
+    while (1)
+    {
+        while ((*rd == ' ') || (*rd == '\t') || (*rd == '\r') || (*rd == '\n'))
+            rd++;
+        if ((*rd == '\0') || (*rd == '#'))
+            break;
+        if (argc == maxArgs)
+            return -1;
+
+        argv[argc++] = wr = rd;
+        quote = 0;
+        while (*rd != '\0')
+        {
+            if (quote != 0)
+            {
+                if (*rd == quote)
+                    quote = 0;
+                else
+                    *wr++ = *rd;
+                rd++;
+            }
+            else if ((*rd == '"') || (*rd == '\''))
+            {
+                quote = *rd++;
+            }
+            else if ((*rd == ' ') || (*rd == '\t') || (*rd == '\r') || (*rd == '\n'))
+            {
+                rd++;
+                break;
+            }
+            else
+            {
+                *wr++ = *rd++;
+            }
+        }
+        // Terminate after the copy, rd is never behind wr
+        *wr = '\0';
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+static uint8_t _sessionHibernate(void)
+{
+    if(uOptFlag.flags.bypass != 1)
+    #ifdef HIBERNATE_ENABLE
+        return 1; // Enable hibernate Context Save
+    #else
+        return 0; // disable hibernate Context Save
+    #endif
+    else
+        return 0; // disable hibernate Context Save
+}
+
+// Release the held session on any exit() outside a batch command
+static void _batchExit(void)
+{
+    trustm_hibernate_flag = _sessionHibernate();
+    trustm_CloseSession();
+}
+
+static int _runBatch(const char *filename)
+{
+    FILE *fp;
+    char line[MAX_BATCH_LINE];
+    char *argv[MAX_BATCH_ARGS+2];   // Room for -X and NULL
+    int argc;
+    int i;
+    uint32_t lineNum = 0;
+    uint32_t cmdCount = 0;
+    uint32_t cmdFail = 0;
+    int ret = 0;
+    optiga_lib_status_t return_status;
+
+    do
+    {
+        if (strcmp(filename, "-") == 0)
+            fp = stdin;
+        else
+            fp = fopen(filename, "r");
+        if (fp == NULL)
+        {
+            printf("Error opening file : %s\n", filename);
+            ret = 1;
+            break;
+        }
+
+        trustm_hibernate_flag = _sessionHibernate();
+        return_status = trustm_OpenSession();
+        if (return_status != OPTIGA_LIB_SUCCESS)
+        {
+            if (fp != stdin)
+                fclose(fp);
+            ret = 1;
+            break;
+        }
+        atexit(_batchExit);
+
+        while (fgets(line, sizeof(line), fp) != NULL)
+        {
+            lineNum++;
+            argc = _splitLine(line, argv, MAX_BATCH_ARGS);
+            if (argc == 0)
+                continue;
+            if (argc < 0)
+            {
+                printf("Line %d : too many arguments\n", lineNum);
+                ret = 1;
+            }
+            else
+            {
+                printf("trustm> ");
+                for (i = 0; i < argc; i++)
+                    printf("%s ", argv[i]);
+                printf("\n");
+
+                cmdCount++;
+                ret = _runBatchCmd(argc, argv);
+                // The tools change it, keep the session setting
+                trustm_hibernate_flag = _sessionHibernate();
+            }
+
+            if (ret != 0)
+            {
+                cmdFail++;
+                printf("Line %d : command failed (%d)\n", lineNum, ret);
+                if (uOptFlag.flags.keepgoing != 1)
+                    break;
+            }
+        }
+
+        if (fp != stdin)
+            fclose(fp);
+
+        printf("Batch : %d commands, %d failed\n", cmdCount, cmdFail);
+        if (cmdFail != 0)
+            ret = 1;
+    } while (FALSE);
+
+    return ret;
+}
+
+int main (int argc, char **argv)
+{
+    const char *batchFile = NULL;
+    const char *progName;
+
+    int option = 0;                    // Command line option.
+
+    // Called through a link named after a tool, e.g. trustm_data -> trustm
+    progName = basename(argv[0]);
+    if ((strcmp(progName, "trustm") != 0) && (_findCmd(progName) != NULL))
+    {
+        return _runCmd(argc, argv);
+    }
+
+/***************************************************************
+ * Getting Input from CLI
+ **************************************************************/
+    uOptFlag.all = 0;
+    do // Begin of DO WHILE(FALSE) for error handling.
+    {
+        // ---------- Command line parsing with getopt ----------
+        opterr = 0; // Disable getopt error messages in case of unknown parameters
+
+        // Loop through parameters with getopt, stop at the command name
+        while (-1 != (option = getopt(argc, argv, "+b:kXh")))
+        {
+            switch (option)
+            {
+                case 'b': // Batch file
+                    uOptFlag.flags.batch = 1;
+                    batchFile = optarg;
+                    break;
+                case 'k': // Keep going
+                    uOptFlag.flags.keepgoing = 1;
+                    break;
+                case 'X': // Bypass Shielded Communication
+                    uOptFlag.flags.bypass = 1;
+                    break;
+                case 'h': // Print Help Menu
+                default:  // Any other command Print Help Menu
+                    _helpmenu();
+                    exit(0);
+                    break;
+            }
+        }
+    } while (0); // End of DO WHILE FALSE loop.
+
+    if (uOptFlag.flags.batch == 1)
+        return _runBatch(batchFile);
+
+    if (optind >= argc)
+    {
+        _helpmenu();
+        return 1;
+    }
+
+    return _runCmd(argc - optind, &argv[optind]);
+}
@@ -45,6 +45,34 @@ extern void pal_os_event_disarm(void);
 static const char *engine_id   = "trustm_engine";
 static const char *engine_name = "Infineon OPTIGA TrustM Engine";
 
+static const ENGINE_CMD_DEFN engine_cmd_defns[] = {
+    {TRUSTM_ENGINE_CMD_DEADLINE,
+     "DEADLINE",
+     "Time to acquire the chip in ms, 0 waits forever",
+     ENGINE_CMD_FLAG_NUMERIC},
+    {TRUSTM_ENGINE_CMD_RAND_FALLBACK,
+     "RAND_FALLBACK",
+     "Use the OpenSSL DRBG when the chip is not acquired in time (0/1)",
+     ENGINE_CMD_FLAG_NUMERIC},
+    {TRUSTM_ENGINE_CMD_ECDHE_POOL,
+     "ECDHE_POOL",
+     "Keep key pairs for ECDHE in 0 to 4 session contexts, 0 stops",
+     ENGINE_CMD_FLAG_NUMERIC},
+    {TRUSTM_ENGINE_CMD_ECDHE_REFILL,
+     "ECDHE_REFILL",
+     "Generate key pairs in the used session contexts",
+     ENGINE_CMD_FLAG_NO_INPUT},
+    {TRUSTM_ENGINE_CMD_ECDHE_POLL,
+     "ECDHE_POLL",
+     "Refill the session contexts without waiting, 1 while key generations are pending",
+     ENGINE_CMD_FLAG_NO_INPUT},
+    {TRUSTM_ENGINE_CMD_ECDHE_HANDSHAKE,
+     "ECDHE_HANDSHAKE",
+     "EC key generations are TLS key shares, take them from the session contexts (0/1)",
+     ENGINE_CMD_FLAG_NUMERIC},
+    {0, NULL, NULL, 0}
+};
+
 //Globe Variable
 // for IPC
 // ---- InterCom
@@ -164,67 +192,6 @@ static void __trustmEngine_ipcInit(void)
     }
 }
 
-/**********************************************************************
-* __trustmEngine_delay()
-**********************************************************************/
-static void __trustmEngine_delay (int cnt)
-{
-    uint32_t wait;
-
-    for(wait=0;wait<(0x1fffffff*cnt);wait++)
-    {}
-}
-
-/**********************************************************************
-* __trustmEngine_secCnt()
-**********************************************************************/
-static uint8_t __trustmEngine_secCnt(void)
-{
-    uint16_t offset, bytes_to_read;
-    uint16_t optiga_oid;
-    uint8_t read_data_buffer[5];
-
-    optiga_lib_status_t return_status;
-
-    // Do not add open_close here.
-    do
-    {
-        //Read device Security Event ounter
-        optiga_oid = 0xE0C5;
-        offset = 0x00;
-        bytes_to_read = sizeof(read_data_buffer);
-
-        optiga_lib_status = OPTIGA_LIB_BUSY;
-        return_status = optiga_util_read_data(me_util,
-                                              optiga_oid,
-                                              offset,
-                                              read_data_buffer,
-                                              &bytes_to_read);
-
-        if (OPTIGA_LIB_SUCCESS != return_status)
-        {
-            //Reading the data object failed.
-            TRUSTM_HELPER_ERRFN("optiga_util_read_data : FAIL!!!\n");
-            read_data_buffer[0] = 0;
-            break;
-        }
-
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) 
-        {
-            pal_os_timer_delay_in_milliseconds(10);
-        }
-
-        if (OPTIGA_LIB_SUCCESS != optiga_lib_status)
-        {
-            read_data_buffer[0] = 0;
-            break;
-        }        
-
-    } while(FALSE);
-
-    return read_data_buffer[0];
-}
-
 /**********************************************************************
 * trustmEngine_Open()
 **********************************************************************/
@@ -258,6 +225,9 @@ optiga_lib_status_t trustmEngine_Open(void)
         }
         return_status = OPTIGA_LIB_SUCCESS;
         TRUSTM_ENGINE_DBGFN("TrustM crypt instance created. \n");
+
+        // Extra instances for commands queued together
+        trustmPoolCreate();
         TRUSTM_ENGINE_DBGFN("TrustM Open. \n");
 
     }while(FALSE);      
@@ -275,9 +245,12 @@ optiga_lib_status_t trustmEngine_App_Open(void)
     pid_t current_pid;
     pid_t queue_pid;
     int queue_delay;
+    uint64_t deadline = 0;
 
     TRUSTM_ENGINE_DBGFN(">");
     trustm_ctx.appOpen = 0;
+    if (trustm_ctx.deadline != 0)
+        deadline = trustmNowMs() + trustm_ctx.deadline;
     do
     {
         //Init IPC
@@ -314,6 +287,11 @@ optiga_lib_status_t trustmEngine_App_Open(void)
               __trustmEngine_writeshm(ipc_FlagInterShmid,current_pid);
               //queue_pid=__trustmEngine_readshm(ipc_FlagInterShmid);
             }
+            else if ((deadline != 0) && (trustmNowMs() >= deadline))
+            {
+              TRUSTM_ENGINE_DBGFN("Deadline expired, held by %d", queue_pid);
+              break;
+            }
             queue_delay= ((current_pid %MAX_IPC_TIME)+1)*IPC_SLEEP_STEPS; // wait for 1 to MAX_IPC_TIME at IPC_SLEEP_STEPS steps depends on process number
             mssleep(queue_delay);
             queue_pid=__trustmEngine_readshm(ipc_FlagInterShmid);
@@ -321,6 +299,13 @@ optiga_lib_status_t trustmEngine_App_Open(void)
         
 
         
+        if (queue_pid != current_pid)
+        {
+            trustmRecordDeadline();
+            return_status = TRUSTM_ACCESS_ERROR_DEADLINE;
+            break;
+        }
+
         TRUSTM_ENGINE_DBGFN("Lock queue %d", queue_pid);
 
         /**
@@ -349,7 +334,7 @@ optiga_lib_status_t trustmEngine_App_Open(void)
 
         TRUSTM_ENGINE_DBGFN("waiting...");
         //Wait until the optiga_util_open_application is completed
-        while (optiga_lib_status == OPTIGA_LIB_BUSY ){}
+        trustmWaitCompletion();
         TRUSTM_ENGINE_DBG("++done.\n");
 
         if (OPTIGA_LIB_SUCCESS != optiga_lib_status)
@@ -373,11 +358,7 @@ optiga_lib_status_t trustmEngine_App_Open(void)
 
                         TRUSTM_ENGINE_DBGFN("waiting (max count: 50)");
                         //Wait until the optiga_util_open_application is completed
-                        while (optiga_lib_status == OPTIGA_LIB_BUSY )
-                        {
-                            //TRUSTM_ENGINE_DBG(".");
-                            //pal_os_timer_delay_in_milliseconds(50);
-                        }
+                        trustmWaitCompletion();
                         TRUSTM_ENGINE_DBG("++\n");
                         
                         if (OPTIGA_LIB_SUCCESS != optiga_lib_status)
@@ -395,6 +376,9 @@ optiga_lib_status_t trustmEngine_App_Open(void)
         
         trustm_ctx.appOpen = 1;
         TRUSTM_ENGINE_DBGFN("Success : optiga_util_open_application \n");
+
+        // Hold back if earlier failures pushed the Security Event Counter up
+        trustmGovernorOpen();
     }while(FALSE);      
 
     TRUSTM_ENGINE_DBGFN("<");
@@ -411,6 +395,7 @@ optiga_lib_status_t trustmEngine_Close(void)
     TRUSTM_HELPER_DBGFN(">");
 
     // destroy util and crypt instances
+    trustmPoolDestroy();
     //optiga_lib_status = OPTIGA_LIB_BUSY;
     return_status = optiga_crypt_destroy(me_crypt);
     if(OPTIGA_LIB_SUCCESS != return_status)
@@ -454,12 +439,12 @@ optiga_lib_status_t trustmEngine_App_Close(void)
             if (access(TRUSTM_HIBERNATE_CTX_FILENAME,F_OK) != -1)
                 remove(TRUSTM_HIBERNATE_CTX_FILENAME);
 
-            secCnt = __trustmEngine_secCnt();
+            secCnt = trustmReadSecCnt();
             while (secCnt)
             {
                 TRUSTM_ENGINE_DBGFN("Security Event Counter : %d [waiting. Ctrl+c to abort.]\n",secCnt);
-                __trustmEngine_delay(2);
-                secCnt = __trustmEngine_secCnt();
+                mssleep(secCnt * TRUSTM_GOV_SEC_DECAY_MS);
+                secCnt = trustmReadSecCnt();
                 if (secCnt == 0)
                     TRUSTM_ENGINE_DBGFN("context saved.\n");
             }
@@ -483,12 +468,8 @@ optiga_lib_status_t trustmEngine_App_Close(void)
             break;
         }
 
-        while (optiga_lib_status == OPTIGA_LIB_BUSY)
-        {
-            //Wait until the optiga_util_close_application is completed
-            //printf("Waiting : optiga_util_close_application \n");
-            //printf(".");
-        }
+        //Wait until the optiga_util_close_application is completed
+        trustmWaitCompletion();
         
         if (OPTIGA_LIB_SUCCESS != optiga_lib_status)
         {
@@ -587,13 +568,24 @@ static uint32_t parseKeyParams(const char *aArg)
             value = 0;
 
         if (((value < 0xE0F0) || (value > 0xE0F3)) &&
-            ((value < 0xE0FC) || (value > 0xE0FD)))
+            ((value < 0xE0FC) || (value > 0xE0FD)) &&
+            ((value < TRUSTM_ENGINE_ECDHE_OID) || (value >= TRUSTM_ENGINE_ECDHE_OID + TRUSTM_ENGINE_ECDHE_MAX)))
         {
             TRUSTM_ENGINE_ERRFN("Invalid Key OID");
             //return EVP_FAIL;
             ret = 0;
             break;
         }
+        else if (value >= TRUSTM_ENGINE_ECDHE_OID)
+        {
+            // Session context, no metadata and no public key store
+            trustm_ctx.key_oid = value;
+            trustm_ctx.ec_key_curve = OPTIGA_ECC_CURVE_NIST_P_256;
+            trustm_ctx.ec_key_usage = OPTIGA_KEY_USAGE_KEY_AGREEMENT;
+            trustm_ctx.rsa_key_type = 0x00;
+            trustm_ctx.rsa_key_usage = 0x00;
+            trustm_ctx.pubkeyStore = 0x0000;
+        }
         else
         {          
             trustm_ctx.key_oid = value;
@@ -664,20 +656,15 @@ static uint32_t parseKeyParams(const char *aArg)
                 trustm_ctx.rsa_flag |= TRUSTM_ENGINE_FLAG_SAVEPUBKEY;                
             }
 
-            if(i == 2)
+            if((i == 2) && (trustm_ctx.pubkeyStore != 0x0000))
             {
-                bytes_to_read = sizeof(read_data_buffer);
-                optiga_lib_status = OPTIGA_LIB_BUSY;
-                return_status = optiga_util_read_data(me_util,
+                TRUSTM_REPLAY(return_status,
+                              bytes_to_read = sizeof(read_data_buffer),
+                              optiga_util_read_data(me_util,
                                                     trustm_ctx.pubkeyStore,
                                                     offset,
                                                     read_data_buffer,
-                                                    (uint16_t *)&bytes_to_read);
-                if (OPTIGA_LIB_SUCCESS != return_status)
-                    break;			
-                //Wait until the optiga_util_read_metadata operation is completed
-                while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-                return_status = optiga_lib_status;
+                                                    (uint16_t *)&bytes_to_read));
                 if (return_status != OPTIGA_LIB_SUCCESS)
                     break;
                 else
@@ -732,6 +719,14 @@ static uint32_t parseKeyParams(const char *aArg)
                     if ((i>5) && (strcmp(token[5], "LOCK") == 0))
                         trustm_ctx.ec_flag |= TRUSTM_ENGINE_FLAG_LOCK;
                 }
+
+                if (value >= TRUSTM_ENGINE_ECDHE_OID)
+                {
+                    // Session key pairs are always new, only the curve applies
+                    TRUSTM_ENGINE_DBGFN("found NEW\n");
+                    if ((i>3) && (strncmp(token[3], "0x",2) == 0))
+                        sscanf(token[3],"%x",&(trustm_ctx.ec_key_curve));
+                }
             }
             else
             {
@@ -777,7 +772,10 @@ static int engine_destroy(ENGINE *e)
     {
         trustm_ctx.pubkey[i] = 0x00;
     }
-    
+
+    // Give the session contexts and the chip back
+    trustmEngine_ecdhePool(0);
+    trustmEngine_certE0E0Free();
     trustmEngine_Close();
     
     TRUSTM_ENGINE_DBGFN("<");
@@ -847,7 +845,7 @@ static EVP_PKEY * engine_load_privkey(ENGINE *e, const char *key_id, UI_METHOD *
             case 0xE101:
             case 0xE102:
             case 0xE103:
-                TRUSTM_ENGINE_MSGFN("Function Not implemented.");
+                key = trustm_ec_loadkeyE100();
                 break;
             default:
                 TRUSTM_ENGINE_ERRFN("Invalid OID!!!");
@@ -860,6 +858,65 @@ static EVP_PKEY * engine_load_privkey(ENGINE *e, const char *key_id, UI_METHOD *
     return key;
 }
 
+/****************************************************************
+ engine_load_ssl_client_cert()
+ Client certificate for a TLS handshake : the device certificate
+ 0xE0E0 with its key 0xE0F0, both from the engine without a file.
+ The certificate is read from the chip once and cached.
+ e        : The engine for this callback.
+ ssl      : The connection asking for a client certificate.
+ ca_dn    : Issuers accepted by the server, empty for any.
+ pcert    : Certificate returned, the caller frees it.
+ pkey     : Key returned, the caller frees it.
+ pother   : Other certificates of the chain (none).
+*****************************************************************/
+static int engine_load_ssl_client_cert(ENGINE *e, SSL *ssl, STACK_OF(X509_NAME) *ca_dn,
+                                       X509 **pcert, EVP_PKEY **pkey, STACK_OF(X509) **pother,
+                                       UI_METHOD *ui, void *cb_data)
+{
+    X509        *x509_cert;
+    EVP_PKEY    *key = NULL;
+    int i;
+    int ret = TRUSTM_ENGINE_FAIL;
+
+    TRUSTM_ENGINE_DBGFN(">");
+    do
+    {
+        x509_cert = trustmEngine_certE0E0();
+        if (x509_cert == NULL)
+            break;
+
+        // Send no certificate the server does not accept
+        if ((ca_dn != NULL) && (sk_X509_NAME_num(ca_dn) > 0))
+        {
+            for (i = 0; i < sk_X509_NAME_num(ca_dn); i++)
+            {
+                if (X509_NAME_cmp(sk_X509_NAME_value(ca_dn, i), X509_get_issuer_name(x509_cert)) == 0)
+                    break;
+            }
+            if (i == sk_X509_NAME_num(ca_dn))
+            {
+                TRUSTM_ENGINE_DBGFN("Issuer of 0xE0E0 not accepted by the server");
+                break;
+            }
+        }
+
+        key = engine_load_privkey(e, "0xE0F0", ui, cb_data);
+        if (key == NULL)
+            break;
+
+        X509_up_ref(x509_cert);
+        *pcert = x509_cert;
+        *pkey = key;
+        if (pother != NULL)
+            *pother = NULL;
+        ret = TRUSTM_ENGINE_SUCCESS;
+    }while(FALSE);
+
+    TRUSTM_ENGINE_DBGFN("<");
+    return ret;
+}
+
 /**************************************************************** 
  engine_load_pubkey()
  This function implements loading trustx key.
@@ -933,8 +990,32 @@ static int engine_ctrl(ENGINE *e, int cmd, long i, void *p, void (*f) ())
     TRUSTM_ENGINE_DBGFN("cmd: %d", cmd);
 
     do {
-        //TRUSTM_ENGINE_MSGFN("Function Not implemented.");
-        //Implement code here;
+        switch (cmd)
+        {
+            case TRUSTM_ENGINE_CMD_DEADLINE:
+                trustm_ctx.deadline = (uint32_t) i;
+                TRUSTM_ENGINE_DBGFN("deadline : %d ms", trustm_ctx.deadline);
+                break;
+            case TRUSTM_ENGINE_CMD_RAND_FALLBACK:
+                trustm_ctx.randFallback = (i != 0);
+                TRUSTM_ENGINE_DBGFN("rand fallback : %d", trustm_ctx.randFallback);
+                break;
+            case TRUSTM_ENGINE_CMD_ECDHE_POOL:
+                ret = trustmEngine_ecdhePool(i);
+                break;
+            case TRUSTM_ENGINE_CMD_ECDHE_REFILL:
+                trustmEngine_ecdheRefill();
+                break;
+            case TRUSTM_ENGINE_CMD_ECDHE_POLL:
+                ret = trustmEngine_ecdhePoll();
+                break;
+            case TRUSTM_ENGINE_CMD_ECDHE_HANDSHAKE:
+                trustmEngine_ecdheHandshake(i);
+                break;
+            default:
+                //TRUSTM_ENGINE_MSGFN("Function Not implemented.");
+                break;
+        }
     }while(FALSE);
    
     TRUSTM_ENGINE_DBGFN("<");
@@ -986,6 +1067,8 @@ static int engine_init(ENGINE *e)
         
         trustm_ctx.appOpen = 0;
         trustm_ctx.ipcInit = 0;
+        trustm_ctx.deadline = TRUSTM_ENGINE_DEADLINE_MS;
+        trustm_ctx.randFallback = 1;
 
         // Init Random Method
         ret = trustmEngine_init_rand(e);
@@ -1048,6 +1131,11 @@ static int bind(ENGINE *e, const char *id)
             break;
         }
 
+        if (!ENGINE_set_load_ssl_client_cert_function(e, engine_load_ssl_client_cert)) {
+            TRUSTM_ENGINE_DBGFN("ENGINE_set_load_ssl_client_cert_function failed\n");
+            break;
+        }
+
         
         if (!ENGINE_set_finish_function(e, engine_finish)) {
             TRUSTM_ENGINE_DBGFN("ENGINE_set_finish_function failed\n");
@@ -1064,12 +1152,10 @@ static int bind(ENGINE *e, const char *id)
             break;
         }
 
-/*
         if (!ENGINE_set_cmd_defns(e, engine_cmd_defns)) {
             TRUSTM_ENGINE_DBGFN("ENGINE_set_cmd_defns failed\n");
             break;
         }
-*/
         ret = TRUSTM_ENGINE_SUCCESS;
     }while(FALSE);
 
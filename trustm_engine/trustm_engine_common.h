@@ -42,6 +42,12 @@
 #define PARAM_MAX_LEN        (128)
 
 #define WORKAROUND 1
+
+// Default time to acquire the chip before giving up [ms], 0 waits forever.
+// Change at run time with the DEADLINE engine control command.
+#ifndef TRUSTM_ENGINE_DEADLINE_MS
+#define TRUSTM_ENGINE_DEADLINE_MS   0
+#endif
 //#define TRUSTM_ENGINE_DEBUG = 1
 
 #ifdef WORKAROUND
@@ -80,10 +86,11 @@
                                             return_status = trustmEngine_App_Open(); \
                                             if (return_status != OPTIGA_LIB_SUCCESS) { \
                                                TRUSTM_ENGINE_ERRFN("Fail to open trustM!!"); \
+                                               trustmPrintErrorCode(return_status); \
                                                x = y;return x;} \
                                            }else{trustm_ctx.appOpen = 2;}
 
-#define TRUSTM_ENGINE_APP_CLOSE        if (trustm_ctx.appOpen == 1) \
+#define TRUSTM_ENGINE_APP_CLOSE        if ((trustm_ctx.appOpen == 1) && (trustm_ctx.holdSession == 0)) \
                                           {trustmEngine_App_Close(); \
                                           }else{trustm_ctx.appOpen = 1;}
 
@@ -98,6 +105,28 @@
 #define TRUE                (1U)
 #endif
 
+// trustm engine control commands
+#define TRUSTM_ENGINE_CMD_DEADLINE         ENGINE_CMD_BASE
+#define TRUSTM_ENGINE_CMD_RAND_FALLBACK    (ENGINE_CMD_BASE+1)
+#define TRUSTM_ENGINE_CMD_ECDHE_POOL       (ENGINE_CMD_BASE+2)
+#define TRUSTM_ENGINE_CMD_ECDHE_REFILL     (ENGINE_CMD_BASE+3)
+#define TRUSTM_ENGINE_CMD_ECDHE_POLL       (ENGINE_CMD_BASE+4)
+#define TRUSTM_ENGINE_CMD_ECDHE_HANDSHAKE  (ENGINE_CMD_BASE+5)
+
+// Session contexts for ephemeral keys, 0xE100 to 0xE103
+#define TRUSTM_ENGINE_ECDHE_OID    0xE100
+#define TRUSTM_ENGINE_ECDHE_MAX    4
+
+// The session contexts keep the application open and the IPC lock with
+// it. After holding the chip this long the engine gives it to other
+// processes for at least TRUSTM_ENGINE_ECDHE_YIELD_MS.
+#ifndef TRUSTM_ENGINE_ECDHE_HOLD_MS
+#define TRUSTM_ENGINE_ECDHE_HOLD_MS    1000
+#endif
+#ifndef TRUSTM_ENGINE_ECDHE_YIELD_MS
+#define TRUSTM_ENGINE_ECDHE_YIELD_MS   100
+#endif
+
 // trustm engine return code
 #define TRUSTM_ENGINE_SUCCESS	1
 #define TRUSTM_ENGINE_FAIL		0
@@ -112,6 +141,7 @@
 
 #define PUBKEYFILE_SIZE 256
 #define PUBKEY_SIZE 1024
+#define TRUSTM_ENGINE_CERT_SIZE 1728    // largest certificate data object
 
 
 //typedefine
@@ -145,6 +175,10 @@ typedef struct trustm_ctx_str
   uint16_t  pubkeyStore;
   uint8_t   appOpen;
   uint8_t   ipcInit;
+  uint32_t  deadline;
+  uint8_t   randFallback;
+  uint8_t   holdSession;    // keep the application open, session contexts in use
+  uint8_t   ecdheSlots;
   
 } trustm_ctx_t;
 
@@ -163,10 +197,20 @@ optiga_lib_status_t trustmEngine_App_Close(void);
 uint16_t trustmEngine_init_rand(ENGINE *e);
 uint16_t trustmEngine_init_rsa(ENGINE *e);
 uint16_t trustmEngine_init_ec(ENGINE *e);
+uint16_t trustmEngine_init_ecdhe(EC_KEY_METHOD *method);
+
+int trustmEngine_ecdhePool(long count);
+int trustmEngine_ecdheRefill(void);
+int trustmEngine_ecdhePoll(void);
+void trustmEngine_ecdheHandshake(long on);
 
 EVP_PKEY *trustm_rsa_loadkey(void);
 EVP_PKEY *trustm_ec_loadkey(void);
 EVP_PKEY *trustm_ec_loadkeyE0E0(void);
+EVP_PKEY *trustm_ec_loadkeyE100(void);
+
+X509 *trustmEngine_certE0E0(void);
+void trustmEngine_certE0E0Free(void);
 
 pthread_mutex_t lock;
 
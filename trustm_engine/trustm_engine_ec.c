@@ -27,6 +27,8 @@
 
 #include "trustm_engine_common.h"
 #include "trustm_helper.h"
+#include "trustm_cache.h"
+#include "trustm_certcomp.h"
 
 #ifdef WORKAROUND
     extern void pal_os_event_disarm(void);
@@ -123,8 +125,7 @@ EVP_PKEY *trustm_ec_generatekey(void)
         if (OPTIGA_LIB_SUCCESS != return_status)
             break;          
         //Wait until the optiga_util_read_metadata operation is completed
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+        return_status = trustmWaitCompletionMs(TRUSTM_CMD_TIMEOUT_LONG_MS);
         if (return_status != OPTIGA_LIB_SUCCESS)
         {
             break;
@@ -150,8 +151,7 @@ EVP_PKEY *trustm_ec_generatekey(void)
             if (OPTIGA_LIB_SUCCESS != return_status)
             break;          
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
             break;
             else
@@ -180,82 +180,118 @@ EVP_PKEY *trustm_ec_generatekey(void)
     return key;
 }
 
-EVP_PKEY *trustm_ec_loadkeyE0E0(void)
+// Device certificate 0xE0E0 of the key 0xE0F0, read and parsed once
+// for the life of the process
+static X509 *trustm_certE0E0 = NULL;
+
+/**********************************************************************
+* trustmEngine_certE0E0()
+* The device certificate 0xE0E0, read from the chip on the first call.
+* The engine keeps the reference, NULL on error.
+**********************************************************************/
+X509 *trustmEngine_certE0E0(void)
 {
-    EVP_PKEY    *key = NULL;
-    X509        *x509_cert   = NULL;
-  
-    uint16_t offset, bytes_to_read;
-    uint8_t read_data_buffer[5000];
-    const unsigned char *pCert;
-    uint16_t certLen;
-    uint8_t *data; 
-    int j; 
-    
+    X509        *x509_cert = NULL;
+    uint16_t bytes_to_read;
+    uint8_t read_data_buffer[TRUSTM_ENGINE_CERT_SIZE];
+
     optiga_lib_status_t return_status;
 
-    TRUSTM_WORKAROUND_TIMER_ARM; 
-    TRUSTM_ENGINE_APP_OPEN_RET(key,NULL);
+    TRUSTM_ENGINE_DBGFN(">");
+    if (trustm_certE0E0 != NULL)
+        return trustm_certE0E0;
+
+    TRUSTM_WORKAROUND_TIMER_ARM;
+    TRUSTM_ENGINE_APP_OPEN_RET(x509_cert,NULL);
     do
     {
-        offset = 9;
+        // Cached across processes when 0xE0E0 is locked
         bytes_to_read = sizeof(read_data_buffer);
-
-        optiga_lib_status = OPTIGA_LIB_BUSY;
-        return_status = optiga_util_read_data(me_util,
-                                            0xE0E0,
-                                            offset,
+        return_status = trustmCacheReadData(0xE0E0,
+                                            0,
                                             read_data_buffer,
-                                            (uint16_t *)&bytes_to_read);
-        if (OPTIGA_LIB_SUCCESS != return_status)
-            break;
-        //Wait until the optiga_util_read_metadata operation is completed
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+                                            &bytes_to_read);
         if (return_status != OPTIGA_LIB_SUCCESS)
             break;
-        else
-        {
-            pCert = read_data_buffer;
-            certLen = bytes_to_read;
 
-        x509_cert = d2i_X509(NULL, &pCert, certLen);
+        // DER, TLS identity or compressed certificate
+        x509_cert = trustmCertParse(read_data_buffer, bytes_to_read);
+        if (x509_cert == NULL)
+        {
+            TRUSTM_ENGINE_ERRFN("No certificate in 0xE0E0");
+            break;
+        }
         TRUSTM_ENGINE_DBGFN("Parsed X509 from raw cert");
-  
-        data = trustm_ctx.pubkey;
-        key = X509_get_pubkey(x509_cert);
-        trustm_ctx.pubkeylen = i2d_PUBKEY(key,&data);
+    } while(FALSE);
+    TRUSTM_ENGINE_APP_CLOSE;
+    TRUSTM_WORKAROUND_TIMER_DISARM;
+
+    // Capture OPTIGA Error
+    if (return_status != OPTIGA_LIB_SUCCESS)
+        trustmPrintErrorCode(return_status);
 
-        j=0;    
+    trustm_certE0E0 = x509_cert;
+    TRUSTM_ENGINE_DBGFN("<");
+    return x509_cert;
+}
+
+/**********************************************************************
+* trustmEngine_certE0E0Free()
+**********************************************************************/
+void trustmEngine_certE0E0Free(void)
+{
+    X509_free(trustm_certE0E0);
+    trustm_certE0E0 = NULL;
+}
+
+/**********************************************************************
+* trustm_ec_loadkeyE0E0()
+* Key 0xE0F0 with the public key of the device certificate. The
+* certificate is cached, so the key is loaded without a chip read.
+**********************************************************************/
+EVP_PKEY *trustm_ec_loadkeyE0E0(void)
+{
+    EVP_PKEY    *key = NULL;
+    X509        *x509_cert;
+    const unsigned char *data;
+    uint8_t *pubkey;
+    int len;
+    int j;
+
+    TRUSTM_ENGINE_DBGFN(">");
+    do
+    {
+        x509_cert = trustmEngine_certE0E0();
+        if ((x509_cert == NULL) || (X509_get0_pubkey(x509_cert) == NULL))
+        {
+            TRUSTM_ENGINE_ERRFN("failed to extract public key from X509 certificate");
+            break;
+        }
+
+        len = i2d_PUBKEY(X509_get0_pubkey(x509_cert), NULL);
+        if ((len <= 0) || (len > PUBKEY_SIZE))
+            break;
+        pubkey = trustm_ctx.pubkey;
+        trustm_ctx.pubkeylen = i2d_PUBKEY(X509_get0_pubkey(x509_cert), &pubkey);
+
+        j=0;
         if((trustm_ctx.pubkey[1] & 0x80) == 0x00)
         j = trustm_ctx.pubkey[3] + 4;
         else
         {
         j = (trustm_ctx.pubkey[1] & 0x7f);
-        j = trustm_ctx.pubkey[j+3] + j + 4; 
+        j = trustm_ctx.pubkey[j+3] + j + 4;
         }
         trustm_ctx.pubkeyHeaderLen = j;
-        
-        //trustmHexDump(trustm_ctx.pubkey,trustm_ctx.pubkeylen);
-        
-        if (key == NULL)
-        {
-        TRUSTM_ENGINE_ERRFN("failed to extract public key from X509 certificate");
-        break;
-        }
-        TRUSTM_ENGINE_DBGFN("Extracted public key from cert");
-      }
 
+        // A new key each load, it takes the EC method of the engine
+        data = trustm_ctx.pubkey;
+        key = d2i_PUBKEY(NULL, &data, trustm_ctx.pubkeylen);
+        TRUSTM_ENGINE_DBGFN("Extracted public key from cert");
     } while(FALSE);
-    TRUSTM_ENGINE_APP_CLOSE;
-    TRUSTM_WORKAROUND_TIMER_DISARM;
-    
-    // Capture OPTIGA Error
-    if (return_status != OPTIGA_LIB_SUCCESS)
-        key = NULL;
 
-    TRUSTM_ENGINE_DBGFN("<");   
-    return key;        
+    TRUSTM_ENGINE_DBGFN("<");
+    return key;
 }
 
 EVP_PKEY *trustm_ec_loadkey(void)
@@ -313,6 +349,7 @@ static ECDSA_SIG* trustm_ecdsa_sign(
 )
 {
     ECDSA_SIG  *ecdsa_sig = NULL;
+    trustm_inst_t *inst;
 
     uint8_t     sig[500];
     uint16_t    sig_len = 500;
@@ -332,20 +369,18 @@ static ECDSA_SIG* trustm_ecdsa_sign(
 
     TRUSTM_WORKAROUND_TIMER_ARM;    
     TRUSTM_ENGINE_APP_OPEN_RET(ecdsa_sig,NULL);
+    // Signatures go to a pool instance, apart from the me_util reads
+    inst = trustmPoolGet();
     do 
     {  
-        optiga_lib_status = OPTIGA_LIB_BUSY;
-        return_status = optiga_crypt_ecdsa_sign(me_crypt,
+        TRUSTM_POOL_REPLAY(return_status, inst,
+                      sig_len = 500,
+                      optiga_crypt_ecdsa_sign(TRUSTM_POOL_CRYPT(inst),
                             dgst,
                             dgstlen,
                             trustm_ctx.key_oid,
                             (sig+2),
-                            &sig_len);
-        if (OPTIGA_LIB_SUCCESS != return_status)
-            break;          
-        //Wait until the optiga_util_read_metadata operation is completed
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+                            &sig_len));
         if (return_status != OPTIGA_LIB_SUCCESS)
             break;
         else
@@ -360,6 +395,7 @@ static ECDSA_SIG* trustm_ecdsa_sign(
             ecdsa_sig = d2i_ECDSA_SIG(NULL, &p, sig_len+2);
         }
     }while(FALSE);
+    trustmPoolPut(inst);
     TRUSTM_ENGINE_APP_CLOSE;
     TRUSTM_WORKAROUND_TIMER_DISARM;
 
@@ -406,6 +442,10 @@ uint16_t trustmEngine_init_ec(ENGINE *e)
     // Need to used OpenSSL verify as HW device has limited verification
     EC_KEY_METHOD_get_verify(trustm_ctx.ec_key_method, &orig_verify,&orig_verify_sig);
     EC_KEY_METHOD_set_verify(trustm_ctx.ec_key_method, orig_verify, orig_verify_sig);
+
+    // Key share from the session contexts and ECDH on the chip
+    if (trustmEngine_init_ecdhe(trustm_ctx.ec_key_method) != TRUSTM_ENGINE_SUCCESS)
+      break;
             
     ret = ENGINE_set_EC(e, trustm_ctx.ec_key_method);
     
@@ -0,0 +1,665 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <string.h>
+#include <stdint.h>
+#include <openssl/engine.h>
+#include <openssl/ec.h>
+
+#include "trustm_engine_common.h"
+#include "trustm_helper.h"
+
+#ifdef WORKAROUND
+    extern void pal_os_event_disarm(void);
+    extern void pal_os_event_arm(void);
+#endif
+
+// Session context states
+#define TRUSTM_ECDHE_EMPTY      0
+#define TRUSTM_ECDHE_PENDING    1   // key generation queued, see trustmEngine_ecdhePoll()
+#define TRUSTM_ECDHE_READY      2   // key pair generated, not handed out
+#define TRUSTM_ECDHE_INUSE      3   // public key handed out, waits for the ECDH
+
+#define TRUSTM_ECDHE_PUBKEY_LEN 104 // BIT STRING of a P-384 point and header
+
+// A session context belongs to the crypt instance which generated the
+// key, the ECDH has to run on the same instance
+typedef struct trustm_ecdhe_slot_str
+{
+    trustm_inst_t       inst;
+    uint8_t             state;
+    optiga_ecc_curve_t  curve;
+    uint8_t             pubkey[TRUSTM_ECDHE_PUBKEY_LEN];
+    uint16_t            pubkeyLen;
+    uint64_t            queued;     // [ms] key generation queued
+} trustm_ecdhe_slot_t;
+
+static trustm_ecdhe_slot_t trustm_ecdhe[TRUSTM_ENGINE_ECDHE_MAX];
+static optiga_ecc_curve_t trustm_ecdheCurve = OPTIGA_ECC_CURVE_NIST_P_256;  // curve of the next refill
+static int trustm_ecdheIdx = -1;    // EC_KEY ex_data: slot number + 1
+static uint8_t trustm_ecdheArmed = 0;   // key generations queued by trustmEngine_ecdhePoll()
+static uint8_t trustm_ecdheHandshake = 0;   // EC key generations are TLS key shares
+static uint64_t trustm_ecdheHeld = 0;   // [ms] application opened for the slots, 0 if closed
+static uint64_t trustm_ecdheYield = 0;  // [ms] no key generation queued before
+
+static int (*trustm_ecdheOrigKeygen)(EC_KEY *key) = NULL;
+static int (*trustm_ecdheOrigCompute)(unsigned char **psec, size_t *pseclen,
+                                      const EC_POINT *pub_key, const EC_KEY *ecdh) = NULL;
+
+static void __trustm_ecdheCallback(void * context, optiga_lib_status_t return_status)
+{
+    trustm_inst_t *inst = (trustm_inst_t *)context;
+
+    inst->status = return_status;
+}
+
+static optiga_ecc_curve_t __trustm_ecdheGetCurve(const EC_KEY *key)
+{
+    const EC_GROUP *group = EC_KEY_get0_group(key);
+
+    if (group == NULL)
+        return 0;
+    switch (EC_GROUP_get_curve_name(group))
+    {
+        case NID_X9_62_prime256v1:
+            return OPTIGA_ECC_CURVE_NIST_P_256;
+        case NID_secp384r1:
+            return OPTIGA_ECC_CURVE_NIST_P_384;
+        default:
+            return 0;
+    }
+}
+
+static trustm_ecdhe_slot_t * __trustm_ecdheGetSlot(const EC_KEY *key)
+{
+    uintptr_t slot;
+
+    if (trustm_ecdheIdx < 0)
+        return NULL;
+    slot = (uintptr_t)EC_KEY_get_ex_data(key, trustm_ecdheIdx);
+    if ((slot == 0) || (slot > trustm_ctx.ecdheSlots))
+        return NULL;
+    return &trustm_ecdhe[slot-1];
+}
+
+/**********************************************************************
+* __trustm_ecdheSetKey()
+* Hand out the key pair of a slot: the public key goes into the EC_KEY,
+* the private key stays in the session context.
+**********************************************************************/
+static int __trustm_ecdheSetKey(EC_KEY *key, uint8_t slot)
+{
+    EC_POINT *point;
+    int ret = 0;
+
+    point = EC_POINT_new(EC_KEY_get0_group(key));
+    if (point == NULL)
+        return 0;
+
+    // Skip the BIT STRING header 0x03 <len> 0x00
+    if (EC_POINT_oct2point(EC_KEY_get0_group(key), point,
+                           &trustm_ecdhe[slot].pubkey[3],
+                           trustm_ecdhe[slot].pubkeyLen - 3, NULL) &&
+        EC_KEY_set_public_key(key, point) &&
+        EC_KEY_set_ex_data(key, trustm_ecdheIdx, (void *)(uintptr_t)(slot + 1)))
+    {
+        trustm_ecdhe[slot].state = TRUSTM_ECDHE_INUSE;
+        ret = 1;
+    }
+
+    EC_POINT_free(point);
+    return ret;
+}
+
+/**********************************************************************
+* __trustm_ecdheQueue()
+* Queue a key generation on the instance of every empty slot.
+**********************************************************************/
+static void __trustm_ecdheQueue(void)
+{
+    optiga_lib_status_t return_status;
+    optiga_key_id_t optiga_key_id;
+    trustm_ecdhe_slot_t *slot;
+    uint8_t i;
+
+    // The key pairs only live while the application is open
+    trustm_ctx.holdSession = 1;
+    if (trustm_ecdheHeld == 0)
+        trustm_ecdheHeld = trustmNowMs();
+
+    for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+    {
+        slot = &trustm_ecdhe[i];
+        if (slot->state != TRUSTM_ECDHE_EMPTY)
+            continue;
+
+        optiga_key_id = OPTIGA_KEY_ID_SESSION_BASED;
+        slot->curve = trustm_ecdheCurve;
+        slot->pubkeyLen = sizeof(slot->pubkey);
+        slot->inst.status = OPTIGA_LIB_BUSY;
+        slot->queued = trustmNowMs();
+        return_status = optiga_crypt_ecc_generate_keypair(slot->inst.crypt,
+                                                          slot->curve,
+                                                          (uint8_t)OPTIGA_KEY_USAGE_KEY_AGREEMENT,
+                                                          FALSE,
+                                                          &optiga_key_id,
+                                                          slot->pubkey,
+                                                          &slot->pubkeyLen);
+        if (return_status == OPTIGA_LIB_SUCCESS)
+            slot->state = TRUSTM_ECDHE_PENDING;
+    }
+}
+
+/**********************************************************************
+* __trustm_ecdheCollect()
+* Wait for the queued key generations.
+**********************************************************************/
+static void __trustm_ecdheCollect(void)
+{
+    optiga_lib_status_t return_status;
+    trustm_ecdhe_slot_t *slot;
+    uint8_t i;
+
+    for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+    {
+        slot = &trustm_ecdhe[i];
+        if (slot->state != TRUSTM_ECDHE_PENDING)
+            continue;
+
+        return_status = trustmPoolWait(&slot->inst);
+        slot->state = (return_status == OPTIGA_LIB_SUCCESS) ? TRUSTM_ECDHE_READY :
+                                                              TRUSTM_ECDHE_EMPTY;
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            trustmPrintErrorCode(return_status);
+    }
+}
+
+/**********************************************************************
+* __trustm_ecdheHold()
+* Returns 1 while key pairs may be handed out and generated. After
+* TRUSTM_ENGINE_ECDHE_HOLD_MS no more are; once no handed out key waits
+* for its ECDH, the ready key pairs are dropped and the application is
+* closed, which releases the IPC lock. Key generations are queued again
+* TRUSTM_ENGINE_ECDHE_YIELD_MS later, other processes get the chip.
+**********************************************************************/
+static uint8_t __trustm_ecdheHold(uint64_t now)
+{
+    uint8_t i;
+
+    if (trustm_ecdheHeld == 0)
+        return (now >= trustm_ecdheYield);
+    if ((now - trustm_ecdheHeld) < TRUSTM_ENGINE_ECDHE_HOLD_MS)
+        return 1;
+
+    for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+    {
+        if (trustm_ecdhe[i].state == TRUSTM_ECDHE_INUSE)
+            return 0;
+    }
+
+    TRUSTM_ENGINE_DBGFN("release the chip for %d ms", TRUSTM_ENGINE_ECDHE_YIELD_MS);
+    if (trustm_ecdheArmed)
+    {
+        __trustm_ecdheCollect();
+        TRUSTM_WORKAROUND_TIMER_DISARM;
+        trustm_ecdheArmed = 0;
+    }
+    for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+        trustm_ecdhe[i].state = TRUSTM_ECDHE_EMPTY;
+    trustm_ctx.holdSession = 0;
+    if (trustm_ctx.appOpen == 1)
+        trustmEngine_App_Close();
+    trustm_ecdheHeld = 0;
+    trustm_ecdheYield = trustmNowMs() + TRUSTM_ENGINE_ECDHE_YIELD_MS;
+    return 0;
+}
+
+/**********************************************************************
+* trustmEngine_ecdheRefill()
+* Generate key pairs in the empty session contexts and wait for them,
+* also for the ones queued by trustmEngine_ecdhePoll(). The key
+* generations are queued on the slot instances together and then
+* collected. Call it while no handshake waits for the chip.
+* Returns the number of ready key pairs.
+**********************************************************************/
+int trustmEngine_ecdheRefill(void)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    uint8_t i;
+    int ready = 0;
+
+    TRUSTM_ENGINE_DBGFN(">");
+    for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+    {
+        if ((trustm_ecdhe[i].state == TRUSTM_ECDHE_EMPTY) ||
+            (trustm_ecdhe[i].state == TRUSTM_ECDHE_PENDING))
+            break;
+    }
+    if (i == trustm_ctx.ecdheSlots)
+    {
+        // Nothing to fill, keep off the chip
+        for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+            ready += (trustm_ecdhe[i].state == TRUSTM_ECDHE_READY);
+        return ready;
+    }
+
+    TRUSTM_WORKAROUND_TIMER_ARM;
+    TRUSTM_ENGINE_APP_OPEN;
+    if (return_status == OPTIGA_LIB_SUCCESS)
+    {
+        __trustm_ecdheQueue();
+        __trustm_ecdheCollect();
+    }
+    TRUSTM_ENGINE_APP_CLOSE;
+    TRUSTM_WORKAROUND_TIMER_DISARM;
+    trustm_ecdheArmed = 0;
+
+    for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+        ready += (trustm_ecdhe[i].state == TRUSTM_ECDHE_READY);
+
+    TRUSTM_ENGINE_DBGFN("< %d ready", ready);
+    return ready;
+}
+
+/**********************************************************************
+* trustmEngine_ecdhePoll()
+* Refill without waiting for the chip: collect the key generations
+* which completed and queue new ones in the empty session contexts.
+* The chip works on them while the caller serves its connections; a
+* handshake command is queued behind them and waits at most one key
+* generation per slot. A key generation not done after
+* TRUSTM_CMD_TIMEOUT_MS resets the chip, as a blocking wait does.
+* Also gives the chip to other processes, see __trustm_ecdheHold().
+* Returns 1 while key generations are pending, call it again then.
+**********************************************************************/
+int trustmEngine_ecdhePoll(void)
+{
+    optiga_lib_status_t return_status;
+    trustm_ecdhe_slot_t *slot;
+    uint64_t now;
+    uint8_t i;
+    uint8_t empty = 0;
+    uint8_t pending = 0;
+
+    now = trustmNowMs();
+    for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+    {
+        slot = &trustm_ecdhe[i];
+        if (slot->state == TRUSTM_ECDHE_PENDING)
+        {
+            if ((slot->inst.status == OPTIGA_LIB_BUSY) &&
+                ((now - slot->queued) < TRUSTM_CMD_TIMEOUT_MS))
+            {
+                pending++;
+                continue;
+            }
+
+            // No wait left, only the result or the reset on expiry.
+            // A failed slot is queued again at the next call
+            return_status = trustmPoolWaitMs(&slot->inst, 0);
+            slot->state = (return_status == OPTIGA_LIB_SUCCESS) ? TRUSTM_ECDHE_READY :
+                                                                  TRUSTM_ECDHE_EMPTY;
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                trustmPrintErrorCode(return_status);
+            continue;
+        }
+        empty += (slot->state == TRUSTM_ECDHE_EMPTY);
+    }
+
+    if ((empty != 0) && __trustm_ecdheHold(now))
+    {
+        // The workaround timer drives the host library until the key
+        // generations are collected. Armed again every time, a chip
+        // command in between disarms it
+        TRUSTM_WORKAROUND_TIMER_ARM;
+        trustm_ecdheArmed = 1;
+        return_status = OPTIGA_LIB_SUCCESS;
+        TRUSTM_ENGINE_APP_OPEN;
+        if (return_status == OPTIGA_LIB_SUCCESS)
+            __trustm_ecdheQueue();
+        TRUSTM_ENGINE_APP_CLOSE;
+
+        for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+            pending += (trustm_ecdhe[i].state == TRUSTM_ECDHE_PENDING);
+    }
+
+    if ((pending == 0) && trustm_ecdheArmed)
+    {
+        TRUSTM_WORKAROUND_TIMER_DISARM;
+        trustm_ecdheArmed = 0;
+    }
+
+    TRUSTM_ENGINE_DBGFN("< %d pending", pending);
+    return (pending != 0);
+}
+
+/**********************************************************************
+* trustmEngine_ecdhePool()
+* Use <count> session contexts for ephemeral keys, 0 stops. The
+* session contexts only live while the application is open, so the
+* engine holds the chip from now on. The access layer instance pool
+* gives its instances to the slots, the host library has no more.
+* Returns 1 on success.
+**********************************************************************/
+int trustmEngine_ecdhePool(long count)
+{
+    uint8_t i;
+
+    TRUSTM_ENGINE_DBGFN("> %ld", count);
+    if ((count < 0) || (count > TRUSTM_ENGINE_ECDHE_MAX))
+    {
+        TRUSTM_ENGINE_ERRFN("Session contexts 0 to %d", TRUSTM_ENGINE_ECDHE_MAX);
+        return TRUSTM_ENGINE_FAIL;
+    }
+
+    // Release the current slots, the session contexts go with the instances.
+    // Key generations still queued are collected first
+    if (trustm_ecdheArmed)
+    {
+        __trustm_ecdheCollect();
+        TRUSTM_WORKAROUND_TIMER_DISARM;
+        trustm_ecdheArmed = 0;
+    }
+    for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+    {
+        optiga_crypt_destroy(trustm_ecdhe[i].inst.crypt);
+        memset(&trustm_ecdhe[i], 0, sizeof(trustm_ecdhe_slot_t));
+    }
+    if (trustm_ctx.ecdheSlots != 0)
+        trustmPoolCreate();
+    trustm_ctx.ecdheSlots = 0;
+
+    trustm_ecdheHeld = 0;
+    trustm_ecdheYield = 0;
+
+    if (count == 0)
+    {
+        trustm_ctx.holdSession = 0;
+        if (trustm_ctx.appOpen == 1)
+            trustmEngine_App_Close();
+        return TRUSTM_ENGINE_SUCCESS;
+    }
+
+    trustmPoolDestroy();
+    for (i = 0; i < count; i++)
+    {
+        trustm_ecdhe[i].inst.crypt = optiga_crypt_create(0, __trustm_ecdheCallback, &trustm_ecdhe[i].inst);
+        if (trustm_ecdhe[i].inst.crypt == NULL)
+            break;
+        trustm_ecdhe[i].inst.inUse = 1;
+        trustm_ecdhe[i].state = TRUSTM_ECDHE_EMPTY;
+    }
+    trustm_ctx.ecdheSlots = i;
+    if (i == 0)
+    {
+        TRUSTM_ENGINE_ERRFN("No crypt instance for the session contexts");
+        trustmPoolCreate();
+        return TRUSTM_ENGINE_FAIL;
+    }
+
+    trustmEngine_ecdheRefill();
+    TRUSTM_ENGINE_DBGFN("< %d slots", trustm_ctx.ecdheSlots);
+    return TRUSTM_ENGINE_SUCCESS;
+}
+
+/**********************************************************************
+* trustmEngine_ecdheHandshake()
+* Mark the EC key generations from now on as TLS key shares (on = 1),
+* e.g. while the server runs its handshakes, or not (on = 0).
+**********************************************************************/
+void trustmEngine_ecdheHandshake(long on)
+{
+    trustm_ecdheHandshake = (on != 0);
+}
+
+/**********************************************************************
+* __trustm_ecdheKeygen()
+* EC key generation. A TLS key share (see ECDHE_HANDSHAKE) takes a ready
+* key pair of the curve from a session context, else the key is
+* generated in software; the chip never generates on the handshake path.
+* Any other key is a software key: a session context key has no private
+* key on the host and does one ECDH only.
+**********************************************************************/
+static int __trustm_ecdheKeygen(EC_KEY *key)
+{
+    optiga_ecc_curve_t curve;
+    uint8_t i;
+
+    curve = __trustm_ecdheGetCurve(key);
+    if ((trustm_ctx.ecdheSlots != 0) && (curve != 0) && trustm_ecdheHandshake &&
+        __trustm_ecdheHold(trustmNowMs()))
+    {
+        for (i = 0; i < trustm_ctx.ecdheSlots; i++)
+        {
+            if ((trustm_ecdhe[i].state == TRUSTM_ECDHE_READY) && (trustm_ecdhe[i].curve == curve))
+                break;
+        }
+        if ((i < trustm_ctx.ecdheSlots) && __trustm_ecdheSetKey(key, i))
+        {
+            TRUSTM_ENGINE_DBGFN("key share from slot %d", i);
+            return 1;
+        }
+
+        // Refill with the curve in demand
+        trustm_ecdheCurve = curve;
+        TRUSTM_ENGINE_DBGFN("no ready key pair, software key");
+    }
+
+    return trustm_ecdheOrigKeygen(key);
+}
+
+/**********************************************************************
+* __trustm_ecdheCompute()
+* ECDH with the private key in the session context. The shared secret
+* is exported to the host, the session context is empty afterwards.
+**********************************************************************/
+static int __trustm_ecdheCompute(unsigned char **psec, size_t *pseclen,
+                                 const EC_POINT *pub_key, const EC_KEY *ecdh)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    public_key_from_host_t peer_public_key;
+    trustm_ecdhe_slot_t *slot;
+    const EC_GROUP *group;
+    uint8_t peer[TRUSTM_ECDHE_PUBKEY_LEN];
+    uint8_t secret[48];
+    size_t len;
+    size_t secretLen;
+    int ret = 0;
+
+    slot = __trustm_ecdheGetSlot(ecdh);
+    if (slot == NULL)
+        return trustm_ecdheOrigCompute(psec, pseclen, pub_key, ecdh);
+
+    TRUSTM_ENGINE_DBGFN(">");
+    do
+    {
+        if (slot->state != TRUSTM_ECDHE_INUSE)
+        {
+            TRUSTM_ENGINE_ERRFN("Session key already used");
+            break;
+        }
+        slot->state = TRUSTM_ECDHE_EMPTY;
+
+        // Peer key as BIT STRING, like the chip returns its own
+        group = EC_KEY_get0_group(ecdh);
+        len = EC_POINT_point2oct(group, pub_key, POINT_CONVERSION_UNCOMPRESSED,
+                                 &peer[3], sizeof(peer) - 3, NULL);
+        if (len == 0)
+            break;
+        peer[0] = 0x03;
+        peer[1] = (uint8_t)(len + 1);
+        peer[2] = 0x00;
+        peer_public_key.public_key = peer;
+        peer_public_key.length = (uint16_t)(len + 3);
+        peer_public_key.key_type = (uint8_t)slot->curve;
+        secretLen = (EC_GROUP_get_degree(group) + 7) / 8;
+
+        TRUSTM_WORKAROUND_TIMER_ARM;
+        TRUSTM_ENGINE_APP_OPEN;
+        if (return_status == OPTIGA_LIB_SUCCESS)
+        {
+            slot->inst.status = OPTIGA_LIB_BUSY;
+            return_status = optiga_crypt_ecdh(slot->inst.crypt,
+                                              OPTIGA_KEY_ID_SESSION_BASED,
+                                              &peer_public_key,
+                                              TRUE,
+                                              secret);
+            if (return_status == OPTIGA_LIB_SUCCESS)
+                return_status = trustmPoolWait(&slot->inst);
+        }
+        TRUSTM_ENGINE_APP_CLOSE;
+        TRUSTM_WORKAROUND_TIMER_DISARM;
+
+        // A server never idle releases the chip here
+        __trustm_ecdheHold(trustmNowMs());
+
+        if (return_status != OPTIGA_LIB_SUCCESS)
+        {
+            trustmPrintErrorCode(return_status);
+            break;
+        }
+
+        *psec = OPENSSL_malloc(secretLen);
+        if (*psec == NULL)
+            break;
+        memcpy(*psec, secret, secretLen);
+        *pseclen = secretLen;
+        ret = 1;
+    } while (FALSE);
+
+    OPENSSL_cleanse(secret, sizeof(secret));
+    TRUSTM_ENGINE_DBGFN("<");
+    return ret;
+}
+
+// A key copy must not use the session context a second time.
+// OpenSSL 3 passes from_d as void **, 1.1.1 as void * to the same pointer.
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int __trustm_ecdheDup(CRYPTO_EX_DATA *to, const CRYPTO_EX_DATA *from,
+                             void **from_d, int idx, long argl, void *argp)
+#else
+static int __trustm_ecdheDup(CRYPTO_EX_DATA *to, const CRYPTO_EX_DATA *from,
+                             void *from_d, int idx, long argl, void *argp)
+#endif
+{
+    *(void **)from_d = NULL;
+    return 1;
+}
+
+// A key freed before its ECDH gives the session context back
+static void __trustm_ecdheFree(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+                               int idx, long argl, void *argp)
+{
+    uintptr_t slot = (uintptr_t)ptr;
+
+    if ((slot != 0) && (slot <= trustm_ctx.ecdheSlots) &&
+        (trustm_ecdhe[slot-1].state == TRUSTM_ECDHE_INUSE))
+        trustm_ecdhe[slot-1].state = TRUSTM_ECDHE_EMPTY;
+}
+
+/**********************************************************************
+* trustm_ec_loadkeyE100()
+* Key pair in the session context of trustm_ctx.key_oid (0xE100 to
+* 0xE103 stand for the slots of the ECDHE_POOL command). The EVP_PKEY
+* does one ECDH on the chip.
+**********************************************************************/
+EVP_PKEY *trustm_ec_loadkeyE100(void)
+{
+    EVP_PKEY *key = NULL;
+    EC_KEY *ec = NULL;
+    uint8_t slot;
+
+    TRUSTM_ENGINE_DBGFN(">");
+    do
+    {
+        slot = trustm_ctx.key_oid - TRUSTM_ENGINE_ECDHE_OID;
+        if (slot >= trustm_ctx.ecdheSlots)
+        {
+            TRUSTM_ENGINE_ERRFN("0x%.4X needs ECDHE_POOL %d or more", trustm_ctx.key_oid, slot + 1);
+            break;
+        }
+
+        // A key generation still queued on the slot is collected first
+        if (trustm_ecdhe[slot].state == TRUSTM_ECDHE_PENDING)
+            trustmEngine_ecdheRefill();
+        if ((trustm_ecdhe[slot].state == TRUSTM_ECDHE_READY) &&
+            (trustm_ecdhe[slot].curve != trustm_ctx.ec_key_curve))
+            trustm_ecdhe[slot].state = TRUSTM_ECDHE_EMPTY;
+        if (trustm_ecdhe[slot].state != TRUSTM_ECDHE_READY)
+        {
+            trustm_ecdhe[slot].state = TRUSTM_ECDHE_EMPTY;
+            trustm_ecdheCurve = trustm_ctx.ec_key_curve;
+            trustmEngine_ecdheRefill();
+            if (trustm_ecdhe[slot].state != TRUSTM_ECDHE_READY)
+                break;
+        }
+
+        ec = EC_KEY_new_by_curve_name((trustm_ecdhe[slot].curve == OPTIGA_ECC_CURVE_NIST_P_384) ?
+                                      NID_secp384r1 : NID_X9_62_prime256v1);
+        if ((ec == NULL) ||
+            !EC_KEY_set_method(ec, trustm_ctx.ec_key_method) ||
+            !__trustm_ecdheSetKey(ec, slot))
+            break;
+
+        key = EVP_PKEY_new();
+        if ((key == NULL) || !EVP_PKEY_assign_EC_KEY(key, ec))
+        {
+            EVP_PKEY_free(key);
+            key = NULL;
+            break;
+        }
+        ec = NULL;
+    } while (FALSE);
+
+    EC_KEY_free(ec);
+    TRUSTM_ENGINE_DBGFN("<");
+    return key;
+}
+
+/*
+ * Hook the session contexts into the engine EC_KEY method.
+ * Return 1 on success, otherwise 0.
+ */
+uint16_t trustmEngine_init_ecdhe(EC_KEY_METHOD *method)
+{
+    int (*orig_keygen)(EC_KEY *key) = NULL;
+    int (*orig_compute)(unsigned char **psec, size_t *pseclen,
+                        const EC_POINT *pub_key, const EC_KEY *ecdh) = NULL;
+
+    TRUSTM_ENGINE_DBGFN(">");
+    if (trustm_ecdheIdx < 0)
+        trustm_ecdheIdx = EC_KEY_get_ex_new_index(0, NULL, NULL, __trustm_ecdheDup, __trustm_ecdheFree);
+    if (trustm_ecdheIdx < 0)
+        return TRUSTM_ENGINE_FAIL;
+
+    EC_KEY_METHOD_get_keygen(method, &orig_keygen);
+    EC_KEY_METHOD_get_compute_key(method, &orig_compute);
+    trustm_ecdheOrigKeygen = orig_keygen;
+    trustm_ecdheOrigCompute = orig_compute;
+    EC_KEY_METHOD_set_keygen(method, __trustm_ecdheKeygen);
+    EC_KEY_METHOD_set_compute_key(method, __trustm_ecdheCompute);
+
+    TRUSTM_ENGINE_DBGFN("<");
+    return TRUSTM_ENGINE_SUCCESS;
+}
@@ -24,6 +24,7 @@
 */
 #include <string.h>
 #include <openssl/engine.h>
+#include <openssl/rand.h>
 
 #include "trustm_helper.h"
 
@@ -74,6 +75,24 @@ uint16_t trustmEngine_init_rand(ENGINE *e)
     
 }
 
+/** Serve a random request from the OpenSSL default DRBG
+ * when the chip is not acquired in time.
+ * @param buf The buffer to write the random values to
+ * @param num The amound of random bytes to generate
+ * @retval 1 on success
+ * @retval 0 on failure
+ */
+static int trustmEngine_getrandomFallback(unsigned char *buf, int num)
+{
+    const RAND_METHOD *meth;
+
+    meth = RAND_OpenSSL();
+    if ((meth == NULL) || (meth->bytes == NULL))
+        return TRUSTM_ENGINE_FAIL;
+
+    return meth->bytes(buf, num);
+}
+
 /** Genereate random values
  * @param buf The buffer to write the random values to
  * @param num The amound of random bytes to generate
@@ -84,7 +103,7 @@ static int trustmEngine_getrandom(unsigned char *buf, int num)
 {
     #define MAX_RAND_INPUT 256
     
-    optiga_lib_status_t return_status;
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
     int i,j,k;
     uint8_t tempbuf[MAX_RAND_INPUT];    
     int ret = TRUSTM_ENGINE_FAIL;
@@ -95,22 +114,38 @@ static int trustmEngine_getrandom(unsigned char *buf, int num)
     j = (num - i)/MAX_RAND_INPUT; // Get the count 
 
     TRUSTM_WORKAROUND_TIMER_ARM; 
-    TRUSTM_ENGINE_APP_OPEN_RET(ret,TRUSTM_ENGINE_FAIL);
+    TRUSTM_ENGINE_APP_OPEN;
+    if (return_status == TRUSTM_ACCESS_ERROR_DEADLINE)
+    {
+        TRUSTM_WORKAROUND_TIMER_DISARM;
+        if (trustm_ctx.randFallback == 0)
+        {
+            trustmPrintErrorCode(return_status);
+            memset(buf, 0, num);
+            return TRUSTM_ENGINE_FAIL;
+        }
+        TRUSTM_ENGINE_DBGFN("Chip busy, use software DRBG");
+        trustmRecordFallback();
+        return trustmEngine_getrandomFallback(buf, num);
+    }
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        TRUSTM_WORKAROUND_TIMER_DISARM;
+        TRUSTM_ENGINE_ERRFN("Fail to open trustM!!");
+        trustmPrintErrorCode(return_status);
+        return TRUSTM_ENGINE_FAIL;
+    }
+
     do 
     {   
         k = 0;
         if(i > 0)  
         {
-            optiga_lib_status = OPTIGA_LIB_BUSY;
-            return_status = optiga_crypt_random(me_crypt, 
+            TRUSTM_REPLAY(return_status, ,
+                          optiga_crypt_random(me_crypt, 
                                 OPTIGA_RNG_TYPE_TRNG, 
                                 tempbuf,
-                                MAX_RAND_INPUT);
-            if (OPTIGA_LIB_SUCCESS != return_status)
-                break;			
-            //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+                                MAX_RAND_INPUT));
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
 
@@ -122,20 +157,17 @@ static int trustmEngine_getrandom(unsigned char *buf, int num)
 
         for(;j>0;j--)  
         {
-            optiga_lib_status = OPTIGA_LIB_BUSY;
-            return_status = optiga_crypt_random(me_crypt, 
+            TRUSTM_REPLAY(return_status, ,
+                          optiga_crypt_random(me_crypt, 
                                 OPTIGA_RNG_TYPE_TRNG, 
                                 (buf+k),
-                                MAX_RAND_INPUT);
-            if (OPTIGA_LIB_SUCCESS != return_status)
-                break;			
-            //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+                                MAX_RAND_INPUT));
             if (return_status != OPTIGA_LIB_SUCCESS)
                 break;
             k += (MAX_RAND_INPUT);
         }
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
 
         ret = TRUSTM_ENGINE_SUCCESS;
     }while(FALSE);
@@ -132,8 +132,7 @@ static EVP_PKEY *trustm_rsa_generatekey(void)
             break;
         //Wait until the optiga_util_read_metadata operation is completed
         printf("Please wait generating RSA key .......\n");
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+        return_status = trustmWaitCompletionMs(TRUSTM_CMD_TIMEOUT_LONG_MS);
         if (return_status != OPTIGA_LIB_SUCCESS)
             break;
 
@@ -153,8 +152,7 @@ static EVP_PKEY *trustm_rsa_generatekey(void)
             if (OPTIGA_LIB_SUCCESS != return_status)
             break;
             //Wait until the optiga_util_read_metadata operation is completed
-            while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-            return_status = optiga_lib_status;
+            return_status = trustmWaitCompletion();
             if (return_status != OPTIGA_LIB_SUCCESS)
             break;
             else
@@ -246,6 +244,7 @@ static int trustmEngine_rsa_priv_enc(int flen,
 {
     int ret = TRUSTM_ENGINE_FAIL;
     optiga_lib_status_t return_status;
+    trustm_inst_t *inst;
     uint16_t templen = 500;
 
     TRUSTM_ENGINE_DBGFN(">");
@@ -256,28 +255,27 @@ static int trustmEngine_rsa_priv_enc(int flen,
     trustmHexDump((uint8_t *)from,flen);
     TRUSTM_WORKAROUND_TIMER_ARM;
     TRUSTM_ENGINE_APP_OPEN_RET(ret,TRUSTM_ENGINE_FAIL);
+    // Signatures go to a pool instance, apart from the me_util reads
+    inst = trustmPoolGet();
     do
     {
-        optiga_lib_status = OPTIGA_LIB_BUSY;
-        return_status = optiga_crypt_rsa_sign(me_crypt,
+        TRUSTM_POOL_REPLAY(return_status, inst,
+                      templen = 500,
+                      optiga_crypt_rsa_sign(TRUSTM_POOL_CRYPT(inst),
                               trustm_ctx.rsa_key_sig_scheme,
                               (uint8_t *)from,
                               flen,
                               trustm_ctx.key_oid,
                               to,
                               &templen,
-                              0x0000);
-        if (OPTIGA_LIB_SUCCESS != return_status)
-            break;
-        //Wait until the optiga_util_read_metadata operation is completed
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+                              0x0000));
         if (return_status != OPTIGA_LIB_SUCCESS)
             break;
 
         TRUSTM_ENGINE_DBGFN("to len : %d",templen);
         ret = templen;
     }while(FALSE);
+    trustmPoolPut(inst);
     TRUSTM_ENGINE_APP_CLOSE;
     TRUSTM_WORKAROUND_TIMER_DISARM;
     // Capture OPTIGA Error
@@ -332,8 +330,7 @@ static int trustmEngine_rsa_priv_dec(int flen,
         if (OPTIGA_LIB_SUCCESS != return_status)
             break;
         //Wait until the optiga_util_read_metadata operation is completed
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+        return_status = trustmWaitCompletion();
         if (return_status != OPTIGA_LIB_SUCCESS)
             break;
 
@@ -413,8 +410,7 @@ static int trustmEngine_rsa_pub_enc(int flen,
         if (OPTIGA_LIB_SUCCESS != return_status)
             break;
         //Wait until the optiga_util_read_metadata operation is completed
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+        return_status = trustmWaitCompletion();
         if (return_status != OPTIGA_LIB_SUCCESS)
             break;
 
@@ -473,6 +469,7 @@ static int trustmEngine_rsa_sign(int type,
 {
     int ret = TRUSTM_ENGINE_FAIL;
     optiga_lib_status_t return_status;
+    trustm_inst_t *inst;
     uint16_t key_oid;
     uint16_t templen = 500;
 
@@ -484,29 +481,28 @@ static int trustmEngine_rsa_sign(int type,
 
     TRUSTM_WORKAROUND_TIMER_ARM;
     TRUSTM_ENGINE_APP_OPEN_RET(ret,TRUSTM_ENGINE_FAIL);
+    // Signatures go to a pool instance, apart from the me_util reads
+    inst = trustmPoolGet();
     do
     {
         key_oid = trustm_ctx.key_oid;
-        optiga_lib_status = OPTIGA_LIB_BUSY;
-        return_status = optiga_crypt_rsa_sign(me_crypt,
+        TRUSTM_POOL_REPLAY(return_status, inst,
+                      templen = 500,
+                      optiga_crypt_rsa_sign(TRUSTM_POOL_CRYPT(inst),
                               trustm_ctx.rsa_key_sig_scheme,
                               (uint8_t *)m,
                               m_length,
                               key_oid,
                               sigret,
                               &templen,
-                              0x0000);
-        if (OPTIGA_LIB_SUCCESS != return_status)
-            break;
-        //Wait until the optiga_util_read_metadata operation is completed
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+                              0x0000));
         if (return_status != OPTIGA_LIB_SUCCESS)
             break;
 
         *siglen = templen;
         ret = TRUSTM_ENGINE_SUCCESS;
     }while(FALSE);
+    trustmPoolPut(inst);
     TRUSTM_ENGINE_APP_CLOSE;
     TRUSTM_WORKAROUND_TIMER_DISARM;
 
@@ -574,8 +570,7 @@ int trustmEngine_rsa_verify(int dtype,
         if (OPTIGA_LIB_SUCCESS != return_status)
             break;
         //Wait until the optiga_util_read_metadata operation is completed
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+        return_status = trustmWaitCompletion();
         if (return_status != OPTIGA_LIB_SUCCESS)
             break;
 
@@ -0,0 +1,191 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#ifndef _TRUSTM_ACCESS_H_
+#define _TRUSTM_ACCESS_H_
+
+#include <stdint.h>
+
+#include "optiga_util.h"
+#include "optiga_crypt.h"
+
+// Shared memory key for the access layer state (next to the IPC queue key)
+#define TRUSTM_SHARED_KEY           0x11111124
+#define TRUSTM_SHARED_MAGIC         0x54524D31
+
+// Security Event Counter (0xE0C5) governor settings.
+// The chip delays commands once the counter rises, and decrements it by one
+// every credit period. Override the defaults with -D at build time.
+#ifndef TRUSTM_GOV_SEC_THRESHOLD
+#define TRUSTM_GOV_SEC_THRESHOLD    4       // highest counter level we let the chip reach
+#endif
+#ifndef TRUSTM_GOV_SEC_DECAY_MS
+#define TRUSTM_GOV_SEC_DECAY_MS     1000    // time for the chip to decrement the counter by one
+#endif
+#ifndef TRUSTM_GOV_SYNC_MS
+#define TRUSTM_GOV_SYNC_MS          1000    // minimum time between two 0xE0C5 reads
+#endif
+#ifndef TRUSTM_GOV_MAX_DELAY_MS
+#define TRUSTM_GOV_MAX_DELAY_MS     5000    // upper bound for a single pacing delay
+#endif
+
+// Command watchdog settings. A command not completed within its deadline
+// is treated as a hang: the chip is reset and the application re-opened.
+#ifndef TRUSTM_CMD_TIMEOUT_MS
+#define TRUSTM_CMD_TIMEOUT_MS       5000    // default deadline for a single command
+#endif
+#ifndef TRUSTM_CMD_TIMEOUT_LONG_MS
+#define TRUSTM_CMD_TIMEOUT_LONG_MS  60000   // deadline for key generation
+#endif
+#ifndef TRUSTM_RESET_LOW_MS
+#define TRUSTM_RESET_LOW_MS         10      // time the reset/vdd line is held low
+#endif
+#ifndef TRUSTM_RESET_SETTLE_MS
+#define TRUSTM_RESET_SETTLE_MS      500     // time for the host library to fail the hung command
+#endif
+#ifndef TRUSTM_REPLAY_MAX
+#define TRUSTM_REPLAY_MAX           1       // replays of an idempotent command after a reset
+#endif
+
+// Instance pool. Every slot is a util/crypt pair with its own callback
+// context, so independent commands can be queued in the host library
+// together. The host library registers OPTIGA_CMD_MAX_REGISTRATIONS (6)
+// instances, me_util/me_crypt use two of them.
+#ifndef TRUSTM_POOL_SIZE
+#define TRUSTM_POOL_SIZE            2
+#endif
+
+// Access layer error codes
+#define TRUSTM_ACCESS_ERROR             0x0F02
+#define TRUSTM_ACCESS_ERROR_TIMEOUT     0x0F03
+#define TRUSTM_ACCESS_ERROR_DEADLINE    0x0F04
+
+// Predicted counter increment per event
+#define TRUSTM_GOV_COST_SESSION     0       // open application
+#define TRUSTM_GOV_COST_SHIELDED    1       // shielded connection handshake, once per session
+#define TRUSTM_GOV_COST_FAIL        1       // command rejected by the chip
+
+// Enable shielded connection, paced by the governor
+#define TRUSTM_UTIL_SHIELDED(p)     { trustmGovernorShielded(); \
+                                      OPTIGA_UTIL_SET_COMMS_PROTOCOL_VERSION(p, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET); \
+                                      OPTIGA_UTIL_SET_COMMS_PROTECTION_LEVEL(p, OPTIGA_COMMS_FULL_PROTECTION); }
+
+#define TRUSTM_CRYPT_SHIELDED(p)    { trustmGovernorShielded(); \
+                                      OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(p, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET); \
+                                      OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(p, OPTIGA_COMMS_FULL_PROTECTION); }
+
+// Issue an idempotent command (read, sign, random) and wait for it.
+// After a watchdog reset the command is replayed, setup is executed
+// before every attempt (e.g. shielded connection, output length).
+#define TRUSTM_REPLAY(status, setup, call) \
+                                    { uint8_t __replay = 0; \
+                                      do { setup; \
+                                           optiga_lib_status = OPTIGA_LIB_BUSY; \
+                                           status = call; \
+                                           if (OPTIGA_LIB_SUCCESS == status) \
+                                               status = trustmWaitCompletion(); \
+                                      } while (trustmReplay(status, &__replay)); }
+
+// TRUSTM_REPLAY on the pool instance inst, on me_util/me_crypt if inst is
+// NULL (no free instance). call takes TRUSTM_POOL_UTIL(inst) or
+// TRUSTM_POOL_CRYPT(inst).
+#define TRUSTM_POOL_UTIL(inst)      (((inst) != NULL) ? (inst)->util : me_util)
+#define TRUSTM_POOL_CRYPT(inst)     (((inst) != NULL) ? (inst)->crypt : me_crypt)
+#define TRUSTM_POOL_REPLAY(ret, inst, setup, call) \
+                                    { uint8_t __replay = 0; \
+                                      do { setup; \
+                                           if ((inst) != NULL) \
+                                               (inst)->status = OPTIGA_LIB_BUSY; \
+                                           else \
+                                               optiga_lib_status = OPTIGA_LIB_BUSY; \
+                                           ret = call; \
+                                           if (OPTIGA_LIB_SUCCESS == ret) \
+                                               ret = ((inst) != NULL) ? trustmPoolWait(inst) : \
+                                                                        trustmWaitCompletion(); \
+                                      } while (((inst) != NULL) ? trustmPoolReplay((inst), ret, &__replay) : \
+                                                                  trustmReplay(ret, &__replay)); }
+
+// ********** typedef
+typedef struct trustm_stats_str
+{
+    uint32_t  secCnt;           // last Security Event Counter read from 0xE0C5
+    uint32_t  secCntMax;        // highest Security Event Counter read
+    uint32_t  secCntRead;       // number of 0xE0C5 reads
+    uint32_t  secEst;           // governor estimate of the counter
+    uint32_t  opCount;          // completed chip operations
+    uint32_t  opFail;           // chip operations completed with error
+    uint32_t  govPaced;         // operations delayed by the governor
+    uint32_t  govCancel;        // predicted throttles cancelled by a 0xE0C5 read
+    uint64_t  govDelayMs;       // total time spent pacing
+    uint32_t  cmdTimeout;       // commands not completed within the deadline
+    uint32_t  chipReset;        // chip resets done by the watchdog
+    uint32_t  chipResetFail;    // chip resets which did not recover the chip
+    uint32_t  cmdReplay;        // idempotent commands replayed after a reset
+    uint32_t  deadlineMiss;     // chip not acquired within the caller deadline
+    uint32_t  randFallback;     // random requests served by the software DRBG
+    uint32_t  poolPeak;         // most pool instances in use at the same time
+    uint64_t  busyUs;           // time spent waiting for chip commands
+} trustm_stats_t;
+
+typedef struct trustm_inst_str
+{
+    optiga_util_t                   *util;
+    optiga_crypt_t                  *crypt;
+    volatile optiga_lib_status_t    status;     // set by the instance callback
+    uint8_t                         inUse;
+    uint8_t                         recovered;  // last timeout on this instance recovered by a reset
+} trustm_inst_t;
+
+// Function Prototype
+uint64_t trustmNowMs(void);
+uint64_t trustmNowUs(void);
+void trustmSortSamples(uint64_t *sample, uint32_t count);
+uint64_t trustmPercentile(const uint64_t *sample, uint32_t count, uint32_t p);
+
+optiga_lib_status_t trustmWaitCompletion(void);
+optiga_lib_status_t trustmWaitCompletionMs(uint32_t timeout);
+optiga_lib_status_t trustmResetChip(void);
+uint8_t trustmReplay(optiga_lib_status_t status, uint8_t *replay);
+uint8_t trustmPoolReplay(trustm_inst_t *inst, optiga_lib_status_t status, uint8_t *replay);
+
+uint8_t trustmReadSecCnt(void);
+void trustmGovernorPace(uint8_t cost);
+void trustmGovernorOpen(void);
+void trustmGovernorShielded(void);
+void trustmGovernorRecord(optiga_lib_status_t status);
+void trustmRecordDeadline(void);
+void trustmRecordFallback(void);
+
+uint8_t trustmPoolCreate(void);
+void trustmPoolDestroy(void);
+trustm_inst_t * trustmPoolGet(void);
+void trustmPoolPut(trustm_inst_t *inst);
+optiga_lib_status_t trustmPoolWait(trustm_inst_t *inst);
+optiga_lib_status_t trustmPoolWaitMs(trustm_inst_t *inst, uint32_t timeout);
+
+void trustmGetStats(trustm_stats_t *stats);
+void trustmClearStats(void);
+void trustmPrintStats(void);
+
+#endif  // _TRUSTM_ACCESS_H_
@@ -0,0 +1,104 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#ifndef _TRUSTM_BATCH_H_
+#define _TRUSTM_BATCH_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <openssl/evp.h>
+
+#include "optiga_lib_common.h"
+
+// Batch of files handled by a CLI tool in one chip session. Host threads
+// work on the items in parallel (hash, verify), the tool takes finished
+// items in list order, e.g. to sign them on the chip meanwhile.
+// A list has one file name per line. A manifest line holds a signature
+// in hex, two spaces and the file name, as written by the sign tools.
+// Empty lines and lines starting with '#' are skipped.
+#define TRUSTM_BATCH_DIGEST_MAX     64      // same as TRUSTM_HASH_MAX
+#define TRUSTM_BATCH_SIG_MAX        512     // largest signature in a manifest
+#define TRUSTM_BATCH_THREADS_MAX    64
+
+// Item status of trustmBatchVerify
+#define TRUSTM_BATCH_OK             0
+#define TRUSTM_BATCH_ERROR          1       // file not readable
+#define TRUSTM_BATCH_INVALID        2       // signature does not match
+
+// ********** typedef
+typedef struct trustm_batch_item_str
+{
+    char        *file;
+    uint8_t     digest[TRUSTM_BATCH_DIGEST_MAX];
+    uint16_t    digestLen;
+    uint8_t     sig[TRUSTM_BATCH_SIG_MAX];  // from the manifest
+    uint16_t    sigLen;
+    uint16_t    status;                     // result of the work function, 0 on success
+    uint8_t     done;                       // work finished, guarded by the batch lock
+} trustm_batch_item_t;
+
+// Work on one item in a host thread, returns 0 on success
+typedef uint16_t (*trustm_batch_fn)(trustm_batch_item_t *item, void *ctx);
+
+typedef struct trustm_batch_str
+{
+    trustm_batch_item_t *item;
+    uint32_t            count;
+    uint32_t            next;               // next item for a thread
+    trustm_batch_fn     work;
+    void                *ctx;
+    pthread_t           thread[TRUSTM_BATCH_THREADS_MAX];
+    uint16_t            threads;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+} trustm_batch_t;
+
+// Key shared read-only by the trustmBatchVerify threads
+typedef struct trustm_batch_key_str
+{
+    EVP_PKEY            *pkey;
+    const EVP_MD        *md;
+} trustm_batch_key_t;
+
+// Function Prototype
+uint16_t trustmBatchLoad(trustm_batch_t *batch, const char *listFile, uint8_t manifest);
+uint16_t trustmBatchStart(trustm_batch_t *batch, trustm_batch_fn work, void *ctx, uint16_t threads);
+trustm_batch_item_t *trustmBatchWait(trustm_batch_t *batch, uint32_t index);
+void trustmBatchFree(trustm_batch_t *batch);
+
+uint16_t trustmBatchHash(trustm_batch_item_t *item, void *ctx);
+void trustmBatchWriteManifest(FILE *fp, const uint8_t *sig, uint16_t sigLen, const char *file);
+uint32_t trustmBatchSign(optiga_key_id_t keyId, int keyType, const char *listFile,
+                         const char *manifestFile, uint16_t threads, uint8_t bypass);
+
+EVP_PKEY *trustmBatchKeyParse(const uint8_t *data, uint16_t len);
+EVP_PKEY *trustmBatchKeyRead(const char *pemFile);
+uint16_t trustmBatchVerify(trustm_batch_item_t *item, void *ctx);
+uint32_t trustmBatchVerifyManifest(uint16_t oid, const char *pubkeyFile, int keyType,
+                                   uint16_t hashBits, const char *manifestFile,
+                                   uint16_t threads, uint8_t bypass);
+
+#endif  // _TRUSTM_BATCH_H_
@@ -0,0 +1,58 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#ifndef _TRUSTM_CACHE_H_
+#define _TRUSTM_CACHE_H_
+
+#include <stdint.h>
+
+#include "optiga_lib_common.h"
+
+// Read-through cache of immutable chip objects, shared by all processes.
+// An object is cached when its metadata locks it for good: change access
+// NEV, or LcsO < operational with the object in operational state. Data
+// objects must be readable always (ALW) as well, the cache holds no
+// object a process could not read from the chip. Entries are kept per
+// chip UID and checked against the metadata read from the chip, /run is
+// emptied at every boot. A data object found mutable is marked as such
+// and read from the chip without the metadata read until
+// trustmCacheForget() drops the mark.
+#ifndef TRUSTM_CACHE_DIR
+#define TRUSTM_CACHE_DIR            "/run/trustm"
+#endif
+#define TRUSTM_CACHE_ENV            "TRUSTM_CACHE"  // "0" bypasses the cache
+#define TRUSTM_CACHE_UID_OID        0xE0C2
+#define TRUSTM_CACHE_UID_LEN        27
+#define TRUSTM_CACHE_METADATA_MAX   64
+#define TRUSTM_CACHE_DATA_MAX       1728    // largest data object
+
+// Function Prototype
+uint8_t trustmCacheImmutable(const uint8_t *metadata, uint16_t len, uint8_t data);
+
+optiga_lib_status_t trustmCacheReadUID(uint8_t *uid, uint16_t *len);
+optiga_lib_status_t trustmCacheReadMetadata(uint16_t oid, uint8_t *buf, uint16_t *len);
+optiga_lib_status_t trustmCacheReadData(uint16_t oid, uint16_t offset, uint8_t *buf, uint16_t *len);
+void trustmCacheForget(uint16_t oid);
+
+#endif  // _TRUSTM_CACHE_H_
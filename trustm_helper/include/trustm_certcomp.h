@@ -0,0 +1,51 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#ifndef _TRUSTM_CERTCOMP_H_
+#define _TRUSTM_CERTCOMP_H_
+
+#include <stdint.h>
+
+#include <openssl/x509.h>
+
+// Compressed certificate container. Fewer bytes in the data object means
+// fewer I2C frames on every read, the certificate is inflated on the host.
+// The layout follows the CompressedCertificate message of RFC 8879:
+//   tag (1) | algorithm (1) | uncompressed length (3) | compressed data
+// The tag is outside the DER (0x30) and identity (0xC0, 0xC2) formats, so
+// readers tell the formats apart by the first byte. The chip does not parse
+// the container, keep certificates the chip reads in DER, see
+// trustmCertChipOid().
+#define TRUSTM_CERTCOMP_TAG         0xCF
+#define TRUSTM_CERTCOMP_HDR_LEN     5
+#define TRUSTM_CERTCOMP_ZLIB        0x01    // RFC 8879 CertificateCompressionAlgorithm
+#define TRUSTM_CERTCOMP_BROTLI      0x02    // reserved, not supported
+#define TRUSTM_CERTCOMP_MAX_LEN     4096    // largest inflated certificate
+
+// Function Prototype
+uint16_t trustmCertCompress(const uint8_t *der, uint16_t derLen, uint8_t *obj, uint16_t *objLen);
+uint16_t trustmCertChipOid(uint16_t oid);
+X509 *trustmCertParse(const uint8_t *data, uint16_t len);
+
+#endif  // _TRUSTM_CERTCOMP_H_
@@ -0,0 +1,65 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#ifndef _TRUSTM_DC_H_
+#define _TRUSTM_DC_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "optiga_lib_common.h"
+
+// TLS delegated credentials (RFC 9345). The chip key of the server
+// certificate signs a short-lived credential for a software key, the
+// TLS 1.3 CertificateVerify is then signed on the host. The certificate
+// needs the DelegationUsage extension, else clients ignore the credential.
+#define TRUSTM_DC_EXT_TYPE          0x0022  // delegated_credential
+#define TRUSTM_DC_MAX_VALID         (7*24*3600)     // [s] RFC 9345 limit
+#define TRUSTM_DC_MAX_LEN           512
+#define TRUSTM_DC_KEY_MAX_LEN       256
+#define TRUSTM_DC_OID_DELEGATION    "1.3.6.1.4.1.44363.44"
+
+// ********** typedef
+// Plain data, it can be copied to memory shared with other processes
+typedef struct trustm_dc_str
+{
+    time_t          expires;                    // end of the validity
+    uint16_t        scheme;                     // TLS SignatureScheme of both keys
+    uint16_t        dcLen;
+    uint8_t         dc[TRUSTM_DC_MAX_LEN];      // DelegatedCredential as sent in TLS
+    uint16_t        keyLen;
+    uint8_t         key[TRUSTM_DC_KEY_MAX_LEN]; // credential private key, DER
+} trustm_dc_t;
+
+// Function Prototype
+optiga_lib_status_t trustmDCCreate(uint16_t keyOid, X509 *cert, uint32_t validSec, trustm_dc_t *dc);
+int trustmDCSet(X509 *cert, const trustm_dc_t *dc);
+int trustmDCEnable(SSL_CTX *ctx);
+int trustmDCUsed(SSL *ssl);
+void trustmDCCleanup(void);
+
+#endif  // _TRUSTM_DC_H_
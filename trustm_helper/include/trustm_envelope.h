@@ -0,0 +1,65 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#ifndef _TRUSTM_ENVELOPE_H_
+#define _TRUSTM_ENVELOPE_H_
+
+#include <stdint.h>
+
+// Envelope for files of any size. A random AES-256-GCM key is wrapped by
+// a chip RSA key, the file body is encrypted on the host in one streaming
+// pass. Decrypting costs one chip RSA decrypt, whatever the file size.
+//   magic "TMEV" (4) | version (1) | algorithm (1) | wrapped key length (2)
+//   | wrapped key | IV (12) | ciphertext | GCM tag (16)
+// Lengths are big endian, the header up to the IV is authenticated as AAD.
+// One key and IV encrypt at most 64 GB (GCM limit).
+#define TRUSTM_ENVELOPE_MAGIC           "TMEV"
+#define TRUSTM_ENVELOPE_VERSION         0x01
+#define TRUSTM_ENVELOPE_RSA_AES256GCM   0x01    // RSAES-PKCS1-v1_5 wrap, AES-256-GCM body
+#define TRUSTM_ENVELOPE_KEY_LEN         32
+#define TRUSTM_ENVELOPE_IV_LEN          12
+#define TRUSTM_ENVELOPE_TAG_LEN         16
+#define TRUSTM_ENVELOPE_WRAP_MAX        512     // RSA 4096
+#define TRUSTM_ENVELOPE_HDR_MAX         (8 + TRUSTM_ENVELOPE_WRAP_MAX + TRUSTM_ENVELOPE_IV_LEN)
+#define TRUSTM_ENVELOPE_CHUNK           65536   // bytes per host cipher update
+#define TRUSTM_ENVELOPE_BODY_MAX        ((1ULL << 36) - 32) // GCM limit of one key and IV
+
+// Error codes
+#define TRUSTM_ENVELOPE_ERROR           1       // file or format error
+#define TRUSTM_ENVELOPE_AUTH            2       // tag mismatch, file altered or wrong key
+
+// ********** typedef
+typedef struct trustm_envelope_str
+{
+    uint8_t     wrap[TRUSTM_ENVELOPE_WRAP_MAX];
+    uint16_t    wrapLen;
+    uint8_t     iv[TRUSTM_ENVELOPE_IV_LEN];
+} trustm_envelope_t;
+
+// Function Prototype
+uint16_t trustmEnvelopeEncrypt(const char *inFile, const char *outFile, const trustm_envelope_t *env, const uint8_t *key);
+uint16_t trustmEnvelopeReadHeader(const char *inFile, trustm_envelope_t *env);
+uint16_t trustmEnvelopeDecrypt(const char *inFile, const char *outFile, const uint8_t *key);
+
+#endif  // _TRUSTM_ENVELOPE_H_
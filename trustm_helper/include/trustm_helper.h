@@ -44,6 +44,8 @@
 #include <time.h>
 #include <errno.h>   
 
+#include "trustm_access.h"
+
 //Debug Print
 //#define DEBUG_TRUSTM_HELPER =1
 //#define HIBERNATE_ENABLE =1
@@ -107,8 +109,37 @@ typedef struct trustm_metadata_str
   uint8_t E0_algo;
   uint8_t E1_keyUsage;
   uint8_t E8_dataObjType;  
+  uint16_t present;           // TRUSTM_MD_xx of the tags found
 } trustm_metadata_t;
 
+// Metadata tags present in trustm_metadata_t
+#define TRUSTM_MD_C0        0x0001
+#define TRUSTM_MD_C1        0x0002
+#define TRUSTM_MD_C4        0x0004
+#define TRUSTM_MD_C5        0x0008
+#define TRUSTM_MD_D0        0x0010
+#define TRUSTM_MD_D1        0x0020
+#define TRUSTM_MD_D3        0x0040
+#define TRUSTM_MD_E0        0x0080
+#define TRUSTM_MD_E1        0x0100
+#define TRUSTM_MD_E8        0x0200
+
+#define TRUSTM_METADATA_MAX     64      // largest metadata of an object
+#define TRUSTM_METADATA_STR_MAX 128     // access condition or key usage as text
+#define TRUSTM_SWEEP_MAX        48      // objects named by trustmGetOIDName
+#define TRUSTM_HASH_CHUNK       2048    // input bytes per chip hash update
+#define TRUSTM_HASH_MAX         64      // largest digest of trustmHashFile
+
+// Metadata of one object read by trustmSweepMetadata
+typedef struct trustm_oid_info_str
+{
+  uint16_t oid;
+  optiga_lib_status_t status; // of the read, raw and md are empty on error
+  uint8_t raw[TRUSTM_METADATA_MAX];
+  uint16_t rawLen;
+  trustm_metadata_t md;
+} trustm_oid_info_t;
+
 
 // *********** Extern
 extern optiga_util_t * me_util;
@@ -116,10 +147,14 @@ extern optiga_crypt_t * me_crypt;
 extern optiga_lib_status_t optiga_lib_status;
 extern uint16_t trustm_open_flag;
 extern uint8_t trustm_hibernate_flag;
+extern uint8_t trustm_session_flag;
 
 // Function Prototype
+int mssleep(long msec);
 optiga_lib_status_t trustm_Open(void);
 optiga_lib_status_t trustm_Close(void);
+optiga_lib_status_t trustm_OpenSession(void);
+optiga_lib_status_t trustm_CloseSession(void);
 void optiga_util_callback(void * context, optiga_lib_status_t return_status);
 void optiga_crypt_callback(void * context, optiga_lib_status_t return_status);
 
@@ -131,6 +166,12 @@ uint16_t trustmReadPEM(uint8_t *buf, uint32_t *len, const char *filename, char *
 uint16_t trustmReadDER(uint8_t *buf, uint32_t *len, const char *filename);
 
 void trustmdecodeMetaData(uint8_t * metaData);
+uint16_t trustmParseMetadata(const uint8_t *buf, uint16_t len, trustm_metadata_t *oidMetadata);
+char *trustmMetadataACStr(const uint8_t *ac, uint8_t len, char *buf, size_t size);
+char *trustmMetadataKeyUsageStr(uint8_t usage, char *buf, size_t size);
+const char *trustmMetadataAlgoStr(uint8_t algo);
+const char *trustmMetadataDataTypeStr(uint8_t type);
+uint16_t trustmSweepMetadata(trustm_oid_info_t *info, uint16_t max, uint8_t shielded);
 uint16_t trustmWriteX509PEM(X509 *x509, const char *filename);
 uint16_t trustmReadX509PEM(X509 **x509, const char *filename);
 
@@ -143,5 +184,7 @@ optiga_lib_status_t trustmReadMetadata(uint16_t optiga_oid, trustm_metadata_t *o
 uint32_t trustmHexorDec(const char *aArg);
 uint16_t trustmwriteTo(uint8_t *buf, uint32_t len, const char *filename);
 uint16_t trustmreadFrom(uint8_t *data, uint8_t *filename);
+uint16_t trustmHashFile(const char *filename, const EVP_MD *md, uint8_t *digest, uint16_t *digestLen);
+optiga_lib_status_t trustmChipHashFile(const char *filename, uint8_t shielded, uint8_t *digest);
 
 #endif  // _TRUSTM_HELPER_H_
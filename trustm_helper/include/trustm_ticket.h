@@ -0,0 +1,66 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#ifndef _TRUSTM_TICKET_H_
+#define _TRUSTM_TICKET_H_
+
+#include <stdint.h>
+
+#include <openssl/ssl.h>
+#include <openssl/hmac.h>
+
+#include "optiga_lib_common.h"
+
+// TLS session ticket keys derived on the chip. A pre-shared secret in a
+// data object is the TLS PRF secret, the chip derives one key set per
+// rotation period. Every process and every restart of a server derives
+// the same keys, the secret itself does not need to leave the chip.
+#ifndef TRUSTM_TICKET_OID
+#define TRUSTM_TICKET_OID           0xF1D8  // data object holding the secret
+#endif
+#ifndef TRUSTM_TICKET_PERIOD
+#define TRUSTM_TICKET_PERIOD        3600    // [s] key rotation period
+#endif
+#define TRUSTM_TICKET_SECRET_LEN    64      // secret written on first use
+#define TRUSTM_TICKET_LABEL         "trustm ticket key"
+
+// ********** typedef
+typedef struct trustm_ticket_key_str
+{
+    uint64_t        epoch;          // rotation period number, 0: empty
+    unsigned char   name[16];       // epoch (8 bytes, big endian) and derived tag
+    unsigned char   aesKey[32];     // AES-256-CBC ticket encryption
+    unsigned char   hmacKey[32];    // HMAC-SHA256 ticket authentication
+} trustm_ticket_key_t;
+
+// Function Prototype
+optiga_lib_status_t trustmTicketInit(uint16_t secretOid, uint32_t period);
+optiga_lib_status_t trustmTicketGetKey(uint64_t epoch, trustm_ticket_key_t *key);
+uint64_t trustmTicketEpoch(void);
+void trustmTicketCleanup(void);
+
+int trustmTicketKeyCb(SSL *ssl, unsigned char keyName[16], unsigned char *iv,
+                        EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc);
+
+#endif  // _TRUSTM_TICKET_H_
@@ -0,0 +1,836 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#define _GNU_SOURCE     // PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "optiga/optiga_util.h"
+#include "optiga/pal/pal_gpio.h"
+#include "optiga/pal/pal_ifx_i2c_config.h"
+
+#include "trustm_helper.h"
+
+/*************************************************************************
+*  Global
+*************************************************************************/
+// Access layer state shared by all processes using the chip.
+// Fields are updated by the process holding the IPC queue.
+typedef struct trustm_shared_str
+{
+    uint32_t        magic;
+    uint32_t        size;
+    uint32_t        secEst;         // estimated Security Event Counter
+    uint64_t        secTime;        // time of the estimate [ms]
+    uint64_t        syncTime;       // time of the last 0xE0C5 read [ms]
+    trustm_stats_t  stats;
+} trustm_shared_t;
+
+static trustm_shared_t *trustm_shared = NULL;
+static trustm_shared_t trustm_sharedLocal;
+static uint8_t trustm_govShielded = 0;
+static uint8_t trustm_recovered = 0;         // of me_util/me_crypt, pool slots keep their own
+static uint32_t trustm_resetGen = 0;         // chip resets done by this process
+static pthread_mutex_t trustm_resetLock = PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP;
+static pthread_mutex_t trustm_govLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Shared counters are updated by every thread of every process
+#define __TRUSTM_STAT_ADD(shared, field, n) \
+                                    __atomic_fetch_add(&(shared)->stats.field, (n), __ATOMIC_RELAXED)
+
+static trustm_inst_t trustm_pool[TRUSTM_POOL_SIZE];
+static uint8_t trustm_poolSize = 0;
+static uint8_t trustm_poolUsed = 0;
+static pthread_mutex_t trustm_poolLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*************************************************************************
+*  functions
+*************************************************************************/
+/**********************************************************************
+* trustmNowMs()
+* Monotonic time in ms.
+**********************************************************************/
+uint64_t trustmNowMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/**********************************************************************
+* trustmNowUs()
+* Monotonic time in us.
+**********************************************************************/
+uint64_t trustmNowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static int __trustm_cmpU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**********************************************************************
+* trustmSortSamples()
+* Sort latency samples ascending for trustmPercentile.
+**********************************************************************/
+void trustmSortSamples(uint64_t *sample, uint32_t count)
+{
+    qsort(sample, count, sizeof(uint64_t), __trustm_cmpU64);
+}
+
+/**********************************************************************
+* trustmPercentile()
+* Nearest rank percentile of sorted samples, p in 1/10 percent.
+**********************************************************************/
+uint64_t trustmPercentile(const uint64_t *sample, uint32_t count, uint32_t p)
+{
+    uint32_t rank;
+
+    if (count == 0)
+        return 0;
+    rank = (uint32_t)(((uint64_t)count * p + 999) / 1000);
+    if (rank == 0)
+        rank = 1;
+    return sample[rank-1];
+}
+
+/**********************************************************************
+* __trustm_shared()
+**********************************************************************/
+static trustm_shared_t * __trustm_shared(void)
+{
+    int shmid;
+    void *segptr;
+
+    if (trustm_shared != NULL)
+        return trustm_shared;
+
+    do
+    {
+        shmid = shmget(TRUSTM_SHARED_KEY, sizeof(trustm_shared_t), IPC_CREAT|0660);
+        if ((shmid == -1) && (errno == EINVAL))
+        {
+            // Segment left by a build with a different layout, recreate it
+            TRUSTM_HELPER_DBGFN("Shared state size mismatch - recreate");
+            shmid = shmget(TRUSTM_SHARED_KEY, 0, 0);
+            if (shmid != -1)
+                shmctl(shmid, IPC_RMID, 0);
+            shmid = shmget(TRUSTM_SHARED_KEY, sizeof(trustm_shared_t), IPC_CREAT|0660);
+        }
+
+        if (shmid == -1)
+        {
+            TRUSTM_HELPER_DBGFN("Shared state not available - use local state");
+            break;
+        }
+
+        /* Attach (map) the shared memory segment for the life of the process */
+        segptr = shmat(shmid, 0, 0);
+        if (segptr == (void *)-1)
+        {
+            TRUSTM_HELPER_DBGFN("Shared state shmat fail - use local state");
+            break;
+        }
+        trustm_shared = (trustm_shared_t *)segptr;
+    } while(FALSE);
+
+    if (trustm_shared == NULL)
+        trustm_shared = &trustm_sharedLocal;
+
+    if ((trustm_shared->magic != TRUSTM_SHARED_MAGIC) ||
+        (trustm_shared->size != sizeof(trustm_shared_t)))
+    {
+        memset(trustm_shared, 0, sizeof(trustm_shared_t));
+        trustm_shared->magic = TRUSTM_SHARED_MAGIC;
+        trustm_shared->size = sizeof(trustm_shared_t);
+    }
+
+    return trustm_shared;
+}
+
+/**********************************************************************
+* __trustm_govDecay()
+* Apply the counter decrements the chip made since the last estimate.
+**********************************************************************/
+static void __trustm_govDecay(trustm_shared_t *shared, uint64_t now)
+{
+    uint64_t steps;
+
+    if (now < shared->secTime)
+        shared->secTime = now;
+
+    steps = (now - shared->secTime) / TRUSTM_GOV_SEC_DECAY_MS;
+    if (steps >= shared->secEst)
+    {
+        shared->secEst = 0;
+        shared->secTime = now;
+    }
+    else
+    {
+        shared->secEst -= (uint32_t)steps;
+        shared->secTime += steps * TRUSTM_GOV_SEC_DECAY_MS;
+    }
+    shared->stats.secEst = shared->secEst;
+}
+
+/**********************************************************************
+* __trustm_waitMs()
+* Returns OPTIGA_LIB_BUSY if the command is still pending after timeout.
+**********************************************************************/
+static optiga_lib_status_t __trustm_waitMs(volatile optiga_lib_status_t *pending,
+                                           uint32_t timeout)
+{
+    uint64_t deadline;
+
+    deadline = trustmNowMs() + timeout;
+    while (OPTIGA_LIB_BUSY == *pending)
+    {
+        if (trustmNowMs() >= deadline)
+            break;
+    }
+
+    return *pending;
+}
+
+/**********************************************************************
+* __trustm_pulse()
+**********************************************************************/
+static void __trustm_pulse(const pal_gpio_t *gpio)
+{
+    pal_gpio_set_low(gpio);
+    mssleep(TRUSTM_RESET_LOW_MS);
+    pal_gpio_set_high(gpio);
+}
+
+/**********************************************************************
+* __trustm_statMax()
+**********************************************************************/
+static void __trustm_statMax(uint32_t *field, uint32_t value)
+{
+    uint32_t cur = __atomic_load_n(field, __ATOMIC_RELAXED);
+
+    while ((value > cur) &&
+           !__atomic_compare_exchange_n(field, &cur, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/**********************************************************************
+* __trustm_reset()
+* Warm reset the chip and re-open the application on util, the instance
+* whose command hung (callback status *pending). Falls back to a power
+* cycle if the host library does not release the hung command. gen is
+* trustm_resetGen when the command was issued, if another instance reset
+* the chip since then, that reset recovered this command too.
+**********************************************************************/
+static optiga_lib_status_t __trustm_reset(volatile optiga_lib_status_t *pending,
+                                          optiga_util_t *util, uint32_t gen)
+{
+    optiga_lib_status_t return_status = TRUSTM_ACCESS_ERROR_TIMEOUT;
+    trustm_shared_t *shared;
+
+    // A hang while recovering is not recovered again
+    if (pthread_mutex_lock(&trustm_resetLock) == EDEADLK)
+        return return_status;
+
+    if (gen != trustm_resetGen)
+    {
+        pthread_mutex_unlock(&trustm_resetLock);
+        return OPTIGA_LIB_SUCCESS;
+    }
+
+    shared = __trustm_shared();
+    __TRUSTM_STAT_ADD(shared, chipReset, 1);
+
+    do
+    {
+        // Warm reset, the pending transfer fails and the host library
+        // completes the hung command with an error.
+        __trustm_pulse(&optiga_reset_0);
+        if (OPTIGA_LIB_BUSY == __trustm_waitMs(pending, TRUSTM_RESET_SETTLE_MS))
+        {
+            TRUSTM_HELPER_ERRFN("Warm reset failed. Power cycle chip.\n");
+            __trustm_pulse(&optiga_vdd_0);
+            if (OPTIGA_LIB_BUSY == __trustm_waitMs(pending, TRUSTM_RESET_SETTLE_MS))
+            {
+                TRUSTM_HELPER_ERRFN("Host library still busy. Give up.\n");
+                break;
+            }
+        }
+
+        if (util == NULL)
+        {
+            // Crypt only instance (engine ECDHE slot), re-open on me_util
+            util = me_util;
+            pending = &optiga_lib_status;
+        }
+
+        // The instance is idle again, its callback reports the open
+        *pending = OPTIGA_LIB_BUSY;
+        return_status = optiga_util_open_application(util, 0); // skip restore
+        if (OPTIGA_LIB_SUCCESS != return_status)
+            break;
+
+        if (OPTIGA_LIB_BUSY == __trustm_waitMs(pending, TRUSTM_CMD_TIMEOUT_MS))
+        {
+            return_status = TRUSTM_ACCESS_ERROR_TIMEOUT;
+            break;
+        }
+
+        return_status = *pending;
+        if (OPTIGA_LIB_SUCCESS != return_status)
+            break;
+
+        TRUSTM_HELPER_DBGFN("Chip recovered.\n");
+        // The reset ended the shielded session, the next shielded
+        // command is paced again. No chip command here, me_util may be
+        // in use by another thread.
+        trustm_govShielded = 0;
+    } while(FALSE);
+
+    if (OPTIGA_LIB_SUCCESS != return_status)
+    {
+        TRUSTM_HELPER_ERRFN("Chip reset failed!!!\n");
+        __TRUSTM_STAT_ADD(shared, chipResetFail, 1);
+    }
+
+    __atomic_fetch_add(&trustm_resetGen, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trustm_resetLock);
+    return return_status;
+}
+
+/**********************************************************************
+* __trustm_complete()
+* Wait for the command pending on *pending, issued on util, and reset the
+* chip on expiry. *recovered tells TRUSTM_REPLAY() of this instance only
+* whether the reset recovered the chip.
+**********************************************************************/
+static optiga_lib_status_t __trustm_complete(volatile optiga_lib_status_t *pending,
+                                             optiga_util_t *util, uint8_t *recovered,
+                                             uint32_t timeout)
+{
+    optiga_lib_status_t return_status;
+    uint64_t start;
+    uint32_t gen;
+
+    *recovered = 0;
+    gen = __atomic_load_n(&trustm_resetGen, __ATOMIC_ACQUIRE);
+    start = trustmNowUs();
+    return_status = __trustm_waitMs(pending, timeout);
+    __TRUSTM_STAT_ADD(__trustm_shared(), busyUs, trustmNowUs() - start);
+    if (OPTIGA_LIB_BUSY == return_status)
+    {
+        TRUSTM_HELPER_ERRFN("No response after %d ms. Reset chip.\n", timeout);
+        __TRUSTM_STAT_ADD(__trustm_shared(), cmdTimeout, 1);
+        if (OPTIGA_LIB_SUCCESS == __trustm_reset(pending, util, gen))
+            *recovered = 1;
+
+        *pending = TRUSTM_ACCESS_ERROR_TIMEOUT;
+        return_status = TRUSTM_ACCESS_ERROR_TIMEOUT;
+    }
+
+    trustmGovernorRecord(return_status);
+    return return_status;
+}
+
+/**********************************************************************
+* trustmWaitCompletion()
+* Wait until the pending optiga_util/optiga_crypt call completes.
+**********************************************************************/
+optiga_lib_status_t trustmWaitCompletion(void)
+{
+    return trustmWaitCompletionMs(TRUSTM_CMD_TIMEOUT_MS);
+}
+
+/**********************************************************************
+* trustmWaitCompletionMs()
+* Wait at most timeout ms. On expiry the chip is reset and
+* TRUSTM_ACCESS_ERROR_TIMEOUT returned.
+**********************************************************************/
+optiga_lib_status_t trustmWaitCompletionMs(uint32_t timeout)
+{
+    return __trustm_complete(&optiga_lib_status, me_util, &trustm_recovered, timeout);
+}
+
+/**********************************************************************
+* trustmResetChip()
+**********************************************************************/
+optiga_lib_status_t trustmResetChip(void)
+{
+    return __trustm_reset(&optiga_lib_status, me_util,
+                          __atomic_load_n(&trustm_resetGen, __ATOMIC_ACQUIRE));
+}
+
+/**********************************************************************
+* trustmReplay()
+* Decide if the command issued by TRUSTM_REPLAY() on me_util/me_crypt
+* is tried again.
+**********************************************************************/
+uint8_t trustmReplay(optiga_lib_status_t status, uint8_t *replay)
+{
+    if ((status != TRUSTM_ACCESS_ERROR_TIMEOUT) ||
+        (trustm_recovered == 0) ||
+        (*replay >= TRUSTM_REPLAY_MAX))
+        return 0;
+
+    (*replay)++;
+    __TRUSTM_STAT_ADD(__trustm_shared(), cmdReplay, 1);
+    TRUSTM_HELPER_DBGFN("Replay command (%d)", *replay);
+    return 1;
+}
+
+/**********************************************************************
+* trustmPoolReplay()
+* Decide if a command on inst is tried again. Only a reset recovering
+* this instance's own timeout counts.
+**********************************************************************/
+uint8_t trustmPoolReplay(trustm_inst_t *inst, optiga_lib_status_t status, uint8_t *replay)
+{
+    if ((status != TRUSTM_ACCESS_ERROR_TIMEOUT) ||
+        (inst->recovered == 0) ||
+        (*replay >= TRUSTM_REPLAY_MAX))
+        return 0;
+
+    (*replay)++;
+    __TRUSTM_STAT_ADD(__trustm_shared(), cmdReplay, 1);
+    TRUSTM_HELPER_DBGFN("Replay pool command (%d)", *replay);
+    return 1;
+}
+
+/**********************************************************************
+* __trustm_readSecCnt()
+* Read the Security Event Counter on the pool instance inst, or on
+* me_util if inst is NULL.
+**********************************************************************/
+static uint8_t __trustm_readSecCnt(trustm_inst_t *inst)
+{
+    uint16_t offset, bytes_to_read;
+    uint16_t optiga_oid;
+    uint8_t read_data_buffer[5];
+    trustm_shared_t *shared;
+
+    optiga_lib_status_t return_status;
+
+    do
+    {
+        //Read device Security Event ounter
+        optiga_oid = 0xE0C5;
+        offset = 0x00;
+        bytes_to_read = sizeof(read_data_buffer);
+
+        if (inst == NULL)
+            optiga_lib_status = OPTIGA_LIB_BUSY;
+        return_status = optiga_util_read_data((inst != NULL) ? inst->util : me_util,
+                                              optiga_oid,
+                                              offset,
+                                              read_data_buffer,
+                                              &bytes_to_read);
+
+        if (OPTIGA_LIB_SUCCESS != return_status)
+        {
+            //Reading the data object failed.
+            TRUSTM_HELPER_ERRFN("optiga_util_read_data : FAIL!!!\n");
+            read_data_buffer[0] = 0;
+            break;
+        }
+
+        return_status = (inst != NULL) ? trustmPoolWait(inst) : trustmWaitCompletion();
+        if (OPTIGA_LIB_SUCCESS != return_status)
+        {
+            read_data_buffer[0] = 0;
+            break;
+        }
+
+        shared = __trustm_shared();
+        pthread_mutex_lock(&trustm_govLock);
+        shared->secEst = read_data_buffer[0];
+        shared->secTime = trustmNowMs();
+        shared->syncTime = shared->secTime;
+
+        shared->stats.secCnt = read_data_buffer[0];
+        shared->stats.secEst = read_data_buffer[0];
+        pthread_mutex_unlock(&trustm_govLock);
+        __TRUSTM_STAT_ADD(shared, secCntRead, 1);
+        __trustm_statMax(&shared->stats.secCntMax, read_data_buffer[0]);
+
+    } while(FALSE);
+
+    return read_data_buffer[0];
+}
+
+/**********************************************************************
+* trustmReadSecCnt()
+* Read the Security Event Counter through a free pool instance, so it
+* does not share optiga_lib_status with pool commands in flight. Uses
+* me_util if the pool is empty or busy.
+**********************************************************************/
+uint8_t trustmReadSecCnt(void)
+{
+    trustm_inst_t *inst;
+    uint8_t secCnt;
+
+    inst = trustmPoolGet();
+    secCnt = __trustm_readSecCnt(inst);
+    trustmPoolPut(inst);
+    return secCnt;
+}
+
+/**********************************************************************
+* trustmGovernorPace()
+* Delay the next operation if it would push the Security Event Counter
+* above TRUSTM_GOV_SEC_THRESHOLD. Must be called with the chip open.
+* The estimate is shared between processes through the IPC lock and
+* between threads through trustm_govLock, released while sleeping and
+* while reading the counter. The counter is read on a pool instance,
+* with every instance busy the estimate stands unconfirmed.
+**********************************************************************/
+void trustmGovernorPace(uint8_t cost)
+{
+    trustm_shared_t *shared;
+    trustm_inst_t *inst;
+    uint64_t now;
+    uint64_t delay;
+
+    shared = __trustm_shared();
+    pthread_mutex_lock(&trustm_govLock);
+    now = trustmNowMs();
+    __trustm_govDecay(shared, now);
+
+    if ((shared->secEst + cost) > TRUSTM_GOV_SEC_THRESHOLD)
+    {
+        // Prediction says the chip will throttle, confirm with the real counter
+        if ((now - shared->syncTime) >= TRUSTM_GOV_SYNC_MS)
+        {
+            pthread_mutex_unlock(&trustm_govLock);
+            // me_util only without a pool, nothing else is in flight then
+            inst = trustmPoolGet();
+            if ((inst != NULL) || (trustm_poolSize == 0))
+                __trustm_readSecCnt(inst);
+            trustmPoolPut(inst);
+            pthread_mutex_lock(&trustm_govLock);
+            now = trustmNowMs();
+            __trustm_govDecay(shared, now);
+        }
+
+        if ((shared->secEst + cost) > TRUSTM_GOV_SEC_THRESHOLD)
+        {
+            delay = (shared->secEst + cost - TRUSTM_GOV_SEC_THRESHOLD) * TRUSTM_GOV_SEC_DECAY_MS;
+            if (delay > TRUSTM_GOV_MAX_DELAY_MS)
+                delay = TRUSTM_GOV_MAX_DELAY_MS;
+
+            TRUSTM_HELPER_DBGFN("SEC estimate %d, pacing %d ms", shared->secEst, (int)delay);
+            __TRUSTM_STAT_ADD(shared, govPaced, 1);
+            __TRUSTM_STAT_ADD(shared, govDelayMs, delay);
+            pthread_mutex_unlock(&trustm_govLock);
+            mssleep((long)delay);
+            pthread_mutex_lock(&trustm_govLock);
+
+            now = trustmNowMs();
+            __trustm_govDecay(shared, now);
+        }
+        else
+        {
+            __TRUSTM_STAT_ADD(shared, govCancel, 1);
+        }
+    }
+
+    if (shared->secEst == 0)
+        shared->secTime = now;
+    shared->secEst += cost;
+    shared->stats.secEst = shared->secEst;
+    pthread_mutex_unlock(&trustm_govLock);
+}
+
+/**********************************************************************
+* trustmGovernorOpen()
+* Called once the application is open. Starts a new shielded session.
+**********************************************************************/
+void trustmGovernorOpen(void)
+{
+    trustm_govShielded = 0;
+    trustmGovernorPace(TRUSTM_GOV_COST_SESSION);
+}
+
+/**********************************************************************
+* trustmGovernorShielded()
+* The shielded connection handshake runs once per session.
+**********************************************************************/
+void trustmGovernorShielded(void)
+{
+    if (trustm_govShielded == 0)
+    {
+        trustmGovernorPace(TRUSTM_GOV_COST_SHIELDED);
+        trustm_govShielded = 1;
+    }
+}
+
+/**********************************************************************
+* trustmGovernorRecord()
+* Account a completed operation. Failed commands raise the counter.
+**********************************************************************/
+void trustmGovernorRecord(optiga_lib_status_t status)
+{
+    trustm_shared_t *shared;
+    uint64_t now;
+
+    shared = __trustm_shared();
+    __TRUSTM_STAT_ADD(shared, opCount, 1);
+
+    if (status != OPTIGA_LIB_SUCCESS)
+    {
+        __TRUSTM_STAT_ADD(shared, opFail, 1);
+        if ((status & OPTIGA_DEVICE_ERROR) == OPTIGA_DEVICE_ERROR)
+        {
+            pthread_mutex_lock(&trustm_govLock);
+            now = trustmNowMs();
+            __trustm_govDecay(shared, now);
+            if (shared->secEst == 0)
+                shared->secTime = now;
+            shared->secEst += TRUSTM_GOV_COST_FAIL;
+            shared->stats.secEst = shared->secEst;
+            pthread_mutex_unlock(&trustm_govLock);
+        }
+    }
+}
+
+/**********************************************************************
+* trustmRecordDeadline()
+* Account a caller which gave up waiting for the chip.
+**********************************************************************/
+void trustmRecordDeadline(void)
+{
+    __TRUSTM_STAT_ADD(__trustm_shared(), deadlineMiss, 1);
+}
+
+/**********************************************************************
+* trustmRecordFallback()
+* Account a random request served without the chip.
+**********************************************************************/
+void trustmRecordFallback(void)
+{
+    __TRUSTM_STAT_ADD(__trustm_shared(), randFallback, 1);
+}
+
+/**********************************************************************
+* __trustm_poolCallback()
+* Completion of a command issued on a pool instance.
+**********************************************************************/
+static void __trustm_poolCallback(void * context, optiga_lib_status_t return_status)
+{
+    trustm_inst_t *inst = (trustm_inst_t *)context;
+
+    inst->status = return_status;
+}
+
+/**********************************************************************
+* trustmPoolCreate()
+* Create the pool instances next to me_util/me_crypt.
+* Returns the number of instances created.
+**********************************************************************/
+uint8_t trustmPoolCreate(void)
+{
+    trustm_inst_t *inst;
+
+    pthread_mutex_lock(&trustm_poolLock);
+    trustm_poolUsed = 0;
+    for (trustm_poolSize = 0; trustm_poolSize < TRUSTM_POOL_SIZE; trustm_poolSize++)
+    {
+        inst = &trustm_pool[trustm_poolSize];
+        inst->inUse = 0;
+        inst->status = OPTIGA_LIB_SUCCESS;
+
+        inst->util = optiga_util_create(0, __trustm_poolCallback, inst);
+        if (inst->util == NULL)
+            break;
+
+        inst->crypt = optiga_crypt_create(0, __trustm_poolCallback, inst);
+        if (inst->crypt == NULL)
+        {
+            optiga_util_destroy(inst->util);
+            inst->util = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trustm_poolLock);
+
+    TRUSTM_HELPER_DBGFN("%d pool instances created", trustm_poolSize);
+    return trustm_poolSize;
+}
+
+/**********************************************************************
+* trustmPoolDestroy()
+**********************************************************************/
+void trustmPoolDestroy(void)
+{
+    uint8_t i;
+
+    pthread_mutex_lock(&trustm_poolLock);
+    for (i = 0; i < trustm_poolSize; i++)
+    {
+        optiga_crypt_destroy(trustm_pool[i].crypt);
+        optiga_util_destroy(trustm_pool[i].util);
+        trustm_pool[i].crypt = NULL;
+        trustm_pool[i].util = NULL;
+    }
+    trustm_poolSize = 0;
+    trustm_poolUsed = 0;
+    pthread_mutex_unlock(&trustm_poolLock);
+}
+
+/**********************************************************************
+* trustmPoolGet()
+* Returns a free instance or NULL, the caller then uses me_util/me_crypt.
+**********************************************************************/
+trustm_inst_t * trustmPoolGet(void)
+{
+    trustm_inst_t *inst = NULL;
+    trustm_shared_t *shared;
+    uint8_t i;
+
+    pthread_mutex_lock(&trustm_poolLock);
+    for (i = 0; i < trustm_poolSize; i++)
+    {
+        if (trustm_pool[i].inUse == 0)
+        {
+            inst = &trustm_pool[i];
+            inst->inUse = 1;
+            inst->recovered = 0;
+            inst->status = OPTIGA_LIB_BUSY;
+            trustm_poolUsed++;
+
+            shared = __trustm_shared();
+            __trustm_statMax(&shared->stats.poolPeak, trustm_poolUsed);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trustm_poolLock);
+
+    return inst;
+}
+
+/**********************************************************************
+* trustmPoolPut()
+**********************************************************************/
+void trustmPoolPut(trustm_inst_t *inst)
+{
+    if (inst == NULL)
+        return;
+
+    pthread_mutex_lock(&trustm_poolLock);
+    inst->inUse = 0;
+    trustm_poolUsed--;
+    pthread_mutex_unlock(&trustm_poolLock);
+}
+
+/**********************************************************************
+* trustmPoolWait()
+* Wait until the command issued on inst completes.
+**********************************************************************/
+optiga_lib_status_t trustmPoolWait(trustm_inst_t *inst)
+{
+    return __trustm_complete(&inst->status, inst->util, &inst->recovered, TRUSTM_CMD_TIMEOUT_MS);
+}
+
+/**********************************************************************
+* trustmPoolWaitMs()
+* Wait at most timeout ms for the command issued on inst, e.g. a key
+* generation with TRUSTM_CMD_TIMEOUT_LONG_MS.
+**********************************************************************/
+optiga_lib_status_t trustmPoolWaitMs(trustm_inst_t *inst, uint32_t timeout)
+{
+    return __trustm_complete(&inst->status, inst->util, &inst->recovered, timeout);
+}
+
+/**********************************************************************
+* trustmGetStats()
+**********************************************************************/
+void trustmGetStats(trustm_stats_t *stats)
+{
+    trustm_shared_t *shared;
+
+    shared = __trustm_shared();
+    pthread_mutex_lock(&trustm_govLock);
+    __trustm_govDecay(shared, trustmNowMs());
+    memcpy(stats, &shared->stats, sizeof(trustm_stats_t));
+    pthread_mutex_unlock(&trustm_govLock);
+}
+
+/**********************************************************************
+* trustmClearStats()
+**********************************************************************/
+void trustmClearStats(void)
+{
+    trustm_shared_t *shared;
+
+    shared = __trustm_shared();
+    pthread_mutex_lock(&trustm_govLock);
+    memset(&shared->stats, 0, sizeof(trustm_stats_t));
+    shared->stats.secEst = shared->secEst;
+    pthread_mutex_unlock(&trustm_govLock);
+}
+
+/**********************************************************************
+* trustmPrintStats()
+**********************************************************************/
+void trustmPrintStats(void)
+{
+    trustm_stats_t stats;
+
+    trustmGetStats(&stats);
+
+    printf("Security Event Counter [0xE0C5] : %d (max %d, read %d times)\n",
+                                    stats.secCnt, stats.secCntMax, stats.secCntRead);
+    printf("Governor estimate               : %d (threshold %d)\n",
+                                    stats.secEst, TRUSTM_GOV_SEC_THRESHOLD);
+    printf("Operations                      : %d (failed %d)\n",
+                                    stats.opCount, stats.opFail);
+    printf("Paced operations                : %d (%llu ms, cancelled %d)\n",
+                                    stats.govPaced, (unsigned long long)stats.govDelayMs, stats.govCancel);
+    printf("Command timeouts                : %d (replayed %d)\n",
+                                    stats.cmdTimeout, stats.cmdReplay);
+    printf("Chip resets                     : %d (failed %d)\n",
+                                    stats.chipReset, stats.chipResetFail);
+    printf("Deadline misses                 : %d (random fallback %d)\n",
+                                    stats.deadlineMiss, stats.randFallback);
+    printf("Pool instances in use (peak)    : %d of %d\n",
+                                    stats.poolPeak, TRUSTM_POOL_SIZE);
+    printf("Chip busy time                  : %llu ms\n",
+                                    (unsigned long long)(stats.busyUs / 1000));
+}
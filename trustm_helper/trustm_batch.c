@@ -0,0 +1,589 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include "trustm_helper.h"
+#include "trustm_batch.h"
+#include "trustm_cache.h"
+#include "trustm_certcomp.h"
+
+/*************************************************************************
+*  functions
+*************************************************************************/
+/**********************************************************************
+* __trustm_batchManifestLine()
+* Split a manifest line into the hex signature and the file name.
+* Returns the file name, NULL on a malformed line.
+**********************************************************************/
+static char *__trustm_batchManifestLine(char *line, trustm_batch_item_t *item)
+{
+    unsigned int byte;
+
+    item->sigLen = 0;
+    while (isxdigit((unsigned char)line[0]) && isxdigit((unsigned char)line[1]))
+    {
+        if (item->sigLen >= sizeof(item->sig))
+            return NULL;
+        sscanf(line, "%2x", &byte);
+        item->sig[item->sigLen++] = (uint8_t)byte;
+        line += 2;
+    }
+    if ((item->sigLen == 0) || !isspace((unsigned char)*line))
+        return NULL;
+    while (isspace((unsigned char)*line))
+        line++;
+    return (*line != '\0') ? line : NULL;
+}
+
+/**********************************************************************
+* trustmBatchLoad()
+* Read a list (manifest = 0) or a manifest (manifest = 1) into batch.
+* Returns 0 on success, 1 on error. trustmBatchFree releases the batch
+* in both cases.
+**********************************************************************/
+uint16_t trustmBatchLoad(trustm_batch_t *batch, const char *listFile, uint8_t manifest)
+{
+    trustm_batch_item_t *item;
+    uint32_t size = 0;
+    char *line = NULL;
+    char *file;
+    size_t lineSize = 0;
+    ssize_t len;
+    uint16_t ret = 0;
+    FILE *fp;
+
+    memset(batch, 0, sizeof(trustm_batch_t));
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->cond, NULL);
+
+    fp = fopen(listFile, "r");
+    if (fp == NULL)
+        return 1;
+
+    while ((len = getline(&line, &lineSize, fp)) >= 0)
+    {
+        while ((len > 0) && ((line[len-1] == '\n') || (line[len-1] == '\r')))
+            line[--len] = '\0';
+        if ((len == 0) || (line[0] == '#'))
+            continue;
+
+        if (batch->count == size)
+        {
+            size = size ? size * 2 : 64;
+            item = realloc(batch->item, size * sizeof(trustm_batch_item_t));
+            if (item == NULL)
+            {
+                ret = 1;
+                break;
+            }
+            batch->item = item;
+        }
+        item = &batch->item[batch->count];
+        memset(item, 0, sizeof(trustm_batch_item_t));
+
+        file = manifest ? __trustm_batchManifestLine(line, item) : line;
+        if (file == NULL)
+        {
+            printf("Invalid manifest line : %s\n", line);
+            ret = 1;
+            break;
+        }
+        item->file = strdup(file);
+        if (item->file == NULL)
+        {
+            ret = 1;
+            break;
+        }
+        batch->count++;
+    }
+
+    free(line);
+    fclose(fp);
+    if (batch->count == 0)
+        ret = 1;
+    return ret;
+}
+
+/**********************************************************************
+* __trustm_batchThread()
+* Take the next item until the batch is exhausted or stopped.
+**********************************************************************/
+static void *__trustm_batchThread(void *arg)
+{
+    trustm_batch_t *batch = (trustm_batch_t *)arg;
+    trustm_batch_item_t *item;
+    uint16_t status;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->lock);
+        if (batch->next >= batch->count)
+        {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+        item = &batch->item[batch->next++];
+        pthread_mutex_unlock(&batch->lock);
+
+        status = batch->work(item, batch->ctx);
+
+        pthread_mutex_lock(&batch->lock);
+        item->status = status;
+        item->done = 1;
+        pthread_cond_broadcast(&batch->cond);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return NULL;
+}
+
+/**********************************************************************
+* trustmBatchStart()
+* Run work on every item in host threads. threads = 0 uses one thread
+* per online CPU. Returns 0 on success, 1 if no thread could be started.
+**********************************************************************/
+uint16_t trustmBatchStart(trustm_batch_t *batch, trustm_batch_fn work, void *ctx, uint16_t threads)
+{
+    long cpus;
+
+    if (threads == 0)
+    {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? (uint16_t)((cpus < TRUSTM_BATCH_THREADS_MAX) ? cpus : TRUSTM_BATCH_THREADS_MAX) : 1;
+    }
+    if (threads > TRUSTM_BATCH_THREADS_MAX)
+        threads = TRUSTM_BATCH_THREADS_MAX;
+    if (threads > batch->count)
+        threads = batch->count;
+
+    batch->work = work;
+    batch->ctx = ctx;
+    for (batch->threads = 0; batch->threads < threads; batch->threads++)
+    {
+        if (pthread_create(&batch->thread[batch->threads], NULL, __trustm_batchThread, batch) != 0)
+            break;
+    }
+    return (batch->threads == 0);
+}
+
+/**********************************************************************
+* trustmBatchWait()
+* Wait until the work on item index is finished.
+**********************************************************************/
+trustm_batch_item_t *trustmBatchWait(trustm_batch_t *batch, uint32_t index)
+{
+    trustm_batch_item_t *item = &batch->item[index];
+
+    pthread_mutex_lock(&batch->lock);
+    while (!item->done)
+        pthread_cond_wait(&batch->cond, &batch->lock);
+    pthread_mutex_unlock(&batch->lock);
+    return item;
+}
+
+/**********************************************************************
+* trustmBatchFree()
+* Stop the threads after their current item and release the batch.
+**********************************************************************/
+void trustmBatchFree(trustm_batch_t *batch)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&batch->lock);
+    batch->next = batch->count;
+    pthread_mutex_unlock(&batch->lock);
+
+    for (i = 0; i < batch->threads; i++)
+        pthread_join(batch->thread[i], NULL);
+
+    for (i = 0; i < batch->count; i++)
+        free(batch->item[i].file);
+    free(batch->item);
+
+    pthread_cond_destroy(&batch->cond);
+    pthread_mutex_destroy(&batch->lock);
+    memset(batch, 0, sizeof(trustm_batch_t));
+}
+
+/**********************************************************************
+* trustmBatchHash()
+* Work function hashing the item file on the host, ctx is the EVP_MD,
+* NULL for SHA-256.
+**********************************************************************/
+uint16_t trustmBatchHash(trustm_batch_item_t *item, void *ctx)
+{
+    const EVP_MD *md = (ctx != NULL) ? (const EVP_MD *)ctx : EVP_sha256();
+
+    return trustmHashFile(item->file, md, item->digest, &item->digestLen);
+}
+
+/**********************************************************************
+* trustmBatchWriteManifest()
+**********************************************************************/
+void trustmBatchWriteManifest(FILE *fp, const uint8_t *sig, uint16_t sigLen, const char *file)
+{
+    uint16_t i;
+
+    for (i = 0; i < sigLen; i++)
+        fprintf(fp, "%.2x", sig[i]);
+    fprintf(fp, "  %s\n", file);
+}
+
+/**********************************************************************
+* __trustm_batchProtect()
+* Shielded connection of the sign tools, as before every single sign.
+**********************************************************************/
+static void __trustm_batchProtect(int keyType, uint8_t bypass)
+{
+    if (bypass == 1)
+        return;
+
+    if (keyType == EVP_PKEY_EC)
+    {
+        TRUSTM_CRYPT_SHIELDED(me_crypt);
+    } else
+    {
+        trustmGovernorShielded();
+        OPTIGA_CRYPT_SET_COMMS_PROTOCOL_VERSION(me_crypt, OPTIGA_COMMS_PROTOCOL_VERSION_PRE_SHARED_SECRET);
+        OPTIGA_CRYPT_SET_COMMS_PROTECTION_LEVEL(me_crypt, OPTIGA_COMMS_COMMAND_PROTECTION);
+    }
+}
+
+/**********************************************************************
+* __trustm_batchSignOne()
+* Sign the item digest with the key in the chip, keyType EVP_PKEY_EC
+* (ECDSA, with SEQUENCE header) or EVP_PKEY_RSA (PKCS#1 v1.5 SHA256).
+**********************************************************************/
+static optiga_lib_status_t __trustm_batchSignOne(trustm_batch_item_t *item, optiga_key_id_t keyId,
+                                                 int keyType, uint8_t bypass,
+                                                 uint8_t *sig, uint16_t *sigLen)
+{
+    optiga_lib_status_t return_status;
+    uint16_t len = *sigLen;
+    int j;
+
+    if (keyType == EVP_PKEY_EC)
+    {
+        TRUSTM_REPLAY(return_status,
+                      __trustm_batchProtect(keyType, bypass); *sigLen = len - 2,
+                      optiga_crypt_ecdsa_sign(me_crypt,
+                                              item->digest,
+                                              item->digestLen,
+                                              keyId,
+                                              sig,
+                                              sigLen));
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            return return_status;
+
+        // Insert SEQUENCE header as -o
+        for (j = *sigLen - 1; j >= 0; j--)
+            sig[j+2] = sig[j];
+        sig[0] = 0x30;
+        sig[1] = (uint8_t)*sigLen;
+        *sigLen += 2;
+        return return_status;
+    }
+
+    TRUSTM_REPLAY(return_status,
+                  __trustm_batchProtect(keyType, bypass); *sigLen = len,
+                  optiga_crypt_rsa_sign(me_crypt,
+                                        OPTIGA_RSASSA_PKCS1_V15_SHA256,
+                                        item->digest,
+                                        item->digestLen,
+                                        keyId,
+                                        sig,
+                                        sigLen,
+                                        0x0000));
+    return return_status;
+}
+
+/**********************************************************************
+* trustmBatchSign()
+* Sign every file of the list in one chip session with the key in the
+* chip, keyType EVP_PKEY_EC or EVP_PKEY_RSA. Host threads hash the next
+* files while the chip signs, so the batch runs at the chip sign rate.
+* Signatures go to <file>.sig or to the manifest. bypass = 1 skips the
+* shielded connection.
+* Returns the number of files not signed.
+**********************************************************************/
+uint32_t trustmBatchSign(optiga_key_id_t keyId, int keyType, const char *listFile,
+                         const char *manifestFile, uint16_t threads, uint8_t bypass)
+{
+    optiga_lib_status_t return_status;
+    trustm_batch_t batch;
+    trustm_batch_item_t *item;
+    uint8_t signature[TRUSTM_BATCH_SIG_MAX];
+    uint16_t signature_length;
+    char sigFile[PATH_MAX];
+    FILE *fp = NULL;
+    uint32_t i;
+    uint32_t done = 0;
+    uint64_t start = trustmNowMs();
+    uint64_t elapsed;
+
+    if (trustmBatchLoad(&batch, listFile, 0) != 0)
+    {
+        printf("Error reading list file!!!\n");
+        trustmBatchFree(&batch);
+        return 1;
+    }
+
+    do
+    {
+        if (manifestFile != NULL)
+        {
+            fp = fopen(manifestFile, "w");
+            if (fp == NULL)
+            {
+                printf("Error opening manifest file!!!\n");
+                break;
+            }
+        }
+
+        if (trustmBatchStart(&batch, trustmBatchHash, (void *)EVP_sha256(), threads) != 0)
+        {
+            printf("Error starting hash threads!!!\n");
+            break;
+        }
+        printf("Batch Files      : %d (%d threads)\n", batch.count, batch.threads);
+
+        for (i = 0; i < batch.count; i++)
+        {
+            item = trustmBatchWait(&batch, i);
+            if (item->status != 0)
+            {
+                printf("%s : Error hashing file\n", item->file);
+                continue;
+            }
+
+            signature_length = sizeof(signature);
+            return_status = __trustm_batchSignOne(item, keyId, keyType, bypass,
+                                                  signature, &signature_length);
+            if (return_status != OPTIGA_LIB_SUCCESS)
+            {
+                // A chip error repeats for the other files, stop here
+                printf("%s : Error signing file\n", item->file);
+                trustmPrintErrorCode(return_status);
+                break;
+            }
+
+            if (fp != NULL)
+            {
+                trustmBatchWriteManifest(fp, signature, signature_length, item->file);
+            } else
+            {
+                snprintf(sigFile, sizeof(sigFile), "%s.sig", item->file);
+                if (trustmwriteTo(signature, signature_length, sigFile) != 0)
+                {
+                    printf("%s : Error writing signature\n", item->file);
+                    continue;
+                }
+            }
+            printf("%s : Signed\n", item->file);
+            done++;
+        }
+    } while (FALSE);
+
+    if (fp != NULL)
+        fclose(fp);
+
+    elapsed = trustmNowMs() - start;
+    printf("Signed %d of %d files in %llu ms", done, batch.count, (unsigned long long)elapsed);
+    if ((elapsed > 0) && (done > 0))
+        printf(" (%.1f sign/s)", done * 1000.0 / elapsed);
+    printf("\n");
+
+    i = batch.count - done;
+    trustmBatchFree(&batch);
+    return i;
+}
+
+/**********************************************************************
+* trustmBatchKeyParse()
+* Public key of a chip object holding a certificate (DER, identity or
+* compressed) or a public key (SubjectPublicKeyInfo, as saved by the
+* keygen tools). Returns NULL if none is found.
+**********************************************************************/
+EVP_PKEY *trustmBatchKeyParse(const uint8_t *data, uint16_t len)
+{
+    const unsigned char *p = data;
+    EVP_PKEY *pkey;
+    X509 *x509;
+
+    x509 = trustmCertParse(data, len);
+    if (x509 != NULL)
+    {
+        pkey = X509_get_pubkey(x509);
+        X509_free(x509);
+        return pkey;
+    }
+    return d2i_PUBKEY(NULL, &p, len);
+}
+
+/**********************************************************************
+* trustmBatchKeyRead()
+* Public key of a PEM file.
+**********************************************************************/
+EVP_PKEY *trustmBatchKeyRead(const char *pemFile)
+{
+    EVP_PKEY *pkey = NULL;
+    FILE *fp;
+
+    fp = fopen(pemFile, "r");
+    if (fp == NULL)
+        return NULL;
+    pkey = PEM_read_PUBKEY(fp, NULL, NULL, NULL);
+    fclose(fp);
+    return pkey;
+}
+
+/**********************************************************************
+* trustmBatchVerify()
+* Work function hashing the item file on the host and verifying the
+* manifest signature with the key, ctx is a trustm_batch_key_t.
+* ECDSA signatures are DER, RSA signatures PKCS#1 v1.5.
+**********************************************************************/
+uint16_t trustmBatchVerify(trustm_batch_item_t *item, void *ctx)
+{
+    trustm_batch_key_t *key = (trustm_batch_key_t *)ctx;
+    EVP_PKEY_CTX *pctx;
+    uint16_t ret = TRUSTM_BATCH_INVALID;
+
+    if (trustmHashFile(item->file, key->md, item->digest, &item->digestLen) != 0)
+        return TRUSTM_BATCH_ERROR;
+
+    pctx = EVP_PKEY_CTX_new(key->pkey, NULL);
+    if ((pctx != NULL) &&
+        (EVP_PKEY_verify_init(pctx) == 1) &&
+        (EVP_PKEY_CTX_set_signature_md(pctx, key->md) == 1) &&
+        (EVP_PKEY_verify(pctx, item->sig, item->sigLen, item->digest, item->digestLen) == 1))
+        ret = TRUSTM_BATCH_OK;
+    EVP_PKEY_CTX_free(pctx);
+
+    return ret;
+}
+
+/**********************************************************************
+* trustmBatchVerifyManifest()
+* Verify every signature of the manifest on the host. The public key,
+* of keyType EVP_PKEY_EC or EVP_PKEY_RSA, is read once: from the
+* certificate or public key object oid (through the cache) or, if given,
+* from pubkeyFile. Host threads then hash and verify the files in
+* parallel, the chip is only used to anchor the key. bypass = 1 skips
+* the shielded connection.
+* Returns the number of files not verified.
+**********************************************************************/
+uint32_t trustmBatchVerifyManifest(uint16_t oid, const char *pubkeyFile, int keyType,
+                                   uint16_t hashBits, const char *manifestFile,
+                                   uint16_t threads, uint8_t bypass)
+{
+    optiga_lib_status_t return_status;
+    trustm_batch_t batch;
+    trustm_batch_key_t key;
+    trustm_batch_item_t *item;
+    uint8_t obj[TRUSTM_CACHE_DATA_MAX];
+    uint16_t objLen = sizeof(obj);
+    uint32_t i;
+    uint32_t done = 0;
+    uint64_t start = trustmNowMs();
+    uint64_t elapsed;
+
+    if (pubkeyFile != NULL)
+    {
+        key.pkey = trustmBatchKeyRead(pubkeyFile);
+    } else
+    {
+        if (bypass != 1)
+        {
+            // OPTIGA Comms Shielded connection settings to enable the protection
+            TRUSTM_UTIL_SHIELDED(me_util);
+        }
+
+        // Immutable objects come from the cache
+        return_status = trustmCacheReadData(oid, 0, obj, &objLen);
+        if (return_status != OPTIGA_LIB_SUCCESS)
+        {
+            trustmPrintErrorCode(return_status);
+            return 1;
+        }
+        key.pkey = trustmBatchKeyParse(obj, objLen);
+    }
+    if ((key.pkey == NULL) || (EVP_PKEY_base_id(key.pkey) != keyType))
+    {
+        printf("No %s public key found!!!\n", (keyType == EVP_PKEY_EC) ? "ECC" : "RSA");
+        EVP_PKEY_free(key.pkey);
+        return 1;
+    }
+    key.md = (hashBits == 384) ? EVP_sha384() : EVP_sha256();
+
+    if (trustmBatchLoad(&batch, manifestFile, 1) != 0)
+    {
+        printf("Error reading manifest file!!!\n");
+        trustmBatchFree(&batch);
+        EVP_PKEY_free(key.pkey);
+        return 1;
+    }
+
+    if (trustmBatchStart(&batch, trustmBatchVerify, &key, threads) != 0)
+    {
+        printf("Error starting verify threads!!!\n");
+    } else
+    {
+        printf("Batch Files         : %d (%d threads)\n", batch.count, batch.threads);
+        for (i = 0; i < batch.count; i++)
+        {
+            item = trustmBatchWait(&batch, i);
+            if (item->status == TRUSTM_BATCH_OK)
+            {
+                printf("%s : Verify Success\n", item->file);
+                done++;
+            } else if (item->status == TRUSTM_BATCH_ERROR)
+                printf("%s : Error reading file\n", item->file);
+            else
+                printf("%s : Verify Failed\n", item->file);
+        }
+    }
+
+    elapsed = trustmNowMs() - start;
+    printf("Verified %d of %d files in %llu ms", done, batch.count, (unsigned long long)elapsed);
+    if ((elapsed > 0) && (done > 0))
+        printf(" (%.1f verify/s)", done * 1000.0 / elapsed);
+    printf("\n");
+
+    i = batch.count - done;
+    // Stops the threads before the key goes
+    trustmBatchFree(&batch);
+    EVP_PKEY_free(key.pkey);
+    return i;
+}
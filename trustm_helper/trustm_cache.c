@@ -0,0 +1,368 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "optiga/optiga_util.h"
+
+#include "trustm_helper.h"
+#include "trustm_cache.h"
+
+/*************************************************************************
+*  Global
+*************************************************************************/
+static uint8_t trustm_cacheUid[TRUSTM_CACHE_UID_LEN];
+static uint8_t trustm_cacheUidValid = 0;
+
+/*************************************************************************
+*  functions
+*************************************************************************/
+static uint8_t __trustm_cacheEnabled(void)
+{
+    const char *env = getenv(TRUSTM_CACHE_ENV);
+
+    return ((env == NULL) || (strcmp(env, "0") != 0)) ? 1 : 0;
+}
+
+static optiga_lib_status_t __trustm_cacheChipData(uint16_t oid, uint16_t offset, uint8_t *buf, uint16_t *len)
+{
+    optiga_lib_status_t return_status;
+    uint16_t size = *len;
+
+    TRUSTM_REPLAY(return_status,
+                  *len = size,
+                  optiga_util_read_data(me_util, oid, offset, buf, len));
+    return return_status;
+}
+
+static optiga_lib_status_t __trustm_cacheChipMetadata(uint16_t oid, uint8_t *buf, uint16_t *len)
+{
+    optiga_lib_status_t return_status;
+    uint16_t size = *len;
+
+    TRUSTM_REPLAY(return_status,
+                  *len = size,
+                  optiga_util_read_metadata(me_util, oid, buf, len));
+    return return_status;
+}
+
+/**********************************************************************
+* __trustm_cachePath()
+* Entry file of an OID in the directory of the chip UID. Returns 0
+* when there is no UID to key the entry with.
+**********************************************************************/
+static uint8_t __trustm_cachePath(char *path, size_t size, uint16_t oid, const char *type)
+{
+    uint8_t uid[TRUSTM_CACHE_UID_LEN];
+    uint16_t uidLen = sizeof(uid);
+    char hex[(TRUSTM_CACHE_UID_LEN * 2) + 1];
+    uint16_t i;
+
+    if (trustmCacheReadUID(uid, &uidLen) != OPTIGA_LIB_SUCCESS)
+        return 0;
+    for (i = 0; i < uidLen; i++)
+        sprintf(&hex[i * 2], "%.2X", uid[i]);
+    hex[uidLen * 2] = '\0';
+
+    snprintf(path, size, "%s/%s/%.4X.%s", TRUSTM_CACHE_DIR, hex, oid, type);
+    return 1;
+}
+
+static uint8_t __trustm_cacheLoad(const char *path, uint8_t *buf, uint16_t size, uint16_t *len)
+{
+    FILE *fp;
+    size_t n;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+        return 0;
+    n = fread(buf, 1, size, fp);
+    fclose(fp);
+    if (n == 0)
+        return 0;
+    *len = (uint16_t)n;
+    return 1;
+}
+
+/**********************************************************************
+* __trustm_cacheStore()
+* Write the entry to a file of this process and rename it into place,
+* readers never see a partial entry. A process without write access to
+* the cache directory just does not fill the cache.
+**********************************************************************/
+static void __trustm_cacheStore(const char *path, const uint8_t *buf, uint16_t len)
+{
+    char dir[256];
+    char tmp[280];
+    char *p;
+    FILE *fp;
+    size_t n;
+
+    strncpy(dir, path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    for (p = dir + 1; *p != '\0'; p++)
+    {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        mkdir(dir, 0755);
+        *p = '/';
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+    fp = fopen(tmp, "wb");
+    if (fp == NULL)
+    {
+        TRUSTM_HELPER_DBGFN("No cache entry %s", path);
+        return;
+    }
+    n = fwrite(buf, 1, len, fp);
+    if ((fclose(fp) != 0) || (n != len) || (rename(tmp, path) != 0))
+        unlink(tmp);
+}
+
+/**********************************************************************
+* trustmCacheImmutable()
+* 1 if the metadata locks the object for good. The change access must
+* be NEV, or LcsO < operational with the object operational already. A
+* data object must be readable always, data behind an access condition
+* is not put into a file.
+**********************************************************************/
+uint8_t trustmCacheImmutable(const uint8_t *metadata, uint16_t len, uint8_t data)
+{
+    static const uint8_t never[] = {0xFF};
+    static const uint8_t lcsoLocked[] = {0xE1, 0xFC, 0x07};
+    const uint8_t *change = NULL;
+    uint8_t changeLen = 0;
+    uint8_t readAlways = 0;
+    uint8_t lcso = CREATION;
+    uint16_t i;
+
+    if ((len < 2) || (metadata[0] != 0x20) || (metadata[1] + 2 > len))
+        return 0;
+
+    for (i = 2; i + 2 <= metadata[1] + 2; i += metadata[i+1] + 2)
+    {
+        if (i + 2 + metadata[i+1] > len)
+            return 0;
+        switch (metadata[i])
+        {
+            case 0xC0:
+                lcso = metadata[i+2];
+                break;
+            case 0xD0:
+                change = &metadata[i+2];
+                changeLen = metadata[i+1];
+                break;
+            case 0xD1:
+                readAlways = ((metadata[i+1] == 1) && (metadata[i+2] == 0x00));
+                break;
+        }
+    }
+
+    if ((data != 0) && (readAlways == 0))
+        return 0;
+    if ((changeLen == sizeof(never)) && (memcmp(change, never, sizeof(never)) == 0))
+        return 1;
+    if ((changeLen == sizeof(lcsoLocked)) && (memcmp(change, lcsoLocked, sizeof(lcsoLocked)) == 0) &&
+        (lcso >= OPERATION))
+        return 1;
+    return 0;
+}
+
+/**********************************************************************
+* trustmCacheReadUID()
+* Coprocessor UID (0xE0C2), read from the chip once per boot. The file
+* is not checked against the chip: it only names the directory of the
+* entries, every entry is still checked against its own metadata, and a
+* chip is only exchanged with the power off, which empties /run.
+**********************************************************************/
+optiga_lib_status_t trustmCacheReadUID(uint8_t *uid, uint16_t *len)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    char path[128];
+    uint8_t buf[TRUSTM_CACHE_UID_LEN + 1];
+    uint16_t bufLen = 0;
+
+    snprintf(path, sizeof(path), "%s/uid", TRUSTM_CACHE_DIR);
+    do
+    {
+        if (trustm_cacheUidValid)
+            break;
+
+        if (__trustm_cacheEnabled() &&
+            __trustm_cacheLoad(path, buf, sizeof(buf), &bufLen) &&
+            (bufLen == TRUSTM_CACHE_UID_LEN))
+        {
+            memcpy(trustm_cacheUid, buf, TRUSTM_CACHE_UID_LEN);
+            trustm_cacheUidValid = 1;
+            break;
+        }
+
+        bufLen = sizeof(buf);
+        return_status = __trustm_cacheChipData(TRUSTM_CACHE_UID_OID, 0, buf, &bufLen);
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+        if (bufLen != TRUSTM_CACHE_UID_LEN)
+        {
+            return_status = TRUSTM_ACCESS_ERROR;
+            break;
+        }
+        memcpy(trustm_cacheUid, buf, TRUSTM_CACHE_UID_LEN);
+        trustm_cacheUidValid = 1;
+        if (__trustm_cacheEnabled())
+            __trustm_cacheStore(path, buf, bufLen);
+    } while (FALSE);
+
+    if (return_status == OPTIGA_LIB_SUCCESS)
+    {
+        if (*len > TRUSTM_CACHE_UID_LEN)
+            *len = TRUSTM_CACHE_UID_LEN;
+        memcpy(uid, trustm_cacheUid, *len);
+    }
+    return return_status;
+}
+
+/**********************************************************************
+* trustmCacheReadMetadata()
+* Metadata of oid, from the cache when the object is immutable.
+**********************************************************************/
+optiga_lib_status_t trustmCacheReadMetadata(uint16_t oid, uint8_t *buf, uint16_t *len)
+{
+    optiga_lib_status_t return_status;
+    char path[256];
+    uint8_t entry[TRUSTM_CACHE_METADATA_MAX];
+    uint16_t entryLen;
+    uint8_t cached;
+
+    cached = __trustm_cacheEnabled() && __trustm_cachePath(path, sizeof(path), oid, "meta");
+    if (cached &&
+        __trustm_cacheLoad(path, entry, sizeof(entry), &entryLen) &&
+        (entryLen <= *len) &&
+        trustmCacheImmutable(entry, entryLen, 0))
+    {
+        TRUSTM_HELPER_DBGFN("0x%.4X metadata from %s", oid, path);
+        memcpy(buf, entry, entryLen);
+        *len = entryLen;
+        return OPTIGA_LIB_SUCCESS;
+    }
+
+    return_status = __trustm_cacheChipMetadata(oid, buf, len);
+    if ((return_status == OPTIGA_LIB_SUCCESS) && cached &&
+        (*len <= TRUSTM_CACHE_METADATA_MAX) && trustmCacheImmutable(buf, *len, 0))
+        __trustm_cacheStore(path, buf, *len);
+    return return_status;
+}
+
+/**********************************************************************
+* trustmCacheForget()
+* Drop the entries and the verdict of oid, after its metadata changed.
+**********************************************************************/
+void trustmCacheForget(uint16_t oid)
+{
+    char path[256];
+
+    if (!__trustm_cacheEnabled())
+        return;
+    if (__trustm_cachePath(path, sizeof(path), oid, "mut"))
+        unlink(path);
+    if (__trustm_cachePath(path, sizeof(path), oid, "meta"))
+        unlink(path);
+    if (__trustm_cachePath(path, sizeof(path), oid, "data"))
+        unlink(path);
+}
+
+/**********************************************************************
+* trustmCacheReadData()
+* Data of oid from offset, like optiga_util_read_data(). An immutable
+* object comes from the cache when the entry was taken with the same
+* metadata, read from the chip for every call. Any other object is read
+* from the chip, the first call leaves a marker so later calls skip the
+* metadata read. The entry holds the whole object.
+**********************************************************************/
+optiga_lib_status_t trustmCacheReadData(uint16_t oid, uint16_t offset, uint8_t *buf, uint16_t *len)
+{
+    char path[256];
+    char mutPath[256];
+    uint8_t metadata[TRUSTM_CACHE_METADATA_MAX];
+    uint16_t metadataLen = sizeof(metadata);
+    uint8_t entry[1 + TRUSTM_CACHE_METADATA_MAX + TRUSTM_CACHE_DATA_MAX];
+    uint16_t entryLen;
+    uint16_t dataLen;
+    uint8_t *data;
+
+    do
+    {
+        if (!__trustm_cacheEnabled() || !__trustm_cachePath(path, sizeof(path), oid, "data"))
+            break;
+
+        // Mutable verdict of an earlier call, straight to the chip
+        if (__trustm_cachePath(mutPath, sizeof(mutPath), oid, "mut") &&
+            (access(mutPath, F_OK) == 0))
+            break;
+
+        if (__trustm_cacheChipMetadata(oid, metadata, &metadataLen) != OPTIGA_LIB_SUCCESS)
+            break;
+        if (!trustmCacheImmutable(metadata, metadataLen, 1))
+        {
+            __trustm_cacheStore(mutPath, metadata, 0);
+            break;
+        }
+
+        // Entry : metadata length, metadata, data
+        if (!__trustm_cacheLoad(path, entry, sizeof(entry), &entryLen) ||
+            (entryLen < 1 + entry[0]) || (entry[0] != metadataLen) ||
+            (memcmp(&entry[1], metadata, metadataLen) != 0))
+        {
+            entry[0] = (uint8_t)metadataLen;
+            memcpy(&entry[1], metadata, metadataLen);
+            dataLen = TRUSTM_CACHE_DATA_MAX;
+            if (__trustm_cacheChipData(oid, 0, &entry[1 + metadataLen], &dataLen) != OPTIGA_LIB_SUCCESS)
+                break;
+            entryLen = 1 + metadataLen + dataLen;
+            __trustm_cacheStore(path, entry, entryLen);
+        }
+        else
+        {
+            TRUSTM_HELPER_DBGFN("0x%.4X data from %s", oid, path);
+        }
+
+        data = &entry[1 + metadataLen];
+        dataLen = entryLen - 1 - metadataLen;
+        if (offset > dataLen)
+            break;
+        if (*len > dataLen - offset)
+            *len = dataLen - offset;
+        memcpy(buf, data + offset, *len);
+        return OPTIGA_LIB_SUCCESS;
+    } while (FALSE);
+
+    return __trustm_cacheChipData(oid, offset, buf, len);
+}
@@ -0,0 +1,125 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <openssl/x509.h>
+
+#include "trustm_certcomp.h"
+
+/*************************************************************************
+*  functions
+*************************************************************************/
+/**********************************************************************
+* trustmCertCompress()
+* Wrap a DER certificate in the compressed container. objLen is the
+* size of obj on input and the container length on return.
+* Returns 0 on success, 1 on error or if the container is not smaller
+* than the certificate, write the DER then.
+**********************************************************************/
+uint16_t trustmCertCompress(const uint8_t *der, uint16_t derLen, uint8_t *obj, uint16_t *objLen)
+{
+    uLongf zLen;
+
+    if ((der == NULL) || (derLen == 0) || (der[0] != 0x30) ||
+        (derLen > TRUSTM_CERTCOMP_MAX_LEN) || (*objLen <= TRUSTM_CERTCOMP_HDR_LEN))
+        return 1;
+
+    zLen = *objLen - TRUSTM_CERTCOMP_HDR_LEN;
+    if (compress2(obj + TRUSTM_CERTCOMP_HDR_LEN, &zLen, der, derLen, Z_BEST_COMPRESSION) != Z_OK)
+        return 1;
+    if (zLen + TRUSTM_CERTCOMP_HDR_LEN >= derLen)
+        return 1;
+
+    obj[0] = TRUSTM_CERTCOMP_TAG;
+    obj[1] = TRUSTM_CERTCOMP_ZLIB;
+    obj[2] = 0;
+    obj[3] = (uint8_t)(derLen >> 8);
+    obj[4] = (uint8_t)(derLen);
+    *objLen = (uint16_t)(zLen + TRUSTM_CERTCOMP_HDR_LEN);
+    return 0;
+}
+
+/**********************************************************************
+* trustmCertChipOid()
+* Returns 1 if the chip may parse a certificate from the OID, as TLS
+* identity, verify or encrypt key source or trust anchor. Keep these in
+* DER, the chip does not understand the compressed container.
+**********************************************************************/
+uint16_t trustmCertChipOid(uint16_t oid)
+{
+    return (((oid >= 0xE0E0) && (oid <= 0xE0E3)) ||
+            (oid == 0xE0E8) || (oid == 0xE0E9) || (oid == 0xE0EF)) ? 1 : 0;
+}
+
+/**********************************************************************
+* trustmCertParse()
+* Certificate from the content of a data object: DER, TLS identity or
+* compressed container. NULL if there is none.
+**********************************************************************/
+X509 *trustmCertParse(const uint8_t *data, uint16_t len)
+{
+    uint8_t buf[TRUSTM_CERTCOMP_MAX_LEN];
+    const unsigned char *p = NULL;
+    uint32_t derLen = 0;
+    uLongf zLen;
+
+    if ((data == NULL) || (len == 0))
+        return NULL;
+
+    switch (data[0])
+    {
+        case 0x30: // DER format Cert
+            p = data;
+            derLen = len;
+            break;
+        case 0xC0: // TLS Indentity
+            if (len <= 9)
+                break;
+            p = data + 9;
+            derLen = len - 9;
+            break;
+        case TRUSTM_CERTCOMP_TAG: // Compressed Cert
+            if ((len <= TRUSTM_CERTCOMP_HDR_LEN) || (data[1] != TRUSTM_CERTCOMP_ZLIB))
+                break;
+            derLen = ((uint32_t)data[2] << 16) + ((uint32_t)data[3] << 8) + data[4];
+            if ((derLen == 0) || (derLen > sizeof(buf)))
+                break;
+            zLen = derLen;
+            if ((uncompress(buf, &zLen, data + TRUSTM_CERTCOMP_HDR_LEN,
+                            len - TRUSTM_CERTCOMP_HDR_LEN) != Z_OK) || (zLen != derLen))
+                break;
+            p = buf;
+            break;
+        case 0xC2: // USB Type-C identity
+        default:
+            break;
+    }
+
+    if (p == NULL)
+        return NULL;
+    return d2i_X509(NULL, &p, derLen);
+}
@@ -0,0 +1,536 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/objects.h>
+#include <openssl/x509v3.h>
+
+#include "optiga/optiga_util.h"
+#include "optiga/optiga_crypt.h"
+
+#include "trustm_helper.h"
+#include "trustm_dc.h"
+
+#define TRUSTM_DC_CONTEXT   "TLS, server delegated credentials"
+#define TRUSTM_DC_MARGIN    60      // [s] stop offering a credential this long before it expires
+
+// Credential in use by the TLS server, kept with the signer key
+typedef struct trustm_dc_signer_str
+{
+    EC_KEY          *dcKey;         // software key of the credential
+    time_t          expires;
+    uint16_t        scheme;
+    uint16_t        dcLen;
+    uint8_t         dc[TRUSTM_DC_MAX_LEN];
+} trustm_dc_signer_t;
+
+/*************************************************************************
+*  Global
+*************************************************************************/
+static pthread_mutex_t trustm_dcLock = PTHREAD_MUTEX_INITIALIZER;
+static EVP_PKEY *trustm_dcSigner = NULL;       // current credential, NULL: none
+static EC_KEY_METHOD *trustm_dcMethod = NULL;
+static int trustm_dcKeyIdx = -1;               // EC_KEY ex_data: trustm_dc_signer_t
+static int trustm_dcSslIdx = -1;               // SSL ex_data: signer of the handshake
+
+/*************************************************************************
+*  functions
+*************************************************************************/
+/**********************************************************************
+* __trustm_dcOpen()
+* Open the chip unless the caller holds it open already.
+* Returns 1 if the chip was opened here.
+**********************************************************************/
+static uint8_t __trustm_dcOpen(optiga_lib_status_t *return_status)
+{
+    *return_status = OPTIGA_LIB_SUCCESS;
+    if (trustm_open_flag == 1)
+        return 0;
+
+    trustm_hibernate_flag = 0;
+    *return_status = trustm_Open();
+    return (*return_status == OPTIGA_LIB_SUCCESS) ? 1 : 0;
+}
+
+/**********************************************************************
+* __trustm_dcScheme()
+* TLS SignatureScheme for the curve of an EC key, 0 if not supported
+* by the chip.
+**********************************************************************/
+static uint16_t __trustm_dcScheme(EVP_PKEY *pkey, const EVP_MD **md)
+{
+    const EC_KEY *ec;
+
+    ec = EVP_PKEY_get0_EC_KEY(pkey);
+    if (ec == NULL)
+        return 0;
+
+    switch (EC_GROUP_get_curve_name(EC_KEY_get0_group(ec)))
+    {
+        case NID_X9_62_prime256v1:
+            *md = EVP_sha256();
+            return 0x0403;      // ecdsa_secp256r1_sha256
+        case NID_secp384r1:
+            *md = EVP_sha384();
+            return 0x0503;      // ecdsa_secp384r1_sha384
+        default:
+            return 0;
+    }
+}
+
+/**********************************************************************
+* trustmDCCreate()
+* New credential key in software and the credential for it, signed by
+* the chip key <keyOid> of the certificate. The validity is counted
+* from now and limited to 7 days.
+**********************************************************************/
+optiga_lib_status_t trustmDCCreate(uint16_t keyOid, X509 *cert, uint32_t validSec, trustm_dc_t *dc)
+{
+    optiga_lib_status_t return_status = OPTIGA_CRYPT_ERROR;
+    EVP_PKEY *certKey;
+    EC_KEY *dcKey = NULL;
+    const EVP_MD *md = NULL;
+    EVP_MD_CTX *mdctx = NULL;
+    EVP_PKEY_CTX *pctx = NULL;
+    ASN1_OBJECT *obj = NULL;
+    uint8_t pad[64];
+    uint8_t digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLen;
+    uint8_t sig[2+TRUSTM_DC_KEY_MAX_LEN];
+    uint16_t sigLen;
+    uint8_t *spki = NULL;
+    uint8_t *certDer = NULL;
+    uint8_t *p;
+    int spkiLen;
+    int certDerLen;
+    int day, sec;
+    uint32_t validTime;
+    uint16_t credLen;
+    uint8_t opened = 0;
+
+    TRUSTM_HELPER_DBGFN(">");
+    memset(dc, 0, sizeof(trustm_dc_t));
+    do
+    {
+        certKey = X509_get0_pubkey(cert);
+        dc->scheme = __trustm_dcScheme(certKey, &md);
+        if (dc->scheme == 0)
+        {
+            TRUSTM_HELPER_ERRFN("Certificate key is not P-256 or P-384\n");
+            return_status = OPTIGA_CRYPT_ERROR_INVALID_INPUT;
+            break;
+        }
+
+        // Clients reject a credential of a certificate without it
+        obj = OBJ_txt2obj(TRUSTM_DC_OID_DELEGATION, 1);
+        if ((obj == NULL) || (X509_get_ext_by_OBJ(cert, obj, -1) < 0))
+        {
+            TRUSTM_HELPER_ERRFN("Certificate has no DelegationUsage extension\n");
+            return_status = OPTIGA_CRYPT_ERROR_INVALID_INPUT;
+            break;
+        }
+
+        // valid_time counts from notBefore of the certificate
+        if (validSec > TRUSTM_DC_MAX_VALID)
+            validSec = TRUSTM_DC_MAX_VALID;
+        if (!ASN1_TIME_diff(&day, &sec, X509_get0_notBefore(cert), NULL) ||
+            (day < 0) || (sec < 0))
+        {
+            TRUSTM_HELPER_ERRFN("Certificate is not valid yet\n");
+            return_status = OPTIGA_CRYPT_ERROR_INVALID_INPUT;
+            break;
+        }
+        validTime = (uint32_t)day * 24 * 3600 + sec + validSec;
+        dc->expires = time(NULL) + validSec;
+
+        // Credential key, always the OpenSSL method and never the engine
+        dcKey = EC_KEY_new_by_curve_name(EC_GROUP_get_curve_name(
+                        EC_KEY_get0_group(EVP_PKEY_get0_EC_KEY(certKey))));
+        if ((dcKey == NULL) ||
+            !EC_KEY_set_method(dcKey, EC_KEY_OpenSSL()) ||
+            !EC_KEY_generate_key(dcKey))
+            break;
+
+        p = dc->key;
+        if (i2d_ECPrivateKey(dcKey, NULL) > (int)sizeof(dc->key))
+            break;
+        dc->keyLen = i2d_ECPrivateKey(dcKey, &p);
+
+        spkiLen = i2d_EC_PUBKEY(dcKey, &spki);
+        certDerLen = i2d_X509(cert, &certDer);
+        if ((spkiLen <= 0) || (certDerLen <= 0) ||
+            (4+2+3+spkiLen+2+2+sizeof(sig) > sizeof(dc->dc)))
+            break;
+
+        // Credential: valid_time, dc_cert_verify_algorithm, ASN1_subjectPublicKeyInfo
+        p = dc->dc;
+        *p++ = (uint8_t)(validTime >> 24);
+        *p++ = (uint8_t)(validTime >> 16);
+        *p++ = (uint8_t)(validTime >> 8);
+        *p++ = (uint8_t)validTime;
+        *p++ = (uint8_t)(dc->scheme >> 8);
+        *p++ = (uint8_t)dc->scheme;
+        *p++ = (uint8_t)(spkiLen >> 16);
+        *p++ = (uint8_t)(spkiLen >> 8);
+        *p++ = (uint8_t)spkiLen;
+        memcpy(p, spki, spkiLen);
+        p += spkiLen;
+        // algorithm of the signature below
+        *p++ = (uint8_t)(dc->scheme >> 8);
+        *p++ = (uint8_t)dc->scheme;
+        credLen = p - dc->dc;
+
+        // Signed: 64 spaces, context string, 0, certificate, Credential, algorithm
+        memset(pad, 0x20, sizeof(pad));
+        mdctx = EVP_MD_CTX_new();
+        if ((mdctx == NULL) ||
+            !EVP_DigestInit_ex(mdctx, md, NULL) ||
+            !EVP_DigestUpdate(mdctx, pad, sizeof(pad)) ||
+            !EVP_DigestUpdate(mdctx, TRUSTM_DC_CONTEXT, sizeof(TRUSTM_DC_CONTEXT)) ||
+            !EVP_DigestUpdate(mdctx, certDer, certDerLen) ||
+            !EVP_DigestUpdate(mdctx, dc->dc, credLen) ||
+            !EVP_DigestFinal_ex(mdctx, digest, &digestLen))
+            break;
+
+        opened = __trustm_dcOpen(&return_status);
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+
+        TRUSTM_REPLAY(return_status,
+                      sigLen = sizeof(sig) - 2,
+                      optiga_crypt_ecdsa_sign(me_crypt,
+                                              digest,
+                                              digestLen,
+                                              keyOid,
+                                              (sig+2),
+                                              &sigLen));
+        if (return_status != OPTIGA_LIB_SUCCESS)
+        {
+            TRUSTM_HELPER_ERRFN("Fail : credential signature 0x%.4X\n", keyOid);
+            trustmPrintErrorCode(return_status);
+            break;
+        }
+
+        // The chip returns r and s, add the SEQUENCE
+        sig[0] = 0x30;
+        sig[1] = sigLen;
+        sigLen += 2;
+
+        // Wrong key for the certificate, better to find out here than in the client
+        return_status = OPTIGA_CRYPT_ERROR;
+        pctx = EVP_PKEY_CTX_new(certKey, NULL);
+        if ((pctx == NULL) ||
+            (EVP_PKEY_verify_init(pctx) != 1) ||
+            (EVP_PKEY_verify(pctx, sig, sigLen, digest, digestLen) != 1))
+        {
+            TRUSTM_HELPER_ERRFN("Key 0x%.4X does not match the certificate\n", keyOid);
+            break;
+        }
+
+        p = &dc->dc[credLen];
+        *p++ = (uint8_t)(sigLen >> 8);
+        *p++ = (uint8_t)sigLen;
+        memcpy(p, sig, sigLen);
+        dc->dcLen = credLen + 2 + sigLen;
+        return_status = OPTIGA_LIB_SUCCESS;
+    } while (FALSE);
+
+    if (opened)
+        trustm_Close();
+
+    if (return_status != OPTIGA_LIB_SUCCESS)
+        OPENSSL_cleanse(dc, sizeof(trustm_dc_t));
+
+    EVP_MD_CTX_free(mdctx);
+    EVP_PKEY_CTX_free(pctx);
+    ASN1_OBJECT_free(obj);
+    OPENSSL_free(spki);
+    OPENSSL_free(certDer);
+    EC_KEY_free(dcKey);
+    TRUSTM_HELPER_DBGFN("<");
+    return return_status;
+}
+
+/**********************************************************************
+* __trustm_dcSign()
+* Sign method of the signer key. The signer carries the public key of
+* the certificate, the signature comes from the credential key.
+**********************************************************************/
+static int __trustm_dcSign(int type, const unsigned char *dgst, int dlen,
+                           unsigned char *sig, unsigned int *siglen,
+                           const BIGNUM *kinv, const BIGNUM *r, EC_KEY *eckey)
+{
+    trustm_dc_signer_t *signer;
+
+    signer = EC_KEY_get_ex_data(eckey, trustm_dcKeyIdx);
+    if (signer == NULL)
+        return 0;
+    return ECDSA_sign_ex(type, dgst, dlen, sig, siglen, kinv, r, signer->dcKey);
+}
+
+static ECDSA_SIG *__trustm_dcSignSig(const unsigned char *dgst, int dlen,
+                                     const BIGNUM *kinv, const BIGNUM *r, EC_KEY *eckey)
+{
+    trustm_dc_signer_t *signer;
+
+    signer = EC_KEY_get_ex_data(eckey, trustm_dcKeyIdx);
+    if (signer == NULL)
+        return NULL;
+    return ECDSA_do_sign_ex(dgst, dlen, kinv, r, signer->dcKey);
+}
+
+static void __trustm_dcKeyFree(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+                               int idx, long argl, void *argp)
+{
+    trustm_dc_signer_t *signer = ptr;
+
+    if (signer == NULL)
+        return;
+    EC_KEY_free(signer->dcKey);
+    OPENSSL_clear_free(signer, sizeof(trustm_dc_signer_t));
+}
+
+static void __trustm_dcSslFree(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+                               int idx, long argl, void *argp)
+{
+    EVP_PKEY_free(ptr);
+}
+
+/**********************************************************************
+* __trustm_dcInit()
+* Signer method and ex_data indexes, once per process.
+**********************************************************************/
+static int __trustm_dcInit(void)
+{
+    if (trustm_dcMethod != NULL)
+        return 1;
+
+    trustm_dcKeyIdx = EC_KEY_get_ex_new_index(0, NULL, NULL, NULL, __trustm_dcKeyFree);
+    trustm_dcSslIdx = SSL_get_ex_new_index(0, NULL, NULL, NULL, __trustm_dcSslFree);
+    if ((trustm_dcKeyIdx < 0) || (trustm_dcSslIdx < 0))
+        return 0;
+
+    trustm_dcMethod = EC_KEY_METHOD_new(EC_KEY_OpenSSL());
+    if (trustm_dcMethod == NULL)
+        return 0;
+    EC_KEY_METHOD_set_sign(trustm_dcMethod, __trustm_dcSign, NULL, __trustm_dcSignSig);
+    return 1;
+}
+
+/**********************************************************************
+* trustmDCSet()
+* Credential for the handshakes of this process from now on. The
+* handshakes in progress keep the credential they started with.
+* Returns 1 on success.
+**********************************************************************/
+int trustmDCSet(X509 *cert, const trustm_dc_t *dc)
+{
+    trustm_dc_signer_t *signer = NULL;
+    EVP_PKEY *pkey = NULL;
+    EC_KEY *ec = NULL;
+    const EC_KEY *certEc;
+    const uint8_t *p;
+    int ret = 0;
+
+    pthread_mutex_lock(&trustm_dcLock);
+    do
+    {
+        if (!__trustm_dcInit())
+            break;
+
+        signer = OPENSSL_zalloc(sizeof(trustm_dc_signer_t));
+        if ((signer == NULL) || (dc->dcLen > sizeof(signer->dc)))
+            break;
+        p = dc->key;
+        signer->dcKey = d2i_ECPrivateKey(NULL, &p, dc->keyLen);
+        if ((signer->dcKey == NULL) || !EC_KEY_set_method(signer->dcKey, EC_KEY_OpenSSL()))
+            break;
+        signer->expires = dc->expires;
+        signer->scheme = dc->scheme;
+        signer->dcLen = dc->dcLen;
+        memcpy(signer->dc, dc->dc, dc->dcLen);
+
+        // Public key of the certificate, so OpenSSL takes it as the
+        // private key of the certificate
+        certEc = EVP_PKEY_get0_EC_KEY(X509_get0_pubkey(cert));
+        ec = EC_KEY_new();
+        if ((certEc == NULL) || (ec == NULL) ||
+            !EC_KEY_set_method(ec, trustm_dcMethod) ||
+            !EC_KEY_set_group(ec, EC_KEY_get0_group(certEc)) ||
+            !EC_KEY_set_public_key(ec, EC_KEY_get0_public_key(certEc)) ||
+            !EC_KEY_set_ex_data(ec, trustm_dcKeyIdx, signer))
+            break;
+        signer = NULL;      // freed with ec
+
+        pkey = EVP_PKEY_new();
+        if ((pkey == NULL) || !EVP_PKEY_assign_EC_KEY(pkey, ec))
+            break;
+        ec = NULL;          // freed with pkey
+
+        EVP_PKEY_free(trustm_dcSigner);
+        trustm_dcSigner = pkey;
+        pkey = NULL;
+        ret = 1;
+    } while (FALSE);
+    pthread_mutex_unlock(&trustm_dcLock);
+
+    if (signer != NULL)
+    {
+        EC_KEY_free(signer->dcKey);
+        OPENSSL_clear_free(signer, sizeof(trustm_dc_signer_t));
+    }
+    EC_KEY_free(ec);
+    EVP_PKEY_free(pkey);
+    return ret;
+}
+
+/**********************************************************************
+* __trustm_dcParse()
+* delegated_credential in the ClientHello: the SignatureSchemeList the
+* client accepts for the credential. If ours is in, the handshake
+* signs with the credential key.
+**********************************************************************/
+static int __trustm_dcParse(SSL *ssl, unsigned int ext_type, unsigned int context,
+                            const unsigned char *in, size_t inlen,
+                            X509 *x, size_t chainidx, int *al, void *parse_arg)
+{
+    trustm_dc_signer_t *signer;
+    EVP_PKEY *pkey = NULL;
+    size_t len;
+    size_t i;
+
+    if ((inlen < 2) || (((in[0] << 8) | in[1]) != inlen - 2) || (inlen & 1))
+    {
+        *al = SSL_AD_DECODE_ERROR;
+        return 0;
+    }
+
+    pthread_mutex_lock(&trustm_dcLock);
+    if (trustm_dcSigner != NULL)
+    {
+        signer = EC_KEY_get_ex_data(EVP_PKEY_get0_EC_KEY(trustm_dcSigner), trustm_dcKeyIdx);
+        len = inlen - 2;
+        for (i = 0; i < len; i += 2)
+        {
+            if (((in[2+i] << 8) | in[3+i]) == signer->scheme)
+                break;
+        }
+        if ((i < len) && (time(NULL) + TRUSTM_DC_MARGIN < signer->expires))
+        {
+            pkey = trustm_dcSigner;
+            EVP_PKEY_up_ref(pkey);
+        }
+    }
+    pthread_mutex_unlock(&trustm_dcLock);
+
+    // A second ClientHello after HelloRetryRequest replaces the first
+    EVP_PKEY_free(SSL_get_ex_data(ssl, trustm_dcSslIdx));
+    SSL_set_ex_data(ssl, trustm_dcSslIdx, pkey);
+    if ((pkey != NULL) && (SSL_use_PrivateKey(ssl, pkey) != 1))
+    {
+        // The certificate key stays, the credential is not sent
+        SSL_set_ex_data(ssl, trustm_dcSslIdx, NULL);
+        EVP_PKEY_free(pkey);
+    }
+    return 1;
+}
+
+/**********************************************************************
+* __trustm_dcAdd()
+* delegated_credential in the CertificateEntry of the server
+* certificate, only if the client asked for it.
+**********************************************************************/
+static int __trustm_dcAdd(SSL *ssl, unsigned int ext_type, unsigned int context,
+                          const unsigned char **out, size_t *outlen,
+                          X509 *x, size_t chainidx, int *al, void *add_arg)
+{
+    trustm_dc_signer_t *signer;
+    EVP_PKEY *pkey;
+
+    if (chainidx != 0)
+        return 0;
+    pkey = SSL_get_ex_data(ssl, trustm_dcSslIdx);
+    if (pkey == NULL)
+        return 0;
+
+    signer = EC_KEY_get_ex_data(EVP_PKEY_get0_EC_KEY(pkey), trustm_dcKeyIdx);
+    *out = signer->dc;
+    *outlen = signer->dcLen;
+    return 1;
+}
+
+/**********************************************************************
+* trustmDCEnable()
+* Offer the credential set with trustmDCSet() in the TLS 1.3
+* handshakes of the context. Clients without delegated credential
+* support get the usual signature of the chip key.
+* Returns 1 on success.
+**********************************************************************/
+int trustmDCEnable(SSL_CTX *ctx)
+{
+    int ret;
+
+    pthread_mutex_lock(&trustm_dcLock);
+    ret = __trustm_dcInit();
+    pthread_mutex_unlock(&trustm_dcLock);
+    if (!ret)
+        return 0;
+
+    return SSL_CTX_add_custom_ext(ctx, TRUSTM_DC_EXT_TYPE,
+                                  SSL_EXT_CLIENT_HELLO | SSL_EXT_TLS1_3_CERTIFICATE |
+                                  SSL_EXT_TLS1_3_ONLY,
+                                  __trustm_dcAdd, NULL, NULL,
+                                  __trustm_dcParse, NULL);
+}
+
+/**********************************************************************
+* trustmDCUsed()
+* 1 if the handshake was signed with the credential key.
+**********************************************************************/
+int trustmDCUsed(SSL *ssl)
+{
+    if (trustm_dcSslIdx < 0)
+        return 0;
+    return ((SSL_get_ex_data(ssl, trustm_dcSslIdx) != NULL) && !SSL_session_reused(ssl)) ? 1 : 0;
+}
+
+/**********************************************************************
+* trustmDCCleanup()
+* Drop the credential of this process.
+**********************************************************************/
+void trustmDCCleanup(void)
+{
+    pthread_mutex_lock(&trustm_dcLock);
+    EVP_PKEY_free(trustm_dcSigner);
+    trustm_dcSigner = NULL;
+    pthread_mutex_unlock(&trustm_dcLock);
+}
@@ -0,0 +1,325 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+
+#include "trustm_envelope.h"
+
+/*************************************************************************
+*  functions
+*************************************************************************/
+/**********************************************************************
+* __trustm_envelopeHeader()
+* Serialize the header, returns its length.
+**********************************************************************/
+static uint16_t __trustm_envelopeHeader(const trustm_envelope_t *env, uint8_t *hdr)
+{
+    uint16_t len = 0;
+
+    memcpy(hdr, TRUSTM_ENVELOPE_MAGIC, 4);
+    len += 4;
+    hdr[len++] = TRUSTM_ENVELOPE_VERSION;
+    hdr[len++] = TRUSTM_ENVELOPE_RSA_AES256GCM;
+    hdr[len++] = (uint8_t)(env->wrapLen >> 8);
+    hdr[len++] = (uint8_t)(env->wrapLen);
+    memcpy(hdr + len, env->wrap, env->wrapLen);
+    len += env->wrapLen;
+    memcpy(hdr + len, env->iv, TRUSTM_ENVELOPE_IV_LEN);
+    len += TRUSTM_ENVELOPE_IV_LEN;
+
+    return len;
+}
+
+/**********************************************************************
+* __trustm_envelopeParse()
+* Read the header from fp. Returns 0 on success.
+**********************************************************************/
+static uint16_t __trustm_envelopeParse(FILE *fp, trustm_envelope_t *env)
+{
+    uint8_t fixed[8];
+
+    if (fread(fixed, 1, sizeof(fixed), fp) != sizeof(fixed))
+        return TRUSTM_ENVELOPE_ERROR;
+    if ((memcmp(fixed, TRUSTM_ENVELOPE_MAGIC, 4) != 0) ||
+        (fixed[4] != TRUSTM_ENVELOPE_VERSION) ||
+        (fixed[5] != TRUSTM_ENVELOPE_RSA_AES256GCM))
+        return TRUSTM_ENVELOPE_ERROR;
+
+    env->wrapLen = ((uint16_t)fixed[6] << 8) | fixed[7];
+    if ((env->wrapLen == 0) || (env->wrapLen > sizeof(env->wrap)))
+        return TRUSTM_ENVELOPE_ERROR;
+    if ((fread(env->wrap, 1, env->wrapLen, fp) != env->wrapLen) ||
+        (fread(env->iv, 1, TRUSTM_ENVELOPE_IV_LEN, fp) != TRUSTM_ENVELOPE_IV_LEN))
+        return TRUSTM_ENVELOPE_ERROR;
+
+    return 0;
+}
+
+/**********************************************************************
+* __trustm_envelopeTemp()
+* Create a temporary file next to outFile, so rename() stays on the
+* same file system. Returns NULL on error.
+**********************************************************************/
+static FILE *__trustm_envelopeTemp(const char *outFile, char *tmpFile, size_t size)
+{
+    const char *base = strrchr(outFile, '/');
+    FILE *fp;
+    int len;
+    int fd;
+
+    if (base == NULL)
+        len = snprintf(tmpFile, size, ".%s.XXXXXX", outFile);
+    else
+        len = snprintf(tmpFile, size, "%.*s/.%s.XXXXXX", (int)(base - outFile), outFile, base + 1);
+    if ((len < 0) || ((size_t)len >= size))
+        return NULL;
+
+    fd = mkstemp(tmpFile);
+    if (fd < 0)
+        return NULL;
+    fp = fdopen(fd, "wb");
+    if (fp == NULL)
+    {
+        close(fd);
+        unlink(tmpFile);
+    }
+    return fp;
+}
+
+/**********************************************************************
+* trustmEnvelopeEncrypt()
+* Write the envelope of inFile to outFile. key is the AES-256 key
+* wrapped in env. Returns 0 on success. The envelope is written to a
+* temporary file next to outFile and renamed over it when complete, so
+* outFile may be inFile. On any error, also if inFile is above
+* TRUSTM_ENVELOPE_BODY_MAX, outFile is left as it was. outFile must be
+* a regular file or not exist.
+**********************************************************************/
+uint16_t trustmEnvelopeEncrypt(const char *inFile, const char *outFile, const trustm_envelope_t *env, const uint8_t *key)
+{
+    EVP_CIPHER_CTX *ctx = NULL;
+    struct stat st;
+    char tmpFile[PATH_MAX];
+    uint8_t hdr[TRUSTM_ENVELOPE_HDR_MAX];
+    uint8_t tag[TRUSTM_ENVELOPE_TAG_LEN];
+    uint8_t *in = NULL;
+    uint8_t *out = NULL;
+    uint16_t hdrLen;
+    uint16_t ret = TRUSTM_ENVELOPE_ERROR;
+    uint64_t total = 0;
+    size_t len = 0;
+    int outLen;
+    FILE *fin = NULL;
+    FILE *fout = NULL;
+
+    do
+    {
+        if ((env->wrapLen == 0) || (env->wrapLen > sizeof(env->wrap)))
+            break;
+
+        fin = fopen(inFile, "rb");
+        if (fin == NULL)
+            break;
+        // No rename over a device or pipe, e.g. /dev/null
+        if ((stat(outFile, &st) == 0) && !S_ISREG(st.st_mode))
+            break;
+        fout = __trustm_envelopeTemp(outFile, tmpFile, sizeof(tmpFile));
+        if (fout == NULL)
+            break;
+        in = malloc(TRUSTM_ENVELOPE_CHUNK);
+        out = malloc(TRUSTM_ENVELOPE_CHUNK);
+        ctx = EVP_CIPHER_CTX_new();
+        if ((in == NULL) || (out == NULL) || (ctx == NULL))
+            break;
+
+        if ((EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1) ||
+            (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, TRUSTM_ENVELOPE_IV_LEN, NULL) != 1) ||
+            (EVP_EncryptInit_ex(ctx, NULL, NULL, key, env->iv) != 1))
+            break;
+
+        hdrLen = __trustm_envelopeHeader(env, hdr);
+        if ((EVP_EncryptUpdate(ctx, NULL, &outLen, hdr, hdrLen) != 1) ||
+            (fwrite(hdr, 1, hdrLen, fout) != hdrLen))
+            break;
+
+        while ((len = fread(in, 1, TRUSTM_ENVELOPE_CHUNK, fin)) > 0)
+        {
+            total += len;
+            if ((total > TRUSTM_ENVELOPE_BODY_MAX) ||
+                (EVP_EncryptUpdate(ctx, out, &outLen, in, len) != 1) ||
+                (fwrite(out, 1, outLen, fout) != (size_t)outLen))
+                break;
+        }
+        if ((len != 0) || ferror(fin))
+            break;
+
+        if ((EVP_EncryptFinal_ex(ctx, out, &outLen) != 1) ||
+            (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TRUSTM_ENVELOPE_TAG_LEN, tag) != 1) ||
+            (fwrite(tag, 1, TRUSTM_ENVELOPE_TAG_LEN, fout) != TRUSTM_ENVELOPE_TAG_LEN))
+            break;
+        ret = 0;
+    } while (0);
+
+    EVP_CIPHER_CTX_free(ctx);
+    free(in);
+    free(out);
+    if (fin != NULL)
+        fclose(fin);
+    if (fout != NULL)
+    {
+        if (fclose(fout) != 0)
+            ret = TRUSTM_ENVELOPE_ERROR;
+        if ((ret == 0) && (rename(tmpFile, outFile) != 0))
+            ret = TRUSTM_ENVELOPE_ERROR;
+        if (ret != 0)
+            unlink(tmpFile);
+    }
+    return ret;
+}
+
+/**********************************************************************
+* trustmEnvelopeReadHeader()
+* Read the header of an envelope file to get the wrapped key.
+**********************************************************************/
+uint16_t trustmEnvelopeReadHeader(const char *inFile, trustm_envelope_t *env)
+{
+    uint16_t ret;
+    FILE *fp;
+
+    fp = fopen(inFile, "rb");
+    if (fp == NULL)
+        return TRUSTM_ENVELOPE_ERROR;
+    ret = __trustm_envelopeParse(fp, env);
+    fclose(fp);
+    return ret;
+}
+
+/**********************************************************************
+* trustmEnvelopeDecrypt()
+* Decrypt the envelope inFile to outFile with the unwrapped key. The
+* plaintext is streamed to a temporary file next to outFile before the
+* tag can be checked, and replaces outFile only once the tag matches.
+* On any error outFile is left as it was. outFile must be a regular
+* file or not exist, the temporary file is created with mode 0600.
+**********************************************************************/
+uint16_t trustmEnvelopeDecrypt(const char *inFile, const char *outFile, const uint8_t *key)
+{
+    EVP_CIPHER_CTX *ctx = NULL;
+    trustm_envelope_t env;
+    struct stat st;
+    char tmpFile[PATH_MAX];
+    uint8_t hdr[TRUSTM_ENVELOPE_HDR_MAX];
+    uint8_t tag[TRUSTM_ENVELOPE_TAG_LEN];
+    uint8_t *in = NULL;
+    uint8_t *out = NULL;
+    uint16_t hdrLen;
+    uint16_t ret = TRUSTM_ENVELOPE_ERROR;
+    uint64_t remain = 0;
+    size_t len;
+    int outLen;
+    FILE *fin = NULL;
+    FILE *fout = NULL;
+
+    do
+    {
+        // The tag is found from the file size
+        fin = fopen(inFile, "rb");
+        if ((fin == NULL) || (fstat(fileno(fin), &st) != 0) || !S_ISREG(st.st_mode))
+            break;
+        if (__trustm_envelopeParse(fin, &env) != 0)
+            break;
+        hdrLen = __trustm_envelopeHeader(&env, hdr);
+        if ((uint64_t)st.st_size < (uint64_t)hdrLen + TRUSTM_ENVELOPE_TAG_LEN)
+            break;
+        remain = st.st_size - hdrLen - TRUSTM_ENVELOPE_TAG_LEN;
+        if (remain > TRUSTM_ENVELOPE_BODY_MAX)
+            break;
+
+        // No rename over a device or pipe, e.g. /dev/stdout
+        if ((stat(outFile, &st) == 0) && !S_ISREG(st.st_mode))
+            break;
+        fout = __trustm_envelopeTemp(outFile, tmpFile, sizeof(tmpFile));
+        if (fout == NULL)
+            break;
+        in = malloc(TRUSTM_ENVELOPE_CHUNK);
+        out = malloc(TRUSTM_ENVELOPE_CHUNK);
+        ctx = EVP_CIPHER_CTX_new();
+        if ((in == NULL) || (out == NULL) || (ctx == NULL))
+            break;
+
+        if ((EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1) ||
+            (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, TRUSTM_ENVELOPE_IV_LEN, NULL) != 1) ||
+            (EVP_DecryptInit_ex(ctx, NULL, NULL, key, env.iv) != 1) ||
+            (EVP_DecryptUpdate(ctx, NULL, &outLen, hdr, hdrLen) != 1))
+            break;
+
+        while (remain > 0)
+        {
+            len = (remain < TRUSTM_ENVELOPE_CHUNK) ? (size_t)remain : TRUSTM_ENVELOPE_CHUNK;
+            if ((fread(in, 1, len, fin) != len) ||
+                (EVP_DecryptUpdate(ctx, out, &outLen, in, len) != 1) ||
+                (fwrite(out, 1, outLen, fout) != (size_t)outLen))
+                break;
+            remain -= len;
+        }
+        if (remain != 0)
+            break;
+
+        if ((fread(tag, 1, TRUSTM_ENVELOPE_TAG_LEN, fin) != TRUSTM_ENVELOPE_TAG_LEN) ||
+            (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TRUSTM_ENVELOPE_TAG_LEN, tag) != 1))
+            break;
+        if (EVP_DecryptFinal_ex(ctx, out, &outLen) != 1)
+        {
+            ret = TRUSTM_ENVELOPE_AUTH;
+            break;
+        }
+        ret = 0;
+    } while (0);
+
+    EVP_CIPHER_CTX_free(ctx);
+    if (out != NULL)
+        OPENSSL_cleanse(out, TRUSTM_ENVELOPE_CHUNK);
+    free(in);
+    free(out);
+    if (fin != NULL)
+        fclose(fin);
+    if (fout != NULL)
+    {
+        if (fclose(fout) != 0)
+            ret = TRUSTM_ENVELOPE_ERROR;
+        if ((ret == 0) && (rename(tmpFile, outFile) != 0))
+            ret = TRUSTM_ENVELOPE_ERROR;
+        if (ret != 0)
+            unlink(tmpFile);
+    }
+    return ret;
+}
@@ -27,14 +27,19 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <fcntl.h>
+
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 #include <openssl/bio.h>
 #include <openssl/pem.h>
 #include <openssl/asn1.h>
+#include <openssl/evp.h>
 
 #include "optiga/optiga_util.h"
 #include "optiga/pal/pal_os_timer.h"
@@ -42,6 +47,7 @@
 #include "optiga/pal/pal_ifx_i2c_config.h"
 
 #include "trustm_helper.h"
+#include "trustm_cache.h"
 
 /*************************************************************************
 *  Global
@@ -51,6 +57,7 @@ optiga_crypt_t * me_crypt;
 optiga_lib_status_t optiga_lib_status;
 uint16_t trustm_open_flag = 0;
 uint8_t trustm_hibernate_flag = 0;
+uint8_t trustm_session_flag = 0;
 
 //Globe Variable
 // for IPC
@@ -115,7 +122,20 @@ static char __HFU[] = "HFU";
 static char __DM[] = "DM";
 static char __SIGN[] = "Sign";
 static char __AGREE[] = "Agreement";
-static char __E1[100];
+static char __RFU[] = "RFU";
+
+// Objects named by trustmGetOIDName, in the order of the metadata sweep
+static const uint16_t __knownOID[] = {
+    0xE0C0,0xE0C1,0xE0C2,0xE0C3,0xE0C4,0xE0C5,0xE0C6,
+    0xE0E0,0xE0E1,0xE0E2,0xE0E3,0xE0E8,0xE0E9,0xE0EF,
+    0xE0F0,0xE0F1,0xE0F2,0xE0F3,0xE0FC,0xE0FD,
+    0xE100,0xE101,0xE102,0xE103,
+    0xE120,0xE121,0xE122,0xE123,
+    0xE140,
+    0xF1C0,0xF1C1,0xF1C2,
+    0xF1D0,0xF1D1,0xF1D2,0xF1D3,0xF1D4,0xF1D5,
+    0xF1D6,0xF1D7,0xF1D8,0xF1D9,0xF1DA,0xF1DB,
+    0xF1E0,0xF1E1};
 
 
 /**********************************************************************
@@ -153,8 +173,9 @@ int mssleep(long msec)
 
 /**********************************************************************
 * __trustm_writeshm()
+* Returns 0 on success, 1 if the segment cannot be attached.
 **********************************************************************/
-static void __trustm_writeshm(int shmid,pid_t data)
+static int __trustm_writeshm(int shmid,pid_t data)
 {
     pid_t  *Flag_segptr;
 
@@ -162,15 +183,17 @@ static void __trustm_writeshm(int shmid,pid_t data)
      if((Flag_segptr = (pid_t *)shmat(shmid, 0, 0)) == (pid_t *)-1)
      {
              perror("write flag shmat");
-             exit(1);
+             return 1;
      }
 
      *Flag_segptr=data;
      shmdt(Flag_segptr);
+     return 0;
 }
 
 /**********************************************************************
 * __trustm_readshm()
+* Returns -1 if the segment cannot be attached.
 **********************************************************************/
 static pid_t __trustm_readshm(int shmid)
 {   pid_t  *Flag_segptr;
@@ -179,7 +202,7 @@ static pid_t __trustm_readshm(int shmid)
      if((Flag_segptr = (pid_t *)shmat(shmid, 0, 0)) == (pid_t *)-1)
      {
              perror("read flag shmat");
-             exit(1);
+             return -1;
      }
      Flag = *Flag_segptr;
      shmdt(Flag_segptr);
@@ -189,8 +212,10 @@ static pid_t __trustm_readshm(int shmid)
 
 /**********************************************************************
 * __trustm_ipcInit()
+* Returns 0 on success, 1 on error. Errors are returned rather than
+* exit(), trustm_Open() fails and a batch of the trustm CLI goes on.
 **********************************************************************/
-static void __trustm_ipcInit(void)
+static int __trustm_ipcInit(void)
 {
 	/* Unique Key for InterCom */
     ipc_FlagInterKey = 0x11111123;
@@ -204,7 +229,7 @@ static void __trustm_ipcInit(void)
         if((ipc_FlagInterShmid = shmget(ipc_FlagInterKey, IPC_FLAGSIZE, 0)) == -1)
         {
             perror("Init shmget");
-            exit(1);
+            return 1;
         }
     }
     else
@@ -214,69 +239,66 @@ static void __trustm_ipcInit(void)
         TRUSTM_HELPER_DBGFN("Init Queue %d", pid);
         
         //~ __trustm_writeshm(ipc_FlagInterShmid,0x1);
-        __trustm_writeshm(ipc_FlagInterShmid,pid); // stores the current PID
+        return __trustm_writeshm(ipc_FlagInterShmid,pid); // stores the current PID
     }
-}
-
-
-static void __delay (int cnt)
-{
-    uint32_t wait;
-    
-    
-    for(wait=0;wait<(0x1fffffff*cnt);wait++)
-    {}
+    return 0;
 }
 
 /**********************************************************************
-* __trustm_secCnt()
+* __trustm_ipcLock()
+* Wait until the IPC flag holds the current PID. Returns 0 on success,
+* 1 if the shared memory cannot be used.
 **********************************************************************/
-static uint8_t __trustm_secCnt(void)
+static int __trustm_ipcLock(void)
 {
-    uint16_t offset, bytes_to_read;
-    uint16_t optiga_oid;
-    uint8_t read_data_buffer[5];
+    pid_t current_pid;
+    pid_t queue_pid;
+    int queue_delay;
 
-    optiga_lib_status_t return_status;
+    //Init IPC
+    if (__trustm_ipcInit() != 0)
+        return 1;
 
-    do
-    {
-        //Read device Security Event ounter
-        optiga_oid = 0xE0C5;
-        offset = 0x00;
-        bytes_to_read = sizeof(read_data_buffer);
+    /// IPC Check
+    current_pid=getpid();
+    queue_delay= ((current_pid %MAX_IPC_TIME)+1)*IPC_SLEEP_STEPS; // wait for 0 to 20ms at IPC_SLEEP_STEPS steps depends on process number
+    mssleep(queue_delay);
 
-        optiga_lib_status = OPTIGA_LIB_BUSY;
-        return_status = optiga_util_read_data(me_util,
-                                              optiga_oid,
-                                              offset,
-                                              read_data_buffer,
-                                              &bytes_to_read);
+    queue_pid = __trustm_readshm(ipc_FlagInterShmid);
+    TRUSTM_HELPER_DBGFN("Check if TrustM Open:queue %d:current:%d:Delay %d", queue_pid,current_pid,queue_delay);
+    if (queue_pid ==0)
+    {
+        if (__trustm_writeshm(ipc_FlagInterShmid,current_pid) != 0) /*write pid into shared memory*/
+            return 1;
+        queue_pid = __trustm_readshm(ipc_FlagInterShmid);
+        TRUSTM_HELPER_DBGFN("Resource seized by %d",current_pid);
+    }
 
-        if (OPTIGA_LIB_SUCCESS != return_status)
+    while ( queue_pid !=current_pid)  /*Check if taken by other process and wait*/
+    {
+        if (queue_pid == -1)
+            return 1;
+        if (queue_pid ==0)
         {
-            //Reading the data object failed.
-            TRUSTM_HELPER_ERRFN("optiga_util_read_data : FAIL!!!\n");
-            read_data_buffer[0] = 0;
-            break;
+            if (__trustm_writeshm(ipc_FlagInterShmid,current_pid) != 0) /*write pid into shared memory*/
+                return 1;
+            TRUSTM_HELPER_DBGFN("Resource seized by %d",current_pid);
         }
-
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) 
+        else if (kill(queue_pid,0) == -1)
         {
-            pal_os_timer_delay_in_milliseconds(10);
+            TRUSTM_HELPER_DBGFN("Process does not exist1:%d", queue_pid);
+            if (__trustm_writeshm(ipc_FlagInterShmid,current_pid) != 0)
+                return 1;
         }
+        mssleep(queue_delay); // wait for 1 to MAX_IPC_TIME at IPC_SLEEP_STEPS steps depends on process number
+        queue_pid=__trustm_readshm(ipc_FlagInterShmid);
+    }
 
-        if (OPTIGA_LIB_SUCCESS != optiga_lib_status)
-        {
-            read_data_buffer[0] = 0;
-            break;
-        }        
-
-    } while(FALSE);
-
-    return read_data_buffer[0];
+    TRUSTM_HELPER_DBGFN("Lock queue %d", queue_pid);
+    return 0;
 }
 
+
 static char* __decodeDataObj(uint8_t data)
 {
     char *ret;
@@ -303,6 +325,9 @@ static char* __decodeDataObj(uint8_t data)
         case 0x23:
             ret = __UPDATSEC; 
             break;
+        default:
+            ret = __RFU;
+            break;
     }
     return ret;
 }
@@ -366,52 +391,30 @@ static char* __decodeAC(uint8_t data)
         case 0xE2:
             ret = __SHA256;
             break;
+        default:
+            ret = __RFU;
+            break;
     }
     return ret;
 }
 
-static char* __decodeAC_E1(uint8_t data)
+/**********************************************************************
+* trustmMetadataKeyUsageStr()
+* Key usage of metadata tag 0xE1 as text, e.g. "Auth/Sign", into buf.
+**********************************************************************/
+char *trustmMetadataKeyUsageStr(uint8_t usage, char *buf, size_t size)
 {
-    char *ret;
-    uint16_t i=0; 
-    
-    if (data & 0x01) // Auth = 0x01 
-    {
-        strcpy((__E1+i),__AUTH);
-        i += (sizeof(__AUTH));
-    }
-    if (data & 0x02) // Enc = 0x02 
-    {
-        __E1[i-1] = '/';
-        strcpy((__E1+i),__ENC);
-        i += sizeof(__ENC);
-    }
-    if (data & 0x04) // HFU = 0x04 
-    {
-        __E1[i-1] = '/';
-        strcpy((__E1+i),__HFU);
-        i += sizeof(__HFU);
-    }
-    if (data & 0x08) // DM = 0x08 
-    {
-        __E1[i-1] = '/';
-        strcpy((__E1+i),__DM);
-        i += sizeof(__DM);
-    }
-    if (data & 0x10) // SIGN = 0x10 
-    {
-        __E1[i-1] = '/';
-        strcpy((__E1+i),__SIGN);
-        i += sizeof(__SIGN);
-    }
-    if (data & 0x20) // AGREE = 0x20 
+    static const char * const name[] = {__AUTH, __ENC, __HFU, __DM, __SIGN, __AGREE};
+    size_t len = 0;
+    uint16_t i;
+
+    buf[0] = '\0';
+    for (i = 0; i < sizeof(name)/sizeof(name[0]); i++)
     {
-        __E1[i-1] = '/';
-        strcpy((__E1+i),__AGREE);
-        i += sizeof(__AGREE);
+        if ((usage & (1 << i)) && (len < size))
+            len += snprintf(buf + len, size - len, "%s%s", (len == 0) ? "" : "/", name[i]);
     }
-    ret = __E1;
-    return ret;
+    return buf;
 }
 
 void trustmdecodeMetaData(uint8_t * metaData)
@@ -421,6 +424,7 @@ void trustmdecodeMetaData(uint8_t * metaData)
     uint16_t len;
     uint8_t LcsO;
     uint16_t maxDataObjSize;
+    char usage[TRUSTM_METADATA_STR_MAX];
     
     if(*metaData == 0x20)
     {
@@ -526,7 +530,7 @@ void trustmdecodeMetaData(uint8_t * metaData)
                 case 0xE1:
                     // len is always 1
                     len = *(metaData+(i++));
-                    printf("Key:%s, ",__decodeAC_E1(*(metaData+(i++))));                
+                    printf("Key:%s, ",trustmMetadataKeyUsageStr(*(metaData+(i++)), usage, sizeof(usage)));                
                     break;
                 
                 case 0xE8:
@@ -545,94 +549,182 @@ void trustmdecodeMetaData(uint8_t * metaData)
     }
 }
 
+/**********************************************************************
+* trustmMetadataAlgoStr()
+* trustmMetadataDataTypeStr()
+* Text of metadata tags 0xE0 and 0xE8.
+**********************************************************************/
+const char *trustmMetadataAlgoStr(uint8_t algo)
+{
+    return __decodeAC(algo);
+}
+
+const char *trustmMetadataDataTypeStr(uint8_t type)
+{
+    return __decodeDataObj(type);
+}
+
+/**********************************************************************
+* trustmMetadataACStr()
+* Access condition of metadata tags 0xD0/0xD1/0xD3 as text into buf,
+* e.g. "LcsO<0x07" or "Conf(0xE140)&&LcsO<0x07".
+**********************************************************************/
+char *trustmMetadataACStr(const uint8_t *ac, uint8_t len, char *buf, size_t size)
+{
+    size_t pos = 0;
+    uint8_t i = 0;
+
+    buf[0] = '\0';
+    while ((i < len) && (pos < size))
+    {
+        switch (ac[i])
+        {
+            case 0x20: // Conf
+            case 0x21: // Int
+            case 0x40: // Luc
+                if (i + 2 >= len)
+                {
+                    i = len;
+                    break;
+                }
+                pos += snprintf(buf + pos, size - pos, "%s(0x%.2X%.2X)", __decodeAC(ac[i]), ac[i+1], ac[i+2]);
+                i += 3;
+                break;
+            case 0x70: // LcsG
+            case 0xE0: // LcsA
+            case 0xE1: // LcsO
+                if (i + 2 >= len)
+                {
+                    i = len;
+                    break;
+                }
+                pos += snprintf(buf + pos, size - pos, "%s%s0x%.2X", __decodeAC(ac[i]), __decodeAC(ac[i+1]), ac[i+2]);
+                i += 3;
+                break;
+            default: // ALW, NEV, &&, ||
+                pos += snprintf(buf + pos, size - pos, "%s", __decodeAC(ac[i]));
+                i++;
+                break;
+        }
+    }
+    return buf;
+}
+
+static uint16_t __copyAC(uint8_t *dst, uint8_t *dstLen, const uint8_t *ac, uint8_t len)
+{
+    // trustm_metadata_t keeps 10 bytes, enough for two conditions,
+    // a cut condition would grant or deny the wrong access
+    if (len > 10)
+        return 1;
+    *dstLen = len;
+    memcpy(dst, ac, len);
+    return 0;
+}
+
+/**********************************************************************
+* trustmParseMetadata()
+* Parse the metadata read from the chip. Unknown tags are skipped.
+* Returns 0 on success, 1 if the TLV is malformed or an access
+* condition is longer than trustm_metadata_t holds.
+**********************************************************************/
+uint16_t trustmParseMetadata(const uint8_t *buf, uint16_t len, trustm_metadata_t *oidMetadata)
+{
+    const uint8_t *v;
+    uint16_t end;
+    uint16_t i;
+    uint8_t tagLen;
+
+    memset(oidMetadata, 0, sizeof(trustm_metadata_t));
+    if ((len < 2) || (buf[0] != 0x20) || (buf[1] + 2 > len))
+        return 1;
+
+    oidMetadata->metadataLen = buf[1];
+    end = buf[1] + 2;
+    for (i = 2; i < end; i += tagLen + 2)
+    {
+        if (i + 2 > end)
+            return 1;
+        tagLen = buf[i+1];
+        v = &buf[i+2];
+        if ((i + 2 + tagLen > end) || (tagLen == 0))
+            return 1;
+
+        switch (buf[i])
+        {
+            case 0xC0:
+                oidMetadata->C0_lsc0 = v[0];
+                oidMetadata->present |= TRUSTM_MD_C0;
+                break;
+            case 0xC1:
+                oidMetadata->C1_verion[0] = v[0];
+                oidMetadata->C1_verion[1] = (tagLen == 2) ? v[1] : 0;
+                oidMetadata->present |= TRUSTM_MD_C1;
+                break;
+            case 0xC4:
+                oidMetadata->C4_maxSize = (tagLen == 2) ? (uint16_t)((v[0] << 8) + v[1]) : v[0];
+                oidMetadata->present |= TRUSTM_MD_C4;
+                break;
+            case 0xC5:
+                oidMetadata->C5_used = (tagLen == 2) ? (uint16_t)((v[0] << 8) + v[1]) : v[0];
+                oidMetadata->present |= TRUSTM_MD_C5;
+                break;
+            case 0xD0:
+                if (__copyAC(oidMetadata->D0_change, &oidMetadata->D0_changeLen, v, tagLen) != 0)
+                    return 1;
+                oidMetadata->present |= TRUSTM_MD_D0;
+                break;
+            case 0xD1:
+                if (__copyAC(oidMetadata->D1_read, &oidMetadata->D1_readLen, v, tagLen) != 0)
+                    return 1;
+                oidMetadata->present |= TRUSTM_MD_D1;
+                break;
+            case 0xD3:
+                if (__copyAC(oidMetadata->D3_execute, &oidMetadata->D3_executeLen, v, tagLen) != 0)
+                    return 1;
+                oidMetadata->present |= TRUSTM_MD_D3;
+                break;
+            case 0xE0:
+                oidMetadata->E0_algo = v[0];
+                oidMetadata->present |= TRUSTM_MD_E0;
+                break;
+            case 0xE1:
+                oidMetadata->E1_keyUsage = v[0];
+                oidMetadata->present |= TRUSTM_MD_E1;
+                break;
+            case 0xE8:
+                oidMetadata->E8_dataObjType = v[0];
+                oidMetadata->present |= TRUSTM_MD_E8;
+                break;
+            default:
+                break;
+        }
+    }
+    return 0;
+}
+
 optiga_lib_status_t trustmReadMetadata(uint16_t optiga_oid, trustm_metadata_t *oidMetadata)
 {
     optiga_lib_status_t return_status;
     uint16_t bytes_to_read;
     uint8_t read_data_buffer[2048];
-    uint16_t i,j;
 
-    oidMetadata->metadataLen = 0;
-    oidMetadata->D0_changeLen = 0;
-    oidMetadata->D1_readLen = 0;
-    oidMetadata->D3_executeLen = 0;
-    oidMetadata->C4_maxSize = 0;
-    oidMetadata->C5_used = 0;
+    memset(oidMetadata, 0, sizeof(trustm_metadata_t));
         
     do
     {
+        // Immutable metadata comes from the cache
         bytes_to_read = sizeof(read_data_buffer);
-        optiga_lib_status = OPTIGA_LIB_BUSY;
-        return_status = optiga_util_read_metadata(me_util,
-                                                    optiga_oid,
-                                                    read_data_buffer,
-                                                    &bytes_to_read);
-        if (OPTIGA_LIB_SUCCESS != return_status)
-            break;          
-        //Wait until the optiga_util_read_metadata operation is completed
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) {}
-        return_status = optiga_lib_status;
+        return_status = trustmCacheReadMetadata(optiga_oid,
+                                                read_data_buffer,
+                                                &bytes_to_read);
         if (return_status != OPTIGA_LIB_SUCCESS)
             break;
-        else
+
+        if (trustmParseMetadata(read_data_buffer, bytes_to_read, oidMetadata) != 0)
         {
-            if(read_data_buffer[0] == 0x20)
-            {
-                oidMetadata->metadataLen = read_data_buffer[1];
-                for(i = 2; i < read_data_buffer[1];i += read_data_buffer[i+1]+2)
-                {
-                    switch(read_data_buffer[i])
-                    {
-                        case 0xC0:
-                            oidMetadata->C0_lsc0 = read_data_buffer[i+2];
-                            break;
-                        case 0xC1:
-                            oidMetadata->C1_verion[0] = read_data_buffer[i+1];
-                            oidMetadata->C1_verion[1] = read_data_buffer[i+2];                    
-                            break;
-                        case 0xC4:
-                            if (read_data_buffer[i+1] == 2)
-                                oidMetadata->C4_maxSize = (uint16_t)((read_data_buffer[i+2] << 8)+read_data_buffer[i+3]);
-                            else
-                                oidMetadata->C4_maxSize = (uint16_t) read_data_buffer[i+2];                              
-                            break;
-                        case 0xC5:
-                            if (read_data_buffer[i+1] == 2)
-                                oidMetadata->C5_used = (uint16_t)((read_data_buffer[i+2] << 8)+read_data_buffer[i+3]);
-                            else
-                                oidMetadata->C5_used = (uint16_t) read_data_buffer[i+2]; 
-                            break;
-                        case 0xD0:
-                            oidMetadata->D0_changeLen = read_data_buffer[i+1];
-                            for(j=0;j<read_data_buffer[i+1];j++)
-                                oidMetadata->D0_change[j] = read_data_buffer[i+2+j];                            
-                            break;
-                        case 0xD1:
-                            oidMetadata->D1_readLen = read_data_buffer[i+1];
-                            for(j=0;j<read_data_buffer[i+1];j++)
-                                oidMetadata->D1_read[j] = read_data_buffer[i+2+j];                        
-                            break;
-                        case 0xD3:
-                            oidMetadata->D3_executeLen = read_data_buffer[i+1];
-                            for(j=0;j<read_data_buffer[i+1];j++)
-                                oidMetadata->D3_execute[j] = read_data_buffer[i+2+j];
-                            break;
-                        case 0xE0:
-                            oidMetadata->E0_algo = read_data_buffer[i+2];                        
-                            break;
-                        case 0xE1:
-                            oidMetadata->E1_keyUsage = read_data_buffer[i+2];
-                            break;
-                        case 0xE8:
-                            oidMetadata->E8_dataObjType = read_data_buffer[i+2];
-                            break;
-                        default:
-                            i = bytes_to_read;
-                            oidMetadata->metadataLen = 0;
-                    }
-                }
-            }
-        }        
+            printf("Invalid metadata of OID 0x%.4X\n", optiga_oid);
+            return_status = OPTIGA_UTIL_ERROR;
+        }
     }while(FALSE);
 
     // Capture OPTIGA Trust M error
@@ -642,6 +734,45 @@ optiga_lib_status_t trustmReadMetadata(uint16_t optiga_oid, trustm_metadata_t *o
     return return_status;
 }
 
+/**********************************************************************
+* trustmSweepMetadata()
+* Read the metadata of every object named by trustmGetOIDName in the
+* open session. A failed read is recorded in the entry and the sweep
+* goes on. Returns the number of entries filled.
+**********************************************************************/
+uint16_t trustmSweepMetadata(trustm_oid_info_t *info, uint16_t max, uint8_t shielded)
+{
+    uint16_t i;
+    uint16_t count = 0;
+
+    for (i = 0; (i < sizeof(__knownOID)/sizeof(__knownOID[0])) && (count < max); i++)
+    {
+        memset(&info[count], 0, sizeof(trustm_oid_info_t));
+        info[count].oid = __knownOID[i];
+        info[count].rawLen = sizeof(info[count].raw);
+
+        if (shielded)
+        {
+            // OPTIGA Comms Shielded connection settings to enable the protection
+            TRUSTM_UTIL_SHIELDED(me_util);
+        }
+        // Immutable metadata comes from the cache
+        info[count].status = trustmCacheReadMetadata(info[count].oid,
+                                                     info[count].raw,
+                                                     &info[count].rawLen);
+        if ((info[count].status == OPTIGA_LIB_SUCCESS) &&
+            (trustmParseMetadata(info[count].raw, info[count].rawLen, &info[count].md) != 0))
+            info[count].status = OPTIGA_UTIL_ERROR;
+        if (info[count].status != OPTIGA_LIB_SUCCESS)
+        {
+            info[count].rawLen = 0;
+            memset(&info[count].md, 0, sizeof(trustm_metadata_t));
+        }
+        count++;
+    }
+    return count;
+}
+
 /**********************************************************************
 * trustmHexDump()
 **********************************************************************/
@@ -865,9 +996,8 @@ uint16_t trustmReadX509PEM(X509 **x509, const char *filename)
 **********************************************************************/
 optiga_lib_status_t trustm_readUID(utrustm_UID_t *UID)
 {
-    uint16_t offset, bytes_to_read;
-    uint16_t optiga_oid;
-    uint8_t read_data_buffer[1024];
+    uint16_t bytes_to_read;
+    uint8_t read_data_buffer[sizeof(UID->b)];
 
     optiga_lib_status_t return_status;
 
@@ -876,18 +1006,9 @@ optiga_lib_status_t trustm_readUID(utrustm_UID_t *UID)
     do
     {
 
-        //Read device UID
-        optiga_oid = 0xE0C2;
-        offset = 0x00;
-        bytes_to_read = sizeof(read_data_buffer);
-
-        optiga_lib_status = OPTIGA_LIB_BUSY;
-        return_status = optiga_util_read_data(me_util,
-                                              optiga_oid,
-                                              offset,
-                                              read_data_buffer,
-                                              &bytes_to_read);
-
+        //Read device UID, once per boot
+        bytes_to_read = sizeof(UID->b);
+        return_status = trustmCacheReadUID(read_data_buffer, &bytes_to_read);
         if (OPTIGA_LIB_SUCCESS != return_status)
         {
             //Reading the data object failed.
@@ -895,17 +1016,6 @@ optiga_lib_status_t trustm_readUID(utrustm_UID_t *UID)
             break;
         }
 
-        while (OPTIGA_LIB_BUSY == optiga_lib_status) 
-        {
-            pal_os_timer_delay_in_milliseconds(10);
-        }
-
-        if (OPTIGA_LIB_SUCCESS != optiga_lib_status)
-        {
-            //Reading metadata data object failed.
-            break;
-        }        
-
         for (i=0;i<bytes_to_read;i++)
         {
             UID->b[i] = read_data_buffer[i];
@@ -936,52 +1046,22 @@ void optiga_crypt_callback(void * context, optiga_lib_status_t return_status)
 optiga_lib_status_t trustm_Open(void)
 {
     optiga_lib_status_t return_status;
-    pid_t current_pid;
-    pid_t queue_pid;
-    int queue_delay;
 
     TRUSTM_HELPER_DBGFN(">");
+    // Session held open by trustm_OpenSession(), keep using it
+    if ((trustm_session_flag != 0) && (trustm_open_flag == 1))
+    {
+        TRUSTM_HELPER_DBGFN("Session held. Skip open\n");
+        return OPTIGA_LIB_SUCCESS;
+    }
     trustm_open_flag = 0;
     do
     {
-        //Init IPC
-        __trustm_ipcInit();
-
-        /// IPC Check
-        current_pid=getpid();
-        queue_delay= ((current_pid %MAX_IPC_TIME)+1)*IPC_SLEEP_STEPS;; // wait for 0 to 20ms at IPC_SLEEP_STEPS steps depends on process number
-        mssleep(queue_delay);
-        
-        queue_pid = __trustm_readshm(ipc_FlagInterShmid);
-        TRUSTM_HELPER_DBGFN("Check if TrustM Open:queue %d:current:%d:Delay %d", queue_pid,current_pid,queue_delay);
-        if (queue_pid ==0)
-        {    __trustm_writeshm(ipc_FlagInterShmid,current_pid); /*write pid into shared memory*/
-            queue_pid = __trustm_readshm(ipc_FlagInterShmid);
-            TRUSTM_HELPER_DBGFN("Resource seized by %d",current_pid);
-        }    
-       
-        while ( queue_pid !=current_pid)  /*Check if taken by other process and wait*/
+        if (__trustm_ipcLock() != 0)
         {
-            queue_pid = __trustm_readshm(ipc_FlagInterShmid);
-            if (queue_pid ==0)
-            {    __trustm_writeshm(ipc_FlagInterShmid,current_pid); /*write pid into shared memory*/
-                //queue_pid=__trustm_readshm(ipc_FlagInterShmid);
-                TRUSTM_HELPER_DBGFN("Resource seized by %d",current_pid);
-            }
-            else if (kill(queue_pid,0) == -1) 
-            {
-              TRUSTM_HELPER_DBGFN("Process does not exist1:%d", queue_pid);
-              __trustm_writeshm(ipc_FlagInterShmid,current_pid);
-              //queue_pid=__trustm_readshm(ipc_FlagInterShmid);
-            }
-            queue_delay= ((current_pid %MAX_IPC_TIME)+1)*IPC_SLEEP_STEPS; // wait for 1 to MAX_IPC_TIME at IPC_SLEEP_STEPS steps depends on process number
-            mssleep(queue_delay);
-            queue_pid=__trustm_readshm(ipc_FlagInterShmid);
+            return_status = OPTIGA_UTIL_ERROR;
+            break;
         }
-        
-
-        
-        TRUSTM_HELPER_DBGFN("Lock queue %d", queue_pid);
 
         
         pal_gpio_init(&optiga_reset_0);
@@ -1003,6 +1083,9 @@ optiga_lib_status_t trustm_Open(void)
         }
         TRUSTM_HELPER_DBGFN("TrustM crypt instance created. \n");
 
+        // Extra instances for commands queued together
+        trustmPoolCreate();
+
         TRUSTM_HELPER_DBGFN("TrustM Open. \n");
 
         /**
@@ -1032,9 +1115,7 @@ optiga_lib_status_t trustm_Open(void)
 
         TRUSTM_HELPER_DBGFN("waiting...");
         //Wait until the optiga_util_open_application is completed
-        while (optiga_lib_status == OPTIGA_LIB_BUSY )
-        {
-        }
+        trustmWaitCompletion();
         TRUSTM_HELPER_DBG("++done\n");
 
         if (OPTIGA_LIB_SUCCESS != optiga_lib_status)
@@ -1048,6 +1129,9 @@ optiga_lib_status_t trustm_Open(void)
         
         trustm_open_flag = 1;
         TRUSTM_HELPER_DBGFN("Success : optiga_util_open_application \n");
+
+        // Hold back if earlier failures pushed the Security Event Counter up
+        trustmGovernorOpen();
     }while(FALSE);      
 
 
@@ -1065,6 +1149,12 @@ optiga_lib_status_t trustm_Close(void)
     uint8_t secCnt;
 
     TRUSTM_HELPER_DBGFN(">");
+    // Session held open by trustm_OpenSession(), released by trustm_CloseSession()
+    if ((trustm_session_flag != 0) && (trustm_open_flag == 1))
+    {
+        TRUSTM_HELPER_DBGFN("Session held. Skip close\n");
+        return OPTIGA_LIB_SUCCESS;
+    }
 
     do{
         if (trustm_open_flag != 1)
@@ -1078,12 +1168,12 @@ optiga_lib_status_t trustm_Close(void)
             if (access(TRUSTM_HIBERNATE_CTX_FILENAME,F_OK) != -1)
                 remove(TRUSTM_HIBERNATE_CTX_FILENAME);
 
-            secCnt = __trustm_secCnt();
+            secCnt = trustmReadSecCnt();
             while (secCnt)
             {
                 TRUSTM_HELPER_INFO("Security Event Counter : %d [waiting. Ctrl+c to abort.]\n",secCnt);
-                __delay(2);
-                secCnt = __trustm_secCnt();
+                mssleep(secCnt * TRUSTM_GOV_SEC_DECAY_MS);
+                secCnt = trustmReadSecCnt();
                 if (secCnt == 0)
                     TRUSTM_HELPER_INFO("context saved.\n");
             }
@@ -1107,9 +1197,7 @@ optiga_lib_status_t trustm_Close(void)
             break;
         }
 
-        while (optiga_lib_status == OPTIGA_LIB_BUSY)
-        {
-        }
+        trustmWaitCompletion();
         
         if (OPTIGA_LIB_SUCCESS != optiga_lib_status)
         {
@@ -1130,6 +1218,7 @@ optiga_lib_status_t trustm_Close(void)
         trustmPrintErrorCode(return_status);
 
     // destroy util and crypt instances
+    trustmPoolDestroy();
     //optiga_lib_status = OPTIGA_LIB_BUSY;
     return_status = optiga_crypt_destroy(me_crypt);
     if(OPTIGA_LIB_SUCCESS != return_status)
@@ -1151,6 +1240,41 @@ optiga_lib_status_t trustm_Close(void)
     return return_status;
 }
 
+/**********************************************************************
+* trustm_OpenSession()
+* Open the chip and hold it across trustm_Open()/trustm_Close() pairs
+* until trustm_CloseSession(). Used to run several commands in one
+* process without re-opening the application for each of them.
+**********************************************************************/
+optiga_lib_status_t trustm_OpenSession(void)
+{
+    optiga_lib_status_t return_status;
+
+    TRUSTM_HELPER_DBGFN(">");
+    return_status = trustm_Open();
+    if (OPTIGA_LIB_SUCCESS == return_status)
+        trustm_session_flag = 1;
+    TRUSTM_HELPER_DBGFN("<");
+    return return_status;
+}
+
+/**********************************************************************
+* trustm_CloseSession()
+**********************************************************************/
+optiga_lib_status_t trustm_CloseSession(void)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+
+    TRUSTM_HELPER_DBGFN(">");
+    if (trustm_session_flag != 0)
+    {
+        trustm_session_flag = 0;
+        return_status = trustm_Close();
+    }
+    TRUSTM_HELPER_DBGFN("<");
+    return return_status;
+}
+
 uint32_t trustmHexorDec(const char *aArg)
 {
     uint32_t value;
@@ -1212,6 +1336,181 @@ uint16_t trustmreadFrom(uint8_t *data, uint8_t *filename)
 
 }
 
+/**********************************************************************
+* trustmHashFile()
+* Hash a file on the host. A regular file is mapped and hashed in one
+* pass, input which cannot be mapped (pipes, empty files) is read in
+* chunks. Returns 0 on success, 1 on error.
+**********************************************************************/
+uint16_t trustmHashFile(const char *filename, const EVP_MD *md, uint8_t *digest, uint16_t *digestLen)
+{
+    EVP_MD_CTX *ctx = NULL;
+    struct stat st;
+    void *map = MAP_FAILED;
+    uint8_t buf[TRUSTM_HASH_CHUNK];
+    ssize_t len = 0;
+    unsigned int mdLen = 0;
+    uint16_t ret = 1;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("File open error!!!\n");
+        return 1;
+    }
+
+    do
+    {
+        if (EVP_MD_size(md) > TRUSTM_HASH_MAX)
+            break;
+
+        ctx = EVP_MD_CTX_new();
+        if ((ctx == NULL) || (EVP_DigestInit_ex(ctx, md, NULL) != 1))
+            break;
+
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+            (st.st_size > 0) && ((uint64_t)st.st_size <= SIZE_MAX))
+            map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map != MAP_FAILED)
+        {
+            // Let the kernel read ahead of the hash
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            madvise(map, st.st_size, MADV_WILLNEED);
+            if (EVP_DigestUpdate(ctx, map, st.st_size) != 1)
+                break;
+        }
+        else
+        {
+            while ((len = read(fd, buf, sizeof(buf))) > 0)
+            {
+                if (EVP_DigestUpdate(ctx, buf, len) != 1)
+                    break;
+            }
+            if (len != 0)
+            {
+                printf("File read error!!!\n");
+                break;
+            }
+        }
+
+        if (EVP_DigestFinal_ex(ctx, digest, &mdLen) != 1)
+            break;
+        *digestLen = mdLen;
+        ret = 0;
+    } while (FALSE);
+
+    if (map != MAP_FAILED)
+        munmap(map, st.st_size);
+    EVP_MD_CTX_free(ctx);
+    close(fd);
+
+    return ret;
+}
+
+/**********************************************************************
+* trustmChipHashFile()
+* SHA-256 of a file computed by the chip. The input is read into two
+* buffers in turn: the next chunk is read from the file while the chip
+* works on the current one, so file I/O and I2C transfers overlap.
+**********************************************************************/
+optiga_lib_status_t trustmChipHashFile(const char *filename, uint8_t shielded, uint8_t *digest)
+{
+    optiga_lib_status_t return_status = OPTIGA_CRYPT_ERROR;
+    optiga_hash_context_t hash_context;
+    hash_data_from_host_t hash_data_host[2];
+    uint8_t hash_context_buffer[2048];
+    uint8_t data[2][TRUSTM_HASH_CHUNK];
+    uint16_t dataLen[2];
+    uint8_t cur = 0;
+    FILE *fp;
+
+    fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        printf("File open error!!!\n");
+        return OPTIGA_CRYPT_ERROR;
+    }
+
+    hash_context.context_buffer = hash_context_buffer;
+    hash_context.context_buffer_length = sizeof(hash_context_buffer);
+    hash_context.hash_algo = (uint8_t)OPTIGA_HASH_TYPE_SHA_256;
+
+    do
+    {
+        if (shielded)
+        {
+            // OPTIGA Comms Shielded connection settings to enable the protection
+            TRUSTM_CRYPT_SHIELDED(me_crypt);
+        }
+
+        optiga_lib_status = OPTIGA_LIB_BUSY;
+        return_status = optiga_crypt_hash_start(me_crypt, &hash_context);
+        if (OPTIGA_LIB_SUCCESS != return_status)
+            break;
+        // Read the first chunk while the chip starts the hash
+        dataLen[cur] = fread(data[cur], 1, TRUSTM_HASH_CHUNK, fp);
+        return_status = trustmWaitCompletion();
+        if (OPTIGA_LIB_SUCCESS != return_status)
+            break;
+
+        while (dataLen[cur] > 0)
+        {
+            hash_data_host[cur].buffer = data[cur];
+            hash_data_host[cur].length = dataLen[cur];
+
+            if (shielded)
+            {
+                // OPTIGA Comms Shielded connection settings to enable the protection
+                TRUSTM_CRYPT_SHIELDED(me_crypt);
+            }
+
+            optiga_lib_status = OPTIGA_LIB_BUSY;
+            return_status = optiga_crypt_hash_update(me_crypt,
+                                                     &hash_context,
+                                                     OPTIGA_CRYPT_HOST_DATA,
+                                                     &hash_data_host[cur]);
+            if (OPTIGA_LIB_SUCCESS != return_status)
+                break;
+            // The chip owns the current buffer until completion,
+            // read ahead into the other one meanwhile
+            cur ^= 1;
+            dataLen[cur] = fread(data[cur], 1, TRUSTM_HASH_CHUNK, fp);
+            return_status = trustmWaitCompletion();
+            if (OPTIGA_LIB_SUCCESS != return_status)
+                break;
+        }
+        if (OPTIGA_LIB_SUCCESS != return_status)
+            break;
+
+        if (ferror(fp))
+        {
+            printf("File read error!!!\n");
+            return_status = OPTIGA_CRYPT_ERROR;
+            break;
+        }
+
+        if (shielded)
+        {
+            // OPTIGA Comms Shielded connection settings to enable the protection
+            TRUSTM_CRYPT_SHIELDED(me_crypt);
+        }
+
+        optiga_lib_status = OPTIGA_LIB_BUSY;
+        return_status = optiga_crypt_hash_finalize(me_crypt,
+                                                   &hash_context,
+                                                   digest);
+        if (OPTIGA_LIB_SUCCESS != return_status)
+            break;
+        return_status = trustmWaitCompletion();
+    } while (FALSE);
+
+    fclose(fp);
+
+    return return_status;
+}
+
 void trustmPrintErrorCode(uint16_t errcode)
 {
     switch (errcode)
@@ -1280,6 +1579,17 @@ void trustmPrintErrorCode(uint16_t errcode)
         case OPTIGA_CRYPT_ERROR_INSTANCE_IN_USE: //OPTIGA crypt API called when, a request of same instance is already in service
             TRUSTM_HELPER_RETCODEFN(errcode, "OPTIGA crypt API called when, a request of same instance is already in service");
             break; 
+
+        // Trust M access layer
+        case TRUSTM_ACCESS_ERROR: //Trust M access layer failed
+            TRUSTM_HELPER_RETCODEFN(errcode, "Trust M access layer failed");
+            break;
+        case TRUSTM_ACCESS_ERROR_TIMEOUT: //Command not completed in time, chip reset
+            TRUSTM_HELPER_RETCODEFN(errcode, "Command not completed in time, chip reset");
+            break;
+        case TRUSTM_ACCESS_ERROR_DEADLINE: //Chip not acquired within the deadline
+            TRUSTM_HELPER_RETCODEFN(errcode, "Chip not acquired within the deadline");
+            break;
             
         // OPTIGA_DEVICE_ERROR (0x8000)
         case 0x8001: // OPTIGA device Invalid OID
@@ -0,0 +1,323 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include "optiga/optiga_util.h"
+#include "optiga/optiga_crypt.h"
+
+#include "trustm_helper.h"
+#include "trustm_ticket.h"
+
+/*************************************************************************
+*  Global
+*************************************************************************/
+static pthread_mutex_t trustm_ticketLock = PTHREAD_MUTEX_INITIALIZER;
+static uint16_t trustm_ticketOid = TRUSTM_TICKET_OID;
+static uint32_t trustm_ticketPeriod = TRUSTM_TICKET_PERIOD;
+static trustm_ticket_key_t trustm_ticketKey[2];    // key sets of the last two epochs derived
+
+/*************************************************************************
+*  functions
+*************************************************************************/
+/**********************************************************************
+* __trustm_ticketOpen()
+* Open the chip unless the caller holds it open already.
+* Returns 1 if the chip was opened here.
+**********************************************************************/
+static uint8_t __trustm_ticketOpen(optiga_lib_status_t *return_status)
+{
+    *return_status = OPTIGA_LIB_SUCCESS;
+    if (trustm_open_flag == 1)
+        return 0;
+
+    trustm_hibernate_flag = 0;
+    *return_status = trustm_Open();
+    return (*return_status == OPTIGA_LIB_SUCCESS) ? 1 : 0;
+}
+
+/**********************************************************************
+* __trustm_ticketDerive()
+* Derive the key set of an epoch with the TLS PRF of the chip, the
+* secret is the data object. The seed is the epoch, so every process
+* derives the same keys for the same period.
+**********************************************************************/
+static optiga_lib_status_t __trustm_ticketDerive(uint64_t epoch, trustm_ticket_key_t *key)
+{
+    optiga_lib_status_t return_status;
+    uint8_t seed[32];
+    uint8_t derived[8+32+32];
+    uint8_t opened;
+    uint8_t i;
+
+    memset(seed, 0, sizeof(seed));
+    for (i = 0; i < 8; i++)
+        seed[i] = (uint8_t)(epoch >> (56 - (i * 8)));
+
+    opened = __trustm_ticketOpen(&return_status);
+    if (return_status != OPTIGA_LIB_SUCCESS)
+        return return_status;
+
+    TRUSTM_REPLAY(return_status, ,
+                  optiga_crypt_tls_prf_sha256(me_crypt,
+                                              trustm_ticketOid,
+                                              (const uint8_t *)TRUSTM_TICKET_LABEL,
+                                              sizeof(TRUSTM_TICKET_LABEL) - 1,
+                                              seed,
+                                              sizeof(seed),
+                                              sizeof(derived),
+                                              TRUE,
+                                              derived));
+    if (opened)
+        trustm_Close();
+
+    if (return_status == OPTIGA_LIB_SUCCESS)
+    {
+        key->epoch = epoch;
+        memcpy(key->name, seed, 8);
+        memcpy(&key->name[8], derived, 8);
+        memcpy(key->aesKey, &derived[8], sizeof(key->aesKey));
+        memcpy(key->hmacKey, &derived[8+32], sizeof(key->hmacKey));
+    }
+    else
+    {
+        TRUSTM_HELPER_ERRFN("Fail : ticket key derivation 0x%.4X\n", trustm_ticketOid);
+        trustmPrintErrorCode(return_status);
+    }
+
+    OPENSSL_cleanse(derived, sizeof(derived));
+    return return_status;
+}
+
+/**********************************************************************
+* trustmTicketInit()
+* Select the secret data object and the rotation period. An empty
+* object gets a secret from the chip TRNG, and the object is typed as
+* pre-shared secret for the TLS PRF. Lock the read access afterwards,
+* e.g. with trustm_metadata, so the secret stays in the chip.
+* Call before the server forks, the workers inherit the current keys.
+**********************************************************************/
+optiga_lib_status_t trustmTicketInit(uint16_t secretOid, uint32_t period)
+{
+    optiga_lib_status_t return_status;
+    trustm_metadata_t oidMetadata;
+    trustm_ticket_key_t key;
+    uint8_t secret[TRUSTM_TICKET_SECRET_LEN];
+    uint8_t presSec[] = {0x20, 0x03, 0xE8, 0x01, 0x21};  // data object type PRESSEC
+    uint8_t opened;
+
+    TRUSTM_HELPER_DBGFN(">");
+    trustmTicketCleanup();
+    trustm_ticketOid = secretOid;
+    trustm_ticketPeriod = (period != 0) ? period : TRUSTM_TICKET_PERIOD;
+
+    opened = __trustm_ticketOpen(&return_status);
+    do
+    {
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+
+        memset(&oidMetadata, 0, sizeof(oidMetadata));
+        return_status = trustmReadMetadata(secretOid, &oidMetadata);
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+
+        if (oidMetadata.C5_used == 0)
+        {
+            TRUSTM_HELPER_DBGFN("0x%.4X empty, write new secret", secretOid);
+            TRUSTM_REPLAY(return_status, ,
+                          optiga_crypt_random(me_crypt,
+                                              OPTIGA_RNG_TYPE_TRNG,
+                                              secret,
+                                              sizeof(secret)));
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                break;
+
+            optiga_lib_status = OPTIGA_LIB_BUSY;
+            return_status = optiga_util_write_data(me_util,
+                                                   secretOid,
+                                                   OPTIGA_UTIL_ERASE_AND_WRITE,
+                                                   0,
+                                                   secret,
+                                                   sizeof(secret));
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                break;
+            return_status = trustmWaitCompletion();
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                break;
+        }
+
+        if (oidMetadata.E8_dataObjType != 0x21)
+        {
+            TRUSTM_HELPER_DBGFN("0x%.4X set type PRESSEC", secretOid);
+            optiga_lib_status = OPTIGA_LIB_BUSY;
+            return_status = optiga_util_write_metadata(me_util,
+                                                       secretOid,
+                                                       presSec,
+                                                       sizeof(presSec));
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                break;
+            return_status = trustmWaitCompletion();
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                break;
+        }
+
+        // Derive the current keys, proves the object works as PRF secret
+        return_status = trustmTicketGetKey(trustmTicketEpoch(), &key);
+        OPENSSL_cleanse(&key, sizeof(key));
+    } while (FALSE);
+
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        TRUSTM_HELPER_ERRFN("Fail : ticket secret 0x%.4X\n", secretOid);
+        trustmPrintErrorCode(return_status);
+    }
+
+    if (opened)
+        trustm_Close();
+
+    OPENSSL_cleanse(secret, sizeof(secret));
+    TRUSTM_HELPER_DBGFN("<");
+    return return_status;
+}
+
+/**********************************************************************
+* trustmTicketEpoch()
+* Rotation period number of the current time. Wall clock time, so it
+* is the same after a restart.
+**********************************************************************/
+uint64_t trustmTicketEpoch(void)
+{
+    return (uint64_t)time(NULL) / trustm_ticketPeriod;
+}
+
+/**********************************************************************
+* trustmTicketGetKey()
+* Key set of an epoch. The last two epochs are kept, so the chip is
+* used once per rotation period.
+**********************************************************************/
+optiga_lib_status_t trustmTicketGetKey(uint64_t epoch, trustm_ticket_key_t *key)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    trustm_ticket_key_t newKey;
+    uint8_t i;
+
+    pthread_mutex_lock(&trustm_ticketLock);
+    do
+    {
+        for (i = 0; i < 2; i++)
+        {
+            if ((trustm_ticketKey[i].epoch != 0) && (trustm_ticketKey[i].epoch == epoch))
+                break;
+        }
+        if (i < 2)
+        {
+            *key = trustm_ticketKey[i];
+            break;
+        }
+
+        return_status = __trustm_ticketDerive(epoch, &newKey);
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+
+        // Replace the older epoch
+        i = (trustm_ticketKey[0].epoch <= trustm_ticketKey[1].epoch) ? 0 : 1;
+        trustm_ticketKey[i] = newKey;
+        *key = newKey;
+        OPENSSL_cleanse(&newKey, sizeof(newKey));
+    } while (FALSE);
+    pthread_mutex_unlock(&trustm_ticketLock);
+
+    return return_status;
+}
+
+/**********************************************************************
+* trustmTicketCleanup()
+* Clear the derived keys.
+**********************************************************************/
+void trustmTicketCleanup(void)
+{
+    pthread_mutex_lock(&trustm_ticketLock);
+    OPENSSL_cleanse(trustm_ticketKey, sizeof(trustm_ticketKey));
+    pthread_mutex_unlock(&trustm_ticketLock);
+}
+
+/**********************************************************************
+* trustmTicketKeyCb()
+* Ticket key callback for SSL_CTX_set_tlsext_ticket_key_cb(). Tickets
+* are issued under the current epoch and accepted for one more epoch.
+* The IV comes from the OpenSSL DRBG, so a ticket costs no chip access.
+**********************************************************************/
+int trustmTicketKeyCb(SSL *ssl, unsigned char keyName[16], unsigned char *iv,
+                        EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc)
+{
+    trustm_ticket_key_t key;
+    uint64_t current;
+    uint64_t epoch = 0;
+    int ret = 0;
+    uint8_t i;
+
+    current = trustmTicketEpoch();
+    if (enc)
+    {
+        // Without keys the session gets no ticket, the handshake goes on
+        if ((trustmTicketGetKey(current, &key) == OPTIGA_LIB_SUCCESS) &&
+            (RAND_OpenSSL()->bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) == 1))
+        {
+            memcpy(keyName, key.name, sizeof(key.name));
+            EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aesKey, iv);
+            HMAC_Init_ex(hctx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), NULL);
+            ret = 1;
+        }
+    }
+    else
+    {
+        for (i = 0; i < 8; i++)
+            epoch = (epoch << 8) | keyName[i];
+
+        if (((epoch == current) || (epoch + 1 == current)) &&
+            (trustmTicketGetKey(epoch, &key) == OPTIGA_LIB_SUCCESS) &&
+            (CRYPTO_memcmp(keyName, key.name, sizeof(key.name)) == 0))
+        {
+            HMAC_Init_ex(hctx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), NULL);
+            EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aesKey, iv);
+            // 2: valid, issue a new ticket. Under the previous epoch it
+            // is renewed, and a TLS 1.3 client uses a ticket only once
+            ret = ((epoch == current) && (SSL_version(ssl) != TLS1_3_VERSION)) ? 1 : 2;
+        }
+    }
+
+    OPENSSL_cleanse(&key, sizeof(key));
+    return ret;
+}
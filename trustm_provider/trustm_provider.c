@@ -0,0 +1,251 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <string.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/params.h>
+#include <openssl/provider.h>
+
+#include "trustm_provider_common.h"
+#include "trustm_helper.h"
+
+#ifdef WORKAROUND
+    extern void pal_os_event_disarm(void);
+    extern void pal_os_event_arm(void);
+#endif
+
+static const OSSL_ALGORITHM trustm_keymgmt[] = {
+    { "EC:id-ecPublicKey:1.2.840.10045.2.1", TRUSTM_PROVIDER_PROPS, trustm_ec_keymgmt_functions, "OPTIGA Trust M EC key" },
+    { "RSA:rsaEncryption:1.2.840.113549.1.1.1", TRUSTM_PROVIDER_PROPS, trustm_rsa_keymgmt_functions, "OPTIGA Trust M RSA key" },
+    { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_ALGORITHM trustm_signature[] = {
+    { "ECDSA", TRUSTM_PROVIDER_PROPS, trustm_signature_functions, "OPTIGA Trust M ECDSA" },
+    { "RSA:rsaEncryption:1.2.840.113549.1.1.1", TRUSTM_PROVIDER_PROPS, trustm_signature_functions, "OPTIGA Trust M RSA PKCS#1 v1.5" },
+    { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_ALGORITHM trustm_asym_cipher[] = {
+    { "RSA:rsaEncryption:1.2.840.113549.1.1.1", TRUSTM_PROVIDER_PROPS, trustm_rsa_asym_cipher_functions, "OPTIGA Trust M RSA PKCS#1 v1.5" },
+    { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_ALGORITHM trustm_rand[] = {
+    { "TRUSTM-RAND", TRUSTM_PROVIDER_PROPS, trustm_rand_functions, "OPTIGA Trust M TRNG" },
+    { NULL, NULL, NULL, NULL }
+};
+
+// URI scheme of the store, e.g. trustm:oid=E0F1
+static const OSSL_ALGORITHM trustm_store[] = {
+    { "trustm", TRUSTM_PROVIDER_PROPS, trustm_store_functions, "OPTIGA Trust M keys and certificates" },
+    { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_PARAM trustm_param_types[] = {
+    OSSL_PARAM_DEFN(OSSL_PROV_PARAM_NAME, OSSL_PARAM_UTF8_PTR, NULL, 0),
+    OSSL_PARAM_DEFN(OSSL_PROV_PARAM_VERSION, OSSL_PARAM_UTF8_PTR, NULL, 0),
+    OSSL_PARAM_DEFN(OSSL_PROV_PARAM_BUILDINFO, OSSL_PARAM_UTF8_PTR, NULL, 0),
+    OSSL_PARAM_DEFN(OSSL_PROV_PARAM_STATUS, OSSL_PARAM_INTEGER, NULL, 0),
+    OSSL_PARAM_END
+};
+
+/**********************************************************************
+* trustmProvBegin()
+* Open the application unless another operation of the process has it
+* open already, and take a pool instance for the command. Threads share
+* the open application and queue their commands on their instances.
+**********************************************************************/
+optiga_lib_status_t trustmProvBegin(trustm_prov_ctx_t *provctx, trustm_inst_t **inst)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    uint8_t counted = 0;
+
+    TRUSTM_PROVIDER_DBGFN(">");
+    *inst = NULL;
+    pthread_mutex_lock(&provctx->lock);
+    do
+    {
+        if (provctx->openCount == 0)
+        {
+            TRUSTM_WORKAROUND_TIMER_ARM;
+            trustm_hibernate_flag = 0;
+            return_status = trustm_Open();
+            if (return_status != OPTIGA_LIB_SUCCESS)
+            {
+                TRUSTM_WORKAROUND_TIMER_DISARM;
+                TRUSTM_PROVIDER_ERRFN("Fail to open trustM!!");
+                break;
+            }
+        }
+        provctx->openCount++;
+        counted = 1;
+
+        // Wait for an instance of the other threads, none at all if the
+        // host library had no registrations left for the pool
+        while (((*inst = trustmPoolGet()) == NULL) && (provctx->instUsed != 0))
+            pthread_cond_wait(&provctx->instFree, &provctx->lock);
+        if (*inst == NULL)
+        {
+            TRUSTM_PROVIDER_ERRFN("No pool instance");
+            return_status = TRUSTM_ACCESS_ERROR;
+            break;
+        }
+        provctx->instUsed++;
+    } while (FALSE);
+    pthread_mutex_unlock(&provctx->lock);
+
+    if ((return_status != OPTIGA_LIB_SUCCESS) && (counted != 0))
+        trustmProvEnd(provctx, NULL);
+
+    TRUSTM_PROVIDER_DBGFN("<");
+    return return_status;
+}
+
+/**********************************************************************
+* trustmProvEnd()
+* Give the instance back, the last operation closes the application.
+**********************************************************************/
+void trustmProvEnd(trustm_prov_ctx_t *provctx, trustm_inst_t *inst)
+{
+    TRUSTM_PROVIDER_DBGFN(">");
+    pthread_mutex_lock(&provctx->lock);
+    if (inst != NULL)
+    {
+        trustmPoolPut(inst);
+        provctx->instUsed--;
+        pthread_cond_signal(&provctx->instFree);
+    }
+    if ((provctx->openCount != 0) && (--provctx->openCount == 0))
+    {
+        trustm_Close();
+        TRUSTM_WORKAROUND_TIMER_DISARM;
+    }
+    pthread_mutex_unlock(&provctx->lock);
+    TRUSTM_PROVIDER_DBGFN("<");
+}
+
+static const OSSL_PARAM *trustm_gettable_params(void *provctx)
+{
+    return trustm_param_types;
+}
+
+static int trustm_get_params(void *provctx, OSSL_PARAM params[])
+{
+    OSSL_PARAM *p;
+
+    p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_NAME);
+    if ((p != NULL) && !OSSL_PARAM_set_utf8_ptr(p, TRUSTM_PROVIDER_NAME))
+        return TRUSTM_PROVIDER_FAIL;
+    p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_VERSION);
+    if ((p != NULL) && !OSSL_PARAM_set_utf8_ptr(p, TRUSTM_PROVIDER_VERSION))
+        return TRUSTM_PROVIDER_FAIL;
+    p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_BUILDINFO);
+    if ((p != NULL) && !OSSL_PARAM_set_utf8_ptr(p, TRUSTM_PROVIDER_VERSION))
+        return TRUSTM_PROVIDER_FAIL;
+    p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_STATUS);
+    if ((p != NULL) && !OSSL_PARAM_set_int(p, 1))
+        return TRUSTM_PROVIDER_FAIL;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static const OSSL_ALGORITHM *trustm_query(void *provctx, int operation_id, int *no_cache)
+{
+    *no_cache = 0;
+    switch (operation_id)
+    {
+        case OSSL_OP_KEYMGMT:
+            return trustm_keymgmt;
+        case OSSL_OP_SIGNATURE:
+            return trustm_signature;
+        case OSSL_OP_ASYM_CIPHER:
+            return trustm_asym_cipher;
+        case OSSL_OP_RAND:
+            return trustm_rand;
+        case OSSL_OP_STORE:
+            return trustm_store;
+    }
+    return NULL;
+}
+
+static void trustm_teardown(void *vprovctx)
+{
+    trustm_prov_ctx_t *provctx = (trustm_prov_ctx_t *)vprovctx;
+
+    TRUSTM_PROVIDER_DBGFN(">");
+    if (provctx == NULL)
+        return;
+
+    trustmProvStoreFlush(provctx);
+    pthread_mutex_destroy(&provctx->storeLock);
+    OSSL_LIB_CTX_free(provctx->libctx);
+    pthread_cond_destroy(&provctx->instFree);
+    pthread_mutex_destroy(&provctx->lock);
+    OPENSSL_free(provctx);
+    TRUSTM_PROVIDER_DBGFN("<");
+}
+
+static const OSSL_DISPATCH trustm_dispatch[] = {
+    { OSSL_FUNC_PROVIDER_TEARDOWN, (void (*)(void))trustm_teardown },
+    { OSSL_FUNC_PROVIDER_GETTABLE_PARAMS, (void (*)(void))trustm_gettable_params },
+    { OSSL_FUNC_PROVIDER_GET_PARAMS, (void (*)(void))trustm_get_params },
+    { OSSL_FUNC_PROVIDER_QUERY_OPERATION, (void (*)(void))trustm_query },
+    { 0, NULL }
+};
+
+/**********************************************************************
+* OSSL_provider_init()
+* The provider keeps no global key context: every key object carries
+* its OID and cached public key, so keys and threads are independent.
+* Public key operations run in a library context of its own with the
+* default provider.
+**********************************************************************/
+int OSSL_provider_init(const OSSL_CORE_HANDLE *handle,
+                       const OSSL_DISPATCH *in,
+                       const OSSL_DISPATCH **out,
+                       void **vprovctx)
+{
+    trustm_prov_ctx_t *provctx;
+
+    TRUSTM_PROVIDER_DBGFN(">");
+    provctx = OPENSSL_zalloc(sizeof(trustm_prov_ctx_t));
+    if (provctx == NULL)
+        return TRUSTM_PROVIDER_FAIL;
+
+    provctx->handle = handle;
+    pthread_mutex_init(&provctx->lock, NULL);
+    pthread_cond_init(&provctx->instFree, NULL);
+    trustmProvStoreInit(provctx);
+    provctx->libctx = OSSL_LIB_CTX_new();
+    if (provctx->libctx == NULL)
+    {
+        trustm_teardown(provctx);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+
+    *out = trustm_dispatch;
+    *vprovctx = provctx;
+    TRUSTM_PROVIDER_DBGFN("<");
+    return TRUSTM_PROVIDER_SUCCESS;
+}
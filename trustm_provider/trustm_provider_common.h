@@ -0,0 +1,174 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#ifndef _TRUSTM_PROVIDER_COMMON_H_
+#define _TRUSTM_PROVIDER_COMMON_H_
+
+#include <stdio.h>
+#include <pthread.h>
+#include <openssl/core.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+
+#include "optiga_lib_common.h"
+#include "optiga_crypt.h"
+#include "optiga_util.h"
+#include "trustm_access.h"
+#include "sys/types.h"
+#include "unistd.h"
+
+#define WORKAROUND 1
+
+//#define TRUSTM_PROVIDER_DEBUG = 1
+
+#ifdef WORKAROUND
+#define TRUSTM_WORKAROUND_TIMER_ARM        pal_os_event_arm()
+#define TRUSTM_WORKAROUND_TIMER_DISARM     pal_os_event_disarm()
+#else
+#define TRUSTM_WORKAROUND_TIMER_ARM
+#define TRUSTM_WORKAROUND_TIMER_DISARM
+#endif
+
+#ifdef TRUSTM_PROVIDER_DEBUG
+
+#define TRUSTM_PROVIDER_DBGFN(x, ...)  fprintf(stderr, "%d:%s:%d %s: " x "\n", getpid(),__FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+#define TRUSTM_PROVIDER_ERRFN(x, ...)  fprintf(stderr, "%d:Error in %s:%d %s: " x "\n",getpid(), __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+
+#else
+
+#define TRUSTM_PROVIDER_DBGFN(x, ...)
+#define TRUSTM_PROVIDER_ERRFN(x, ...)  fprintf(stderr, "Error in %s:%d %s: " x "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+
+#endif
+
+/// Definition for false
+#ifndef FALSE
+#define FALSE               (0U)
+#endif
+
+/// Definition for true
+#ifndef TRUE
+#define TRUE                (1U)
+#endif
+
+// trustm provider return code
+#define TRUSTM_PROVIDER_SUCCESS    1
+#define TRUSTM_PROVIDER_FAIL       0
+
+#define TRUSTM_PROVIDER_NAME       "Infineon OPTIGA TrustM Provider"
+#define TRUSTM_PROVIDER_VERSION    "1.0.0"
+#define TRUSTM_PROVIDER_PROPS      "provider=trustm"
+
+// Key parameters besides the OpenSSL ones
+#define TRUSTM_PKEY_PARAM_OID           "trustm-oid"            // key OID, e.g. 0xE0F1
+#define TRUSTM_PKEY_PARAM_KEY_USAGE     "trustm-key-usage"      // key generation, default sign
+#define TRUSTM_PKEY_PARAM_SAVE_PUBKEY   "trustm-save-pubkey"    // key generation, store the public key
+
+#define TRUSTM_PROVIDER_PUBKEY_SIZE     300     // SubjectPublicKeyInfo of a RSA 2048 key
+#define TRUSTM_PROVIDER_RSA_SIZE        256     // RSA 2048 signature and cipher text
+#define TRUSTM_PROVIDER_RAND_MAX        256     // largest chip random request
+#define TRUSTM_PROVIDER_CERT_SIZE       1728    // largest certificate data object
+#define TRUSTM_PROVIDER_STORE_MAX       12      // key and certificate OIDs of the store
+
+// Issue an idempotent command on a pool instance and wait for it. The
+// command is issued under the provider lock, the wait runs unlocked so
+// other threads queue their commands meanwhile. Replayed after a
+// watchdog reset recovered this instance, like TRUSTM_REPLAY().
+#define TRUSTM_PROVIDER_REPLAY(ret, provctx, inst, setup, call) \
+                                    { uint8_t __replay = 0; \
+                                      do { setup; \
+                                           (inst)->status = OPTIGA_LIB_BUSY; \
+                                           pthread_mutex_lock(&(provctx)->lock); \
+                                           ret = call; \
+                                           pthread_mutex_unlock(&(provctx)->lock); \
+                                           if (OPTIGA_LIB_SUCCESS == ret) \
+                                               ret = trustmPoolWait(inst); \
+                                      } while (trustmPoolReplay(inst, ret, &__replay)); }
+
+//typedefine
+typedef struct trustm_prov_key_str trustm_prov_key_t;
+
+// Store cache entry of a key or certificate OID
+typedef struct trustm_prov_obj_str
+{
+    uint16_t                oid;
+    uint8_t                 algo;           // keys : metadata tag 0xE0, 0 : no key
+    uint16_t                used;           // certificates : metadata tag 0xC5, 0 : empty
+    trustm_prov_key_t       *key;           // key object loaded from the chip
+    uint8_t                 *der;           // certificate read from the chip
+    uint16_t                derLen;
+} trustm_prov_obj_t;
+
+typedef struct trustm_prov_ctx_str
+{
+    const OSSL_CORE_HANDLE  *handle;
+    OSSL_LIB_CTX            *libctx;        // software operations with the public keys
+    pthread_mutex_t         lock;           // chip open/close and command issue
+    pthread_cond_t          instFree;
+    uint32_t                openCount;      // operations using the open application
+    uint32_t                instUsed;       // pool instances held by the provider
+    pthread_mutex_t         storeLock;      // store cache
+    uint8_t                 storeSwept;     // metadata of all store OIDs read
+    trustm_prov_obj_t       store[TRUSTM_PROVIDER_STORE_MAX];
+} trustm_prov_ctx_t;
+
+typedef enum trustm_prov_keytype
+{
+    TRUSTM_PROVIDER_KEY_EC = 1,
+    TRUSTM_PROVIDER_KEY_RSA = 2
+} trustm_prov_keytype_t;
+
+// Key object: the private key stays in the chip at oid, the public part
+// is cached on load so the chip is not read again for this key
+struct trustm_prov_key_str
+{
+    trustm_prov_ctx_t       *provctx;
+    trustm_prov_keytype_t   type;
+    uint16_t                oid;            // 0x0000 : public key only
+    uint8_t                 algo;           // optiga_ecc_curve_t or optiga_rsa_key_type_t
+    uint16_t                bits;
+    EVP_PKEY                *pub;           // cached public key, provctx->libctx
+};
+
+//function prototype
+optiga_lib_status_t trustmProvBegin(trustm_prov_ctx_t *provctx, trustm_inst_t **inst);
+void trustmProvEnd(trustm_prov_ctx_t *provctx, trustm_inst_t *inst);
+
+trustm_prov_key_t *trustmProvKeyNew(trustm_prov_ctx_t *provctx, trustm_prov_keytype_t type);
+void trustmProvKeyFree(trustm_prov_key_t *key);
+int trustmProvKeyLoad(trustm_prov_key_t *key, uint16_t oid);
+size_t trustmProvKeySize(const trustm_prov_key_t *key);
+
+void trustmProvStoreInit(trustm_prov_ctx_t *provctx);
+void trustmProvStoreFlush(trustm_prov_ctx_t *provctx);
+
+extern const OSSL_DISPATCH trustm_ec_keymgmt_functions[];
+extern const OSSL_DISPATCH trustm_rsa_keymgmt_functions[];
+extern const OSSL_DISPATCH trustm_signature_functions[];
+extern const OSSL_DISPATCH trustm_rsa_asym_cipher_functions[];
+extern const OSSL_DISPATCH trustm_rand_functions[];
+extern const OSSL_DISPATCH trustm_store_functions[];
+
+#endif // _TRUSTM_PROVIDER_COMMON_H_
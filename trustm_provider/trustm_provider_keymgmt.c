@@ -0,0 +1,770 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/x509.h>
+
+#include "trustm_provider_common.h"
+#include "trustm_helper.h"
+#include "trustm_certcomp.h"
+
+// Key generation context
+typedef struct trustm_prov_gen_str
+{
+    trustm_prov_ctx_t       *provctx;
+    trustm_prov_keytype_t   type;
+    uint16_t                oid;
+    uint8_t                 algo;
+    uint8_t                 keyUsage;
+    int                     savePubkey;
+} trustm_prov_gen_t;
+
+// SubjectPublicKeyInfo headers for the public keys returned by the chip
+static const uint8_t eccheader256[] = {0x30,0x59, // SEQUENCE
+                                       0x30,0x13, // SEQUENCE
+                                       0x06,0x07, // OID:1.2.840.10045.2.1
+                                       0x2A,0x86,0x48,0xCE,0x3D,0x02,0x01,
+                                       0x06,0x08, // OID:1.2.840.10045.3.1.7
+                                       0x2A,0x86,0x48,0xCE,0x3D,0x03,0x01,0x07};
+
+static const uint8_t eccheader384[] = {0x30,0x76, // SEQUENCE
+                                       0x30,0x10, //SEQUENCE
+                                       0x06,0x07, // OID:1.2.840.10045.2.1
+                                       0x2A,0x86,0x48,0xCE,0x3D,0x02,0x01,
+                                       0x06,0x05, // OID:1.3.132.0.34
+                                       0x2B,0x81,0x04,0x00,0x22};
+
+static const uint8_t rsaheader2048[] = {0x30,0x82,0x01,0x22,
+                                        0x30,0x0d,
+                                        0x06,0x09,
+                                        0x2a,0x86,0x48,0x86,0xf7,0x0d,0x01,0x01,0x01,0x05,0x00};
+
+static const uint8_t rsaheader1024[] = {0x30,0x81,0x9F,
+                                        0x30,0x0D,
+                                        0x06,0x09,
+                                        0x2A,0x86,0x48,0x86,0xF7,0x0D,0x01,0x01,0x01,0x05,0x00};
+
+/**********************************************************************
+* __trustm_getOid()
+* Key OID from a number or a hex string, e.g. "0xE0F1" or "E0F1".
+**********************************************************************/
+static int __trustm_getOid(const OSSL_PARAM *p, uint16_t *oid)
+{
+    unsigned int value = 0;
+    const char *str;
+
+    if (p->data_type == OSSL_PARAM_UTF8_STRING)
+    {
+        if (!OSSL_PARAM_get_utf8_string_ptr(p, &str))
+            return TRUSTM_PROVIDER_FAIL;
+        value = (unsigned int)strtoul(str, NULL, 16);
+    }
+    else if (!OSSL_PARAM_get_uint(p, &value))
+        return TRUSTM_PROVIDER_FAIL;
+
+    if (((value < 0xE0F0) || (value > 0xE0F3)) &&
+        ((value < 0xE0FC) || (value > 0xE0FD)))
+    {
+        TRUSTM_PROVIDER_ERRFN("Invalid Key OID 0x%.4X", value);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    *oid = (uint16_t)value;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+/**********************************************************************
+* __trustm_setPub()
+* Cache the public key from a DER SubjectPublicKeyInfo.
+**********************************************************************/
+static int __trustm_setPub(trustm_prov_key_t *key, const uint8_t *spki, long len)
+{
+    EVP_PKEY *pub;
+    const unsigned char *p = spki;
+
+    pub = d2i_PUBKEY_ex(NULL, &p, len, key->provctx->libctx, NULL);
+    if (pub == NULL)
+        return TRUSTM_PROVIDER_FAIL;
+    if (!EVP_PKEY_is_a(pub, (key->type == TRUSTM_PROVIDER_KEY_EC) ? "EC" : "RSA"))
+    {
+        TRUSTM_PROVIDER_ERRFN("Public key type mismatch");
+        EVP_PKEY_free(pub);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    EVP_PKEY_free(key->pub);
+    key->pub = pub;
+    key->bits = (uint16_t)EVP_PKEY_get_bits(pub);
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+trustm_prov_key_t *trustmProvKeyNew(trustm_prov_ctx_t *provctx, trustm_prov_keytype_t type)
+{
+    trustm_prov_key_t *key;
+
+    key = OPENSSL_zalloc(sizeof(trustm_prov_key_t));
+    if (key == NULL)
+        return NULL;
+    key->provctx = provctx;
+    key->type = type;
+    return key;
+}
+
+void trustmProvKeyFree(trustm_prov_key_t *key)
+{
+    if (key == NULL)
+        return;
+    EVP_PKEY_free(key->pub);
+    OPENSSL_free(key);
+}
+
+/**********************************************************************
+* trustmProvKeySize()
+* Digest bytes signed by an EC key, signature bytes of a RSA key.
+**********************************************************************/
+size_t trustmProvKeySize(const trustm_prov_key_t *key)
+{
+    return (key->bits + 7) / 8;
+}
+
+/**********************************************************************
+* trustmProvKeyLoad()
+* Bind the key to oid. The algorithm comes from the key metadata unless
+* it is set already, e.g. by the store metadata sweep, the public key
+* from its public key data object (0xE0F1 -> 0xF1D1, 0xE0FC -> 0xF1E0)
+* or, for 0xE0F0, from the device certificate 0xE0E0. A public key set
+* before, e.g. from the certificate of the key, is kept and no chip
+* read is done for it.
+**********************************************************************/
+int trustmProvKeyLoad(trustm_prov_key_t *key, uint16_t oid)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    trustm_inst_t *inst;
+    uint8_t buf[TRUSTM_PROVIDER_CERT_SIZE];
+    uint16_t len;
+    uint16_t pubOid;
+    uint16_t i;
+    unsigned char *der;
+    X509 *x509 = NULL;
+    int ret = TRUSTM_PROVIDER_FAIL;
+
+    TRUSTM_PROVIDER_DBGFN("> 0x%.4X", oid);
+    key->oid = oid;
+    if (key->pub != NULL)
+        return TRUSTM_PROVIDER_SUCCESS;
+
+    if (trustmProvBegin(key->provctx, &inst) != OPTIGA_LIB_SUCCESS)
+        return TRUSTM_PROVIDER_FAIL;
+    do
+    {
+        if (oid == 0xE0F0)
+        {
+            TRUSTM_PROVIDER_REPLAY(return_status, key->provctx, inst,
+                                   len = sizeof(buf),
+                                   optiga_util_read_data(inst->util, 0xE0E0, 0, buf, &len));
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                break;
+
+            // DER, TLS identity or compressed certificate
+            x509 = trustmCertParse(buf, len);
+            if ((x509 == NULL) || (X509_get0_pubkey(x509) == NULL))
+            {
+                TRUSTM_PROVIDER_ERRFN("No certificate in 0xE0E0");
+                break;
+            }
+            len = (uint16_t)i2d_PUBKEY(X509_get0_pubkey(x509), NULL);
+            if ((len == 0) || (len > sizeof(buf)))
+                break;
+            der = buf;
+            i2d_PUBKEY(X509_get0_pubkey(x509), &der);
+        }
+        else
+        {
+            // Key algorithm from the metadata tag 0xE0
+            if (key->algo == 0)
+            {
+                TRUSTM_PROVIDER_REPLAY(return_status, key->provctx, inst,
+                                       len = sizeof(buf),
+                                       optiga_util_read_metadata(inst->util, oid, buf, &len));
+                if (return_status != OPTIGA_LIB_SUCCESS)
+                    break;
+                for (i = 2; (buf[0] == 0x20) && (i + 2 < len); i += buf[i+1] + 2)
+                {
+                    if (buf[i] == 0xE0)
+                        key->algo = buf[i+2];
+                }
+            }
+
+            pubOid = (key->type == TRUSTM_PROVIDER_KEY_EC) ? (oid + 0x10E0) : (oid + 0x10E4);
+            TRUSTM_PROVIDER_REPLAY(return_status, key->provctx, inst,
+                                   len = sizeof(buf),
+                                   optiga_util_read_data(inst->util, pubOid, 0, buf, &len));
+            if ((return_status != OPTIGA_LIB_SUCCESS) || (len == 0))
+            {
+                TRUSTM_PROVIDER_ERRFN("No public key in 0x%.4X", pubOid);
+                break;
+            }
+        }
+
+        ret = __trustm_setPub(key, buf, len);
+    } while (FALSE);
+    trustmProvEnd(key->provctx, inst);
+
+    X509_free(x509);
+    TRUSTM_PROVIDER_DBGFN("<");
+    return ret;
+}
+
+static void *trustm_ec_keymgmt_new(void *provctx)
+{
+    return trustmProvKeyNew((trustm_prov_ctx_t *)provctx, TRUSTM_PROVIDER_KEY_EC);
+}
+
+static void *trustm_rsa_keymgmt_new(void *provctx)
+{
+    return trustmProvKeyNew((trustm_prov_ctx_t *)provctx, TRUSTM_PROVIDER_KEY_RSA);
+}
+
+static void trustm_keymgmt_free(void *vkey)
+{
+    trustmProvKeyFree((trustm_prov_key_t *)vkey);
+}
+
+static void *trustm_keymgmt_dup(const void *vsrc, int selection)
+{
+    const trustm_prov_key_t *src = (const trustm_prov_key_t *)vsrc;
+    trustm_prov_key_t *key;
+
+    key = trustmProvKeyNew(src->provctx, src->type);
+    if (key == NULL)
+        return NULL;
+    key->algo = src->algo;
+    key->bits = src->bits;
+    if ((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0)
+        key->oid = src->oid;
+    if ((src->pub != NULL) && EVP_PKEY_up_ref(src->pub))
+        key->pub = src->pub;
+    return key;
+}
+
+static int trustm_keymgmt_has(const void *vkey, int selection)
+{
+    const trustm_prov_key_t *key = (const trustm_prov_key_t *)vkey;
+
+    if (key == NULL)
+        return TRUSTM_PROVIDER_FAIL;
+    if (((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0) && (key->oid == 0))
+        return TRUSTM_PROVIDER_FAIL;
+    if (((selection & (OSSL_KEYMGMT_SELECT_PUBLIC_KEY | OSSL_KEYMGMT_SELECT_ALL_PARAMETERS)) != 0) &&
+        (key->pub == NULL))
+        return TRUSTM_PROVIDER_FAIL;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static int trustm_keymgmt_match(const void *vkey1, const void *vkey2, int selection)
+{
+    const trustm_prov_key_t *key1 = (const trustm_prov_key_t *)vkey1;
+    const trustm_prov_key_t *key2 = (const trustm_prov_key_t *)vkey2;
+
+    if ((key1->pub == NULL) || (key2->pub == NULL))
+        return TRUSTM_PROVIDER_FAIL;
+    // The private keys only differ if both are bound to the chip
+    if (((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0) &&
+        (key1->oid != 0) && (key2->oid != 0) && (key1->oid != key2->oid))
+        return TRUSTM_PROVIDER_FAIL;
+    return (EVP_PKEY_eq(key1->pub, key2->pub) == 1);
+}
+
+/**********************************************************************
+* trustm_keymgmt_import()
+* A public key, e.g. of a certificate, or a chip key with
+* TRUSTM_PKEY_PARAM_OID. Software private keys are not taken.
+**********************************************************************/
+static int trustm_keymgmt_import(void *vkey, int selection, const OSSL_PARAM params[])
+{
+    trustm_prov_key_t *key = (trustm_prov_key_t *)vkey;
+    const OSSL_PARAM *p;
+    EVP_PKEY_CTX *ctx = NULL;
+    EVP_PKEY *pub = NULL;
+    uint16_t oid = 0;
+    int ret = TRUSTM_PROVIDER_FAIL;
+
+    TRUSTM_PROVIDER_DBGFN(">");
+    do
+    {
+        p = OSSL_PARAM_locate_const(params, TRUSTM_PKEY_PARAM_OID);
+        if ((p != NULL) && !__trustm_getOid(p, &oid))
+            break;
+        if (((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) != 0) && (oid == 0) &&
+            ((OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_PRIV_KEY) != NULL) ||
+             (OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_RSA_D) != NULL)))
+        {
+            TRUSTM_PROVIDER_ERRFN("Private keys stay in the chip");
+            break;
+        }
+
+        if ((OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_PUB_KEY) != NULL) ||
+            (OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_RSA_N) != NULL))
+        {
+            ctx = EVP_PKEY_CTX_new_from_name(key->provctx->libctx,
+                                             (key->type == TRUSTM_PROVIDER_KEY_EC) ? "EC" : "RSA",
+                                             NULL);
+            if ((ctx == NULL) ||
+                (EVP_PKEY_fromdata_init(ctx) <= 0) ||
+                (EVP_PKEY_fromdata(ctx, &pub, EVP_PKEY_PUBLIC_KEY, (OSSL_PARAM *)params) <= 0))
+                break;
+            EVP_PKEY_free(key->pub);
+            key->pub = pub;
+            key->bits = (uint16_t)EVP_PKEY_get_bits(pub);
+        }
+
+        if (oid != 0)
+            ret = trustmProvKeyLoad(key, oid);
+        else
+            ret = (key->pub != NULL);
+    } while (FALSE);
+
+    EVP_PKEY_CTX_free(ctx);
+    TRUSTM_PROVIDER_DBGFN("<");
+    return ret;
+}
+
+/**********************************************************************
+* trustm_keymgmt_export()
+* Only the public part leaves the provider.
+**********************************************************************/
+static int trustm_keymgmt_export(void *vkey, int selection, OSSL_CALLBACK *param_cb, void *cbarg)
+{
+    trustm_prov_key_t *key = (trustm_prov_key_t *)vkey;
+    OSSL_PARAM *params = NULL;
+    int ret;
+
+    if ((key->pub == NULL) ||
+        ((selection & (OSSL_KEYMGMT_SELECT_PUBLIC_KEY | OSSL_KEYMGMT_SELECT_ALL_PARAMETERS)) == 0))
+        return TRUSTM_PROVIDER_FAIL;
+    if (EVP_PKEY_todata(key->pub, EVP_PKEY_PUBLIC_KEY, &params) <= 0)
+        return TRUSTM_PROVIDER_FAIL;
+    ret = param_cb(params, cbarg);
+    OSSL_PARAM_free(params);
+    return ret;
+}
+
+static const OSSL_PARAM trustm_ec_key_types[] = {
+    OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, NULL, 0),
+    OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_PUB_KEY, NULL, 0),
+    OSSL_PARAM_uint(TRUSTM_PKEY_PARAM_OID, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM trustm_rsa_key_types[] = {
+    OSSL_PARAM_BN(OSSL_PKEY_PARAM_RSA_N, NULL, 0),
+    OSSL_PARAM_BN(OSSL_PKEY_PARAM_RSA_E, NULL, 0),
+    OSSL_PARAM_uint(TRUSTM_PKEY_PARAM_OID, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM *trustm_ec_keymgmt_types(int selection)
+{
+    return trustm_ec_key_types;
+}
+
+static const OSSL_PARAM *trustm_rsa_keymgmt_types(int selection)
+{
+    return trustm_rsa_key_types;
+}
+
+/**********************************************************************
+* trustm_keymgmt_get_params()
+* Public key parameters from the cached public key. The default digest
+* follows the key size: SHA-384 for P-384, SHA-256 otherwise.
+**********************************************************************/
+static int trustm_keymgmt_get_params(void *vkey, OSSL_PARAM params[])
+{
+    trustm_prov_key_t *key = (trustm_prov_key_t *)vkey;
+    OSSL_PARAM *p;
+
+    if ((key->pub != NULL) && !EVP_PKEY_get_params(key->pub, params))
+        return TRUSTM_PROVIDER_FAIL;
+
+    p = OSSL_PARAM_locate(params, OSSL_PKEY_PARAM_DEFAULT_DIGEST);
+    if ((p != NULL) &&
+        !OSSL_PARAM_set_utf8_string(p, ((key->type == TRUSTM_PROVIDER_KEY_EC) && (key->bits > 256)) ?
+                                       "SHA384" : "SHA256"))
+        return TRUSTM_PROVIDER_FAIL;
+
+    p = OSSL_PARAM_locate(params, TRUSTM_PKEY_PARAM_OID);
+    if ((p != NULL) && !OSSL_PARAM_set_uint(p, key->oid))
+        return TRUSTM_PROVIDER_FAIL;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static const OSSL_PARAM trustm_ec_gettable[] = {
+    OSSL_PARAM_int(OSSL_PKEY_PARAM_BITS, NULL),
+    OSSL_PARAM_int(OSSL_PKEY_PARAM_SECURITY_BITS, NULL),
+    OSSL_PARAM_int(OSSL_PKEY_PARAM_MAX_SIZE, NULL),
+    OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_DEFAULT_DIGEST, NULL, 0),
+    OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, NULL, 0),
+    OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_ENCODED_PUBLIC_KEY, NULL, 0),
+    OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_PUB_KEY, NULL, 0),
+    OSSL_PARAM_uint(TRUSTM_PKEY_PARAM_OID, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM trustm_rsa_gettable[] = {
+    OSSL_PARAM_int(OSSL_PKEY_PARAM_BITS, NULL),
+    OSSL_PARAM_int(OSSL_PKEY_PARAM_SECURITY_BITS, NULL),
+    OSSL_PARAM_int(OSSL_PKEY_PARAM_MAX_SIZE, NULL),
+    OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_DEFAULT_DIGEST, NULL, 0),
+    OSSL_PARAM_BN(OSSL_PKEY_PARAM_RSA_N, NULL, 0),
+    OSSL_PARAM_BN(OSSL_PKEY_PARAM_RSA_E, NULL, 0),
+    OSSL_PARAM_uint(TRUSTM_PKEY_PARAM_OID, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM *trustm_ec_keymgmt_gettable(void *provctx)
+{
+    return trustm_ec_gettable;
+}
+
+static const OSSL_PARAM *trustm_rsa_keymgmt_gettable(void *provctx)
+{
+    return trustm_rsa_gettable;
+}
+
+static const char *trustm_ec_keymgmt_query(int operation_id)
+{
+    return (operation_id == OSSL_OP_SIGNATURE) ? "ECDSA" : NULL;
+}
+
+static const char *trustm_rsa_keymgmt_query(int operation_id)
+{
+    return "RSA";
+}
+
+static void *trustm_keymgmt_gen_init(trustm_prov_ctx_t *provctx, trustm_prov_keytype_t type)
+{
+    trustm_prov_gen_t *gen;
+
+    gen = OPENSSL_zalloc(sizeof(trustm_prov_gen_t));
+    if (gen == NULL)
+        return NULL;
+    gen->provctx = provctx;
+    gen->type = type;
+    gen->keyUsage = OPTIGA_KEY_USAGE_SIGN;
+    if (type == TRUSTM_PROVIDER_KEY_EC)
+        gen->algo = OPTIGA_ECC_CURVE_NIST_P_256;
+    else
+        gen->algo = OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL;
+    return gen;
+}
+
+static int trustm_keymgmt_gen_set_params(void *vgen, const OSSL_PARAM params[])
+{
+    trustm_prov_gen_t *gen = (trustm_prov_gen_t *)vgen;
+    const OSSL_PARAM *p;
+    const char *group;
+    unsigned int value;
+
+    p = OSSL_PARAM_locate_const(params, TRUSTM_PKEY_PARAM_OID);
+    if ((p != NULL) && !__trustm_getOid(p, &gen->oid))
+        return TRUSTM_PROVIDER_FAIL;
+
+    p = OSSL_PARAM_locate_const(params, TRUSTM_PKEY_PARAM_KEY_USAGE);
+    if (p != NULL)
+    {
+        if (!OSSL_PARAM_get_uint(p, &value))
+            return TRUSTM_PROVIDER_FAIL;
+        gen->keyUsage = (uint8_t)value;
+    }
+
+    p = OSSL_PARAM_locate_const(params, TRUSTM_PKEY_PARAM_SAVE_PUBKEY);
+    if ((p != NULL) && !OSSL_PARAM_get_int(p, &gen->savePubkey))
+        return TRUSTM_PROVIDER_FAIL;
+
+    p = OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_GROUP_NAME);
+    if (p != NULL)
+    {
+        if (!OSSL_PARAM_get_utf8_string_ptr(p, &group))
+            return TRUSTM_PROVIDER_FAIL;
+        if (!strcasecmp(group, "P-256") || !strcmp(group, "prime256v1"))
+            gen->algo = OPTIGA_ECC_CURVE_NIST_P_256;
+        else if (!strcasecmp(group, "P-384") || !strcmp(group, "secp384r1"))
+            gen->algo = OPTIGA_ECC_CURVE_NIST_P_384;
+        else
+        {
+            TRUSTM_PROVIDER_ERRFN("Curve %s not supported", group);
+            return TRUSTM_PROVIDER_FAIL;
+        }
+    }
+
+    p = OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_RSA_BITS);
+    if (p != NULL)
+    {
+        if (!OSSL_PARAM_get_uint(p, &value))
+            return TRUSTM_PROVIDER_FAIL;
+        if (value == 1024)
+            gen->algo = OPTIGA_RSA_KEY_1024_BIT_EXPONENTIAL;
+        else if (value == 2048)
+            gen->algo = OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL;
+        else
+        {
+            TRUSTM_PROVIDER_ERRFN("RSA %d bits not supported", value);
+            return TRUSTM_PROVIDER_FAIL;
+        }
+    }
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static void *trustm_ec_keymgmt_gen_init(void *provctx, int selection, const OSSL_PARAM params[])
+{
+    trustm_prov_gen_t *gen = trustm_keymgmt_gen_init(provctx, TRUSTM_PROVIDER_KEY_EC);
+
+    if ((gen != NULL) && !trustm_keymgmt_gen_set_params(gen, params))
+    {
+        OPENSSL_free(gen);
+        gen = NULL;
+    }
+    return gen;
+}
+
+static void *trustm_rsa_keymgmt_gen_init(void *provctx, int selection, const OSSL_PARAM params[])
+{
+    trustm_prov_gen_t *gen = trustm_keymgmt_gen_init(provctx, TRUSTM_PROVIDER_KEY_RSA);
+
+    if ((gen != NULL) && !trustm_keymgmt_gen_set_params(gen, params))
+    {
+        OPENSSL_free(gen);
+        gen = NULL;
+    }
+    return gen;
+}
+
+static const OSSL_PARAM trustm_ec_gen_settable[] = {
+    OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, NULL, 0),
+    OSSL_PARAM_uint(TRUSTM_PKEY_PARAM_OID, NULL),
+    OSSL_PARAM_uint(TRUSTM_PKEY_PARAM_KEY_USAGE, NULL),
+    OSSL_PARAM_int(TRUSTM_PKEY_PARAM_SAVE_PUBKEY, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM trustm_rsa_gen_settable[] = {
+    OSSL_PARAM_uint(OSSL_PKEY_PARAM_RSA_BITS, NULL),
+    OSSL_PARAM_uint(TRUSTM_PKEY_PARAM_OID, NULL),
+    OSSL_PARAM_uint(TRUSTM_PKEY_PARAM_KEY_USAGE, NULL),
+    OSSL_PARAM_int(TRUSTM_PKEY_PARAM_SAVE_PUBKEY, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM *trustm_ec_keymgmt_gen_settable(void *vgen, void *provctx)
+{
+    return trustm_ec_gen_settable;
+}
+
+static const OSSL_PARAM *trustm_rsa_keymgmt_gen_settable(void *vgen, void *provctx)
+{
+    return trustm_rsa_gen_settable;
+}
+
+/**********************************************************************
+* trustm_keymgmt_gen()
+* Generate the key pair in the chip, optionally save the public key to
+* its public key data object so a later load finds it.
+**********************************************************************/
+static void *trustm_keymgmt_gen(void *vgen, OSSL_CALLBACK *cb, void *cbarg)
+{
+    trustm_prov_gen_t *gen = (trustm_prov_gen_t *)vgen;
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    optiga_key_id_t optiga_key_id;
+    trustm_prov_key_t *key = NULL;
+    trustm_inst_t *inst;
+    uint8_t public_key[TRUSTM_PROVIDER_PUBKEY_SIZE + 32];
+    uint16_t public_key_length;
+    uint16_t headerLen;
+    uint16_t pubOid;
+
+    TRUSTM_PROVIDER_DBGFN(">");
+    if ((gen->oid == 0) ||
+        ((gen->type == TRUSTM_PROVIDER_KEY_EC) && ((gen->oid < 0xE0F1) || (gen->oid > 0xE0F3))) ||
+        ((gen->type == TRUSTM_PROVIDER_KEY_RSA) && (gen->oid < 0xE0FC)))
+    {
+        TRUSTM_PROVIDER_ERRFN("Key generation needs a key OID (%s)", TRUSTM_PKEY_PARAM_OID);
+        return NULL;
+    }
+
+    key = trustmProvKeyNew(gen->provctx, gen->type);
+    if (key == NULL)
+        return NULL;
+    if (trustmProvBegin(gen->provctx, &inst) != OPTIGA_LIB_SUCCESS)
+    {
+        trustmProvKeyFree(key);
+        return NULL;
+    }
+    do
+    {
+        optiga_key_id = gen->oid;
+        if (gen->type == TRUSTM_PROVIDER_KEY_EC)
+        {
+            headerLen = (gen->algo == OPTIGA_ECC_CURVE_NIST_P_256) ? sizeof(eccheader256) : sizeof(eccheader384);
+            memcpy(public_key, (gen->algo == OPTIGA_ECC_CURVE_NIST_P_256) ? eccheader256 : eccheader384, headerLen);
+            public_key_length = sizeof(public_key) - headerLen;
+            inst->status = OPTIGA_LIB_BUSY;
+            pthread_mutex_lock(&gen->provctx->lock);
+            return_status = optiga_crypt_ecc_generate_keypair(inst->crypt,
+                                                              gen->algo,
+                                                              gen->keyUsage,
+                                                              FALSE,
+                                                              &optiga_key_id,
+                                                              public_key + headerLen,
+                                                              &public_key_length);
+            pthread_mutex_unlock(&gen->provctx->lock);
+            pubOid = gen->oid + 0x10E0;
+        }
+        else
+        {
+            headerLen = (gen->algo == OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL) ? sizeof(rsaheader2048) : sizeof(rsaheader1024);
+            memcpy(public_key, (gen->algo == OPTIGA_RSA_KEY_2048_BIT_EXPONENTIAL) ? rsaheader2048 : rsaheader1024, headerLen);
+            public_key_length = sizeof(public_key) - headerLen;
+            inst->status = OPTIGA_LIB_BUSY;
+            pthread_mutex_lock(&gen->provctx->lock);
+            return_status = optiga_crypt_rsa_generate_keypair(inst->crypt,
+                                                              gen->algo,
+                                                              gen->keyUsage,
+                                                              FALSE,
+                                                              &optiga_key_id,
+                                                              public_key + headerLen,
+                                                              &public_key_length);
+            pthread_mutex_unlock(&gen->provctx->lock);
+            pubOid = gen->oid + 0x10E4;
+        }
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+        return_status = trustmPoolWaitMs(inst, TRUSTM_CMD_TIMEOUT_LONG_MS);
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+        public_key_length += headerLen;
+
+        if (gen->savePubkey)
+        {
+            TRUSTM_PROVIDER_DBGFN("Save Pubkey to : 0x%.4X", pubOid);
+            inst->status = OPTIGA_LIB_BUSY;
+            pthread_mutex_lock(&gen->provctx->lock);
+            return_status = optiga_util_write_data(inst->util,
+                                                   pubOid,
+                                                   OPTIGA_UTIL_ERASE_AND_WRITE,
+                                                   0,
+                                                   public_key,
+                                                   public_key_length);
+            pthread_mutex_unlock(&gen->provctx->lock);
+            if (return_status == OPTIGA_LIB_SUCCESS)
+                return_status = trustmPoolWait(inst);
+            if (return_status != OPTIGA_LIB_SUCCESS)
+                break;
+        }
+
+        key->algo = gen->algo;
+        key->oid = gen->oid;
+        if (!__trustm_setPub(key, public_key, public_key_length))
+            return_status = TRUSTM_ACCESS_ERROR;
+    } while (FALSE);
+    trustmProvEnd(gen->provctx, inst);
+
+    // The store cache holds the old key of the OID
+    trustmProvStoreFlush(gen->provctx);
+
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        trustmPrintErrorCode(return_status);
+        trustmProvKeyFree(key);
+        key = NULL;
+    }
+    TRUSTM_PROVIDER_DBGFN("<");
+    return key;
+}
+
+static void trustm_keymgmt_gen_cleanup(void *vgen)
+{
+    OPENSSL_free(vgen);
+}
+
+/**********************************************************************
+* trustm_keymgmt_load()
+* Key object passed by reference, e.g. from the trustm: store loader.
+* The caller keeps its key, the copy shares the cached public key.
+**********************************************************************/
+static void *trustm_keymgmt_load(const void *reference, size_t reference_sz)
+{
+    const trustm_prov_key_t *key;
+
+    if ((reference == NULL) || (reference_sz != sizeof(key)))
+        return NULL;
+    key = *(const trustm_prov_key_t * const *)reference;
+    return trustm_keymgmt_dup(key, OSSL_KEYMGMT_SELECT_ALL);
+}
+
+const OSSL_DISPATCH trustm_ec_keymgmt_functions[] = {
+    { OSSL_FUNC_KEYMGMT_NEW, (void (*)(void))trustm_ec_keymgmt_new },
+    { OSSL_FUNC_KEYMGMT_FREE, (void (*)(void))trustm_keymgmt_free },
+    { OSSL_FUNC_KEYMGMT_DUP, (void (*)(void))trustm_keymgmt_dup },
+    { OSSL_FUNC_KEYMGMT_HAS, (void (*)(void))trustm_keymgmt_has },
+    { OSSL_FUNC_KEYMGMT_MATCH, (void (*)(void))trustm_keymgmt_match },
+    { OSSL_FUNC_KEYMGMT_IMPORT, (void (*)(void))trustm_keymgmt_import },
+    { OSSL_FUNC_KEYMGMT_IMPORT_TYPES, (void (*)(void))trustm_ec_keymgmt_types },
+    { OSSL_FUNC_KEYMGMT_EXPORT, (void (*)(void))trustm_keymgmt_export },
+    { OSSL_FUNC_KEYMGMT_EXPORT_TYPES, (void (*)(void))trustm_ec_keymgmt_types },
+    { OSSL_FUNC_KEYMGMT_GET_PARAMS, (void (*)(void))trustm_keymgmt_get_params },
+    { OSSL_FUNC_KEYMGMT_GETTABLE_PARAMS, (void (*)(void))trustm_ec_keymgmt_gettable },
+    { OSSL_FUNC_KEYMGMT_QUERY_OPERATION_NAME, (void (*)(void))trustm_ec_keymgmt_query },
+    { OSSL_FUNC_KEYMGMT_GEN_INIT, (void (*)(void))trustm_ec_keymgmt_gen_init },
+    { OSSL_FUNC_KEYMGMT_GEN_SET_PARAMS, (void (*)(void))trustm_keymgmt_gen_set_params },
+    { OSSL_FUNC_KEYMGMT_GEN_SETTABLE_PARAMS, (void (*)(void))trustm_ec_keymgmt_gen_settable },
+    { OSSL_FUNC_KEYMGMT_GEN, (void (*)(void))trustm_keymgmt_gen },
+    { OSSL_FUNC_KEYMGMT_GEN_CLEANUP, (void (*)(void))trustm_keymgmt_gen_cleanup },
+    { OSSL_FUNC_KEYMGMT_LOAD, (void (*)(void))trustm_keymgmt_load },
+    { 0, NULL }
+};
+
+const OSSL_DISPATCH trustm_rsa_keymgmt_functions[] = {
+    { OSSL_FUNC_KEYMGMT_NEW, (void (*)(void))trustm_rsa_keymgmt_new },
+    { OSSL_FUNC_KEYMGMT_FREE, (void (*)(void))trustm_keymgmt_free },
+    { OSSL_FUNC_KEYMGMT_DUP, (void (*)(void))trustm_keymgmt_dup },
+    { OSSL_FUNC_KEYMGMT_HAS, (void (*)(void))trustm_keymgmt_has },
+    { OSSL_FUNC_KEYMGMT_MATCH, (void (*)(void))trustm_keymgmt_match },
+    { OSSL_FUNC_KEYMGMT_IMPORT, (void (*)(void))trustm_keymgmt_import },
+    { OSSL_FUNC_KEYMGMT_IMPORT_TYPES, (void (*)(void))trustm_rsa_keymgmt_types },
+    { OSSL_FUNC_KEYMGMT_EXPORT, (void (*)(void))trustm_keymgmt_export },
+    { OSSL_FUNC_KEYMGMT_EXPORT_TYPES, (void (*)(void))trustm_rsa_keymgmt_types },
+    { OSSL_FUNC_KEYMGMT_GET_PARAMS, (void (*)(void))trustm_keymgmt_get_params },
+    { OSSL_FUNC_KEYMGMT_GETTABLE_PARAMS, (void (*)(void))trustm_rsa_keymgmt_gettable },
+    { OSSL_FUNC_KEYMGMT_QUERY_OPERATION_NAME, (void (*)(void))trustm_rsa_keymgmt_query },
+    { OSSL_FUNC_KEYMGMT_GEN_INIT, (void (*)(void))trustm_rsa_keymgmt_gen_init },
+    { OSSL_FUNC_KEYMGMT_GEN_SET_PARAMS, (void (*)(void))trustm_keymgmt_gen_set_params },
+    { OSSL_FUNC_KEYMGMT_GEN_SETTABLE_PARAMS, (void (*)(void))trustm_rsa_keymgmt_gen_settable },
+    { OSSL_FUNC_KEYMGMT_GEN, (void (*)(void))trustm_keymgmt_gen },
+    { OSSL_FUNC_KEYMGMT_GEN_CLEANUP, (void (*)(void))trustm_keymgmt_gen_cleanup },
+    { OSSL_FUNC_KEYMGMT_LOAD, (void (*)(void))trustm_keymgmt_load },
+    { 0, NULL }
+};
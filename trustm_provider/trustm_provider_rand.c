@@ -0,0 +1,224 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <string.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+
+#include "trustm_provider_common.h"
+#include "trustm_helper.h"
+
+#define TRUSTM_RAND_MIN         8       // smallest chip random request
+#define TRUSTM_RAND_STRENGTH    256
+#define TRUSTM_RAND_MAX_REQUEST 0x10000
+
+// TRNG context, EVP_RAND_CTX of OpenSSL
+typedef struct trustm_prov_rand_str
+{
+    trustm_prov_ctx_t   *provctx;
+    int                 state;
+    pthread_mutex_t     *lock;
+} trustm_prov_rand_t;
+
+static void *trustm_rand_newctx(void *provctx, void *parent, const OSSL_DISPATCH *parent_calls)
+{
+    trustm_prov_rand_t *ctx;
+
+    ctx = OPENSSL_zalloc(sizeof(trustm_prov_rand_t));
+    if (ctx == NULL)
+        return NULL;
+    ctx->provctx = (trustm_prov_ctx_t *)provctx;
+    ctx->state = EVP_RAND_STATE_UNINITIALISED;
+    return ctx;
+}
+
+static void trustm_rand_freectx(void *vctx)
+{
+    trustm_prov_rand_t *ctx = (trustm_prov_rand_t *)vctx;
+
+    if (ctx->lock != NULL)
+    {
+        pthread_mutex_destroy(ctx->lock);
+        OPENSSL_free(ctx->lock);
+    }
+    OPENSSL_free(ctx);
+}
+
+static int trustm_rand_instantiate(void *vctx, unsigned int strength, int prediction_resistance,
+                                   const unsigned char *pstr, size_t pstr_len,
+                                   const OSSL_PARAM params[])
+{
+    trustm_prov_rand_t *ctx = (trustm_prov_rand_t *)vctx;
+
+    if (strength > TRUSTM_RAND_STRENGTH)
+        return TRUSTM_PROVIDER_FAIL;
+    ctx->state = EVP_RAND_STATE_READY;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static int trustm_rand_uninstantiate(void *vctx)
+{
+    trustm_prov_rand_t *ctx = (trustm_prov_rand_t *)vctx;
+
+    ctx->state = EVP_RAND_STATE_UNINITIALISED;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+/**********************************************************************
+* trustm_rand_generate()
+* Random bytes from the chip TRNG, in requests of 8 to 256 bytes.
+**********************************************************************/
+static int trustm_rand_generate(void *vctx, unsigned char *out, size_t outlen,
+                                unsigned int strength, int prediction_resistance,
+                                const unsigned char *adin, size_t adin_len)
+{
+    trustm_prov_rand_t *ctx = (trustm_prov_rand_t *)vctx;
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    trustm_inst_t *inst;
+    uint8_t tempbuf[TRUSTM_PROVIDER_RAND_MAX];
+    size_t len;
+
+    TRUSTM_PROVIDER_DBGFN("> %d", (int)outlen);
+    if ((ctx->state != EVP_RAND_STATE_READY) || (strength > TRUSTM_RAND_STRENGTH))
+        return TRUSTM_PROVIDER_FAIL;
+
+    if (trustmProvBegin(ctx->provctx, &inst) != OPTIGA_LIB_SUCCESS)
+    {
+        ctx->state = EVP_RAND_STATE_ERROR;
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    while (outlen > 0)
+    {
+        len = (outlen > TRUSTM_PROVIDER_RAND_MAX) ? TRUSTM_PROVIDER_RAND_MAX : outlen;
+        TRUSTM_PROVIDER_REPLAY(return_status, ctx->provctx, inst, ,
+                               optiga_crypt_random(inst->crypt,
+                                                   OPTIGA_RNG_TYPE_TRNG,
+                                                   tempbuf,
+                                                   (len < TRUSTM_RAND_MIN) ? TRUSTM_RAND_MIN : (uint16_t)len));
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+        memcpy(out, tempbuf, len);
+        out += len;
+        outlen -= len;
+    }
+    trustmProvEnd(ctx->provctx, inst);
+    OPENSSL_cleanse(tempbuf, sizeof(tempbuf));
+
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        trustmPrintErrorCode(return_status);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    TRUSTM_PROVIDER_DBGFN("<");
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static int trustm_rand_reseed(void *vctx, int prediction_resistance,
+                              const unsigned char *ent, size_t ent_len,
+                              const unsigned char *adin, size_t adin_len)
+{
+    // Every request is served by the TRNG, nothing to reseed
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static int trustm_rand_enable_locking(void *vctx)
+{
+    trustm_prov_rand_t *ctx = (trustm_prov_rand_t *)vctx;
+
+    if (ctx->lock != NULL)
+        return TRUSTM_PROVIDER_SUCCESS;
+    ctx->lock = OPENSSL_malloc(sizeof(pthread_mutex_t));
+    if (ctx->lock == NULL)
+        return TRUSTM_PROVIDER_FAIL;
+    pthread_mutex_init(ctx->lock, NULL);
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static int trustm_rand_lock(void *vctx)
+{
+    trustm_prov_rand_t *ctx = (trustm_prov_rand_t *)vctx;
+
+    if (ctx->lock != NULL)
+        pthread_mutex_lock(ctx->lock);
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static void trustm_rand_unlock(void *vctx)
+{
+    trustm_prov_rand_t *ctx = (trustm_prov_rand_t *)vctx;
+
+    if (ctx->lock != NULL)
+        pthread_mutex_unlock(ctx->lock);
+}
+
+static int trustm_rand_get_ctx_params(void *vctx, OSSL_PARAM params[])
+{
+    trustm_prov_rand_t *ctx = (trustm_prov_rand_t *)vctx;
+    OSSL_PARAM *p;
+
+    p = OSSL_PARAM_locate(params, OSSL_RAND_PARAM_STATE);
+    if ((p != NULL) && !OSSL_PARAM_set_int(p, ctx->state))
+        return TRUSTM_PROVIDER_FAIL;
+    p = OSSL_PARAM_locate(params, OSSL_RAND_PARAM_STRENGTH);
+    if ((p != NULL) && !OSSL_PARAM_set_uint(p, TRUSTM_RAND_STRENGTH))
+        return TRUSTM_PROVIDER_FAIL;
+    p = OSSL_PARAM_locate(params, OSSL_RAND_PARAM_MAX_REQUEST);
+    if ((p != NULL) && !OSSL_PARAM_set_size_t(p, TRUSTM_RAND_MAX_REQUEST))
+        return TRUSTM_PROVIDER_FAIL;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static const OSSL_PARAM trustm_rand_gettable[] = {
+    OSSL_PARAM_int(OSSL_RAND_PARAM_STATE, NULL),
+    OSSL_PARAM_uint(OSSL_RAND_PARAM_STRENGTH, NULL),
+    OSSL_PARAM_size_t(OSSL_RAND_PARAM_MAX_REQUEST, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM *trustm_rand_gettable_ctx_params(void *vctx, void *provctx)
+{
+    return trustm_rand_gettable;
+}
+
+static int trustm_rand_verify_zeroization(void *vctx)
+{
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+const OSSL_DISPATCH trustm_rand_functions[] = {
+    { OSSL_FUNC_RAND_NEWCTX, (void (*)(void))trustm_rand_newctx },
+    { OSSL_FUNC_RAND_FREECTX, (void (*)(void))trustm_rand_freectx },
+    { OSSL_FUNC_RAND_INSTANTIATE, (void (*)(void))trustm_rand_instantiate },
+    { OSSL_FUNC_RAND_UNINSTANTIATE, (void (*)(void))trustm_rand_uninstantiate },
+    { OSSL_FUNC_RAND_GENERATE, (void (*)(void))trustm_rand_generate },
+    { OSSL_FUNC_RAND_RESEED, (void (*)(void))trustm_rand_reseed },
+    { OSSL_FUNC_RAND_ENABLE_LOCKING, (void (*)(void))trustm_rand_enable_locking },
+    { OSSL_FUNC_RAND_LOCK, (void (*)(void))trustm_rand_lock },
+    { OSSL_FUNC_RAND_UNLOCK, (void (*)(void))trustm_rand_unlock },
+    { OSSL_FUNC_RAND_GET_CTX_PARAMS, (void (*)(void))trustm_rand_get_ctx_params },
+    { OSSL_FUNC_RAND_GETTABLE_CTX_PARAMS, (void (*)(void))trustm_rand_gettable_ctx_params },
+    { OSSL_FUNC_RAND_VERIFY_ZEROIZATION, (void (*)(void))trustm_rand_verify_zeroization },
+    { 0, NULL }
+};
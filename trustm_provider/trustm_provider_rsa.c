@@ -0,0 +1,259 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <string.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+
+#include "trustm_provider_common.h"
+#include "trustm_helper.h"
+
+#define TRUSTM_TLS_PREMASTER_SIZE   48
+
+// RSA cipher context
+typedef struct trustm_prov_cipher_str
+{
+    trustm_prov_ctx_t   *provctx;
+    trustm_prov_key_t   *key;
+    int                 pad;
+    unsigned int        tlsClientVersion;
+} trustm_prov_cipher_t;
+
+static void *trustm_cipher_newctx(void *provctx)
+{
+    trustm_prov_cipher_t *ctx;
+
+    ctx = OPENSSL_zalloc(sizeof(trustm_prov_cipher_t));
+    if (ctx == NULL)
+        return NULL;
+    ctx->provctx = (trustm_prov_ctx_t *)provctx;
+    ctx->pad = RSA_PKCS1_PADDING;
+    return ctx;
+}
+
+static void trustm_cipher_freectx(void *vctx)
+{
+    OPENSSL_free(vctx);
+}
+
+static void *trustm_cipher_dupctx(void *vctx)
+{
+    return OPENSSL_memdup(vctx, sizeof(trustm_prov_cipher_t));
+}
+
+static int trustm_cipher_set_ctx_params(void *vctx, const OSSL_PARAM params[])
+{
+    trustm_prov_cipher_t *ctx = (trustm_prov_cipher_t *)vctx;
+    const OSSL_PARAM *p;
+    const char *mode;
+
+    p = OSSL_PARAM_locate_const(params, OSSL_ASYM_CIPHER_PARAM_PAD_MODE);
+    if (p != NULL)
+    {
+        if (p->data_type == OSSL_PARAM_UTF8_STRING)
+        {
+            if (!OSSL_PARAM_get_utf8_string_ptr(p, &mode))
+                return TRUSTM_PROVIDER_FAIL;
+            ctx->pad = (strcmp(mode, OSSL_PKEY_RSA_PAD_MODE_PKCSV15) == 0) ? RSA_PKCS1_PADDING : RSA_NO_PADDING;
+        }
+        else if (!OSSL_PARAM_get_int(p, &ctx->pad))
+            return TRUSTM_PROVIDER_FAIL;
+
+        // The chip decrypts PKCS#1 v1.5 only
+        if ((ctx->pad != RSA_PKCS1_PADDING) && (ctx->pad != RSA_PKCS1_WITH_TLS_PADDING))
+        {
+            TRUSTM_PROVIDER_ERRFN("Only PKCS#1 v1.5 padding");
+            return TRUSTM_PROVIDER_FAIL;
+        }
+    }
+
+    p = OSSL_PARAM_locate_const(params, OSSL_ASYM_CIPHER_PARAM_TLS_CLIENT_VERSION);
+    if ((p != NULL) && !OSSL_PARAM_get_uint(p, &ctx->tlsClientVersion))
+        return TRUSTM_PROVIDER_FAIL;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static int trustm_cipher_get_ctx_params(void *vctx, OSSL_PARAM params[])
+{
+    trustm_prov_cipher_t *ctx = (trustm_prov_cipher_t *)vctx;
+    OSSL_PARAM *p;
+
+    p = OSSL_PARAM_locate(params, OSSL_ASYM_CIPHER_PARAM_PAD_MODE);
+    if ((p != NULL) && !OSSL_PARAM_set_int(p, ctx->pad))
+        return TRUSTM_PROVIDER_FAIL;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static const OSSL_PARAM trustm_cipher_settable[] = {
+    OSSL_PARAM_utf8_string(OSSL_ASYM_CIPHER_PARAM_PAD_MODE, NULL, 0),
+    OSSL_PARAM_uint(OSSL_ASYM_CIPHER_PARAM_TLS_CLIENT_VERSION, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM trustm_cipher_gettable[] = {
+    OSSL_PARAM_int(OSSL_ASYM_CIPHER_PARAM_PAD_MODE, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM *trustm_cipher_settable_ctx_params(void *vctx, void *provctx)
+{
+    return trustm_cipher_settable;
+}
+
+static const OSSL_PARAM *trustm_cipher_gettable_ctx_params(void *vctx, void *provctx)
+{
+    return trustm_cipher_gettable;
+}
+
+static int trustm_cipher_init(void *vctx, void *vkey, const OSSL_PARAM params[])
+{
+    trustm_prov_cipher_t *ctx = (trustm_prov_cipher_t *)vctx;
+
+    ctx->key = (trustm_prov_key_t *)vkey;
+    if ((ctx->key == NULL) || (ctx->key->pub == NULL))
+        return TRUSTM_PROVIDER_FAIL;
+    return trustm_cipher_set_ctx_params(ctx, params);
+}
+
+/**********************************************************************
+* trustm_cipher_encrypt()
+* Public key operation, done in software.
+**********************************************************************/
+static int trustm_cipher_encrypt(void *vctx, unsigned char *out, size_t *outlen, size_t outsize,
+                                 const unsigned char *in, size_t inlen)
+{
+    trustm_prov_cipher_t *ctx = (trustm_prov_cipher_t *)vctx;
+    EVP_PKEY_CTX *pctx;
+    int ret = TRUSTM_PROVIDER_FAIL;
+
+    pctx = EVP_PKEY_CTX_new_from_pkey(ctx->provctx->libctx, ctx->key->pub, NULL);
+    if (pctx == NULL)
+        return TRUSTM_PROVIDER_FAIL;
+    *outlen = outsize;
+    if ((EVP_PKEY_encrypt_init(pctx) > 0) &&
+        (EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PADDING) > 0))
+        ret = (EVP_PKEY_encrypt(pctx, out, outlen, in, inlen) == 1);
+    EVP_PKEY_CTX_free(pctx);
+    return ret;
+}
+
+/**********************************************************************
+* trustm_cipher_decrypt()
+* Decrypt with the chip key. For the TLS 1.2 RSA key exchange
+* (RSA_PKCS1_WITH_TLS_PADDING) a bad padding or version is answered
+* with a random premaster secret and the handshake fails later, like
+* the OpenSSL implicit rejection. The chip itself reports a bad padding
+* as an error, which is slower than a success.
+**********************************************************************/
+static int trustm_cipher_decrypt(void *vctx, unsigned char *out, size_t *outlen, size_t outsize,
+                                 const unsigned char *in, size_t inlen)
+{
+    trustm_prov_cipher_t *ctx = (trustm_prov_cipher_t *)vctx;
+    optiga_lib_status_t return_status;
+    trustm_inst_t *inst;
+    uint8_t buf[TRUSTM_PROVIDER_RSA_SIZE];
+    uint16_t len = sizeof(buf);
+    uint8_t rnd[TRUSTM_TLS_PREMASTER_SIZE];
+    int good;
+
+    TRUSTM_PROVIDER_DBGFN("> 0x%.4X inlen %d", ctx->key->oid, (int)inlen);
+    if (out == NULL)
+    {
+        *outlen = trustmProvKeySize(ctx->key);
+        return TRUSTM_PROVIDER_SUCCESS;
+    }
+    if (ctx->key->oid == 0)
+    {
+        TRUSTM_PROVIDER_ERRFN("Public key only");
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    if ((ctx->pad == RSA_PKCS1_WITH_TLS_PADDING) &&
+        ((outsize < TRUSTM_TLS_PREMASTER_SIZE) || (RAND_bytes_ex(ctx->provctx->libctx, rnd, sizeof(rnd), 0) != 1)))
+        return TRUSTM_PROVIDER_FAIL;
+
+    return_status = trustmProvBegin(ctx->provctx, &inst);
+    if (return_status == OPTIGA_LIB_SUCCESS)
+    {
+        // Not replayed, a failed decryption raises the Security Event
+        // Counter
+        inst->status = OPTIGA_LIB_BUSY;
+        pthread_mutex_lock(&ctx->provctx->lock);
+        return_status = optiga_crypt_rsa_decrypt_and_export(inst->crypt,
+                                                            OPTIGA_RSAES_PKCS1_V15,
+                                                            in,
+                                                            (uint16_t)inlen,
+                                                            NULL,
+                                                            0,
+                                                            ctx->key->oid,
+                                                            buf,
+                                                            &len);
+        pthread_mutex_unlock(&ctx->provctx->lock);
+        if (return_status == OPTIGA_LIB_SUCCESS)
+            return_status = trustmPoolWait(inst);
+        trustmProvEnd(ctx->provctx, inst);
+    }
+
+    if (ctx->pad == RSA_PKCS1_WITH_TLS_PADDING)
+    {
+        good = (return_status == OPTIGA_LIB_SUCCESS) && (len == TRUSTM_TLS_PREMASTER_SIZE) &&
+               (buf[0] == ((ctx->tlsClientVersion >> 8) & 0xFF)) &&
+               (buf[1] == (ctx->tlsClientVersion & 0xFF));
+        memcpy(out, good ? buf : rnd, TRUSTM_TLS_PREMASTER_SIZE);
+        *outlen = TRUSTM_TLS_PREMASTER_SIZE;
+        OPENSSL_cleanse(buf, sizeof(buf));
+        return TRUSTM_PROVIDER_SUCCESS;
+    }
+
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        trustmPrintErrorCode(return_status);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    if (len > outsize)
+        return TRUSTM_PROVIDER_FAIL;
+    memcpy(out, buf, len);
+    *outlen = len;
+    OPENSSL_cleanse(buf, sizeof(buf));
+
+    TRUSTM_PROVIDER_DBGFN("< outlen %d", len);
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+const OSSL_DISPATCH trustm_rsa_asym_cipher_functions[] = {
+    { OSSL_FUNC_ASYM_CIPHER_NEWCTX, (void (*)(void))trustm_cipher_newctx },
+    { OSSL_FUNC_ASYM_CIPHER_FREECTX, (void (*)(void))trustm_cipher_freectx },
+    { OSSL_FUNC_ASYM_CIPHER_DUPCTX, (void (*)(void))trustm_cipher_dupctx },
+    { OSSL_FUNC_ASYM_CIPHER_ENCRYPT_INIT, (void (*)(void))trustm_cipher_init },
+    { OSSL_FUNC_ASYM_CIPHER_ENCRYPT, (void (*)(void))trustm_cipher_encrypt },
+    { OSSL_FUNC_ASYM_CIPHER_DECRYPT_INIT, (void (*)(void))trustm_cipher_init },
+    { OSSL_FUNC_ASYM_CIPHER_DECRYPT, (void (*)(void))trustm_cipher_decrypt },
+    { OSSL_FUNC_ASYM_CIPHER_GET_CTX_PARAMS, (void (*)(void))trustm_cipher_get_ctx_params },
+    { OSSL_FUNC_ASYM_CIPHER_GETTABLE_CTX_PARAMS, (void (*)(void))trustm_cipher_gettable_ctx_params },
+    { OSSL_FUNC_ASYM_CIPHER_SET_CTX_PARAMS, (void (*)(void))trustm_cipher_set_ctx_params },
+    { OSSL_FUNC_ASYM_CIPHER_SETTABLE_CTX_PARAMS, (void (*)(void))trustm_cipher_settable_ctx_params },
+    { 0, NULL }
+};
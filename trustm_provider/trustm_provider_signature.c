@@ -0,0 +1,385 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <string.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/rsa.h>
+
+#include "trustm_provider_common.h"
+#include "trustm_helper.h"
+
+// Signature context, for ECDSA and RSA PKCS#1 v1.5
+typedef struct trustm_prov_sig_str
+{
+    trustm_prov_ctx_t   *provctx;
+    trustm_prov_key_t   *key;
+    EVP_MD              *md;
+    EVP_MD_CTX          *mdctx;
+} trustm_prov_sig_t;
+
+static void *trustm_sig_newctx(void *provctx, const char *propq)
+{
+    trustm_prov_sig_t *ctx;
+
+    ctx = OPENSSL_zalloc(sizeof(trustm_prov_sig_t));
+    if (ctx != NULL)
+        ctx->provctx = (trustm_prov_ctx_t *)provctx;
+    return ctx;
+}
+
+static void trustm_sig_freectx(void *vctx)
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+
+    EVP_MD_CTX_free(ctx->mdctx);
+    EVP_MD_free(ctx->md);
+    OPENSSL_free(ctx);
+}
+
+static void *trustm_sig_dupctx(void *vctx)
+{
+    trustm_prov_sig_t *src = (trustm_prov_sig_t *)vctx;
+    trustm_prov_sig_t *ctx;
+
+    ctx = OPENSSL_memdup(src, sizeof(trustm_prov_sig_t));
+    if (ctx == NULL)
+        return NULL;
+    ctx->mdctx = NULL;
+    if ((ctx->md != NULL) && !EVP_MD_up_ref(ctx->md))
+        ctx->md = NULL;
+    if (src->mdctx != NULL)
+    {
+        ctx->mdctx = EVP_MD_CTX_new();
+        if ((ctx->mdctx == NULL) || !EVP_MD_CTX_copy_ex(ctx->mdctx, src->mdctx))
+        {
+            trustm_sig_freectx(ctx);
+            return NULL;
+        }
+    }
+    return ctx;
+}
+
+/**********************************************************************
+* __trustm_setDigest()
+* No digest name: SHA-384 for P-384, SHA-256 otherwise.
+**********************************************************************/
+static int __trustm_setDigest(trustm_prov_sig_t *ctx, const char *mdname)
+{
+    EVP_MD *md;
+
+    if (mdname == NULL)
+    {
+        if (ctx->md != NULL)
+            return TRUSTM_PROVIDER_SUCCESS;
+        mdname = ((ctx->key->type == TRUSTM_PROVIDER_KEY_EC) && (ctx->key->bits > 256)) ? "SHA384" : "SHA256";
+    }
+
+    md = EVP_MD_fetch(ctx->provctx->libctx, mdname, NULL);
+    if (md == NULL)
+    {
+        TRUSTM_PROVIDER_ERRFN("Digest %s not available", mdname);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    if ((ctx->key->type == TRUSTM_PROVIDER_KEY_RSA) &&
+        !EVP_MD_is_a(md, "SHA256") && !EVP_MD_is_a(md, "SHA384"))
+    {
+        TRUSTM_PROVIDER_ERRFN("RSA signature with %s not supported by the chip", mdname);
+        EVP_MD_free(md);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    EVP_MD_free(ctx->md);
+    ctx->md = md;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static int trustm_sig_set_ctx_params(void *vctx, const OSSL_PARAM params[])
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+    const OSSL_PARAM *p;
+    const char *mdname;
+    int pad;
+
+    p = OSSL_PARAM_locate_const(params, OSSL_SIGNATURE_PARAM_DIGEST);
+    if (p != NULL)
+    {
+        if (!OSSL_PARAM_get_utf8_string_ptr(p, &mdname) || !__trustm_setDigest(ctx, mdname))
+            return TRUSTM_PROVIDER_FAIL;
+    }
+
+    // The chip signs PKCS#1 v1.5 only
+    p = OSSL_PARAM_locate_const(params, OSSL_SIGNATURE_PARAM_PAD_MODE);
+    if (p != NULL)
+    {
+        if (p->data_type == OSSL_PARAM_UTF8_STRING)
+        {
+            if (!OSSL_PARAM_get_utf8_string_ptr(p, &mdname))
+                return TRUSTM_PROVIDER_FAIL;
+            pad = (strcmp(mdname, OSSL_PKEY_RSA_PAD_MODE_PKCSV15) == 0) ? RSA_PKCS1_PADDING : RSA_NO_PADDING;
+        }
+        else if (!OSSL_PARAM_get_int(p, &pad))
+            return TRUSTM_PROVIDER_FAIL;
+        if (pad != RSA_PKCS1_PADDING)
+        {
+            TRUSTM_PROVIDER_ERRFN("Only PKCS#1 v1.5 padding");
+            return TRUSTM_PROVIDER_FAIL;
+        }
+    }
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static int trustm_sig_get_ctx_params(void *vctx, OSSL_PARAM params[])
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+    OSSL_PARAM *p;
+
+    p = OSSL_PARAM_locate(params, OSSL_SIGNATURE_PARAM_DIGEST);
+    if ((p != NULL) && (ctx->md != NULL) && !OSSL_PARAM_set_utf8_string(p, EVP_MD_get0_name(ctx->md)))
+        return TRUSTM_PROVIDER_FAIL;
+    p = OSSL_PARAM_locate(params, OSSL_SIGNATURE_PARAM_PAD_MODE);
+    if ((p != NULL) && !OSSL_PARAM_set_int(p, RSA_PKCS1_PADDING))
+        return TRUSTM_PROVIDER_FAIL;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static const OSSL_PARAM trustm_sig_settable[] = {
+    OSSL_PARAM_utf8_string(OSSL_SIGNATURE_PARAM_DIGEST, NULL, 0),
+    OSSL_PARAM_utf8_string(OSSL_SIGNATURE_PARAM_PAD_MODE, NULL, 0),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM trustm_sig_gettable[] = {
+    OSSL_PARAM_utf8_string(OSSL_SIGNATURE_PARAM_DIGEST, NULL, 0),
+    OSSL_PARAM_int(OSSL_SIGNATURE_PARAM_PAD_MODE, NULL),
+    OSSL_PARAM_END
+};
+
+static const OSSL_PARAM *trustm_sig_settable_ctx_params(void *vctx, void *provctx)
+{
+    return trustm_sig_settable;
+}
+
+static const OSSL_PARAM *trustm_sig_gettable_ctx_params(void *vctx, void *provctx)
+{
+    return trustm_sig_gettable;
+}
+
+static int trustm_sig_init(void *vctx, void *vkey, const OSSL_PARAM params[])
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+    trustm_prov_key_t *key = (trustm_prov_key_t *)vkey;
+
+    if (key != NULL)
+        ctx->key = key;
+    if ((ctx->key == NULL) || (ctx->key->pub == NULL))
+        return TRUSTM_PROVIDER_FAIL;
+    return trustm_sig_set_ctx_params(ctx, params);
+}
+
+/**********************************************************************
+* trustm_sig_sign()
+* Sign a digest with the chip key. ECDSA signs the leftmost bytes of
+* the digest up to the key size, so SHA-384 works with P-256 and
+* SHA-256/SHA-384 with P-384. The chip returns R and S as DER INTEGERs,
+* the SEQUENCE is added here.
+**********************************************************************/
+static int trustm_sig_sign(void *vctx, unsigned char *sig, size_t *siglen, size_t sigsize,
+                           const unsigned char *tbs, size_t tbslen)
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+    trustm_prov_key_t *key = ctx->key;
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    optiga_rsa_signature_scheme_t scheme;
+    trustm_inst_t *inst;
+    uint8_t buf[TRUSTM_PROVIDER_RSA_SIZE];
+    uint16_t len;
+    size_t dgstlen;
+
+    TRUSTM_PROVIDER_DBGFN("> 0x%.4X tbslen %d", key->oid, (int)tbslen);
+    if (sig == NULL)
+    {
+        *siglen = EVP_PKEY_get_size(key->pub);
+        return TRUSTM_PROVIDER_SUCCESS;
+    }
+    if (key->oid == 0)
+    {
+        TRUSTM_PROVIDER_ERRFN("Public key only");
+        return TRUSTM_PROVIDER_FAIL;
+    }
+
+    if (key->type == TRUSTM_PROVIDER_KEY_EC)
+    {
+        dgstlen = trustmProvKeySize(key);
+        if (tbslen < dgstlen)
+            dgstlen = tbslen;
+    }
+    else
+    {
+        dgstlen = tbslen;
+        if (tbslen == 32)
+            scheme = OPTIGA_RSASSA_PKCS1_V15_SHA256;
+        else if (tbslen == 48)
+            scheme = OPTIGA_RSASSA_PKCS1_V15_SHA384;
+        else
+        {
+            TRUSTM_PROVIDER_ERRFN("RSA signs SHA-256/SHA-384 digests only");
+            return TRUSTM_PROVIDER_FAIL;
+        }
+    }
+
+    if (trustmProvBegin(ctx->provctx, &inst) != OPTIGA_LIB_SUCCESS)
+        return TRUSTM_PROVIDER_FAIL;
+    if (key->type == TRUSTM_PROVIDER_KEY_EC)
+    {
+        TRUSTM_PROVIDER_REPLAY(return_status, ctx->provctx, inst,
+                               len = sizeof(buf) - 2,
+                               optiga_crypt_ecdsa_sign(inst->crypt,
+                                                       tbs,
+                                                       (uint8_t)dgstlen,
+                                                       key->oid,
+                                                       buf + 2,
+                                                       &len));
+        buf[0] = 0x30;
+        buf[1] = (uint8_t)len;
+        len += 2;
+    }
+    else
+    {
+        TRUSTM_PROVIDER_REPLAY(return_status, ctx->provctx, inst,
+                               len = sizeof(buf),
+                               optiga_crypt_rsa_sign(inst->crypt,
+                                                     scheme,
+                                                     tbs,
+                                                     (uint8_t)dgstlen,
+                                                     key->oid,
+                                                     buf,
+                                                     &len,
+                                                     0x0000));
+    }
+    trustmProvEnd(ctx->provctx, inst);
+
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        trustmPrintErrorCode(return_status);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    if (len > sigsize)
+        return TRUSTM_PROVIDER_FAIL;
+    memcpy(sig, buf, len);
+    *siglen = len;
+
+    TRUSTM_PROVIDER_DBGFN("< siglen %d", len);
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+/**********************************************************************
+* trustm_sig_verify()
+* Verification needs no chip, done in software with the public key.
+**********************************************************************/
+static int trustm_sig_verify(void *vctx, const unsigned char *sig, size_t siglen,
+                             const unsigned char *tbs, size_t tbslen)
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+    EVP_PKEY_CTX *pctx;
+    int ret = TRUSTM_PROVIDER_FAIL;
+
+    pctx = EVP_PKEY_CTX_new_from_pkey(ctx->provctx->libctx, ctx->key->pub, NULL);
+    if (pctx == NULL)
+        return TRUSTM_PROVIDER_FAIL;
+    if ((EVP_PKEY_verify_init(pctx) > 0) &&
+        ((ctx->key->type == TRUSTM_PROVIDER_KEY_EC) ||
+         ((EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PADDING) > 0) &&
+          ((ctx->md == NULL) || (EVP_PKEY_CTX_set_signature_md(pctx, ctx->md) > 0)))))
+        ret = (EVP_PKEY_verify(pctx, sig, siglen, tbs, tbslen) == 1);
+    EVP_PKEY_CTX_free(pctx);
+    return ret;
+}
+
+static int trustm_sig_digest_init(void *vctx, const char *mdname, void *vkey, const OSSL_PARAM params[])
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+
+    if (!trustm_sig_init(ctx, vkey, params) || !__trustm_setDigest(ctx, mdname))
+        return TRUSTM_PROVIDER_FAIL;
+
+    if (ctx->mdctx == NULL)
+        ctx->mdctx = EVP_MD_CTX_new();
+    if ((ctx->mdctx == NULL) || !EVP_DigestInit_ex2(ctx->mdctx, ctx->md, NULL))
+        return TRUSTM_PROVIDER_FAIL;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static int trustm_sig_digest_update(void *vctx, const unsigned char *data, size_t datalen)
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+
+    return EVP_DigestUpdate(ctx->mdctx, data, datalen);
+}
+
+static int trustm_sig_digest_sign_final(void *vctx, unsigned char *sig, size_t *siglen, size_t sigsize)
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+    unsigned char dgst[EVP_MAX_MD_SIZE];
+    unsigned int dgstlen;
+
+    if (sig == NULL)
+        return trustm_sig_sign(ctx, NULL, siglen, sigsize, NULL, 0);
+    if (!EVP_DigestFinal_ex(ctx->mdctx, dgst, &dgstlen))
+        return TRUSTM_PROVIDER_FAIL;
+    return trustm_sig_sign(ctx, sig, siglen, sigsize, dgst, dgstlen);
+}
+
+static int trustm_sig_digest_verify_final(void *vctx, const unsigned char *sig, size_t siglen)
+{
+    trustm_prov_sig_t *ctx = (trustm_prov_sig_t *)vctx;
+    unsigned char dgst[EVP_MAX_MD_SIZE];
+    unsigned int dgstlen;
+
+    if (!EVP_DigestFinal_ex(ctx->mdctx, dgst, &dgstlen))
+        return TRUSTM_PROVIDER_FAIL;
+    return trustm_sig_verify(ctx, sig, siglen, dgst, dgstlen);
+}
+
+// ECDSA and RSA, the key type selects the chip command
+const OSSL_DISPATCH trustm_signature_functions[] = {
+    { OSSL_FUNC_SIGNATURE_NEWCTX, (void (*)(void))trustm_sig_newctx },
+    { OSSL_FUNC_SIGNATURE_FREECTX, (void (*)(void))trustm_sig_freectx },
+    { OSSL_FUNC_SIGNATURE_DUPCTX, (void (*)(void))trustm_sig_dupctx },
+    { OSSL_FUNC_SIGNATURE_SIGN_INIT, (void (*)(void))trustm_sig_init },
+    { OSSL_FUNC_SIGNATURE_SIGN, (void (*)(void))trustm_sig_sign },
+    { OSSL_FUNC_SIGNATURE_VERIFY_INIT, (void (*)(void))trustm_sig_init },
+    { OSSL_FUNC_SIGNATURE_VERIFY, (void (*)(void))trustm_sig_verify },
+    { OSSL_FUNC_SIGNATURE_DIGEST_SIGN_INIT, (void (*)(void))trustm_sig_digest_init },
+    { OSSL_FUNC_SIGNATURE_DIGEST_SIGN_UPDATE, (void (*)(void))trustm_sig_digest_update },
+    { OSSL_FUNC_SIGNATURE_DIGEST_SIGN_FINAL, (void (*)(void))trustm_sig_digest_sign_final },
+    { OSSL_FUNC_SIGNATURE_DIGEST_VERIFY_INIT, (void (*)(void))trustm_sig_digest_init },
+    { OSSL_FUNC_SIGNATURE_DIGEST_VERIFY_UPDATE, (void (*)(void))trustm_sig_digest_update },
+    { OSSL_FUNC_SIGNATURE_DIGEST_VERIFY_FINAL, (void (*)(void))trustm_sig_digest_verify_final },
+    { OSSL_FUNC_SIGNATURE_GET_CTX_PARAMS, (void (*)(void))trustm_sig_get_ctx_params },
+    { OSSL_FUNC_SIGNATURE_GETTABLE_CTX_PARAMS, (void (*)(void))trustm_sig_gettable_ctx_params },
+    { OSSL_FUNC_SIGNATURE_SET_CTX_PARAMS, (void (*)(void))trustm_sig_set_ctx_params },
+    { OSSL_FUNC_SIGNATURE_SETTABLE_CTX_PARAMS, (void (*)(void))trustm_sig_settable_ctx_params },
+    { 0, NULL }
+};
@@ -0,0 +1,430 @@
+/**
+* MIT License
+*
+* Copyright (c) 2020 Infineon Technologies AG
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE
+
+*/
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/core_object.h>
+#include <openssl/params.h>
+#include <openssl/store.h>
+#include <openssl/x509.h>
+
+#include "trustm_provider_common.h"
+#include "trustm_helper.h"
+#include "trustm_certcomp.h"
+
+#define TRUSTM_STORE_SCHEME     "trustm:"
+
+// Key and certificate OIDs the store knows
+static const uint16_t trustm_store_oid[TRUSTM_PROVIDER_STORE_MAX] = {
+    0xE0F0, 0xE0F1, 0xE0F2, 0xE0F3, 0xE0FC, 0xE0FD,
+    0xE0E0, 0xE0E1, 0xE0E2, 0xE0E3, 0xE0E8, 0xE0E9
+};
+
+// Store context, OSSL_STORE_CTX of OpenSSL
+typedef struct trustm_prov_store_str
+{
+    trustm_prov_ctx_t   *provctx;
+    uint8_t             list[TRUSTM_PROVIDER_STORE_MAX];    // index to provctx->store
+    uint8_t             count;
+    uint8_t             next;
+    uint8_t             enumerate;      // whole store, skip what does not load
+    int                 expect;         // OSSL_STORE_INFO_* wanted, 0 : all
+} trustm_prov_store_t;
+
+static int __trustm_isKey(uint16_t oid)
+{
+    return ((oid & 0xFFF0) == 0xE0F0);
+}
+
+/**********************************************************************
+* trustmProvStoreInit()
+**********************************************************************/
+void trustmProvStoreInit(trustm_prov_ctx_t *provctx)
+{
+    uint16_t i;
+
+    pthread_mutex_init(&provctx->storeLock, NULL);
+    for (i = 0; i < TRUSTM_PROVIDER_STORE_MAX; i++)
+        provctx->store[i].oid = trustm_store_oid[i];
+}
+
+/**********************************************************************
+* trustmProvStoreFlush()
+* Drop the cached objects and the metadata sweep, e.g. after a key
+* generation.
+**********************************************************************/
+void trustmProvStoreFlush(trustm_prov_ctx_t *provctx)
+{
+    trustm_prov_obj_t *obj;
+    uint16_t i;
+
+    pthread_mutex_lock(&provctx->storeLock);
+    for (i = 0; i < TRUSTM_PROVIDER_STORE_MAX; i++)
+    {
+        obj = &provctx->store[i];
+        trustmProvKeyFree(obj->key);
+        OPENSSL_free(obj->der);
+        obj->key = NULL;
+        obj->der = NULL;
+        obj->derLen = 0;
+        obj->algo = 0;
+        obj->used = 0;
+    }
+    provctx->storeSwept = 0;
+    pthread_mutex_unlock(&provctx->storeLock);
+}
+
+/**********************************************************************
+* __trustm_storeSweep()
+* Read the metadata of all store OIDs in one chip session: the key
+* algorithm (tag 0xE0) tells which keys exist, the used size (tag 0xC5)
+* which certificates. Done once, the result stays in the cache.
+* Called with storeLock held.
+**********************************************************************/
+static int __trustm_storeSweep(trustm_prov_ctx_t *provctx)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    trustm_inst_t *inst;
+    trustm_prov_obj_t *obj;
+    uint8_t buf[64];
+    uint16_t len;
+    uint16_t i, j;
+
+    if (provctx->storeSwept)
+        return TRUSTM_PROVIDER_SUCCESS;
+
+    TRUSTM_PROVIDER_DBGFN(">");
+    if (trustmProvBegin(provctx, &inst) != OPTIGA_LIB_SUCCESS)
+        return TRUSTM_PROVIDER_FAIL;
+    for (i = 0; i < TRUSTM_PROVIDER_STORE_MAX; i++)
+    {
+        obj = &provctx->store[i];
+        TRUSTM_PROVIDER_REPLAY(return_status, provctx, inst,
+                               len = sizeof(buf),
+                               optiga_util_read_metadata(inst->util, obj->oid, buf, &len));
+        if (return_status != OPTIGA_LIB_SUCCESS)
+            break;
+
+        obj->algo = 0;
+        obj->used = 0;
+        // Stop at a TLV whose value runs past the metadata
+        for (j = 2; (buf[0] == 0x20) && (j + 2 < len) && (j + 2 + buf[j+1] <= len); j += buf[j+1] + 2)
+        {
+            if ((buf[j] == 0xE0) && __trustm_isKey(obj->oid))
+                obj->algo = buf[j+2];
+            else if (buf[j] == 0xC5)
+                obj->used = (buf[j+1] == 2) ? (uint16_t)((buf[j+2] << 8) + buf[j+3]) : buf[j+2];
+        }
+        TRUSTM_PROVIDER_DBGFN("0x%.4X algo 0x%.2X used %d", obj->oid, obj->algo, obj->used);
+    }
+    trustmProvEnd(provctx, inst);
+
+    if (return_status != OPTIGA_LIB_SUCCESS)
+    {
+        trustmPrintErrorCode(return_status);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    provctx->storeSwept = 1;
+    TRUSTM_PROVIDER_DBGFN("<");
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+/**********************************************************************
+* __trustm_storeKey()
+* Key object of the cache entry, loaded from the chip the first time.
+* Called with storeLock held.
+**********************************************************************/
+static trustm_prov_key_t *__trustm_storeKey(trustm_prov_ctx_t *provctx, trustm_prov_obj_t *obj)
+{
+    trustm_prov_key_t *key;
+
+    if (obj->key != NULL)
+        return obj->key;
+
+    key = trustmProvKeyNew(provctx, (obj->oid >= 0xE0FC) ? TRUSTM_PROVIDER_KEY_RSA : TRUSTM_PROVIDER_KEY_EC);
+    if (key == NULL)
+        return NULL;
+    key->algo = obj->algo;
+    if (!trustmProvKeyLoad(key, obj->oid))
+    {
+        trustmProvKeyFree(key);
+        return NULL;
+    }
+    obj->key = key;
+    return key;
+}
+
+/**********************************************************************
+* __trustm_storeCert()
+* DER certificate of the cache entry, read from the chip the first
+* time. Called with storeLock held.
+**********************************************************************/
+static int __trustm_storeCert(trustm_prov_ctx_t *provctx, trustm_prov_obj_t *obj)
+{
+    optiga_lib_status_t return_status = OPTIGA_LIB_SUCCESS;
+    trustm_inst_t *inst;
+    uint8_t buf[TRUSTM_PROVIDER_CERT_SIZE];
+    uint16_t len = 0;
+    unsigned char *der = NULL;
+    int derLen;
+    X509 *x509 = NULL;
+
+    if (obj->der != NULL)
+        return TRUSTM_PROVIDER_SUCCESS;
+
+    if (trustmProvBegin(provctx, &inst) != OPTIGA_LIB_SUCCESS)
+        return TRUSTM_PROVIDER_FAIL;
+    TRUSTM_PROVIDER_REPLAY(return_status, provctx, inst,
+                           len = sizeof(buf),
+                           optiga_util_read_data(inst->util, obj->oid, 0, buf, &len));
+    trustmProvEnd(provctx, inst);
+    if ((return_status != OPTIGA_LIB_SUCCESS) || (len < 10))
+    {
+        TRUSTM_PROVIDER_ERRFN("No certificate in 0x%.4X", obj->oid);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+
+    // DER, TLS identity or compressed certificate
+    x509 = trustmCertParse(buf, len);
+    if (x509 == NULL)
+    {
+        TRUSTM_PROVIDER_ERRFN("No certificate in 0x%.4X", obj->oid);
+        return TRUSTM_PROVIDER_FAIL;
+    }
+    derLen = i2d_X509(x509, &der);
+    X509_free(x509);
+    if (derLen <= 0)
+        return TRUSTM_PROVIDER_FAIL;
+
+    obj->der = der;
+    obj->derLen = (uint16_t)derLen;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+/**********************************************************************
+* __trustm_storeParse()
+* URI : trustm:oid=<key OID>&cert=<certificate OID>... in hex, e.g.
+* trustm:oid=E0F1&cert=E0E0 for a key and its certificate, or trustm:
+* alone for every key and certificate present.
+**********************************************************************/
+static int __trustm_storeParse(trustm_prov_store_t *ctx, const char *uri)
+{
+    char item[32];
+    const char *p;
+    size_t n;
+    unsigned int oid;
+    uint16_t i;
+
+    p = uri + strlen(TRUSTM_STORE_SCHEME);
+    if (strncmp(p, "//", 2) == 0)
+        p += 2;
+    if (*p == '\0')
+    {
+        ctx->enumerate = 1;
+        return TRUSTM_PROVIDER_SUCCESS;
+    }
+
+    while (*p != '\0')
+    {
+        n = strcspn(p, "&;");
+        if (n >= sizeof(item))
+            return TRUSTM_PROVIDER_FAIL;
+        memcpy(item, p, n);
+        item[n] = '\0';
+        p += n;
+        if (*p != '\0')
+            p++;
+
+        if (strncasecmp(item, "oid=", 4) == 0)
+            oid = (unsigned int)strtoul(item + 4, NULL, 16);
+        else if (strncasecmp(item, "cert=", 5) == 0)
+            oid = (unsigned int)strtoul(item + 5, NULL, 16);
+        else
+        {
+            TRUSTM_PROVIDER_ERRFN("Unknown URI item : %s", item);
+            return TRUSTM_PROVIDER_FAIL;
+        }
+
+        for (i = 0; i < TRUSTM_PROVIDER_STORE_MAX; i++)
+        {
+            if (trustm_store_oid[i] == oid)
+                break;
+        }
+        if ((i == TRUSTM_PROVIDER_STORE_MAX) ||
+            (__trustm_isKey(oid) != (strncasecmp(item, "oid=", 4) == 0)) ||
+            (ctx->count == TRUSTM_PROVIDER_STORE_MAX))
+        {
+            TRUSTM_PROVIDER_ERRFN("Invalid OID : %s", item);
+            return TRUSTM_PROVIDER_FAIL;
+        }
+        ctx->list[ctx->count++] = (uint8_t)i;
+    }
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+static void *trustm_store_open(void *provctx, const char *uri)
+{
+    trustm_prov_store_t *ctx;
+    uint16_t i;
+
+    TRUSTM_PROVIDER_DBGFN("> %s", uri);
+    if (strncasecmp(uri, TRUSTM_STORE_SCHEME, strlen(TRUSTM_STORE_SCHEME)) != 0)
+        return NULL;
+
+    ctx = OPENSSL_zalloc(sizeof(trustm_prov_store_t));
+    if (ctx == NULL)
+        return NULL;
+    ctx->provctx = (trustm_prov_ctx_t *)provctx;
+    if (!__trustm_storeParse(ctx, uri))
+    {
+        OPENSSL_free(ctx);
+        return NULL;
+    }
+
+    if (ctx->enumerate)
+    {
+        pthread_mutex_lock(&ctx->provctx->storeLock);
+        if (__trustm_storeSweep(ctx->provctx))
+        {
+            for (i = 0; i < TRUSTM_PROVIDER_STORE_MAX; i++)
+            {
+                if ((ctx->provctx->store[i].algo != 0) || (ctx->provctx->store[i].used != 0))
+                    ctx->list[ctx->count++] = (uint8_t)i;
+            }
+        }
+        pthread_mutex_unlock(&ctx->provctx->storeLock);
+    }
+    TRUSTM_PROVIDER_DBGFN("< %d objects", ctx->count);
+    return ctx;
+}
+
+static const OSSL_PARAM *trustm_store_settable_ctx_params(void *provctx)
+{
+    static const OSSL_PARAM settable[] = {
+        OSSL_PARAM_int(OSSL_STORE_PARAM_EXPECT, NULL),
+        OSSL_PARAM_END
+    };
+    return settable;
+}
+
+static int trustm_store_set_ctx_params(void *vctx, const OSSL_PARAM params[])
+{
+    trustm_prov_store_t *ctx = (trustm_prov_store_t *)vctx;
+    const OSSL_PARAM *p;
+
+    p = OSSL_PARAM_locate_const(params, OSSL_STORE_PARAM_EXPECT);
+    if ((p != NULL) && !OSSL_PARAM_get_int(p, &ctx->expect))
+        return TRUSTM_PROVIDER_FAIL;
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+/**********************************************************************
+* trustm_store_load()
+* Pass the next object to OpenSSL: a key as reference to the cached key
+* object, a certificate as its cached DER. The callback runs with the
+* cache locked, so the reference stays valid until the key is copied.
+**********************************************************************/
+static int trustm_store_load(void *vctx,
+                             OSSL_CALLBACK *object_cb, void *object_cbarg,
+                             OSSL_PASSPHRASE_CALLBACK *pw_cb, void *pw_cbarg)
+{
+    trustm_prov_store_t *ctx = (trustm_prov_store_t *)vctx;
+    trustm_prov_obj_t *obj;
+    trustm_prov_key_t *key;
+    OSSL_PARAM params[4];
+    int objType;
+    int ret = TRUSTM_PROVIDER_FAIL;
+
+    pthread_mutex_lock(&ctx->provctx->storeLock);
+    while (ctx->next < ctx->count)
+    {
+        obj = &ctx->provctx->store[ctx->list[ctx->next++]];
+        if (__trustm_isKey(obj->oid))
+        {
+            if ((ctx->expect != 0) && (ctx->expect != OSSL_STORE_INFO_PKEY) &&
+                (ctx->expect != OSSL_STORE_INFO_PUBKEY))
+                continue;
+            key = __trustm_storeKey(ctx->provctx, obj);
+            if (key == NULL)
+            {
+                if (ctx->enumerate)
+                    continue;
+                break;
+            }
+            objType = OSSL_OBJECT_PKEY;
+            params[0] = OSSL_PARAM_construct_int(OSSL_OBJECT_PARAM_TYPE, &objType);
+            params[1] = OSSL_PARAM_construct_utf8_string(OSSL_OBJECT_PARAM_DATA_TYPE,
+                                                         (key->type == TRUSTM_PROVIDER_KEY_EC) ? "EC" : "RSA", 0);
+            params[2] = OSSL_PARAM_construct_octet_string(OSSL_OBJECT_PARAM_REFERENCE, &key, sizeof(key));
+            params[3] = OSSL_PARAM_construct_end();
+        }
+        else
+        {
+            if ((ctx->expect != 0) && (ctx->expect != OSSL_STORE_INFO_CERT))
+                continue;
+            if (!__trustm_storeCert(ctx->provctx, obj))
+            {
+                if (ctx->enumerate)
+                    continue;
+                break;
+            }
+            objType = OSSL_OBJECT_CERT;
+            params[0] = OSSL_PARAM_construct_int(OSSL_OBJECT_PARAM_TYPE, &objType);
+            params[1] = OSSL_PARAM_construct_octet_string(OSSL_OBJECT_PARAM_DATA, obj->der, obj->derLen);
+            params[2] = OSSL_PARAM_construct_end();
+        }
+
+        TRUSTM_PROVIDER_DBGFN("0x%.4X", obj->oid);
+        ret = object_cb(params, object_cbarg);
+        break;
+    }
+    pthread_mutex_unlock(&ctx->provctx->storeLock);
+    return ret;
+}
+
+static int trustm_store_eof(void *vctx)
+{
+    trustm_prov_store_t *ctx = (trustm_prov_store_t *)vctx;
+
+    return (ctx->next >= ctx->count);
+}
+
+static int trustm_store_close(void *vctx)
+{
+    OPENSSL_free(vctx);
+    return TRUSTM_PROVIDER_SUCCESS;
+}
+
+const OSSL_DISPATCH trustm_store_functions[] = {
+    { OSSL_FUNC_STORE_OPEN, (void (*)(void))trustm_store_open },
+    { OSSL_FUNC_STORE_SETTABLE_CTX_PARAMS, (void (*)(void))trustm_store_settable_ctx_params },
+    { OSSL_FUNC_STORE_SET_CTX_PARAMS, (void (*)(void))trustm_store_set_ctx_params },
+    { OSSL_FUNC_STORE_LOAD, (void (*)(void))trustm_store_load },
+    { OSSL_FUNC_STORE_EOF, (void (*)(void))trustm_store_eof },
+    { OSSL_FUNC_STORE_CLOSE, (void (*)(void))trustm_store_close },
+    { 0, NULL }
+};